@@ -172,7 +172,8 @@ public:
 		OUTPUT_OBJECT_ID,
 		OUTPUT_OBJECT_ID_MASK ,
 		OUTPUT_BY_OBJECT_ID,
-		OUTPUT_FRAMEBUFFER_MASK
+		OUTPUT_FRAMEBUFFER_MASK,
+		OUTPUT_CONVERGENCE
 	} FilmOutputType;
 
 	/*!
@@ -205,7 +206,8 @@ public:
 		CHANNEL_OBJECT_ID = 1 << 22,
 		CHANNEL_OBJECT_ID_MASK = 1 << 23,
 		CHANNEL_BY_OBJECT_ID = 1 << 24,
-		CHANNEL_FRAMEBUFFER_MASK = 1 << 25
+		CHANNEL_FRAMEBUFFER_MASK = 1 << 25,
+		CHANNEL_CONVERGENCE = 1 << 26
 	} FilmChannelType;
 
 	virtual ~Film();
@@ -472,7 +474,9 @@ public:
 		TESSEL_RIBBON,
 		TESSEL_RIBBON_ADAPTIVE,
 		TESSEL_SOLID,
-		TESSEL_SOLID_ADAPTIVE
+		TESSEL_SOLID_ADAPTIVE,
+		TESSEL_SEGMENTS,
+		TESSEL_SEGMENTS_ADAPTIVE
 	} StrandsTessellationType;
 
 	/*!
@@ -579,7 +583,8 @@ public:
 	 * \param meshName is the name of the defined mesh to be saved.
 	 * \param fileName is the name of the file where to save the mesh. If it has
 	 * the extension ".ply", the text PLY format will be used. If it has
-	 * the extension ".bpy", the text PLY format will be used.
+	 * the extension ".bpy", the text PLY format will be used. Native strands
+	 * meshes (see DefineStrands()) can be saved only in BPY format.
 	 */
 	virtual void SaveMesh(const std::string &meshName, const std::string &fileName) = 0;
 	/*!
@@ -589,6 +594,9 @@ public:
 	 * \param shapeName is the name of the defined shape.
 	 * \param strandsFile includes all information about the strands .
 	 * \param tesselType is the tessellation used to transform the strands in a triangle mesh.
+	 * TESSEL_SEGMENTS and TESSEL_SEGMENTS_ADAPTIVE don't tessellate the strands
+	 * at all: they are rendered as native segments (supported only by CPU
+	 * render engines).
 	 * \param adaptiveMaxDepth is maximum number of subdivisions for adaptive tessellation.
 	 * \param adaptiveError is the error threshold for adaptive tessellation.
 	 * \param solidSideCount is the number of sides for solid tessellation.
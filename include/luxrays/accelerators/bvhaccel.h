@@ -25,9 +25,45 @@
 #include "luxrays/luxrays.h"
 #include "luxrays/core/accelerator.h"
 #include "luxrays/core/bvh/bvhbuild.h"
+#include "luxrays/core/bvh/bvhcache.h"
 
 namespace luxrays {
 
+// The number of rays traced together by BVHAccel::IntersectPacket(), one SSE
+// register
+#define BVH_PACKET_SIZE 4
+
+// The format of the nodes used for the CPU traversal. The quantized formats
+// store the bounding box of each node with 16 or 8 bits per component,
+// relative to the bounding box of the parent node.
+typedef enum {
+	BVH_NODE_FLOAT, BVH_NODE_QUANTIZED16, BVH_NODE_QUANTIZED8
+} BVHNodeFormat;
+
+// The max. depth of a tree with quantized nodes: the traversal keeps the
+// decoded bounding box of each ancestor
+#define BVH_QUANTIZED_MAX_DEPTH 128
+
+// Same layout of BVHArrayNode (i.e. depth-first order with skip indices) but
+// with quantized bounding boxes and without the triangle vertex indices (they
+// are read from the mesh)
+template<class T> struct BVHQuantizedNode {
+	union {
+		struct {
+			T bboxMin[3];
+			T bboxMax[3];
+			// The depth of the node, used to find the decoded bounding box
+			// of the parent
+			T depth;
+		} bvhNode;
+		struct {
+			u_int meshIndex, triangleIndex;
+		} triangleLeaf;
+	};
+	// Most significant bit is used to mark leafs, same as BVHArrayNode
+	u_int nodeData;
+};
+
 // BVHAccel Declarations
 class BVHAccel : public Accelerator {
 public:
@@ -38,13 +74,47 @@ public:
 	virtual AcceleratorType GetType() const { return ACCEL_BVH; }
 	virtual OpenCLKernels *NewOpenCLKernels(OpenCLIntersectionDevice *device,
 		const u_int kernelCount, const u_int stackSize) const;
+	// The quantized nodes are available only for the CPU traversal
+	virtual bool CanRunOnOpenCLDevice(OpenCLIntersectionDevice *device) const {
+		return (nodeFormat == BVH_NODE_FLOAT);
+	}
 	virtual void Init(const std::deque<const Mesh *> &meshes,
 		const u_longlong totalVertexCount,
 		const u_longlong totalTriangleCount);
 
 	virtual bool Intersect(const Ray *ray, RayHit *hit) const;
+	virtual void IntersectStream(const Ray *rays, RayHit *hits, const size_t count) const;
+	virtual bool Occluded(const Ray *ray) const;
+
+	virtual size_t GetMemoryUsage() const;
+
+	// Packet traversal of up to BVH_PACKET_SIZE rays, selected by rayMask. All
+	// rays visit the same sequence of nodes so each node is fetched only once.
+	// hits[i].t must be already initialized and it is used as ray maxt.
+	// useLocalVertices is used to read the not transformed vertices of
+	// instances (i.e. for MBVH leafs).
+	static void IntersectPacket(const luxrays::ocl::BVHArrayNode *bvhTree,
+		const std::deque<const Mesh *> &meshes, const u_int meshOffset,
+		const bool useLocalVertices, const Ray *rays, const int rayMask,
+		RayHit *hits);
+	// Returns true if the rays have all the same direction signs so they are
+	// likely to visit the same nodes
+	static bool IsCoherentPacket(const Ray *rays, const u_int count);
 
 	static BVHParams ToBVHParams(const Properties &props);
+	// Build the list of triangles and the BVH array with the configured builder
+	static luxrays::ocl::BVHArrayNode *BuildBVHTree(const Context *ctx,
+		const BVHParams &params, const std::deque<const Mesh *> &meshes,
+		const u_longlong totalTriangleCount, u_int *nNodes);
+
+	// Recompute the bounding boxes of all nodes, bottom-up, after an edit of
+	// the mesh vertices. The topology of the meshes must be unchanged.
+	void Refit();
+	// Build again the tree from scratch
+	void Rebuild();
+	// Sum of the surface areas of all inner nodes normalized by the root one,
+	// it is an estimation of the traversal cost used to check a refit quality
+	float GetSAHCost() const;
 
 	friend class MBVHAccel;
 #if !defined(LUXRAYS_DISABLE_OPENCL)
@@ -53,10 +123,32 @@ public:
 #endif
 
 private:
+	void FreeBVHTree();
+
+	template<class T> BVHQuantizedNode<T> *BuildQuantizedBVHTree() const;
+	template<class T> bool IntersectQuantized(const BVHQuantizedNode<T> *tree,
+		const Ray *ray, RayHit *hit) const;
+	template<class T> bool OccludedQuantized(const BVHQuantizedNode<T> *tree,
+		const Ray *ray) const;
+
 	BVHParams params;
 
 	u_int nNodes;
 	luxrays::ocl::BVHArrayNode *bvhTree;
+	// Not NULL if bvhTree has been loaded from the persistent cache
+	boost::iostreams::mapped_file *bvhTreeFile;
+
+	// The node format used for the CPU traversal, if it is not
+	// BVH_NODE_FLOAT, bvhTree is freed after the quantized tree is built
+	BVHNodeFormat nodeFormat;
+	BVHQuantizedNode<u_short> *quantizedTree16;
+	BVHQuantizedNode<u_char> *quantizedTree8;
+	// The frame of the quantized bounding box of the root node
+	BBox rootBBox;
+
+	// NULL if the persistent cache is disabled
+	BVHCache *cache;
+	u_int cacheMinTriangleCount;
 
 	const Context *ctx;
 	std::deque<const Mesh *> meshes;
@@ -50,12 +50,14 @@ public:
 	virtual void Update();
 
 	virtual bool Intersect(const Ray *ray, RayHit *hit) const;
+	virtual bool Occluded(const Ray *ray) const;
 
 private:
 	static bool MeshPtrCompare(const Mesh *p0, const Mesh *p1);
 	
 	u_int ExportTriangleMesh(const RTCScene embreeScene, const Mesh *mesh) const;
 	u_int ExportMotionTriangleMesh(const RTCScene embreeScene, const MotionTriangleMesh *mtm) const;
+	u_int ExportStrandsMesh(const RTCScene embreeScene, const Mesh *mesh) const;
 
 	// Used for Embree initialization
 	static boost::mutex initMutex;
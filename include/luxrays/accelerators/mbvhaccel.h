@@ -20,6 +20,7 @@
 #define	_LUXRAYS_MBVHACCEL_H
 
 #include <vector>
+#include <map>
 
 #include "luxrays/luxrays.h"
 #include "luxrays/accelerators/bvhaccel.h"
@@ -44,8 +45,14 @@ public:
 
 	virtual bool DoesSupportUpdate() const { return true; }
 	virtual void Update();
+	virtual bool DoesSupportRefit() const { return true; }
+	virtual void Refit(const std::vector<const Mesh *> &meshes);
 
 	virtual bool Intersect(const Ray *ray, RayHit *hit) const;
+	virtual void IntersectStream(const Ray *rays, RayHit *hits, const size_t count) const;
+	virtual bool Occluded(const Ray *ray) const;
+
+	virtual size_t GetMemoryUsage() const;
 
 #if !defined(LUXRAYS_DISABLE_OPENCL)
 	friend class OpenCLMBVHKernels;
@@ -53,8 +60,26 @@ public:
 
 private:
 	static bool MeshPtrCompare(const Mesh *, const Mesh *);
+	typedef std::map<const Mesh *, u_int, bool (*)(const Mesh *, const Mesh *)> LeafIndexByMeshMap;
 
+	// Used by Refit() to refit the unique leafs in parallel
+	void RefitUniqueLeafs(const u_int first, const u_int last,
+		const std::vector<u_int> &leafIndices, u_int *rebuildCount);
 	void UpdateRootBVH();
+	// Compute the indices used to refit the root tree after a (re)build
+	void UpdateRootBVHIndices();
+	// Update the bounding boxes of the root tree nodes on the paths of the
+	// edited leafs, it is a lot faster than a rebuild if few leafs are edited
+	void RefitRootBVH(const std::vector<u_int> &editedLeafs);
+	BBox GetRootNodeBBox(const u_int index) const;
+	// Compute the bounding boxes of the root tree nodes for each time segment
+	void UpdateRootMotionBBoxes();
+	u_int GetMotionTimeSegment(const float time) const {
+		const int segment = Floor2Int((time - motionStartTime) * motionTimeScale);
+		return Clamp<int>(segment, 0, motionTimeSegments - 1);
+	}
+	float GetRootSAHCost() const;
+	void IntersectPacket(const Ray *rays, const int rayMask, RayHit *hits) const;
 
 	BVHParams params;
 
@@ -64,8 +89,43 @@ private:
 	// The root BVH tree
 	unsigned int nRootNodes;
 	luxrays::ocl::BVHArrayNode *bvhRootTree;
-
-	std::vector<const BVHAccel *> uniqueLeafs;
+	// The parent of each root tree node (NULL_INDEX for the root) and the
+	// root tree node of each leaf, used to refit the root tree
+	std::vector<u_int> bvhRootParents;
+	std::vector<u_int> bvhRootLeafNodes;
+	// Sum of the surface areas of the root tree inner nodes
+	double bvhRootInnerArea;
+	// The SAH cost of the root tree after the last rebuild
+	float bvhRootBuildCost;
+	// If the root tree is refitted or rebuilt when a leaf bounding box changes
+	bool rootRefitEnabled;
+	// A root tree refit is replaced by a rebuild if the cost is greater than
+	// this ratio. It is lower than refitMaxCostRatio because the root tree is
+	// cheap to rebuild (a node for each leaf) but it is traversed by all rays.
+	float rootRefitMaxCostRatio;
+
+	// Motion blur: the shutter interval is split in motionTimeSegments
+	// segments and the root tree nodes with motion leafs in their sub-tree
+	// have a bounding box for each segment. A ray is tested only against
+	// the bounding boxes of its time segment.
+	u_int motionTimeSegments;
+	float motionStartTime, motionTimeScale;
+	// The index of the first bounding box of each root tree node in
+	// bvhRootMotionBBoxes, NULL_INDEX if the node has no motion. It is empty
+	// if the time segments are not used.
+	std::vector<u_int> bvhRootMotionBBoxIndex;
+	std::vector<BBox> bvhRootMotionBBoxes;
+
+	std::vector<BVHAccel *> uniqueLeafs;
+	// Used to find the leaf to refit
+	LeafIndexByMeshMap uniqueLeafIndexByMesh;
+	// The SAH cost of each unique leaf after the last (re)build, 0 if not yet
+	// computed. It is used to check when a refit degrades the tree too much.
+	std::vector<float> uniqueLeafsBuildCost;
+	// A leaf refit is replaced by a rebuild if the cost is greater than this ratio
+	float refitMaxCostRatio;
+	// Incremented at each refit, used to know if the vertices have changed
+	u_int refitCount;
 	std::vector<const Transform *> uniqueLeafsTransform;
 	std::vector<const MotionSystem *> uniqueLeafsMotionSystem;
 	
@@ -0,0 +1,104 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+#ifndef _LUXRAYS_WIDEBVHACCEL_H
+#define	_LUXRAYS_WIDEBVHACCEL_H
+
+#include <vector>
+#include <deque>
+
+#include "luxrays/luxrays.h"
+#include "luxrays/core/accelerator.h"
+#include "luxrays/core/bvh/bvhbuild.h"
+
+namespace luxrays {
+
+// Most significant bit is used to mark triangle leafs
+#define WideBVHChild_IsLeaf(child) ((child) & 0x80000000u)
+#define WideBVHChild_GetIndex(child) ((child) & 0x7fffffffu)
+#define WIDEBVH_EMPTY_CHILD 0xffffffffu
+
+// The bounding boxes of all children are stored as structure of arrays so
+// they can be tested at once with SSE. Empty slots have an inverted bounding
+// box (min = +inf, max = -inf) so they never pass the test.
+template<u_int WIDTH> struct WideBVHNode {
+	float bboxMin[3][WIDTH];
+	float bboxMax[3][WIDTH];
+	u_int children[WIDTH];
+};
+
+typedef struct {
+	u_int v[3];
+	u_int meshIndex, triangleIndex;
+} WideBVHTriangleLeaf;
+
+// WideBVHAccel Declarations
+template<u_int WIDTH> class WideBVHAccel : public Accelerator {
+public:
+	// WideBVHAccel Public Methods
+	WideBVHAccel(const Context *context);
+	virtual ~WideBVHAccel();
+
+	virtual AcceleratorType GetType() const;
+
+	// The wide BVH is a CPU only accelerator
+	virtual OpenCLKernels *NewOpenCLKernels(OpenCLIntersectionDevice *device,
+		const u_int kernelCount, const u_int stackSize) const { return NULL; }
+	virtual bool CanRunOnOpenCLDevice(OpenCLIntersectionDevice *device) const {
+		return false;
+	}
+
+	virtual void Init(const std::deque<const Mesh *> &meshes,
+		const u_longlong totalVertexCount,
+		const u_longlong totalTriangleCount);
+
+	virtual bool Intersect(const Ray *ray, RayHit *hit) const;
+	virtual bool Occluded(const Ray *ray) const;
+
+	virtual size_t GetMemoryUsage() const {
+		return nNodes * sizeof(WideBVHNode<WIDTH>) + nLeafs * sizeof(WideBVHTriangleLeaf);
+	}
+
+private:
+	u_int BuildWideBVHNodes(const luxrays::ocl::BVHArrayNode *bvhTree,
+		const u_int bvhNodeIndex, const u_int depth,
+		std::vector<WideBVHNode<WIDTH> > &wideNodes,
+		std::vector<WideBVHTriangleLeaf> &wideLeafs);
+	BBox GetTriangleLeafBBox(const WideBVHTriangleLeaf &leaf) const;
+
+	BVHParams params;
+
+	u_int nNodes, nLeafs, maxDepth;
+	WideBVHNode<WIDTH> *nodes;
+	WideBVHTriangleLeaf *leafs;
+	// It can be a node or a leaf
+	u_int rootChild;
+
+	const Context *ctx;
+	std::deque<const Mesh *> meshes;
+	u_longlong totalVertexCount, totalTriangleCount;
+
+	bool initialized;
+};
+
+typedef WideBVHAccel<4> BVH4Accel;
+typedef WideBVHAccel<8> BVH8Accel;
+
+}
+
+#endif	/* _LUXRAYS_WIDEBVHACCEL_H */
@@ -21,6 +21,7 @@
 
 #include <string>
 #include <deque>
+#include <vector>
 
 #include "luxrays/luxrays.h"
 #include "luxrays/core/geometry/ray.h"
@@ -29,7 +30,7 @@
 namespace luxrays {
 
 typedef enum {
-	ACCEL_AUTO, ACCEL_BVH, ACCEL_MBVH, ACCEL_EMBREE
+	ACCEL_AUTO, ACCEL_BVH, ACCEL_MBVH, ACCEL_EMBREE, ACCEL_BVH4, ACCEL_BVH8
 } AcceleratorType;
 
 class OpenCLKernels;
@@ -49,8 +50,29 @@ public:
 	virtual void Init(const std::deque<const Mesh *> &meshes, const u_longlong totalVertexCount, const u_longlong totalTriangleCount) = 0;
 	virtual bool DoesSupportUpdate() const { return false; }
 	virtual void Update() { throw new std::runtime_error("Internal error in Accelerator::Update()"); }
+	// Refit is used when only the vertices of some mesh have been edited (the
+	// topology is unchanged). It includes the work done by Update().
+	virtual bool DoesSupportRefit() const { return false; }
+	virtual void Refit(const std::vector<const Mesh *> &meshes) { throw new std::runtime_error("Internal error in Accelerator::Refit()"); }
 
 	virtual bool Intersect(const Ray *ray, RayHit *hit) const = 0;
+	// Stream query: intersects count rays. Accelerators can override this to
+	// trace coherent rays together and amortize the node fetches.
+	virtual void IntersectStream(const Ray *rays, RayHit *hits, const size_t count) const {
+		for (size_t i = 0; i < count; ++i)
+			Intersect(&rays[i], &hits[i]);
+	}
+	// Any-hit query: returns true if there is any intersection between
+	// ray.mint and ray.maxt. Accelerators can override this to stop the
+	// traversal at the first hit.
+	virtual bool Occluded(const Ray *ray) const {
+		RayHit hit;
+		return Intersect(ray, &hit);
+	}
+
+	// The memory used by the accelerator data structures (in bytes), 0 if it
+	// is unknown
+	virtual size_t GetMemoryUsage() const { return 0; }
 
 	static std::string AcceleratorType2String(const AcceleratorType type);
 	static AcceleratorType String2AcceleratorType(const std::string &type);
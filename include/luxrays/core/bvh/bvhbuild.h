@@ -40,6 +40,10 @@ typedef struct {
 	u_int treeType;
 	int costSamples, isectCost, traversalCost;
 	float emptyBonus;
+	// SBVH: max. number of additional triangle references (as a fraction of
+	// the triangle count) and min. children overlap (as a fraction of the
+	// root surface area) required to test a spatial split
+	float sbvhMemoryBudget, sbvhAlpha;
 } BVHParams;
 
 struct BVHTreeNode {
@@ -69,6 +73,16 @@ extern luxrays::ocl::BVHArrayNode *BuildBVH(const BVHParams &params,
 		u_int *nNodes, const std::deque<const Mesh *> *meshes,
 		std::vector<BVHTreeNode *> &leafList);
 
+// Multi-threaded binned SAH BVH build
+extern luxrays::ocl::BVHArrayNode *BuildParallelBVHBinnedSAH(const BVHParams &params,
+		u_int *nNodes, const std::deque<const Mesh *> *meshes,
+		std::vector<BVHTreeNode *> &leafList);
+
+// Spatial split BVH build
+extern luxrays::ocl::BVHArrayNode *BuildSBVH(const BVHParams &params,
+		u_int *nNodes, const std::deque<const Mesh *> *meshes,
+		std::vector<BVHTreeNode *> &leafList);
+
 // Embree BVH build
 extern luxrays::ocl::BVHArrayNode *BuildEmbreeBVHBinnedSAH(const BVHParams &params,
 		u_int *nNodes, const std::deque<const Mesh *> *meshes,
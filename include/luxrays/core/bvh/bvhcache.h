@@ -0,0 +1,68 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+
+#ifndef _LUXRAYS_BVHCACHE_H
+#define	_LUXRAYS_BVHCACHE_H
+
+#include <string>
+#include <deque>
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include "luxrays/luxrays.h"
+#include "luxrays/core/trianglemesh.h"
+#include "luxrays/core/bvh/bvhbuild.h"
+
+namespace luxrays {
+
+class Context;
+
+// A persistent on-disk cache of BVH node arrays. Each tree is stored in its
+// own file named after a hash of the mesh vertices/triangles, of the BVHParams
+// and of the builder type. The cached trees are memory mapped when loaded.
+//
+// The cache is only an optimization: any error is logged and the tree is built
+// again.
+class BVHCache {
+public:
+	BVHCache(const Context *context, const std::string &dir);
+	~BVHCache();
+
+	// Returns an empty string if the meshes can not be cached
+	static std::string GetKey(const BVHParams &params, const std::string &builderType,
+		const std::deque<const Mesh *> &meshes);
+
+	// Returns NULL if the tree is not available. The returned object owns the
+	// memory of the nodes (a private copy-on-write mapping so the nodes can
+	// be still edited, for instance by a refit).
+	boost::iostreams::mapped_file *Load(const std::string &key,
+		luxrays::ocl::BVHArrayNode **nodes, u_int *nNodes) const;
+	void Save(const std::string &key,
+		const luxrays::ocl::BVHArrayNode *nodes, const u_int nNodes) const;
+
+	static std::string GetDefaultCacheDir();
+
+private:
+	const Context *ctx;
+	boost::filesystem::path cacheDir;
+};
+
+}
+
+#endif	/* _LUXRAYS_BVHCACHE_H */
@@ -71,6 +71,8 @@ public:
 	 * the all the available platforms will be selected.
 	 * - context.verbose is an optional flag to enable/disable the log print of information
 	 * related to the available devices.
+	 * - context.native.raybufferqueue.type is the queue used by native devices
+	 * for PushRayBuffer()/PopRayBuffer(): LOCKFREE (default) or MUTEX.
 	 * - accelerator.type
 	 * - accelerator.instances.enable
 	 * - accelerator.motionblur.enable
@@ -55,7 +55,13 @@ public:
 	const Accelerator *GetAccelerator();
 	const Accelerator *GetAccelerator(const AcceleratorType accelType);
 	bool DoesAllAcceleratorsSupportUpdate() const;
+	bool DoesAllAcceleratorsSupportRefit() const;
+	// Used to mark a mesh with edited vertices (but unchanged topology), the
+	// accelerators are refitted at the next UpdateAccelerators()
+	void AddRefitMesh(const Mesh *mesh) { refitMeshes.push_back(mesh); }
 	void UpdateAccelerators();
+	// Total time (in seconds) spent to build and update the accelerators
+	double GetAcceleratorsBuildTime() const { return accelsBuildTime; }
 
 	const BBox &GetBBox() const { return bbox; }
 	const BSphere &GetBSphere() const { return bsphere; }
@@ -82,6 +88,8 @@ private:
 	BSphere bsphere;
 
 	boost::unordered_map<AcceleratorType, Accelerator *> accels;
+	double accelsBuildTime;
+	std::vector<const Mesh *> refitMeshes;
 
 	AcceleratorType accelType;
 	bool preprocessed;
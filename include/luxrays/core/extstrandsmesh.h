@@ -0,0 +1,252 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+#ifndef _LUXRAYS_EXTSTRANDSMESH_H
+#define	_LUXRAYS_EXTSTRANDSMESH_H
+
+#include <string>
+
+#include <boost/serialization/version.hpp>
+#include <boost/serialization/export.hpp>
+
+#include "luxrays/luxrays.h"
+#include "luxrays/core/exttrianglemesh.h"
+#include "luxrays/core/geometry/segment.h"
+
+namespace luxrays {
+
+/*
+ * A mesh of strands (i.e. hairs) made of segments with a radius for each
+ * vertex. It is intersected natively by the CPU accelerators without any
+ * tessellation. The "triangle" index used by ExtMesh methods is the segment
+ * index, b1 is the position along the segment and b2 is always 0.
+ */
+
+class ExtStrandsMesh : public ExtMesh {
+public:
+	// NOTE: meshSegments is the index of the first vertex of each segment, the
+	// second vertex is always the next one. meshSegments is copied while
+	// deleting all the other buffers is up to Delete()
+	ExtStrandsMesh(const u_int meshVertCount, const u_int meshSegmentCount,
+			Point *meshVertices, float *meshRadii, const u_int *meshSegments,
+			UV *meshUV = NULL, Spectrum *meshCols = NULL, float *meshAlpha = NULL);
+	virtual ~ExtStrandsMesh() { }
+	virtual void Delete() {
+		delete[] vertices;
+		delete[] radii;
+		delete[] segments;
+		delete[] uvs;
+		delete[] cols;
+		delete[] alphas;
+	}
+
+	virtual MeshType GetType() const { return TYPE_EXT_STRANDS; }
+
+	virtual BBox GetBBox() const;
+	virtual Point GetVertex(const float time, const u_int vertIndex) const { return vertices[vertIndex]; }
+
+	virtual Point *GetVertices() const { return vertices; }
+	// The segments use SEGMENT_PRIMITIVE_MARKER as third vertex index
+	virtual Triangle *GetTriangles() const { return segments; }
+	virtual u_int GetTotalVertexCount() const { return vertCount; }
+	virtual u_int GetTotalTriangleCount() const { return segmentCount; }
+	virtual float *GetRadii() const { return radii; }
+
+	virtual bool HasNormals() const { return false; }
+	virtual bool HasUVs() const { return uvs != NULL; }
+	virtual bool HasColors() const { return cols != NULL; }
+	virtual bool HasAlphas() const { return alphas != NULL; }
+
+	// The ribbon of a segment faces the ray so this is only an arbitrary
+	// normal orthogonal to the segment. Use GetHitPointNormals() instead.
+	virtual Normal GetGeometryNormal(const float time, const u_int segIndex) const;
+	// Strands have no vertex normals (i.e. HasNormals() is false)
+	virtual Normal GetShadeNormal(const float time, const u_int segIndex, const u_int vertIndex) const {
+		return GetGeometryNormal(time, segIndex);
+	}
+	virtual Normal GetShadeNormal(const float time, const u_int vertIndex) const { return Normal(); }
+	virtual UV GetUV(const u_int vertIndex) const { return uvs[vertIndex]; }
+	virtual Spectrum GetColor(const u_int vertIndex) const { return cols[vertIndex]; }
+	virtual float GetAlpha(const u_int vertIndex) const { return alphas[vertIndex]; }
+
+	virtual bool GetTriBaryCoords(const float time, const u_int segIndex, const Point &hitPoint, float *b1, float *b2) const;
+	virtual void GetDifferentials(const float time, const u_int segIndex, const Normal &shadeNormal,
+		Vector *dpdu, Vector *dpdv,
+		Normal *dndu, Normal *dndv) const;
+	virtual void GetLocal2World(const float time, luxrays::Transform &t) const { }
+
+	virtual void ApplyTransform(const Transform &trans);
+
+	// The geometry normal of the ribbon facing the ray and the shading
+	// normal of the cylinder around the segment
+	void GetHitPointNormals(const Ray &ray, const u_int segIndex, const float b1,
+		const Point &hitPoint, Normal *geometryN, Normal *shadeN) const;
+
+	virtual Normal InterpolateTriNormal(const float time, const u_int segIndex, const float b1, const float b2) const {
+		return GetGeometryNormal(time, segIndex);
+	}
+
+	virtual UV InterpolateTriUV(const u_int segIndex, const float b1, const float b2) const {
+		if (uvs) {
+			const Triangle &seg = segments[segIndex];
+			return Lerp(b1, uvs[seg.v[0]], uvs[seg.v[1]]);
+		} else
+			return UV(0.f, 0.f);
+	}
+
+	virtual Spectrum InterpolateTriColor(const u_int segIndex, const float b1, const float b2) const {
+		if (cols) {
+			const Triangle &seg = segments[segIndex];
+			return Lerp(b1, cols[seg.v[0]], cols[seg.v[1]]);
+		} else
+			return Spectrum(1.f);
+	}
+
+	virtual float InterpolateTriAlpha(const u_int segIndex, const float b1, const float b2) const {
+		if (alphas) {
+			const Triangle &seg = segments[segIndex];
+			return Lerp(b1, alphas[seg.v[0]], alphas[seg.v[1]]);
+		} else
+			return 1.f;
+	}
+
+	virtual float GetMeshArea(const float time) const {
+		return area;
+	}
+	// The area of the ribbon
+	virtual float GetTriangleArea(const float time, const unsigned int segIndex) const;
+	virtual void Sample(const float time, const u_int segIndex, const float u0, const float u1,
+			Point *p, float *b0, float *b1, float *b2) const;
+
+	// Only the serialized (i.e. ".bpy") format is supported
+	virtual void Save(const std::string &fileName) const;
+
+	static ExtStrandsMesh *Load(const std::string &fileName);
+
+	friend class boost::serialization::access;
+
+private:
+	// Used by serialization
+	ExtStrandsMesh() {
+	}
+
+	void Preprocess();
+
+	template<class Archive> void save(Archive &ar, const unsigned int version) const {
+		ar & BOOST_SERIALIZATION_BASE_OBJECT_NVP(ExtMesh);
+
+		ar & vertCount;
+		for (u_int i = 0; i < vertCount; ++i)
+			ar & vertices[i];
+		for (u_int i = 0; i < vertCount; ++i)
+			ar & radii[i];
+
+		ar & segmentCount;
+		for (u_int i = 0; i < segmentCount; ++i)
+			ar & segments[i].v[0];
+
+		const bool hasUVs = HasUVs();
+		ar & hasUVs;
+		if (HasUVs())
+			for (u_int i = 0; i < vertCount; ++i)
+				ar & uvs[i];
+
+		const bool hasColors = HasColors();
+		ar & hasColors;
+		if (HasColors())
+			for (u_int i = 0; i < vertCount; ++i)
+				ar & cols[i];
+
+		const bool hasAlphas = HasAlphas();
+		ar & hasAlphas;
+		if (HasAlphas())
+			for (u_int i = 0; i < vertCount; ++i)
+				ar & alphas[i];
+	}
+
+	template<class Archive>	void load(Archive &ar, const unsigned int version) {
+		ar & BOOST_SERIALIZATION_BASE_OBJECT_NVP(ExtMesh);
+
+		ar & vertCount;
+		vertices = new Point[vertCount];
+		for (u_int i = 0; i < vertCount; ++i)
+			ar & vertices[i];
+		radii = new float[vertCount];
+		for (u_int i = 0; i < vertCount; ++i)
+			ar & radii[i];
+
+		ar & segmentCount;
+		segments = new Triangle[segmentCount];
+		for (u_int i = 0; i < segmentCount; ++i) {
+			u_int v0;
+			ar & v0;
+			segments[i] = Triangle(v0, v0 + 1, SEGMENT_PRIMITIVE_MARKER);
+		}
+
+		bool hasUVs;
+		ar & hasUVs;
+		if (hasUVs) {
+			uvs = new UV[vertCount];
+			for (u_int i = 0; i < vertCount; ++i)
+				ar & uvs[i];
+		} else
+			uvs = NULL;
+
+		bool hasColors;
+		ar & hasColors;
+		if (hasColors) {
+			cols = new Spectrum[vertCount];
+			for (u_int i = 0; i < vertCount; ++i)
+				ar & cols[i];
+		} else
+			cols = NULL;
+
+		bool hasAlphas;
+		ar & hasAlphas;
+		if (hasAlphas) {
+			alphas = new float[vertCount];
+			for (u_int i = 0; i < vertCount; ++i)
+				ar & alphas[i];
+		} else
+			alphas = NULL;
+
+		Preprocess();
+	}
+	BOOST_SERIALIZATION_SPLIT_MEMBER()
+
+	u_int vertCount;
+	u_int segmentCount;
+	Point *vertices;
+	float *radii; // Vertex radius
+	Triangle *segments;
+	UV *uvs; // Vertex uvs
+	Spectrum *cols; // Vertex color
+	float *alphas; // Vertex alpha
+
+	float area;
+	mutable BBox cachedBBox;
+	mutable bool cachedBBoxValid;
+};
+
+}
+
+BOOST_CLASS_VERSION(luxrays::ExtStrandsMesh, 1)
+
+BOOST_CLASS_EXPORT_KEY(luxrays::ExtStrandsMesh)
+
+#endif	/* _LUXRAYS_EXTSTRANDSMESH_H */
@@ -167,6 +167,9 @@ public:
 	Matrix4x4 Sample(const float time) const;
 
 	BBox Bound(BBox ibox, const bool storingGlobal2Local) const;
+	// The bounding box of the motion inside the [startTime, endTime] interval
+	BBox Bound(BBox ibox, const bool storingGlobal2Local,
+		const float startTime, const float endTime) const;
 
 	void ApplyTransform(const Transform &trans);
 
@@ -26,7 +26,9 @@
 #include <algorithm>
 
 #include "luxrays/core/geometry/ray.h"
+#include "luxrays/utils/utils.h"
 
+#include <boost/atomic.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/condition_variable.hpp>
 
@@ -158,11 +160,16 @@ public:
 
 	virtual void PushDone(RayBuffer *rayBuffer) = 0;
 	virtual RayBuffer *PopDone(const size_t index = 0) = 0;
+
+	// Total time (in seconds, summed over all threads) spent waiting
+	// inside the queue
+	virtual double GetWaitTime() = 0;
+	virtual void ResetWaitTime() = 0;
 };
 
 class RayBufferSingleQueue {
 public:
-	RayBufferSingleQueue() {
+	RayBufferSingleQueue() : waitTime(0.0) {
 	}
 
 	~RayBufferSingleQueue() {
@@ -180,6 +187,18 @@ public:
 		return queue.size();
 	}
 
+	double GetWaitTime() {
+		boost::unique_lock<boost::mutex> lock(queueMutex);
+
+		return waitTime;
+	}
+
+	void ResetWaitTime() {
+		boost::unique_lock<boost::mutex> lock(queueMutex);
+
+		waitTime = 0.0;
+	}
+
 	//--------------------------------------------------------------------------
 
 	void Push(RayBuffer *rayBuffer) {
@@ -194,9 +213,13 @@ public:
 	RayBuffer *Pop() {
 		boost::unique_lock<boost::mutex> lock(queueMutex);
 
-		while (queue.size() < 1) {
-			// Wait for a new buffer to arrive
-			condition.wait(lock);
+		if (queue.size() < 1) {
+			const double t0 = WallClockTime();
+			while (queue.size() < 1) {
+				// Wait for a new buffer to arrive
+				condition.wait(lock);
+			}
+			waitTime += WallClockTime() - t0;
 		}
 
 		RayBuffer *rayBuffer = queue.front();
@@ -219,6 +242,7 @@ public:
 	RayBuffer *Pop(const size_t queueIndex) {
 		boost::unique_lock<boost::mutex> lock(queueMutex);
 
+		double t0 = 0.0;
 		for (;;) {
 			for (size_t i = 0; i < queue.size(); ++i) {
 				// Check if it matches the requested queueIndex
@@ -227,11 +251,15 @@ public:
 					queue.erase(queue.begin() + i);
 					rayBuffer->PopUserData();
 
+					if (t0 > 0.0)
+						waitTime += WallClockTime() - t0;
 					return rayBuffer;
 				}
 			}
 
 			// Wait for a new buffer to arrive
+			if (t0 == 0.0)
+				t0 = WallClockTime();
 			condition.wait(lock);
 		}
 	}
@@ -253,6 +281,7 @@ public:
 	RayBuffer *Pop(const size_t queueIndex, const size_t queueProgressive) {
 		boost::unique_lock<boost::mutex> lock(queueMutex);
 
+		double t0 = 0.0;
 		for (;;) {
 			for (size_t i = 0; i < queue.size(); ++i) {
 				// Check if it matches the requested queueIndex and queueProgressive
@@ -263,11 +292,15 @@ public:
 					rayBuffer->PopUserData();
 					rayBuffer->PopUserData();
 
+					if (t0 > 0.0)
+						waitTime += WallClockTime() - t0;
 					return rayBuffer;
 				}
 			}
 
 			// Wait for a new buffer to arrive
+			if (t0 == 0.0)
+				t0 = WallClockTime();
 			condition.wait(lock);
 		}
 	}
@@ -277,6 +310,7 @@ private:
 	boost::condition_variable condition;
 
 	std::deque<RayBuffer *> queue;
+	double waitTime;
 };
 
 // A one producer, one consumer queue
@@ -299,6 +333,12 @@ public:
 	void PushDone(RayBuffer *rayBuffer) { doneQueue.Push(rayBuffer); }
 	RayBuffer *PopDone(const size_t queueIndex) { return doneQueue.Pop(); }
 
+	double GetWaitTime() { return todoQueue.GetWaitTime() + doneQueue.GetWaitTime(); }
+	void ResetWaitTime() {
+		todoQueue.ResetWaitTime();
+		doneQueue.ResetWaitTime();
+	}
+
 private:
 	RayBufferSingleQueue todoQueue;
 	RayBufferSingleQueue doneQueue;
@@ -324,6 +364,12 @@ public:
 	void PushDone(RayBuffer *rayBuffer) { doneQueue.Push(rayBuffer); }
 	RayBuffer *PopDone(const size_t queueIndex) { return doneQueue.Pop(queueIndex); }
 
+	double GetWaitTime() { return todoQueue.GetWaitTime() + doneQueue.GetWaitTime(); }
+	void ResetWaitTime() {
+		todoQueue.ResetWaitTime();
+		doneQueue.ResetWaitTime();
+	}
+
 private:
 	RayBufferSingleQueue todoQueue;
 	RayBufferSingleQueue doneQueue;
@@ -362,6 +408,12 @@ public:
 		return rb;
 	}
 
+	double GetWaitTime() { return todoQueue.GetWaitTime() + doneQueue.GetWaitTime(); }
+	void ResetWaitTime() {
+		todoQueue.ResetWaitTime();
+		doneQueue.ResetWaitTime();
+	}
+
 private:
 	std::vector<unsigned int> queueToDoCounters;
 	std::vector<unsigned int> queueDoneCounters;
@@ -369,6 +421,84 @@ private:
 	RayBufferSingleQueue doneQueue;
 };
 
+// A many producers, many consumers lock-free queue with the same semantic of
+// RayBufferQueueM2M. The to-do side is a bounded MPMC ring where each cell
+// has its own sequence number. The done side has a ring for each queue index
+// where a buffer is stored at the slot selected by its progressive number,
+// so PopDone() returns the buffers in the same order they were pushed.
+//
+// NOTE: each ring is bounded, there can be at most buffersCount
+// buffers in flight for each queue index (as required by
+// IntersectionDevice::SetBufferCount()).
+class RayBufferQueueM2MLockFree : public RayBufferQueue {
+public:
+	RayBufferQueueM2MLockFree(const size_t consumersCount, const size_t buffersCount);
+	~RayBufferQueueM2MLockFree();
+
+	void Clear();
+
+	size_t GetSizeToDo();
+	size_t GetSizeDone();
+
+	void PushToDo(RayBuffer *rayBuffer, const size_t queueIndex);
+	RayBuffer *PopToDo();
+
+	void PushDone(RayBuffer *rayBuffer);
+	RayBuffer *PopDone(const size_t queueIndex);
+
+	double GetWaitTime();
+	void ResetWaitTime();
+
+private:
+	typedef struct {
+		boost::atomic<size_t> sequence;
+		RayBuffer *rayBuffer;
+	} ToDoCell;
+
+	typedef struct {
+		boost::atomic<RayBuffer *> *slots;
+		size_t mask;
+		// Only accessed by the thread owning the queue index
+		size_t toDoCounter, doneCounter;
+	} DoneRing;
+
+	typedef enum {
+		WAIT_TODO_NOT_FULL, WAIT_TODO_NOT_EMPTY,
+		WAIT_DONE_SLOT_FREE, WAIT_DONE_SLOT_READY
+	} WaitCondition;
+
+	bool TryPushToDo(RayBuffer *rayBuffer);
+	RayBuffer *TryPopToDo();
+
+	bool IsReady(const WaitCondition condition, const size_t queueIndex,
+			const size_t progressive) const;
+	void Wait(const WaitCondition condition, const size_t queueIndex,
+			const size_t progressive, u_int &attempt, double &startTime);
+	void EndWait(const double startTime);
+	void WakeUpWaiters();
+
+	ToDoCell *toDoRing;
+	size_t toDoMask;
+
+	// Each position is kept on its own cache line to avoid false sharing
+	char padding0[64];
+	boost::atomic<size_t> toDoEnqueuePos;
+	char padding1[64];
+	boost::atomic<size_t> toDoDequeuePos;
+	char padding2[64];
+
+	std::vector<DoneRing> doneRings;
+	boost::atomic<size_t> doneSize;
+
+	// Used only by threads that have been waiting for a while
+	boost::mutex waitMutex;
+	boost::condition_variable waitCondition;
+	boost::atomic<u_int> waitingThreads;
+
+	// In nanoseconds
+	boost::atomic<u_longlong> waitTime;
+};
+
 }
 
 #endif	/* _LUXRAYS_RAYBUFFER_H */
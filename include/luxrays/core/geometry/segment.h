@@ -0,0 +1,86 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+#ifndef _LUXRAYS_SEGMENT_H
+#define	_LUXRAYS_SEGMENT_H
+
+#include "luxrays/luxrays.h"
+#include "luxrays/core/geometry/point.h"
+#include "luxrays/core/geometry/vector.h"
+#include "luxrays/core/geometry/ray.h"
+#include "luxrays/core/geometry/bbox.h"
+#include "luxrays/utils/utils.h"
+
+namespace luxrays {
+
+// Strands meshes (see ExtStrandsMesh) store each segment as a Triangle with
+// this marker as third vertex index
+#define SEGMENT_PRIMITIVE_MARKER 0xffffffffu
+
+// A segment of a strand with a linearly interpolated radius. It is intersected
+// as a ribbon always facing the ray, like Embree line segments.
+class Segment {
+public:
+	static BBox WorldBound(const Point &p0, const Point &p1,
+			const float r0, const float r1) {
+		BBox bbox(p0, p1);
+		bbox.Expand(Max(r0, r1));
+
+		return bbox;
+	}
+
+	// b1 is the position along the segment, b2 is always 0
+	static bool Intersect(const Ray &ray, const Point &p0, const Point &p1,
+			const float r0, const float r1, float *t, float *b1, float *b2) {
+		const float invDLength2 = 1.f / ray.d.LengthSquared();
+		const Vector a = p0 - ray.o;
+		const Vector e = p1 - p0;
+
+		// Project the segment on the plane orthogonal to the ray direction
+		const Vector aPerp = a - (Dot(a, ray.d) * invDLength2) * ray.d;
+		const Vector ePerp = e - (Dot(e, ray.d) * invDLength2) * ray.d;
+
+		// The point of the segment closest to the ray
+		const float ePerpLength2 = ePerp.LengthSquared();
+		const float u = (ePerpLength2 > 0.f) ?
+			Clamp(-Dot(aPerp, ePerp) / ePerpLength2, 0.f, 1.f) : 0.f;
+
+		const float r = Lerp(u, r0, r1);
+		if ((aPerp + u * ePerp).LengthSquared() > r * r)
+			return false;
+
+		const float tHit = Dot(a + u * e, ray.d) * invDLength2;
+		if ((tHit < ray.mint) || (tHit > ray.maxt))
+			return false;
+
+		// Ignore the hits closer than the radius in order to avoid
+		// self-intersections of the rays leaving the strand
+		if (tHit * tHit < r * r * invDLength2)
+			return false;
+
+		*t = tHit;
+		*b1 = u;
+		*b2 = 0.f;
+
+		return true;
+	}
+};
+
+}
+
+#endif	/* _LUXRAYS_SEGMENT_H */
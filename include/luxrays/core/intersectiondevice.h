@@ -58,6 +58,9 @@ public:
 		const double statsTotalRayTime = WallClockTime() - statsStartTime;
 		return (statsTotalRayTime == 0.0) ?	1.0 : (statsTotalDataParallelRayCount / statsTotalRayTime);
 	}
+	// Total time (in seconds) spent by all threads waiting on the
+	// PushRayBuffer()/PopRayBuffer() queues
+	virtual double GetQueueWaitTime() const { return 0.0; }
 	virtual void ResetPerformaceStats() {
 		statsStartTime = WallClockTime();
 		statsTotalSerialRayCount = 0.0;
@@ -102,6 +105,12 @@ public:
 		return accel->Intersect(ray, rayHit);
 	}
 
+	// Any-hit version of TraceRay(): useful for shadow rays
+	virtual bool TraceShadowRay(const Ray *ray) {
+		statsTotalSerialRayCount += 1.0;
+		return accel->Occluded(ray);
+	}
+
 	friend class Context;
 	friend class VirtualIntersectionDevice;
 
@@ -167,6 +176,7 @@ public:
 	virtual double GetTotalRaysCount() const;
 	virtual double GetTotalPerformance() const;
 	virtual double GetDataParallelPerformance() const;
+	virtual double GetQueueWaitTime() const;
 	virtual void ResetPerformaceStats();
 
 	friend class Context;
@@ -179,7 +189,7 @@ private:
 
 	u_int threadCount;
 	std::vector<boost::thread *> intersectionThreads;
-	RayBufferQueueM2M *rayBufferQueue;
+	RayBufferQueue *rayBufferQueue;
 	
 	// Per thread statistics
 	mutable std::vector<double> threadDeviceIdleTime, threadTotalDataParallelRayCount,
@@ -29,6 +29,7 @@
 
 #include "luxrays/luxrays.h"
 #include "luxrays/core/geometry/triangle.h"
+#include "luxrays/core/geometry/segment.h"
 #include "luxrays/core/geometry/transform.h"
 #include "luxrays/core/geometry/motionsystem.h"
 
@@ -44,7 +45,8 @@ typedef u_int TriangleID;
 
 typedef enum {
 	TYPE_TRIANGLE, TYPE_TRIANGLE_INSTANCE, TYPE_TRIANGLE_MOTION,
-	TYPE_EXT_TRIANGLE, TYPE_EXT_TRIANGLE_INSTANCE, TYPE_EXT_TRIANGLE_MOTION
+	TYPE_EXT_TRIANGLE, TYPE_EXT_TRIANGLE_INSTANCE, TYPE_EXT_TRIANGLE_MOTION,
+	TYPE_EXT_STRANDS
 } MeshType;
 
 class Mesh {
@@ -61,9 +63,25 @@ public:
 	virtual Triangle *GetTriangles() const = 0;
 	virtual u_int GetTotalVertexCount() const = 0;
 	virtual u_int GetTotalTriangleCount() const = 0;
+	// Only strands meshes have a radius for each vertex
+	virtual float *GetRadii() const { return NULL; }
 
 	virtual void ApplyTransform(const Transform &trans) = 0;
 
+	// Used by the accelerators for the primitives with SEGMENT_PRIMITIVE_MARKER
+	// as third vertex index
+	BBox GetSegmentBBox(const u_int v0, const u_int v1) const {
+		const float *radii = GetRadii();
+		return Segment::WorldBound(GetVertex(0.f, v0), GetVertex(0.f, v1),
+				radii[v0], radii[v1]);
+	}
+	bool IntersectSegment(const Ray &ray, const u_int v0, const u_int v1,
+			float *t, float *b1, float *b2) const {
+		const float *radii = GetRadii();
+		return Segment::Intersect(ray, GetVertex(0.f, v0), GetVertex(0.f, v1),
+				radii[v0], radii[v1], t, b1, b2);
+	}
+
 	friend class boost::serialization::access;
 
 private:
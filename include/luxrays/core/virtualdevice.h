@@ -65,11 +65,20 @@ public:
 		return realDevices[traceRayRealDeviceIndex]->TraceRay(ray, rayHit);
 	}
 
+	virtual bool TraceShadowRay(const Ray *ray) {
+		// Update this device statistics
+		statsTotalSerialRayCount += 1.0;
+
+		traceRayRealDeviceIndex = (traceRayRealDeviceIndex + 1) % realDevices.size();
+		return realDevices[traceRayRealDeviceIndex]->TraceShadowRay(ray);
+	}
+
 	//--------------------------------------------------------------------------
 	// Statistics
 	//--------------------------------------------------------------------------
 
 	virtual double GetLoad() const;
+	virtual double GetQueueWaitTime() const;
 	virtual void ResetPerformaceStats();
 
 protected:
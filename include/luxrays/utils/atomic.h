@@ -49,6 +49,30 @@ inline void AtomicAdd(float *val, const float delta) {
 			((uint32_t *)val), newVal.i, oldVal.i) != oldVal.i);
 }
 
+inline void AtomicAdd(double *val, const double delta) {
+	union bits {
+		double f;
+		uint64_t i;
+	};
+
+	bits oldVal, newVal;
+
+	do {
+#if (defined(__i386__) || defined(__amd64__))
+		__asm__ __volatile__("pause\n");
+#endif
+
+		oldVal.f = *val;
+		newVal.f = oldVal.f + delta;
+	} while (
+#if defined(WIN32)
+		(uint64_t)InterlockedCompareExchange64((LONGLONG *)val, (LONGLONG)newVal.i, (LONGLONG)oldVal.i)
+#else
+		__sync_val_compare_and_swap((uint64_t *)val, oldVal.i, newVal.i)
+#endif
+			!= oldVal.i);
+}
+
 inline void AtomicAdd(unsigned int *val, const unsigned int delta) {
 #if defined(WIN32)
    uint32_t newVal;
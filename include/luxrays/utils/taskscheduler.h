@@ -0,0 +1,158 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+#ifndef _LUXRAYS_TASKSCHEDULER_H
+#define	_LUXRAYS_TASKSCHEDULER_H
+
+#include <deque>
+#include <vector>
+#include <string>
+
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include "luxrays/luxrays.h"
+
+namespace luxrays {
+
+//------------------------------------------------------------------------------
+// TaskScheduler
+//------------------------------------------------------------------------------
+
+// A work-stealing thread pool shared by BVH builds, image pipeline, scene
+// preprocessing, etc. Each worker has its own task queue: the owner pushes
+// and pops at the back (LIFO, hot caches) while idle workers steal from the
+// front (FIFO, usually the largest tasks). A thread waiting for a TaskGroup
+// runs the pending tasks of the same group instead of blocking, so nested
+// parallelism never adds threads and never deadlocks. It never runs the tasks
+// of other groups because it may own locks they need.
+//
+// Only short lived tasks run here: render threads, intersection device
+// threads and the OpenMP loops of some image pipeline plugins have their own
+// threads and are not limited by the thread count of the scheduler.
+
+typedef boost::function<void ()> TaskFunc;
+
+class TaskGroup;
+
+class TaskScheduler {
+public:
+	// A threadCount of 0 means boost::thread::hardware_concurrency(). The
+	// thread waiting for a TaskGroup is one of the threads so only
+	// threadCount - 1 workers run.
+	TaskScheduler(const u_int threadCount = 0);
+	~TaskScheduler();
+
+	// The number of threads can be changed at any time but it is clamped to
+	// Max(hardware_concurrency(), the constructor threadCount): the unused
+	// workers are parked, not destroyed.
+	void SetThreadCount(const u_int threadCount);
+	u_int GetThreadCount() const { return activeWorkerCount + 1; }
+
+	// Statistics
+	u_longlong GetExecutedTaskCount() const { return executedTaskCount; }
+	u_longlong GetStolenTaskCount() const { return stolenTaskCount; }
+
+	// The instance shared by all LuxRays and SLG code
+	static TaskScheduler &GetInstance();
+
+	friend class TaskGroup;
+
+private:
+	typedef struct {
+		TaskFunc func;
+		TaskGroup *group;
+	} Task;
+
+	class TaskQueue {
+	public:
+		boost::mutex queueMutex;
+		std::deque<Task> tasks;
+	};
+
+	void Submit(TaskGroup *group, const TaskFunc &func);
+	// Returns false if there was nothing to run. If group is not NULL, only
+	// the tasks of that group are run.
+	bool RunPendingTask(const TaskGroup *group = NULL);
+	bool GetTask(Task &task, const TaskGroup *group);
+	bool PopTask(TaskQueue *queue, const TaskGroup *group, const bool fromBack,
+			Task &task);
+	void Execute(Task &task);
+
+	int GetCurrentQueueIndex() const;
+	void WorkerThread(const u_int index);
+
+	// One queue for each worker plus the last one for all non worker threads
+	std::vector<TaskQueue *> queues;
+	std::vector<boost::thread *> workers;
+	boost::thread_specific_ptr<u_int> currentWorkerIndex;
+
+	boost::mutex sleepMutex;
+	// Idle workers wait on sleepCondition, parked ones on parkCondition
+	boost::condition_variable sleepCondition, parkCondition;
+	boost::atomic<u_int> queuedTaskCount, sleepingWorkerCount;
+	boost::atomic<u_int> activeWorkerCount;
+	boost::atomic<u_longlong> executedTaskCount, stolenTaskCount;
+	bool done;
+};
+
+//------------------------------------------------------------------------------
+// TaskGroup
+//------------------------------------------------------------------------------
+
+class TaskGroup {
+public:
+	TaskGroup(TaskScheduler &s = TaskScheduler::GetInstance());
+	~TaskGroup();
+
+	void Run(const TaskFunc &func);
+	// Helps to run the tasks of this group until they are all done. It can be
+	// called from any thread, worker or not. The first error thrown by a task
+	// is re-thrown here as runtime_error.
+	void Wait();
+
+	friend class TaskScheduler;
+
+private:
+	void TaskDone(const std::string *error);
+
+	TaskScheduler &scheduler;
+
+	boost::mutex groupMutex;
+	boost::condition_variable groupCondition;
+	boost::atomic<u_int> pendingTaskCount;
+	std::string taskError;
+	bool hasTaskError;
+};
+
+//------------------------------------------------------------------------------
+// ParallelFor
+//------------------------------------------------------------------------------
+
+// Calls func(chunkBegin, chunkEnd) over [begin, end) split in chunks of
+// grainSize items (0 to select a size giving a few chunks for each thread)
+extern void ParallelFor(const u_int begin, const u_int end, const u_int grainSize,
+		const boost::function<void (u_int, u_int)> &func,
+		TaskScheduler &scheduler = TaskScheduler::GetInstance());
+
+}
+
+#endif	/* _LUXRAYS_TASKSCHEDULER_H */
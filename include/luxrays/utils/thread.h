@@ -19,6 +19,9 @@
 #ifndef _LUXRAYS_THREAD_H
 #define	_LUXRAYS_THREAD_H
 
+#include <string>
+#include <vector>
+
 #include <boost/thread.hpp>
 
 #include "luxrays/utils/utils.h"
@@ -53,6 +56,51 @@ inline bool SetThreadRRPriority(boost::thread *thread, int pri = 0) {
 #endif
 }
 
+//------------------------------------------------------------------------------
+// Thread affinity and NUMA topology
+//------------------------------------------------------------------------------
+
+typedef enum {
+	THREAD_AFFINITY_NONE,
+	// Fill all the CPUs of a NUMA node before to use the next one
+	THREAD_AFFINITY_COMPACT,
+	// Distribute the threads round robin over the NUMA nodes
+	THREAD_AFFINITY_SCATTER
+} ThreadAffinityType;
+
+extern ThreadAffinityType String2ThreadAffinityType(const std::string &type);
+extern std::string ThreadAffinityType2String(const ThreadAffinityType type);
+
+// Pin the calling thread to a logical CPU, it returns false on failure or if
+// it is not supported by the platform. It is called by the thread itself,
+// before any allocation, so its memory is first touched on the right node.
+extern bool SetCurrentThreadAffinity(const u_int cpuIndex);
+
+// The logical CPUs of each NUMA node. A system without NUMA support (or a
+// platform where the topology is unknown) is a single node with all CPUs.
+class NUMATopology {
+public:
+	u_int GetNodeCount() const { return nodeCPUs.size(); }
+	const std::vector<u_int> &GetNodeCPUs(const u_int node) const { return nodeCPUs[node]; }
+	u_int GetCPUNode(const u_int cpuIndex) const;
+
+	// Returns the logical CPU to use for each thread
+	std::vector<u_int> GetThreadCPUs(const u_int threadCount,
+			const ThreadAffinityType type) const;
+
+	// The memory pages allocated on the node of the requesting thread
+	// (local) or on another node (remote), as counted by the OS for the
+	// whole system. They are always 0 where not available (i.e. not Linux).
+	void GetPageAllocationCounts(u_longlong *localPages, u_longlong *remotePages) const;
+
+	static const NUMATopology &GetInstance();
+
+private:
+	NUMATopology();
+
+	std::vector<std::vector<u_int> > nodeCPUs;
+};
+
 }
 
 #endif	/* _LUXRAYS_THREAD_H */
@@ -33,7 +33,8 @@ typedef enum {
 	MATERIAL_TYPES_EDIT = 1 << 4, // Use this if the kind of materials used changes
 	LIGHTS_EDIT         = 1 << 5, // Use this for any Light related editing
 	LIGHT_TYPES_EDIT    = 1 << 6, // Use this if the kind of lights used changes
-	IMAGEMAPS_EDIT      = 1 << 7  // Use this for any ImageMaps related editing
+	IMAGEMAPS_EDIT      = 1 << 7, // Use this for any ImageMaps related editing
+	GEOMETRY_REFIT_EDIT = 1 << 8  // Use this for mesh vertices editing without topology changes
 } EditAction;
 
 class EditActionList {
@@ -51,6 +52,7 @@ public:
 		AddAction(LIGHTS_EDIT);
 		AddAction(LIGHT_TYPES_EDIT);
 		AddAction(IMAGEMAPS_EDIT);
+		AddAction(GEOMETRY_REFIT_EDIT);
 	}
 	void AddActions(const u_int a) { actions |= a; };
 	u_int GetActions() const { return actions; };
@@ -105,6 +107,10 @@ inline std::ostream &operator<<(std::ostream &os, const EditActionList &eal) {
         SHOW_SEP;
 		os << "IMAGEMAPS_EDIT";
 	}
+	if (eal.Has(GEOMETRY_REFIT_EDIT)) {
+        SHOW_SEP;
+		os << "GEOMETRY_REFIT_EDIT";
+	}
 
 	os << "]";
 
@@ -71,7 +71,7 @@ protected:
 		return a * a; // Power heuristic
 	}
 
-	virtual boost::thread *AllocRenderThread() { return new boost::thread(&BiDirCPURenderThread::RenderFunc, this); }
+	virtual boost::thread *AllocRenderThread() { return AllocPinnedRenderThread(boost::bind(&BiDirCPURenderThread::RenderFunc, this)); }
 
 	SampleResult &AddResult(std::vector<SampleResult> &sampleResults, const bool fromLight) const;
 	void RenderFunc();
@@ -100,7 +100,7 @@ public:
 	friend class BiDirVMCPURenderEngine;
 
 private:
-	virtual boost::thread *AllocRenderThread() { return new boost::thread(&BiDirVMCPURenderThread::RenderFuncVM, this); }
+	virtual boost::thread *AllocRenderThread() { return AllocPinnedRenderThread(boost::bind(&BiDirVMCPURenderThread::RenderFuncVM, this)); }
 
 	void RenderFuncVM();
 };
@@ -19,7 +19,11 @@
 #ifndef _SLG_CPURENDERENGINE_H
 #define	_SLG_CPURENDERENGINE_H
 
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+
 #include "luxrays/utils/utils.h"
+#include "luxrays/utils/thread.h"
 
 #include "slg/slg.h"
 #include "slg/engines/renderengine.h"
@@ -53,10 +57,15 @@ public:
 
 protected:
 	virtual boost::thread *AllocRenderThread() = 0;
+	// Used by AllocRenderThread(): the new thread pins itself to its CPU
+	// before running renderFunc
+	boost::thread *AllocPinnedRenderThread(const boost::function<void()> &renderFunc);
 
 	virtual void StartRenderThread();
 	virtual void StopRenderThread();
 
+	void PinnedRenderFunc(const boost::function<void()> renderFunc);
+
 	u_int threadIndex;
 	CPURenderEngine *renderEngine;
 
@@ -74,6 +83,13 @@ public:
 	virtual bool HasDone() const;
 	virtual void WaitForDone() const;
 
+	u_int GetNUMANodeCount() const;
+	// The ratio of memory pages allocated on a remote NUMA node since the
+	// rendering has started. It is counted by the OS for the whole system,
+	// not only for this process, so other applications affect it. It is
+	// available only on Linux (0.0 otherwise).
+	double GetSystemRemoteMemoryRatio() const;
+
 	static luxrays::Properties ToProperties(const luxrays::Properties &cfg);
 
 	friend class CPURenderThread;
@@ -94,6 +110,14 @@ protected:
 	virtual void UpdateCounters() = 0;
 
 	std::vector<CPURenderThread *> renderThreads;
+
+	luxrays::ThreadAffinityType threadAffinity;
+	// The logical CPU of each render thread, empty if affinity is disabled.
+	// NOTE: there are no per NUMA node replicas of the scene data (accelerators,
+	// meshes, image maps), they are shared by all nodes. Pinning only makes the
+	// memory allocated by each render thread local to its node.
+	std::vector<u_int> threadCPUs;
+	u_longlong startLocalPages, startRemotePages;
 };
 
 //------------------------------------------------------------------------------
@@ -113,6 +137,7 @@ public:
 protected:
 	virtual void StartRenderThread();
 
+	// It is the engine film when native.film.shared.enable is true
 	Film *threadFilm;
 };
 
@@ -131,11 +156,16 @@ public:
 protected:
 	static const luxrays::Properties &GetDefaultProps();
 
+	virtual void EndSceneEditLockLess(const EditActionList &editActions);
+
 	virtual void UpdateFilmLockLess();
 	virtual void UpdateCounters();
 
 	SamplerSharedData *samplerSharedData;
 
+	// If all render threads splat directly on the (thread safe) engine film
+	// instead of having their own full resolution copy
+	bool useSharedFilm;
 	bool hasStartFilm;
 };
 
@@ -42,7 +42,7 @@ public:
 	friend class LightCPURenderEngine;
 
 private:
-	virtual boost::thread *AllocRenderThread() { return new boost::thread(&LightCPURenderThread::RenderFunc, this); }
+	virtual boost::thread *AllocRenderThread() { return AllocPinnedRenderThread(boost::bind(&LightCPURenderThread::RenderFunc, this)); }
 
 	void RenderFunc();
 
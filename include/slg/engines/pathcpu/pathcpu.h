@@ -45,7 +45,7 @@ public:
 
 protected:
 	void RenderFunc();
-	virtual boost::thread *AllocRenderThread() { return new boost::thread(&PathCPURenderThread::RenderFunc, this); }
+	virtual boost::thread *AllocRenderThread() { return AllocPinnedRenderThread(boost::bind(&PathCPURenderThread::RenderFunc, this)); }
 };
 
 class PathCPURenderEngine : public CPUNoTileRenderEngine {
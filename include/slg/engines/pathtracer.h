@@ -67,10 +67,38 @@ public:
 
 	bool forceBlackBackground;
 
+	friend class WavefrontPathCPURenderThread;
+
 private:
+	// The result of the first step of direct light sampling, it is added to
+	// the SampleResult only if the shadow ray is not occluded
+	typedef struct {
+		luxrays::Spectrum incomingRadiance, irradiance;
+		u_int lightID;
+		BSDFEvent event;
+		bool addContribution, addIrradiance;
+	} DirectLightSample;
+
 	void GenerateEyeRay(const Camera *camera, const Film *film,
 			luxrays::Ray &eyeRay, Sampler *sampler, SampleResult &sampleResult) const;
 
+	// The steps of a path, they are shared by RenderSample() and the
+	// render engines tracing rays in batches
+	void ClearSampleResult(SampleResult &sampleResult) const;
+	void HitNothing(const Scene *scene, const BSDFEvent lastBSDFEvent,
+			const luxrays::Spectrum &pathThroughput, const luxrays::Vector &eyeDir,
+			const float lastPdfW, SampleResult &sampleResult) const;
+	void HitObject(const Scene *scene, const BSDFEvent lastBSDFEvent,
+			const luxrays::Spectrum &pathThroughput, const float distance,
+			const BSDF &bsdf, const float lastPdfW, const PathDepthInfo &depthInfo,
+			SampleResult &sampleResult) const;
+	// Returns false if the path is terminated
+	bool GenerateNextVertexRay(Sampler *sampler, const u_int sampleOffset,
+			const BSDF &bsdf, const bool isLightVisible, luxrays::Ray *eyeRay,
+			luxrays::Spectrum *pathThroughput, float *lastPdfW, BSDFEvent *lastBSDFEvent,
+			PathVolumeInfo *volInfo, PathDepthInfo *depthInfo,
+			SampleResult &sampleResult) const;
+
 	bool DirectLightSampling(
 		luxrays::IntersectionDevice *device, const Scene *scene,
 		const float time, const float u0,
@@ -79,6 +107,18 @@ private:
 		const luxrays::Spectrum &pathThrouput, const BSDF &bsdf,
 		PathVolumeInfo volInfo, const u_int depth,
 		SampleResult *sampleResult) const;
+	// Direct light sampling split in 2 steps, the generation of the shadow
+	// ray and the evaluation of its result, so rays can be traced in batches
+	bool GenerateDirectLightRay(const Scene *scene,
+		const float time, const float u0,
+		const float u1, const float u2,
+		const float u3, const BSDF &bsdf, const u_int pathVertexCount,
+		const SampleResult &sampleResult,
+		luxrays::Ray *shadowRay, DirectLightSample *directLightSample) const;
+	void AddDirectLightSample(const DirectLightSample &directLightSample,
+		const luxrays::Spectrum &pathThroughput,
+		const luxrays::Spectrum &connectionThroughput,
+		SampleResult *sampleResult) const;
 
 	void DirectHitFiniteLight(const Scene *scene, 
 			const BSDFEvent lastBSDFEvent, const luxrays::Spectrum &pathThrouput,
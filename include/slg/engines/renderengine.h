@@ -20,7 +20,9 @@
 #define	_SLG_RENDERENGINE_H
 
 #include <deque>
+#include <boost/atomic.hpp>
 #include <boost/heap/priority_queue.hpp>
+#include <boost/thread.hpp>
 #include <boost/thread/condition_variable.hpp>
 
 #include "luxrays/utils/utils.h"
@@ -46,6 +48,7 @@ typedef enum {
 	TILEPATHCPU,
 	TILEPATHOCL,
 	RTPATHCPU,
+	WAVEFRONTPATHCPU,
 	RENDER_ENGINE_TYPE_COUNT
 } RenderEngineType;
 
@@ -111,6 +114,9 @@ public:
 	}
 	double GetTotalSampleCount() const { return samplesCount; }
 	float GetConvergence() const { return convergence; }
+	// Time spent (in seconds) by the last convergence test and by all tests
+	double GetConvergenceTestTime() const { return convergenceTestTime; }
+	double GetConvergenceTestTotalTime() const { return convergenceTestTotalTime; }
 	double GetTotalSamplesSec() const {
 		return (elapsedTime == 0.0) ? 0.0 : (samplesCount / elapsedTime);
 	}
@@ -145,6 +151,11 @@ protected:
 
 	void ResetConvergenceTest();
 	void RunConvergenceTest();
+	// The convergence test runs in its own thread so UpdateFilm() doesn't
+	// have to wait for it. It holds the film mutex while running so it only
+	// overlaps the film updates not requiring the mutex (i.e. shared films).
+	void ConvergenceTestThread(const float threshold);
+	void JoinConvergenceTestThread();
 
 	virtual void InitFilm() = 0;
 	virtual void StartLockLess() = 0;
@@ -178,6 +189,14 @@ protected:
 	float convergence;
 	double lastConvergenceTestTime;
 	double lastConvergenceTestSamplesCount;
+	double convergenceTestTime, convergenceTestTotalTime;
+
+	// The thread running the convergence test and its results, they are read
+	// only once convergenceTestDone is set
+	boost::thread *convergenceTestThread;
+	boost::atomic<bool> convergenceTestDone;
+	u_int convergenceTestTodoPixelsCount;
+	double convergenceTestThreadTime;
 
 	RenderState *startRenderState;
 
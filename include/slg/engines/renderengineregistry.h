@@ -27,6 +27,7 @@
 #include "slg/engines/lightcpu/lightcpu.h"
 #include "slg/engines/pathcpu/pathcpu.h"
 #include "slg/engines/rtpathcpu/rtpathcpu.h"
+#include "slg/engines/wavefrontpathcpu/wavefrontpathcpu.h"
 #include "slg/engines/bidircpu/bidircpu.h"
 #include "slg/engines/bidirvmcpu/bidirvmcpu.h"
 #include "slg/engines/filesaver/filesaver.h"
@@ -77,6 +78,7 @@ protected:
 	OBJECTSTATICREGISTRY_DECLARE_REGISTRATION(RenderEngineRegistry, TilePathOCLRenderEngine);
 #endif
 	OBJECTSTATICREGISTRY_DECLARE_REGISTRATION(RenderEngineRegistry, RTPathCPURenderEngine);
+	OBJECTSTATICREGISTRY_DECLARE_REGISTRATION(RenderEngineRegistry, WavefrontPathCPURenderEngine);
 	// Just add here any new Engine (don't forget in the .cpp too)
 
 	friend class RenderEngine;
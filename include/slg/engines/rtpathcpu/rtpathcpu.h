@@ -43,7 +43,7 @@ public:
 
 protected:
 	void RTRenderFunc();
-	virtual boost::thread *AllocRenderThread() { return new boost::thread(&RTPathCPURenderThread::RTRenderFunc, this); }
+	virtual boost::thread *AllocRenderThread() { return AllocPinnedRenderThread(boost::bind(&RTPathCPURenderThread::RTRenderFunc, this)); }
 
 	virtual void StartRenderThread();
 };
@@ -44,7 +44,7 @@ public:
 	friend class TilePathCPURenderEngine;
 
 private:
-	virtual boost::thread *AllocRenderThread() { return new boost::thread(&TilePathCPURenderThread::RenderFunc, this); }
+	virtual boost::thread *AllocRenderThread() { return AllocPinnedRenderThread(boost::bind(&TilePathCPURenderThread::RenderFunc, this)); }
 
 	void RenderFunc();
 
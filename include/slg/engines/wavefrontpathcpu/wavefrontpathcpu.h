@@ -0,0 +1,151 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+#ifndef _SLG_WAVEFRONTPATHCPU_H
+#define	_SLG_WAVEFRONTPATHCPU_H
+
+#include <vector>
+
+#include "slg/engines/pathcpu/pathcpu.h"
+#include "slg/utils/varianceclamping.h"
+
+namespace slg {
+
+//------------------------------------------------------------------------------
+// Wavefront path tracing CPU render engine
+//
+// Each render thread keeps many paths in flight and traces all their rays in
+// batches with the RayBuffer interface of its IntersectionDevice (like
+// PATHOCL does). The paths are split in groups so a group can be shaded
+// while the rays of the others are traced.
+//------------------------------------------------------------------------------
+
+class WavefrontPathCPURenderEngine;
+
+class WavefrontPathCPURenderThread : public PathCPURenderThread {
+public:
+	WavefrontPathCPURenderThread(WavefrontPathCPURenderEngine *engine, const u_int index,
+			luxrays::IntersectionDevice *device);
+	~WavefrontPathCPURenderThread();
+
+	friend class WavefrontPathCPURenderEngine;
+
+protected:
+	// The path finite state machine, the same of PATHOCL
+	typedef enum {
+		RT_NEXT_VERTEX,
+		HIT_NOTHING,
+		HIT_OBJECT,
+		RT_DL,
+		GENERATE_NEXT_VERTEX_RAY,
+		SPLAT_SAMPLE,
+		GENERATE_CAMERA_RAY
+	} PathState;
+
+	typedef struct {
+		PathState state;
+
+		Sampler *sampler;
+		std::vector<SampleResult> sampleResults;
+		u_int rayCount;
+
+		// The path state
+		luxrays::Ray ray;
+		luxrays::Spectrum pathThroughput, connectionThroughput;
+		float passThrough, originalMaxT, hitDistance, lastPdfW;
+		BSDFEvent lastBSDFEvent;
+		PathVolumeInfo volInfo;
+		PathDepthInfo depthInfo;
+		BSDF bsdf;
+		bool isLightVisible;
+
+		// The direct light sampling state
+		luxrays::Ray shadowRay;
+		luxrays::Spectrum dlConnectionThroughput;
+		float dlPassThrough, dlOriginalMaxT;
+		PathVolumeInfo dlVolInfo;
+		PathTracer::DirectLightSample directLightSample;
+		bool dlAnyHit;
+	} WavefrontPath;
+
+	// Used to sort the paths by state and material
+	class PathShadingOrder;
+
+	void WavefrontRenderFunc();
+	virtual boost::thread *AllocRenderThread() { return AllocPinnedRenderThread(boost::bind(&WavefrontPathCPURenderThread::WavefrontRenderFunc, this)); }
+
+	void InitPaths(luxrays::RandomGenerator *rndGen);
+	void FreePaths();
+
+	void EvaluateRayHit(WavefrontPath &path, luxrays::RayHit &rayHit);
+	// Returns the ray to trace for the path
+	const luxrays::Ray &AdvancePath(WavefrontPath &path, VarianceClamping &varianceClamping);
+	void SetNextVertexRay(WavefrontPath &path);
+
+	void FillRayBuffer(const u_int group, luxrays::RayBuffer *rayBuffer,
+			VarianceClamping &varianceClamping);
+
+	std::vector<WavefrontPath> paths;
+	std::vector<luxrays::RayBuffer *> rayBuffers;
+	// Used to group the paths by state and material before the shading
+	std::vector<u_int> pathIndices;
+	BSDF dlBSDF;
+
+	u_int groupSize;
+	// Number of samples done by the thread
+	u_int samplesCount;
+};
+
+class WavefrontPathCPURenderEngine : public PathCPURenderEngine {
+public:
+	WavefrontPathCPURenderEngine(const RenderConfig *cfg, Film *flm, boost::mutex *flmMutex);
+	~WavefrontPathCPURenderEngine();
+
+	virtual RenderEngineType GetType() const { return GetObjectType(); }
+	virtual std::string GetTag() const { return GetObjectTag(); }
+
+	//--------------------------------------------------------------------------
+	// Static methods used by RenderEngineRegistry
+	//--------------------------------------------------------------------------
+
+	static RenderEngineType GetObjectType() { return WAVEFRONTPATHCPU; }
+	static std::string GetObjectTag() { return "WAVEFRONTPATHCPU"; }
+	static luxrays::Properties ToProperties(const luxrays::Properties &cfg);
+	static RenderEngine *FromProperties(const RenderConfig *rcfg, Film *flm, boost::mutex *flmMutex);
+
+	friend class WavefrontPathCPURenderThread;
+
+protected:
+	static const luxrays::Properties &GetDefaultProps();
+
+	CPURenderThread *NewRenderThread(const u_int index,
+			luxrays::IntersectionDevice *device) {
+		return new WavefrontPathCPURenderThread(this, index, device);
+	}
+
+	virtual void StartLockLess();
+
+	// Number of paths traced by each render thread
+	u_int pathCount;
+	// Number of groups the paths are split in
+	u_int groupCount;
+};
+
+}
+
+#endif	/* _SLG_WAVEFRONTPATHCPU_H */
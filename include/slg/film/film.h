@@ -27,16 +27,20 @@
 #include <iostream>
 #include <vector>
 #include <set>
+#include <map>
 
+#include <boost/atomic.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/serialization/version.hpp>
 #include <boost/serialization/vector.hpp>
 #include <boost/serialization/set.hpp>
+#include <boost/serialization/map.hpp>
 
 #include "luxrays/core/geometry/point.h"
 #include "luxrays/core/geometry/normal.h"
 #include "luxrays/core/geometry/uv.h"
 #include "luxrays/core/oclintersectiondevice.h"
+#include "luxrays/utils/atomic.h"
 #include "luxrays/utils/oclcache.h"
 #include "luxrays/utils/properties.h"
 #include "luxrays/utils/serializationutils.h"
@@ -46,6 +50,7 @@
 #include "slg/film/framebuffer.h"
 #include "slg/film/filmoutputs.h"
 #include "slg/film/filmconvtest.h"
+#include "slg/film/filmasyncimagepipeline.h"
 #include "slg/utils/varianceclamping.h"
 
 namespace slg {
@@ -85,7 +90,8 @@ public:
 		OBJECT_ID = 1 << 22,
 		OBJECT_ID_MASK = 1 << 23,
 		BY_OBJECT_ID = 1 << 24,
-		FRAMEBUFFER_MASK = 1 << 25
+		FRAMEBUFFER_MASK = 1 << 25,
+		CONVERGENCE = 1 << 26
 	} FilmChannelType;
 
 	class RadianceChannelScale {
@@ -135,6 +141,10 @@ public:
 		const luxrays::Properties *prop = NULL);
 	// This one must be called before Init()
 	void RemoveChannel(const FilmChannelType type);
+	// The storage type used to serialize the channel and to write its output.
+	// It doesn't change the in-memory channel, always in full precision.
+	void SetChannelStorage(const FilmChannelType type, const FrameBufferStorageType storage);
+	FrameBufferStorageType GetChannelStorage(const FilmChannelType type) const;
 	// This one must be called before Init()
 	void SetRadianceGroupCount(const u_int count) { radianceGroupCount = count; }
 	u_int GetRadianceGroupCount() const { return radianceGroupCount; }
@@ -149,6 +159,25 @@ public:
 
 	void SetConvTestFlag(const bool enabled) { enabledConvTest = enabled; }
 	bool GetConvTestFlag() const { return enabledConvTest; }
+
+	// When enabled, AddSample*() and AddSampleCount() can be called by
+	// multiple threads at the same time. The film is partitioned in tiles
+	// of THREADSAFE_TILE_SIZE x THREADSAFE_TILE_SIZE pixels, each one
+	// protected by its own lock.
+	void SetThreadSafeFlag(const bool enabled);
+	bool IsThreadSafe() const { return (tileLocks != NULL); }
+	// The readers of the sample channels of a thread safe film (AddFilm(),
+	// the image pipelines, the convergence test, etc.) own the locks of the
+	// tiles of the rows [firstRow, lastRow) they are reading. They do nothing
+	// if the film is not thread safe.
+	void LockTileRows(const u_int firstRow, const u_int lastRow) const;
+	void UnlockTileRows(const u_int firstRow, const u_int lastRow) const;
+
+	// When enabled, the image pipelines executed to read the IMAGEPIPELINE
+	// channels and outputs run on a background thread. The last completed
+	// frame is returned without waiting the end of the current execution.
+	void SetAsyncImagePipelineFlag(const bool enabled);
+	bool IsAsyncImagePipeline() const { return enabledAsyncImagePipeline; }
 	
 	void Init();
 	void Resize(const u_int w, const u_int h);
@@ -161,6 +190,8 @@ public:
 
 	void SetOverlappedScreenBufferUpdateFlag(const bool overlappedScreenBufferUpdate) {
 		enabledOverlappedScreenBufferUpdate = overlappedScreenBufferUpdate;
+		InvalidateImagePipelines();
+		DeleteAsyncImagePipeline();
 	}
 	bool IsOverlappedScreenBufferUpdate() const { return enabledOverlappedScreenBufferUpdate; }
 
@@ -207,7 +238,15 @@ public:
 	bool HasDataChannel() { return hasDataChannel; }
 	bool HasComposingChannel() { return hasComposingChannel; }
 
+	// Per-pixel image pipelines are executed only on the regions of the film
+	// modified since their last execution
 	void ExecuteImagePipeline(const u_int index);
+	// Forces the next execution of all image pipelines over the complete film.
+	// It must be called after any direct write to the film channels.
+	void InvalidateImagePipelines() { imagePipelineTileSerials.clear(); }
+	// Used to read the IMAGEPIPELINE channels and outputs: it is the same of
+	// ExecuteImagePipeline() unless the asynchronous image pipeline is enabled
+	void RefreshImagePipeline(const u_int index);
 
 	//--------------------------------------------------------------------------
 
@@ -239,7 +278,10 @@ public:
 		statsTotalSampleCount = count;
 	}
 	void AddSampleCount(const double count) {
-		statsTotalSampleCount += count;
+		if (tileLocks)
+			luxrays::AtomicAdd(&statsTotalSampleCount, count);
+		else
+			statsTotalSampleCount += count;
 	}
 
 	void AddSample(const u_int x, const u_int y,
@@ -283,6 +325,10 @@ public:
 	// channel_IMAGEPIPELINEs, it is the only AOV updated only after having run
 	// the image pipeline. It is updated inside MergeSampleBuffers().
 	GenericFrameBuffer<1, 0, u_int> *channel_FRAMEBUFFER_MASK;
+	// This AOV is written by the convergence test: it is the per-pixel error
+	// normalized by the largest error of the last test (0.0 means converged
+	// and INFINITY means not yet tested). It is used by adaptive samplers.
+	GenericFrameBuffer<1, 0, float> *channel_CONVERGENCE;
 
 	// (Optional) OpenCL context
 	bool oclEnable;
@@ -316,6 +362,7 @@ public:
 
 	static FilmChannelType String2FilmChannelType(const std::string &type);
 	static const std::string FilmChannelType2String(const FilmChannelType type);
+	static bool IsChannelStorageSupported(const FilmChannelType type, const FrameBufferStorageType storage);
 
 	friend class boost::serialization::access;
 
@@ -328,7 +375,49 @@ private:
 	BOOST_SERIALIZATION_SPLIT_MEMBER()
 
 	void FreeChannels();
+	void ApplyChannelStorages();
+	void AllocTileLocks();
+	boost::mutex &GetTileLock(const u_int x, const u_int y) {
+		return tileLocks[(y / THREADSAFE_TILE_SIZE) * tileLocksCountX + x / THREADSAFE_TILE_SIZE];
+	}
+	void AddSampleResultColorLockLess(const u_int x, const u_int y,
+		const SampleResult &sampleResult, const float weight);
+	void AddSampleResultDataLockLess(const u_int x, const u_int y,
+		const SampleResult &sampleResult);
+
+	// Used by AddFilm() to merge all channels of the rows [firstRow, lastRow)
+	// in parallel
+	void AddFilmRows(const Film &film,
+			const u_int firstRow, const u_int lastRow,
+			const u_int srcOffsetX, const u_int srcOffsetY, const u_int srcWidth,
+			const u_int dstOffsetX, const u_int dstOffsetY);
+	void AddFilmRowsLockLess(const Film &film,
+			const u_int firstRow, const u_int lastRow,
+			const u_int srcOffsetX, const u_int srcOffsetY, const u_int srcWidth,
+			const u_int dstOffsetX, const u_int dstOffsetY);
+	void AllocDirtyTiles();
+	void DeleteAsyncImagePipeline();
+	// It must be called after the pixel has been written
+	void MarkDirtyPixel(const u_int x, const u_int y) {
+		if (dirtyTilesTracking)
+			++dirtyTileSerials[(y / IMAGEPIPELINE_TILE_SIZE) * dirtyTilesCountX + x / IMAGEPIPELINE_TILE_SIZE];
+	}
+	void MarkDirtyRegion(const u_int xStart, const u_int xEnd,
+			const u_int yStart, const u_int yEnd);
+	bool GetDirtyRegions(const u_int index, std::vector<u_int> &regions);
+	// Used by ExecuteImagePipeline() to merge the dirty regions [first, last)
+	// in parallel
+	void MergeDirtyRegions(const u_int index, const std::vector<u_int> &regions,
+			const u_int first, const u_int last);
 	void MergeSampleBuffers(const u_int index);
+	// Used by MergeSampleBuffers() to merge all radiance groups of the
+	// pixels [first, last) in parallel
+	void MergeRadianceGroups(const u_int first, const u_int last,
+			const float screenFactor, luxrays::Spectrum *p);
+	// Used by MergeSampleBuffers() on thread safe films, to merge the rows
+	// [firstRow, lastRow) holding their tile locks
+	void MergeRadianceRows(const u_int firstRow, const u_int lastRow,
+			const float screenFactor, luxrays::Spectrum *p);
 	void GetPixelFromMergedSampleBuffers(const u_int index, float *c) const;
 	void GetPixelFromMergedSampleBuffers(const u_int x, const u_int y, float *c) const {
 		GetPixelFromMergedSampleBuffers(x + y * width, c);
@@ -347,10 +436,15 @@ private:
 	void MergeSampleBuffersOCL(const u_int index);
 #endif
 
+	// Returns the channel (with a configurable storage type) used by an output
+	static bool GetOutputChannelType(const FilmOutputs::FilmOutputType outputType,
+			FilmChannelType *channelType);
+
 	static ImagePipeline *AllocImagePipeline(const luxrays::Properties &props, const std::string &prefix);
 	static std::vector<ImagePipeline *>AllocImagePipelines(const luxrays::Properties &props);
 
 	std::set<FilmChannelType> channels;
+	std::map<FilmChannelType, FrameBufferStorageType> channelStorages;
 	u_int width, height, pixelCount, radianceGroupCount;
 	u_int subRegion[4];
 	std::vector<u_int> maskMaterialIDs, byMaterialIDs;
@@ -363,11 +457,35 @@ private:
 
 	std::vector<ImagePipeline *> imagePipelines;
 	FilmConvTest *convTest;
+	FilmAsyncImagePipeline *asyncImagePipeline;
+
+	// The minimum number of pixels merged by each AddFilm() task
+	static const u_int ADDFILM_MIN_TASK_PIXELS = 16384;
+
+	// Used to track the regions modified since the last execution of each
+	// image pipeline. The serial of a tile is incremented after each write
+	// and a tile is dirty for an image pipeline if its serial is different
+	// from the one read by the last execution of the image pipeline. A write
+	// racing with the execution is always seen by the next one.
+	static const u_int IMAGEPIPELINE_TILE_SIZE = 32;
+	boost::atomic<u_int> *dirtyTileSerials;
+	u_int dirtyTilesCountX, dirtyTilesCountY;
+	// The tracking starts with the first execution of an image pipeline so
+	// the films never used for that (i.e. the per thread films) don't pay
+	// the atomic increments
+	boost::atomic<bool> dirtyTilesTracking;
+	std::vector<std::vector<u_int> > imagePipelineTileSerials;
+
+	// Used only in thread safe mode
+	static const u_int THREADSAFE_TILE_SIZE = 32;
+	boost::mutex *tileLocks;
+	u_int tileLocksCountX;
 
 	std::vector<RadianceChannelScale> radianceChannelScales;
 	FilmOutputs filmOutputs;
 
-	bool initialized, enabledConvTest, enabledOverlappedScreenBufferUpdate;	
+	bool initialized, enabledConvTest, enabledOverlappedScreenBufferUpdate,
+		enabledAsyncImagePipeline;
 };
 
 template<> const float *Film::GetChannel<float>(const FilmChannelType type, const u_int index);
@@ -377,7 +495,7 @@ template<> void Film::GetOutput<u_int>(const FilmOutputs::FilmOutputType type, u
 
 }
 
-BOOST_CLASS_VERSION(slg::Film, 8)
+BOOST_CLASS_VERSION(slg::Film, 10)
 BOOST_CLASS_VERSION(slg::Film::RadianceChannelScale, 1)
 
 BOOST_CLASS_EXPORT_KEY(slg::Film)
@@ -0,0 +1,79 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+#ifndef _SLG_FILMASYNCIMAGEPIPELINE_H
+#define	_SLG_FILMASYNCIMAGEPIPELINE_H
+
+#include <vector>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include "slg/slg.h"
+
+namespace slg {
+
+//------------------------------------------------------------------------------
+// FilmAsyncImagePipeline
+//------------------------------------------------------------------------------
+
+class Film;
+
+// Runs the image pipelines of a film on a background thread. The worker
+// executes them on a snapshot of the film, so the film can keep receiving
+// samples in the meanwhile. The snapshot has only the channels read by the
+// image pipelines. The channel_IMAGEPIPELINEs of the snapshot are the back
+// buffers, swapped with the ones of the film when a frame is published.
+
+class FilmAsyncImagePipeline {
+public:
+	FilmAsyncImagePipeline(Film *film);
+	~FilmAsyncImagePipeline();
+
+	// It must be called with the film locked. It publishes the last frame
+	// completed for the image pipeline index, if there is one, and starts a
+	// new execution if the worker is idle. It returns false if no frame has
+	// been published yet: the caller has to execute the image pipeline.
+	bool Refresh(const u_int index);
+	// It must be called with the film locked, after Film::Reset(): the frames
+	// computed from samples no more in the film are not published
+	void Invalidate();
+
+private:
+	void WorkerThread();
+
+	Film *film;
+	Film *snapshot;
+
+	boost::thread *workerThread;
+	boost::mutex workerMutex;
+	boost::condition_variable workerCondition;
+
+	// The index of the image pipeline to execute and of the last completed
+	// one (-1 if there is none)
+	int pendingIndex, completedIndex;
+	// The total sample count of the film when the snapshot was taken
+	double snapshotSampleCount;
+	bool working, invalidated, staleFrame, done;
+	std::vector<bool> publishedFrames;
+};
+
+}
+
+#endif	/* _SLG_FILMASYNCIMAGEPIPELINE_H */
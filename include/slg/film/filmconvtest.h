@@ -19,6 +19,8 @@
 #ifndef _SLG_FILMCONVTEST_H
 #define	_SLG_FILMCONVTEST_H
 
+#include <vector>
+
 #include <boost/serialization/version.hpp>
 
 #include "eos/portable_oarchive.hpp"
@@ -52,21 +54,46 @@ private:
 	// Used by serialization
 	FilmConvTest();
 
+	// The test is run in parallel over blocks of rows
+	void WeightRows(const u_int firstRow, const u_int lastRow);
+	void TestRows(const u_int firstRow, const u_int lastRow, const float threshold,
+			const float meanWeightDelta);
+	void NormalizeRows(const u_int firstRow, const u_int lastRow, const float invMaxError);
+
 	template<class Archive> void serialize(Archive &ar, const u_int version) {
 		ar & film;
 		ar & referenceImage;
 		ar & firstTest;
+		if (version > 1)
+			ar & referenceWeights;
+		else {
+			// Only when loading an old version: start again from the first pass
+			referenceWeights = new GenericFrameBuffer<1, 0, float>(referenceImage->GetWidth(), referenceImage->GetHeight());
+			firstTest = true;
+		}
 	}
 
 	const Film *film;
 
+	// The image and the pixel weights of the last test
 	GenericFrameBuffer<3, 0, float> *referenceImage;
+	GenericFrameBuffer<1, 0, float> *referenceWeights;
 	bool firstTest;
+
+	// Per pixel scratch buffer: the weight added since the last test and
+	// then the error. The CONVERGENCE channel is written only once the error
+	// has been normalized, so the samplers never read partial results.
+	std::vector<float> pixelErrors;
+
+	// Per row results of the last test
+	std::vector<double> rowWeightDelta;
+	std::vector<u_int> rowTodoPixelsCount;
+	std::vector<float> rowMaxError;
 };
 
 }
 
-BOOST_CLASS_VERSION(slg::FilmConvTest, 1)
+BOOST_CLASS_VERSION(slg::FilmConvTest, 2)
 
 BOOST_CLASS_EXPORT_KEY(slg::FilmConvTest)
 
@@ -52,6 +52,7 @@ public:
 		INDIRECT_SPECULAR, MATERIAL_ID_MASK, DIRECT_SHADOW_MASK, INDIRECT_SHADOW_MASK,
 		RADIANCE_GROUP, UV, RAYCOUNT, BY_MATERIAL_ID, IRRADIANCE,
 		OBJECT_ID, OBJECT_ID_MASK, BY_OBJECT_ID, FRAMEBUFFER_MASK,
+		CONVERGENCE,
 		FILMOUTPUT_TYPE_COUNT
 	} FilmOutputType;
 
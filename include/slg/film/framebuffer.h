@@ -19,16 +19,85 @@
 #ifndef _SLG_FRAMEBUFFER_H
 #define	_SLG_FRAMEBUFFER_H
 
+#include <algorithm>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 1))
+#define SLG_FRAMEBUFFER_SSE
+#include <xmmintrin.h>
+#endif
+
 #include <boost/serialization/vector.hpp>
+#include <OpenEXR/half.h>
 
 #include "luxrays/utils/utils.h"
 
 namespace slg {
 
+//------------------------------------------------------------------------------
+// Frame buffer storage types
+//------------------------------------------------------------------------------
+
+// The storage type is used only when a frame buffer is serialized or written
+// as a film output. It doesn't reduce the film memory usage: in memory,
+// the pixels are always float, also for the channels written only once like
+// normals and UV: GetPixels() is shared with the OpenCL engines and the
+// public film API. Compact types store the normalized values (and the weight
+// in full precision) of each pixel.
+typedef enum {
+	FRAMEBUFFER_STORAGE_FLOAT,
+	FRAMEBUFFER_STORAGE_HALF,
+	// Only for values in the [0, 1] range
+	FRAMEBUFFER_STORAGE_BYTE
+} FrameBufferStorageType;
+
+FrameBufferStorageType String2FrameBufferStorageType(const std::string &type);
+const std::string FrameBufferStorageType2String(const FrameBufferStorageType type);
+
+//------------------------------------------------------------------------------
+// Bulk operations on contiguous values, used to merge frame buffers
+//------------------------------------------------------------------------------
+
+template<class T> inline void FrameBufferAddValues(T *dst, const T *src, const u_int count) {
+	for (u_int i = 0; i < count; ++i)
+		dst[i] += src[i];
+}
+
+template<class T> inline void FrameBufferMinValues(T *dst, const T *src, const u_int count) {
+	for (u_int i = 0; i < count; ++i)
+		dst[i] = std::min(dst[i], src[i]);
+}
+
+#if defined(SLG_FRAMEBUFFER_SSE)
+template<> inline void FrameBufferAddValues<float>(float *dst, const float *src, const u_int count) {
+	u_int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const __m128 a = _mm_add_ps(_mm_loadu_ps(&dst[i]), _mm_loadu_ps(&src[i]));
+		const __m128 b = _mm_add_ps(_mm_loadu_ps(&dst[i + 4]), _mm_loadu_ps(&src[i + 4]));
+		_mm_storeu_ps(&dst[i], a);
+		_mm_storeu_ps(&dst[i + 4], b);
+	}
+	for (; i < count; ++i)
+		dst[i] += src[i];
+}
+
+template<> inline void FrameBufferMinValues<float>(float *dst, const float *src, const u_int count) {
+	u_int i = 0;
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(&dst[i], _mm_min_ps(_mm_loadu_ps(&dst[i]), _mm_loadu_ps(&src[i])));
+	for (; i < count; ++i)
+		dst[i] = std::min(dst[i], src[i]);
+}
+#endif
+
+//------------------------------------------------------------------------------
+// GenericFrameBuffer
+//------------------------------------------------------------------------------
+
 template<u_int CHANNELS, u_int WEIGHT_CHANNELS, class T> class GenericFrameBuffer {
 public:
 	GenericFrameBuffer(const u_int w, const u_int h)
-		: width(w), height(h), pixels(width * height * CHANNELS, (T)0) {
+		: width(w), height(h), pixels(width * height * CHANNELS, (T)0),
+		storageType(FRAMEBUFFER_STORAGE_FLOAT) {
 	}
 	~GenericFrameBuffer() { }
 
@@ -76,6 +145,30 @@ public:
 			pixel[i] += v[i];
 	}
 
+	// Adds count consecutive pixels of the row y, starting from x
+	void AddPixels(const u_int x, const u_int y, const T *v, const u_int count) {
+		assert (x + count <= width);
+		assert (y < height);
+
+		FrameBufferAddValues(&pixels[(x + y * width) * CHANNELS], v, count * CHANNELS);
+	}
+
+	// Sets count consecutive pixels of the row y, starting from x
+	void SetPixels(const u_int x, const u_int y, const T *v, const u_int count) {
+		assert (x + count <= width);
+		assert (y < height);
+
+		std::copy(v, v + count * CHANNELS, &pixels[(x + y * width) * CHANNELS]);
+	}
+
+	// Per value minimum of count consecutive pixels of the row y, starting from x
+	void MinPixels(const u_int x, const u_int y, const T *v, const u_int count) {
+		assert (x + count <= width);
+		assert (y < height);
+
+		FrameBufferMinValues(&pixels[(x + y * width) * CHANNELS], v, count * CHANNELS);
+	}
+
 	void AddWeightedPixel(const u_int x, const u_int y, const T *v, const float weight) {
 		assert (x >= 0);
 		assert (x < width);
@@ -209,21 +302,148 @@ public:
 	u_int GetHeight() const { return height; }
 	size_t GetSize() const { return width * height * CHANNELS * sizeof(T); }
 
+	// Compact storage types are supported only by float frame buffers
+	void SetStorageType(const FrameBufferStorageType type) { storageType = type; }
+	FrameBufferStorageType GetStorageType() const { return storageType; }
+
 	friend class boost::serialization::access;
 
 private:
 	// Used by serialization
-	GenericFrameBuffer() { }
+	GenericFrameBuffer() : storageType(FRAMEBUFFER_STORAGE_FLOAT) { }
+
+	static const u_int VALUE_CHANNELS = CHANNELS - WEIGHT_CHANNELS;
+
+	// Quantize the normalized values of each pixel. The weight channel, if
+	// any, is stored apart in full precision.
+	template<class S> void EncodePixels(std::vector<S> &values, std::vector<float> &weights,
+			S (*encode)(const float)) const {
+		const u_int pixelCount = width * height;
+		values.resize(pixelCount * VALUE_CHANNELS);
+		weights.resize((WEIGHT_CHANNELS == 0) ? 0 : pixelCount);
+
+		float v[CHANNELS];
+		for (u_int i = 0; i < pixelCount; ++i) {
+			for (u_int j = 0; j < CHANNELS; ++j)
+				v[j] = pixels[i * CHANNELS + j];
+			if (WEIGHT_CHANNELS != 0) {
+				const float weight = v[CHANNELS - 1];
+				const float k = (weight == 0.f) ? 0.f : (1.f / weight);
+				for (u_int j = 0; j < VALUE_CHANNELS; ++j)
+					v[j] *= k;
+				weights[i] = weight;
+			}
 
-	template<class Archive> void serialize(Archive &ar, const u_int version) {
+			for (u_int j = 0; j < VALUE_CHANNELS; ++j)
+				values[i * VALUE_CHANNELS + j] = encode(v[j]);
+		}
+	}
+
+	template<class S> void DecodePixels(const std::vector<S> &values, const std::vector<float> &weights,
+			float (*decode)(const S)) {
+		const u_int pixelCount = width * height;
+		pixels.resize(pixelCount * CHANNELS);
+
+		for (u_int i = 0; i < pixelCount; ++i) {
+			const float weight = (WEIGHT_CHANNELS == 0) ? 1.f : weights[i];
+			for (u_int j = 0; j < VALUE_CHANNELS; ++j)
+				pixels[i * CHANNELS + j] = (T)(decode(values[i * VALUE_CHANNELS + j]) * weight);
+			if (WEIGHT_CHANNELS != 0)
+				pixels[i * CHANNELS + CHANNELS - 1] = (T)weight;
+		}
+	}
+
+	static u_short EncodeHalf(const float v) {
+		// Clamp the finite values to the half range to avoid turning large
+		// values in infinity. Both infinities are kept.
+		return half((fabsf(v) == std::numeric_limits<float>::infinity()) ? v :
+			luxrays::Clamp(v, -HALF_MAX, HALF_MAX)).bits();
+	}
+	static float DecodeHalf(const u_short v) {
+		half h;
+		h.setBits(v);
+		return h;
+	}
+	static u_char EncodeByte(const float v) {
+		return (u_char)luxrays::Floor2UInt(luxrays::Clamp(v, 0.f, 1.f) * 255.f + .5f);
+	}
+	static float DecodeByte(const u_char v) {
+		return v * (1.f / 255.f);
+	}
+
+	template<class Archive> void save(Archive &ar, const u_int version) const {
 		ar & width;
 		ar & height;
-		ar & pixels;
+		ar & storageType;
+
+		switch (storageType) {
+			case FRAMEBUFFER_STORAGE_HALF: {
+				std::vector<u_short> values;
+				std::vector<float> weights;
+				EncodePixels(values, weights, &EncodeHalf);
+
+				ar & values;
+				ar & weights;
+				break;
+			}
+			case FRAMEBUFFER_STORAGE_BYTE: {
+				std::vector<u_char> values;
+				std::vector<float> weights;
+				EncodePixels(values, weights, &EncodeByte);
+
+				ar & values;
+				ar & weights;
+				break;
+			}
+			default:
+				ar & pixels;
+				break;
+		}
 	}
 
+	template<class Archive>	void load(Archive &ar, const u_int version) {
+		ar & width;
+		ar & height;
+
+		if (version < 2) {
+			storageType = FRAMEBUFFER_STORAGE_FLOAT;
+			ar & pixels;
+			return;
+		}
+
+		ar & storageType;
+
+		switch (storageType) {
+			case FRAMEBUFFER_STORAGE_HALF: {
+				std::vector<u_short> values;
+				std::vector<float> weights;
+				ar & values;
+				ar & weights;
+
+				DecodePixels(values, weights, &DecodeHalf);
+				break;
+			}
+			case FRAMEBUFFER_STORAGE_BYTE: {
+				std::vector<u_char> values;
+				std::vector<float> weights;
+				ar & values;
+				ar & weights;
+
+				DecodePixels(values, weights, &DecodeByte);
+				break;
+			}
+			default:
+				ar & pixels;
+				break;
+		}
+	}
+	BOOST_SERIALIZATION_SPLIT_MEMBER()
+
 	u_int width, height;
 
 	std::vector<T> pixels;
+
+	FrameBufferStorageType storageType;
 };
 
 // Mostly used for Boost serialization macros
@@ -236,12 +456,12 @@ typedef GenericFrameBuffer<1, 0, u_int> GenericFrameBuffer10UInt;
 
 }
 
-BOOST_CLASS_VERSION(slg::GenericFrameBuffer41Float, 1)
-BOOST_CLASS_VERSION(slg::GenericFrameBuffer30Float, 1)
-BOOST_CLASS_VERSION(slg::GenericFrameBuffer21Float, 1)
-BOOST_CLASS_VERSION(slg::GenericFrameBuffer20Float, 1)
-BOOST_CLASS_VERSION(slg::GenericFrameBuffer10Float, 1)
-BOOST_CLASS_VERSION(slg::GenericFrameBuffer10UInt, 1)
+BOOST_CLASS_VERSION(slg::GenericFrameBuffer41Float, 2)
+BOOST_CLASS_VERSION(slg::GenericFrameBuffer30Float, 2)
+BOOST_CLASS_VERSION(slg::GenericFrameBuffer21Float, 2)
+BOOST_CLASS_VERSION(slg::GenericFrameBuffer20Float, 2)
+BOOST_CLASS_VERSION(slg::GenericFrameBuffer10Float, 2)
+BOOST_CLASS_VERSION(slg::GenericFrameBuffer10UInt, 2)
 
 BOOST_CLASS_EXPORT_KEY(slg::GenericFrameBuffer41Float)
 BOOST_CLASS_EXPORT_KEY(slg::GenericFrameBuffer30Float)
@@ -23,6 +23,7 @@
 #include <memory>
 #include <typeinfo> 
 #include <boost/serialization/version.hpp>
+#include <boost/serialization/split_member.hpp>
 #include <boost/serialization/assume_abstract.hpp>
 #include <boost/serialization/export.hpp>
 #include <boost/serialization/vector.hpp>
@@ -55,6 +56,25 @@ public:
 		throw std::runtime_error("Internal error in ImagePipelinePlugin::ApplyOCL()");
 	};
 
+	// The film channels read by the plugin (a mask of Film::FilmChannelType),
+	// in addition to the radiance groups and IMAGEPIPELINE channels
+	virtual u_int GetRequiredChannels() const { return 0; }
+
+	// Per-pixel plugins (i.e. the result of each pixel depends only on the
+	// pixel itself) can be applied only to the modified regions of the film.
+	// The region is [xStart, xEnd) x [yStart, yEnd). ApplyRegion() runs
+	// only in the caller thread: ImagePipeline fuses the consecutive
+	// per-pixel plugins in a single multi-threaded pass over the film.
+	// The inner loop over the pixels of a row should be free of branches
+	// (i.e. the FRAMEBUFFER_MASK selects the value to use instead of
+	// skipping the pixel) so the compiler can vectorize it.
+	virtual bool IsPerPixel() const { return false; }
+	virtual void ApplyRegion(Film &film, const u_int index,
+			const u_int xStart, const u_int xEnd,
+			const u_int yStart, const u_int yEnd) {
+		throw std::runtime_error("Internal error in ImagePipelinePlugin::ApplyRegion()");
+	};
+
 #if !defined(LUXRAYS_DISABLE_OPENCL)
 	static cl::Program *CompileProgram(Film &film, const std::string &kernelsParameters,
 		const std::string &kernelSource, const std::string &name);
@@ -64,6 +84,11 @@ public:
 
 	friend class boost::serialization::access;
 
+protected:
+	// Used by per-pixel plugins to implement Apply() with a multi-threaded
+	// pass of ApplyRegion() over the complete film
+	void ApplyPerPixel(Film &film, const u_int index);
+
 private:
 	template<class Archive> void serialize(Archive &ar, const u_int version) {
 	}
@@ -86,20 +111,60 @@ public:
 
 	ImagePipeline *Copy() const;
 
+	// True if all plugins are per-pixel
+	bool IsPerPixel() const { return isPerPixel; }
+	// The film channels read by the plugins
+	u_int GetRequiredChannels() const;
+
 	void AddPlugin(ImagePipelinePlugin *plugin);
 	void Apply(Film &film, const u_int index);
+	// Available only for per-pixel image pipelines. Each region is
+	// [xStart, xEnd) x [yStart, yEnd), stored as 4 consecutive values.
+	void ApplyRegions(Film &film, const u_int index, const std::vector<u_int> &regions);
+
+	// Applies the per-pixel plugins [0, pluginCount) to the regions with a
+	// single multi-threaded pass: the film is split in blocks of rows and
+	// all the plugins are applied to a block, while it is in the cache,
+	// before moving to the next one.
+	static void ApplyPerPixelPlugins(Film &film, const u_int index,
+			ImagePipelinePlugin *const *plugins, const u_int pluginCount,
+			const std::vector<u_int> &regions);
 
 	friend class boost::serialization::access;
 
 private:
-	template<class Archive> void serialize(Archive &ar, const u_int version) {
+	template<class Archive> void save(Archive &ar, const u_int version) const {
 		ar & pipeline;
 		ar & canUseOpenCL;
 	}
 
+	template<class Archive>	void load(Archive &ar, const u_int version) {
+		ar & pipeline;
+		ar & canUseOpenCL;
+
+		isPerPixel = true;
+		for (u_int i = 0; i < pipeline.size(); ++i)
+			isPerPixel = isPerPixel && pipeline[i]->IsPerPixel();
+	}
+	BOOST_SERIALIZATION_SPLIT_MEMBER()
+
+	// True if the plugin can be fused with the other per-pixel plugins
+	static bool IsFusible(const Film &film, const ImagePipelinePlugin *plugin);
+	// Used by ApplyPerPixelPlugins() to process the blocks [first, last). With
+	// lockTiles, the tile locks of the rows of each block are owned while the
+	// plugins are applied.
+	static void ApplyPerPixelBlocks(Film &film, const u_int index,
+			ImagePipelinePlugin *const *plugins, const u_int pluginCount,
+			const std::vector<u_int> &blocks, const bool lockTiles,
+			const u_int first, const u_int last);
+
+	// The maximum number of pixels of a block of rows processed by each task
+	// of ApplyPerPixelPlugins()
+	static const u_int PERPIXEL_BLOCK_PIXELS = 8192;
+
 	std::vector<ImagePipelinePlugin *> pipeline;
 
-	bool canUseOpenCL;
+	bool canUseOpenCL, isPerPixel;
 };
 
 }
@@ -50,6 +50,7 @@ public:
 	virtual ImagePipelinePlugin *Copy() const;
 
 	virtual void Apply(Film &film, const u_int index);
+	virtual u_int GetRequiredChannels() const;
 
 #if !defined(LUXRAYS_DISABLE_OPENCL)
 	virtual bool CanUseOpenCL() const { return true; }
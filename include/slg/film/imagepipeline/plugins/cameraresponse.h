@@ -50,11 +50,20 @@ public:
 
 	virtual void Apply(Film &film, const u_int index);
 
+	virtual bool IsPerPixel() const { return true; }
+	virtual void ApplyRegion(Film &film, const u_int index,
+			const u_int xStart, const u_int xEnd,
+			const u_int yStart, const u_int yEnd);
+
 #if !defined(LUXRAYS_DISABLE_OPENCL)
 	virtual bool CanUseOpenCL() const { return true; }
 	virtual void ApplyOCL(Film &film, const u_int index);
 #endif
 
+	// Reference evaluation of the response functions, searching the curve
+	// data. ApplyRegion() uses the LUTs instead.
+	void Map(luxrays::RGBColor &rgb) const;
+
 	friend class boost::serialization::access;
 
 private:
@@ -70,12 +79,32 @@ private:
 		ar & blueI;
 		ar & blueB;
 		ar & color;
+
+		// The LUTs are not serialized
+		if (Archive::is_loading::value)
+			InitLUTs();
 	}
 
+	// Size limits of a LUT and the error it is refined to
+	static const u_int LUT_MIN_INTERVALS = 4096;
+	static const u_int LUT_MAX_INTERVALS = 65536;
+	static const float LUT_MAX_ERROR;
+
+	// A response function sampled at uniform steps over its input range
+	struct CrfLUT {
+		float start, invStep;
+		u_int intervals;
+		std::vector<float> values;
+		// False if LUT_MAX_ERROR can not be reached with LUT_MAX_INTERVALS,
+		// the curve data are used instead
+		bool accurate;
+	};
+
 	bool LoadPreset(const std::string &filmName);
 	void LoadFile(const std::string &filmName);
 
-	void Map(luxrays::RGBColor &rgb) const;
+	void InitLUTs();
+	void InitLUT(const std::vector<float> &from, const std::vector<float> &to, CrfLUT &lut) const;
 	float ApplyCrf(float point, const std::vector<float> &from, const std::vector<float> &to) const;
 
 	std::vector<float> redI; // image irradiance (on the image plane)
@@ -86,6 +115,9 @@ private:
 	std::vector<float> blueB; // measured intensity
 	bool color;
 
+	// Used by ApplyRegion(), built from the curves above
+	CrfLUT redLUT, greenLUT, blueLUT;
+
 #if !defined(LUXRAYS_DISABLE_OPENCL)
 	// Used inside the object destructor to free buffers
 	luxrays::OpenCLIntersectionDevice *oclIntersectionDevice;
@@ -49,6 +49,7 @@ public:
 	virtual ImagePipelinePlugin *Copy() const;
 
 	virtual void Apply(Film &film, const u_int index);
+	virtual u_int GetRequiredChannels() const;
 
 	friend class boost::serialization::access;
 
@@ -48,6 +48,7 @@ public:
 	virtual ImagePipelinePlugin *Copy() const;
 
 	virtual void Apply(Film &film, const u_int index);
+	virtual u_int GetRequiredChannels() const;
 
 	Film::FilmChannelType type;
 	u_int index;
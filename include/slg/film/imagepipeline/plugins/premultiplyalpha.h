@@ -51,6 +51,12 @@ public:
 	virtual ImagePipelinePlugin *Copy() const;
 
 	virtual void Apply(Film &film, const u_int index);
+	virtual u_int GetRequiredChannels() const;
+
+	virtual bool IsPerPixel() const { return true; }
+	virtual void ApplyRegion(Film &film, const u_int index,
+			const u_int xStart, const u_int xEnd,
+			const u_int yStart, const u_int yEnd);
 
 #if !defined(LUXRAYS_DISABLE_OPENCL)
 	virtual bool CanUseOpenCL() const { return true; }
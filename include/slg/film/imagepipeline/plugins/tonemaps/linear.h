@@ -50,6 +50,11 @@ public:
 
 	virtual void Apply(Film &film, const u_int index);
 
+	virtual bool IsPerPixel() const { return true; }
+	virtual void ApplyRegion(Film &film, const u_int index,
+			const u_int xStart, const u_int xEnd,
+			const u_int yStart, const u_int yEnd);
+
 #if !defined(LUXRAYS_DISABLE_OPENCL)
 	virtual bool CanUseOpenCL() const { return true; }
 	virtual void ApplyOCL(Film &film, const u_int index);
@@ -37,13 +37,14 @@ namespace slg {
 
 class RandomSamplerSharedData : public SamplerSharedData {
 public:
-	RandomSamplerSharedData() { }
+	RandomSamplerSharedData(Film *engineFlm) : engineFilm(engineFlm) { }
 	virtual ~RandomSamplerSharedData() { }
 
 	static SamplerSharedData *FromProperties(const luxrays::Properties &cfg,
 			luxrays::RandomGenerator *rndGen, Film *film);
 
-	// Nothing to share
+	// The render engine film, it is used for adaptive sampling
+	Film *engineFilm;
 };
 
 //------------------------------------------------------------------------------
@@ -53,16 +54,20 @@ public:
 class RandomSampler : public Sampler {
 public:
 	RandomSampler(luxrays::RandomGenerator *rnd, Film *flm,
-			const FilmSampleSplatter *flmSplatter) : Sampler(rnd, flm, flmSplatter) { }
+			const FilmSampleSplatter *flmSplatter,
+			RandomSamplerSharedData *samplerSharedData,
+			const float adaptiveStrength);
 	virtual ~RandomSampler() { }
 
 	virtual SamplerType GetType() const { return GetObjectType(); }
 	virtual std::string GetTag() const { return GetObjectTag(); }
-	virtual void RequestSamples(const u_int size) { }
+	virtual void RequestSamples(const u_int size);
 
-	virtual float GetSample(const u_int index) { return rndGen->floatValue(); }
+	virtual float GetSample(const u_int index);
 	virtual void NextSample(const std::vector<SampleResult> &sampleResults);
 
+	virtual luxrays::Properties ToProperties() const;
+
 	//--------------------------------------------------------------------------
 	// Static methods used by SamplerRegistry
 	//--------------------------------------------------------------------------
@@ -76,6 +81,15 @@ public:
 
 private:
 	static const luxrays::Properties &GetDefaultProps();
+
+	void InitNewSample();
+
+	RandomSamplerSharedData *sharedData;
+	float adaptiveStrength;
+	// NULL if adaptive sampling is disabled
+	const Film *adaptiveFilm;
+
+	float sample0, sample1;
 };
 
 }
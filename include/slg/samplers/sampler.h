@@ -103,6 +103,13 @@ protected:
 
 	void AddSamplesToFilm(const std::vector<SampleResult> &sampleResults, const float weight = 1.f) const;
 
+	// Used by adaptive samplers: the film has to provide a CONVERGENCE channel
+	static bool IsAdaptiveSamplingSupported(const Film *adaptiveFilm);
+	// Returns true if the image plane sample (u0, u1) has to be rendered
+	// according to the CONVERGENCE channel of the film
+	bool IsAdaptiveSampleAccepted(const Film *adaptiveFilm, const float adaptiveStrength,
+			const float u0, const float u1) const;
+
 	luxrays::RandomGenerator *rndGen;
 	Film *film;
 	const FilmSampleSplatter *filmSplatter;
@@ -39,12 +39,15 @@ namespace slg {
 
 class SobolSamplerSharedData : public SamplerSharedData {
 public:
-	SobolSamplerSharedData(luxrays::RandomGenerator *rndGen);
+	SobolSamplerSharedData(luxrays::RandomGenerator *rndGen, Film *engineFlm);
 	virtual ~SobolSamplerSharedData() { }
 
 	static SamplerSharedData *FromProperties(const luxrays::Properties &cfg,
 			luxrays::RandomGenerator *rndGen, Film *film);
 
+	// The render engine film, it is used for adaptive sampling
+	Film *engineFilm;
+
 	float rng0, rng1;
 	boost::atomic<u_int> pass;
 };
@@ -64,7 +67,8 @@ class SobolSampler : public Sampler {
 public:
 	SobolSampler(luxrays::RandomGenerator *rnd, Film *flm,
 			const FilmSampleSplatter *flmSplatter,
-			SobolSamplerSharedData *samplerSharedData);
+			SobolSamplerSharedData *samplerSharedData,
+			const float adaptiveStrength);
 	virtual ~SobolSampler();
 
 	virtual SamplerType GetType() const { return GetObjectType(); }
@@ -74,6 +78,8 @@ public:
 	virtual float GetSample(const u_int index);
 	virtual void NextSample(const std::vector<SampleResult> &sampleResults);
 
+	virtual luxrays::Properties ToProperties() const;
+
 	//--------------------------------------------------------------------------
 	// Static methods used by SamplerRegistry
 	//--------------------------------------------------------------------------
@@ -89,8 +95,13 @@ private:
 	static const luxrays::Properties &GetDefaultProps();
 
 	u_int SobolDimension(const u_int index, const u_int dimension) const;
+	void NextPass();
+	void InitNewSample();
 
 	SobolSamplerSharedData *sharedData;
+	float adaptiveStrength;
+	// NULL if adaptive sampling is disabled
+	const Film *adaptiveFilm;
 
 	u_int *directions;
 	u_int passBase, passOffset;
@@ -54,7 +54,8 @@ public:
 class TilePathSampler : public Sampler {
 public:
 	TilePathSampler(luxrays::RandomGenerator *rnd, Film *flm,
-			const FilmSampleSplatter *flmSplatter);
+			const FilmSampleSplatter *flmSplatter,
+			const float adaptiveStrength);
 	virtual ~TilePathSampler();
 
 	virtual SamplerType GetType() const { return GetObjectType(); }
@@ -64,6 +65,8 @@ public:
 	virtual float GetSample(const u_int index);
 	virtual void NextSample(const std::vector<SampleResult> &sampleResults);
 
+	virtual luxrays::Properties ToProperties() const;
+
 	//--------------------------------------------------------------------------
 	// TilePathSampler specific methods
 	//--------------------------------------------------------------------------
@@ -86,8 +89,13 @@ private:
 	static const luxrays::Properties &GetDefaultProps();
 	
 	void InitNewSample();
+	void NextPixel();
 	void SampleGrid(const u_int ix, const u_int iy, float *u0, float *u1) const;
 	
+	float adaptiveStrength;
+	// NULL if adaptive sampling is disabled
+	const Film *adaptiveFilm;
+
 	u_int aaSamples;
 
 	TileRepository::Tile *tile;
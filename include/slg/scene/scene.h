@@ -66,6 +66,23 @@ public:
 		const float passThrough, luxrays::Ray *ray, luxrays::RayHit *rayHit, BSDF *bsdf,
 		luxrays::Spectrum *connectionThroughput, const luxrays::Spectrum *pathThroughput = NULL,
 		SampleResult *sampleResult = NULL) const;
+	// Evaluates the result of a ray traced for Intersect(). It is used by
+	// render engines tracing rays in batches too. It returns true if the ray
+	// has to be traced again (i.e. pass-through materials, volume
+	// priorities, etc.), otherwise *result is the result of Intersect().
+	bool EvaluateTracedRay(const bool fromLight, PathVolumeInfo *volInfo,
+		float *passThrough, const float originalMaxT,
+		luxrays::Ray *ray, luxrays::RayHit *rayHit, BSDF *bsdf,
+		luxrays::Spectrum *connectionThroughput, const luxrays::Spectrum *pathThroughput,
+		SampleResult *sampleResult, bool *result) const;
+	// Shadow ray query: returns true if the ray is blocked. It honours
+	// pass-through materials and volumes like Intersect() but it can use the
+	// faster any-hit device query when the scene has only opaque surfaces.
+	bool Occluded(luxrays::IntersectionDevice *device,
+		const bool fromLight, PathVolumeInfo *volInfo,
+		const float passThrough, luxrays::Ray *ray,
+		luxrays::Spectrum *connectionThroughput) const;
+	bool UseAnyHitShadowRays() const { return useAnyHitShadowRays; }
 
 	void PreprocessCamera(const u_int filmWidth, const u_int filmHeight, const u_int *filmSubRegion);
 	void Preprocess(luxrays::Context *ctx,
@@ -151,6 +168,7 @@ public:
 
 private:
 	void Init(const float imageScale);
+	bool IsOnlyOpaqueSurfacesScene() const;
 
 	void ParseCamera(const luxrays::Properties &props);
 	void ParseTextures(const luxrays::Properties &props);
@@ -176,6 +194,11 @@ private:
 	luxrays::ExtMesh *CreateInlinedMesh(const std::string &shapeName,
 			const std::string &propName, const luxrays::Properties &props);
 
+	// True if shadow rays can be traced with the any-hit device query (i.e.
+	// there are no volumes or pass-through/transparent materials). It is
+	// updated by Preprocess().
+	bool useAnyHitShadowRays;
+
 	template<class Archive> void load(Archive &ar, const u_int version) {
 		// Load ExtMeshCache
 		ar & extMeshCache;
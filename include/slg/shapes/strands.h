@@ -32,7 +32,8 @@ class StrendsShape : public Shape {
 public:
 	typedef enum {
 		TESSEL_RIBBON, TESSEL_RIBBON_ADAPTIVE,
-		TESSEL_SOLID, TESSEL_SOLID_ADAPTIVE
+		TESSEL_SOLID, TESSEL_SOLID_ADAPTIVE,
+		TESSEL_SEGMENTS, TESSEL_SEGMENTS_ADAPTIVE
 	} TessellationType;
 
 	StrendsShape(const Scene *scene,
@@ -54,6 +55,12 @@ protected:
 		std::vector<luxrays::Point> &meshVerts, std::vector<luxrays::Normal> &meshNorms,
 		std::vector<luxrays::Triangle> &meshTris, std::vector<luxrays::UV> &meshUVs, std::vector<luxrays::Spectrum> &meshCols,
 		std::vector<float> &meshTransps) const;
+	void RefineAdaptive(const std::vector<luxrays::Point> &hairPoints,
+		const std::vector<float> &hairSizes, const std::vector<luxrays::Spectrum> &hairCols,
+		const std::vector<luxrays::UV> &hairUVs, const std::vector<float> &hairTransps,
+		std::vector<luxrays::Point> &tesselPoints, std::vector<float> &tesselSizes,
+		std::vector<luxrays::Spectrum> &tesselCols, std::vector<luxrays::UV> &tesselUVs,
+		std::vector<float> &tesselTransps) const;
 	void TessellateAdaptive(const Scene *scene,
 		const bool solid, const std::vector<luxrays::Point> &hairPoints,
 		const std::vector<float> &hairSizes, const std::vector<luxrays::Spectrum> &hairCols,
@@ -68,6 +75,13 @@ protected:
 		std::vector<luxrays::Point> &meshVerts, std::vector<luxrays::Normal> &meshNorms,
 		std::vector<luxrays::Triangle> &meshTris, std::vector<luxrays::UV> &meshUVs, std::vector<luxrays::Spectrum> &meshCols,
 		std::vector<float> &meshTransps) const;
+	// Native strands: the points are used as they are, as segments with a radius
+	void AddSegments(const std::vector<luxrays::Point> &hairPoints,
+		const std::vector<float> &hairSizes, const std::vector<luxrays::Spectrum> &hairCols,
+		const std::vector<luxrays::UV> &hairUVs, const std::vector<float> &hairTransps,
+		std::vector<luxrays::Point> &meshVerts, std::vector<float> &meshRadii,
+		std::vector<u_int> &meshSegs, std::vector<luxrays::UV> &meshUVs,
+		std::vector<luxrays::Spectrum> &meshCols, std::vector<float> &meshTransps) const;
 
 	// Tessellation options
 	u_int adaptiveMaxDepth;
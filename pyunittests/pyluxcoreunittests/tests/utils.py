@@ -49,6 +49,11 @@ engineProperties = {
 		native.threads.count = 1
 		batch.haltdebug = 8
 		"""),
+	"WAVEFRONTPATHCPU" : pyluxcore.Properties().SetFromString(
+		"""
+		native.threads.count = 1
+		batch.haltdebug = 8
+		"""),
 	"BIDIRCPU" : pyluxcore.Properties().SetFromString(
 		"""
 		native.threads.count = 1
@@ -86,6 +91,9 @@ def GetTestCases():
 		("PATHCPU", "RANDOM", GetDefaultEngineProperties("PATHCPU"), False),
 		("PATHCPU", "SOBOL", GetDefaultEngineProperties("PATHCPU"), False),
 		("PATHCPU", "METROPOLIS", GetDefaultEngineProperties("PATHCPU"), False),
+		("WAVEFRONTPATHCPU", "RANDOM", GetDefaultEngineProperties("WAVEFRONTPATHCPU"), False),
+		("WAVEFRONTPATHCPU", "SOBOL", GetDefaultEngineProperties("WAVEFRONTPATHCPU"), False),
+		("WAVEFRONTPATHCPU", "METROPOLIS", GetDefaultEngineProperties("WAVEFRONTPATHCPU"), False),
 		("BIDIRCPU", "RANDOM", GetDefaultEngineProperties("BIDIRCPU"), False),
 		("BIDIRCPU", "SOBOL", GetDefaultEngineProperties("BIDIRCPU"), False),
 		("BIDIRCPU", "METROPOLIS", GetDefaultEngineProperties("BIDIRCPU"), False),
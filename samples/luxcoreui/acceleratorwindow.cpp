@@ -37,6 +37,8 @@ AcceleratorWindow::AcceleratorWindow(LuxCoreApp *a) : ObjectEditorWindow(a, "Acc
 		.Add("QBVH", 3)
 		.Add("MQBVH", 4)
 		.Add("EMBREE", 5)
+		.Add("BVH4", 6)
+		.Add("BVH8", 7)
 		.SetDefault("AUTO");
 }
 
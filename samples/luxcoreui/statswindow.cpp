@@ -101,6 +101,9 @@ void StatsWindow::Draw() {
 			
 			const float convergence = stats.Get("stats.renderengine.convergence").Get<float>();
 			LuxCoreApp::ColoredLabelText("Convergence:", "%f%%", 100.f * convergence);
+			LuxCoreApp::ColoredLabelText("Convergence test time:", "%dms (total %.1fsecs)",
+					int(stats.Get("stats.renderengine.convergence.testtime").Get<double>() * 1000.0),
+					stats.Get("stats.renderengine.convergence.totaltime").Get<double>());
 		}
 
 		if (ImGui::CollapsingHeader("Intersection devices used", NULL, true, true)) {
@@ -712,6 +712,8 @@ void RenderSessionImpl::UpdateStats() {
 	stats.Set(Property("stats.renderengine.pass")(renderSession->renderEngine->GetPass()));
 	stats.Set(Property("stats.renderengine.time")(renderSession->renderEngine->GetRenderingTime()));
 	stats.Set(Property("stats.renderengine.convergence")(renderSession->renderEngine->GetConvergence()));
+	stats.Set(Property("stats.renderengine.convergence.testtime")(renderSession->renderEngine->GetConvergenceTestTime()));
+	stats.Set(Property("stats.renderengine.convergence.totaltime")(renderSession->renderEngine->GetConvergenceTestTotalTime()));
 	
 	// Intersection devices statistics
 	const vector<IntersectionDevice *> &idevices = renderSession->renderEngine->GetIntersectionDevices();
@@ -743,6 +745,7 @@ void RenderSessionImpl::UpdateStats() {
 		stats.Set(Property(prefix + ".performance.total")(dev->GetTotalPerformance()));
 		stats.Set(Property(prefix + ".performance.serial")(dev->GetSerialPerformance()));
 		stats.Set(Property(prefix + ".performance.dataparallel")(dev->GetDataParallelPerformance()));
+		stats.Set(Property(prefix + ".queue.waittime")(dev->GetQueueWaitTime()));
 		stats.Set(Property(prefix + ".memory.total")((u_longlong)dev->GetMaxMemory()));
 		stats.Set(Property(prefix + ".memory.used")((u_longlong)dev->GetUsedMemory()));
 	}
@@ -751,6 +754,14 @@ void RenderSessionImpl::UpdateStats() {
 
 	// The explicit cast to size_t is required by VisualC++
 	stats.Set(Property("stats.dataset.trianglecount")(renderSession->renderConfig->scene->dataSet->GetTotalTriangleCount()));
+	stats.Set(Property("stats.dataset.accelerator.buildtime")(renderSession->renderConfig->scene->dataSet->GetAcceleratorsBuildTime()));
+
+	// CPU render engines NUMA statistics
+	const slg::CPURenderEngine *cpuEngine = dynamic_cast<const slg::CPURenderEngine *>(renderSession->renderEngine);
+	if (cpuEngine) {
+		stats.Set(Property("stats.renderengine.native.numa.nodecount")(cpuEngine->GetNUMANodeCount()));
+		stats.Set(Property("stats.renderengine.native.numa.system.remotememoryratio")(cpuEngine->GetSystemRemoteMemoryRatio()));
+	}
 
 	// Some engine specific statistic
 	switch (renderSession->renderEngine->GetType()) {
@@ -991,6 +991,10 @@ static void Scene_DefineStrands(luxcore::detail::SceneImpl *scene, const string
 		tessellationType = Scene::TESSEL_SOLID;
 	else if (tessellationTypeStr == "solidadaptive")
 		tessellationType = Scene::TESSEL_SOLID_ADAPTIVE;
+	else if (tessellationTypeStr == "segments")
+		tessellationType = Scene::TESSEL_SEGMENTS;
+	else if (tessellationTypeStr == "segmentsadaptive")
+		tessellationType = Scene::TESSEL_SEGMENTS_ADAPTIVE;
 	else
 		throw runtime_error("Tessellation type unknown in method Scene.DefineStrands(): " + tessellationTypeStr);
 
@@ -1198,6 +1202,7 @@ BOOST_PYTHON_MODULE(pyluxcore) {
 		.value("OBJECT_ID", Film::OUTPUT_OBJECT_ID)
 		.value("OBJECT_ID_MASK", Film::OUTPUT_OBJECT_ID_MASK)
 		.value("BY_OBJECT_ID", Film::OUTPUT_BY_OBJECT_ID)
+		.value("CONVERGENCE", Film::OUTPUT_CONVERGENCE)
 	;
 
     class_<luxcore::detail::FilmImpl>("Film", init<string>())
@@ -20,14 +20,17 @@
 // Based of "Efficiency Issues for Ray Tracing" by Brian Smits
 // Available at http://www.cs.utah.edu/~bes/papers/fastRT/paper.html
 
+#include <xmmintrin.h>
 #include <iostream>
 #include <functional>
 #include <algorithm>
 #include <limits>
+#include <boost/bind.hpp>
 
 #include "luxrays/accelerators/bvhaccel.h"
 #include "luxrays/utils/utils.h"
 #include "luxrays/core/context.h"
+#include "luxrays/utils/taskscheduler.h"
 
 using namespace std;
 
@@ -35,15 +38,54 @@ namespace luxrays {
 
 // BVHAccel Method Definitions
 
-BVHAccel::BVHAccel(const Context *context) : ctx(context) {
-	params = ToBVHParams(ctx->GetConfig());
+BVHAccel::BVHAccel(const Context *context) : bvhTreeFile(NULL),
+		quantizedTree16(NULL), quantizedTree8(NULL), ctx(context) {
+	const Properties &cfg = ctx->GetConfig();
+	params = ToBVHParams(cfg);
+
+	const string nodeFormatName = cfg.Get(Property("accelerator.bvh.nodeformat")("FLOAT")).Get<string>();
+	if (nodeFormatName == "FLOAT")
+		nodeFormat = BVH_NODE_FLOAT;
+	else if (nodeFormatName == "QUANTIZED16")
+		nodeFormat = BVH_NODE_QUANTIZED16;
+	else if (nodeFormatName == "QUANTIZED8")
+		nodeFormat = BVH_NODE_QUANTIZED8;
+	else
+		throw runtime_error("Unknown BVH node format in BVHAccel::BVHAccel(): " + nodeFormatName);
+
+	if (cfg.Get(Property("accelerator.bvh.cache.enable")(false)).Get<bool>()) {
+		// An empty directory name means the default per-user cache directory
+		const string cacheDir = cfg.Get(Property("accelerator.bvh.cache.dir")("")).Get<string>();
+		cache = new BVHCache(ctx, (cacheDir.length() > 0) ? cacheDir : BVHCache::GetDefaultCacheDir());
+		// Small trees are faster to build than to load
+		cacheMinTriangleCount = cfg.Get(Property("accelerator.bvh.cache.mintrianglecount")(10000u)).Get<u_int>();
+	} else {
+		cache = NULL;
+		cacheMinTriangleCount = 0;
+	}
 
 	initialized = false;
 }
 
 BVHAccel::~BVHAccel() {
 	if (initialized)
-		delete bvhTree;
+		FreeBVHTree();
+	delete cache;
+}
+
+void BVHAccel::FreeBVHTree() {
+	if (bvhTreeFile) {
+		// The memory is owned by the memory mapped file
+		delete bvhTreeFile;
+		bvhTreeFile = NULL;
+	} else
+		delete[] bvhTree;
+	bvhTree = NULL;
+
+	delete[] quantizedTree16;
+	quantizedTree16 = NULL;
+	delete[] quantizedTree8;
+	quantizedTree8 = NULL;
 }
 
 BVHParams BVHAccel::ToBVHParams(const Properties &props) {
@@ -54,6 +96,8 @@ BVHParams BVHAccel::ToBVHParams(const Properties &props) {
 	const int isectCost = props.Get(Property("accelerator.bvh.isectcost")(80)).Get<int>();
 	const int travCost = props.Get(Property("accelerator.bvh.travcost")(10)).Get<int>();
 	const float emptyBonus = props.Get(Property("accelerator.bvh.emptybonus")(.5)).Get<float>();
+	const float sbvhMemoryBudget = props.Get(Property("accelerator.bvh.sbvh.memorybudget")(.3f)).Get<float>();
+	const float sbvhAlpha = props.Get(Property("accelerator.bvh.sbvh.alpha")(1e-5f)).Get<float>();
 	
 	BVHParams params;
 	// Make sure treeType is 2, 4 or 8
@@ -65,28 +109,42 @@ BVHParams BVHAccel::ToBVHParams(const Properties &props) {
 	params.isectCost = isectCost;
 	params.traversalCost = travCost;
 	params.emptyBonus = emptyBonus;
+	params.sbvhMemoryBudget = Max(0.f, sbvhMemoryBudget);
+	params.sbvhAlpha = Max(0.f, sbvhAlpha);
 
 	return params;
 }
 
-void BVHAccel::Init(const deque<const Mesh *> &ms, const u_longlong totVert,
-		const u_longlong totTri) {
-	assert (!initialized);
+// Initialize the leaf nodes of triangles (or segments) [first, last) of a mesh
+static void InitLeafNodes(const u_int first, const u_int last,
+		const Mesh *mesh, const u_int meshIndex,
+		BVHTreeNode *nodes, BVHTreeNode **list) {
+	const Triangle *p = mesh->GetTriangles();
 
-	meshes = ms;
-	totalVertexCount = totVert;
-	totalTriangleCount = totTri;
+	for (u_int i = first; i < last; ++i) {
+		BVHTreeNode *node = &nodes[i];
 
-	// Handle the empty DataSet case
-	if (totalTriangleCount == 0) {
-		LR_LOG(ctx, "Empty BVH");
-		nNodes = 0;
-		bvhTree = NULL;
-		initialized = true;
+		if (p[i].v[2] == SEGMENT_PRIMITIVE_MARKER)
+			node->bbox = mesh->GetSegmentBBox(p[i].v[0], p[i].v[1]);
+		else
+			node->bbox = Union(
+					BBox(mesh->GetVertex(0.f, p[i].v[0]), mesh->GetVertex(0.f, p[i].v[1])),
+					mesh->GetVertex(0.f, p[i].v[2]));
+		// NOTE - Ratow - Expand bbox a little to make sure rays collide
+		node->bbox.Expand(MachineEpsilon::E(node->bbox));
+		node->triangleLeaf.meshIndex = meshIndex;
+		node->triangleLeaf.triangleIndex = i;
 
-		return;
+		node->leftChild = NULL;
+		node->rightSibling = NULL;
+
+		list[i] = node;
 	}
+}
 
+luxrays::ocl::BVHArrayNode *BVHAccel::BuildBVHTree(const Context *ctx,
+		const BVHParams &params, const deque<const Mesh *> &meshes,
+		const u_longlong totalTriangleCount, u_int *nNodes) {
 	const double t0 = WallClockTime();
 
 	//--------------------------------------------------------------------------
@@ -98,32 +156,11 @@ void BVHAccel::Init(const deque<const Mesh *> &ms, const u_longlong totVert,
 	u_int meshIndex = 0;
 	u_int bvListIndex = 0;
 	BOOST_FOREACH(const Mesh *mesh, meshes) {
-		const Triangle *p = mesh->GetTriangles();
 		const u_int triangleCount = mesh->GetTotalTriangleCount();
 
-		#pragma omp parallel for
-		for (
-				// Visual C++ 2013 supports only OpenMP 2.5
-#if _OPENMP >= 200805
-				unsigned
-#endif
-				int i = 0; i < triangleCount; ++i) {
-			const int index = bvListIndex + i;
-			BVHTreeNode *node = &bvNodes[index];
-
-			node->bbox = Union(
-					BBox(mesh->GetVertex(0.f, p[i].v[0]), mesh->GetVertex(0.f, p[i].v[1])),
-					mesh->GetVertex(0.f, p[i].v[2]));
-			// NOTE - Ratow - Expand bbox a little to make sure rays collide
-			node->bbox.Expand(MachineEpsilon::E(node->bbox));
-			node->triangleLeaf.meshIndex = meshIndex;
-			node->triangleLeaf.triangleIndex = i;
-
-			node->leftChild = NULL;
-			node->rightSibling = NULL;
-
-			bvList[index] = node;
-		}
+		if (triangleCount > 0)
+			ParallelFor(0, triangleCount, 16 * 1024, boost::bind(&InitLeafNodes, _1, _2,
+					mesh, meshIndex, &bvNodes[bvListIndex], &bvList[bvListIndex]));
 		
 		bvListIndex += triangleCount;
 		++meshIndex;
@@ -142,17 +179,66 @@ void BVHAccel::Init(const deque<const Mesh *> &ms, const u_longlong totVert,
 		)).Get<string>();
 
 	LR_LOG(ctx, "BVH builder: " << builderType);
+	luxrays::ocl::BVHArrayNode *bvhTree;
 	if (builderType == "CLASSIC")
-		bvhTree = BuildBVH(params, &nNodes, &meshes, bvList);
+		bvhTree = BuildBVH(params, nNodes, &meshes, bvList);
 	else if (builderType == "EMBREE_BINNED_SAH")
-		bvhTree = BuildEmbreeBVHBinnedSAH(params, &nNodes, &meshes, bvList);
+		bvhTree = BuildEmbreeBVHBinnedSAH(params, nNodes, &meshes, bvList);
+	else if (builderType == "PARALLEL_BINNED_SAH")
+		bvhTree = BuildParallelBVHBinnedSAH(params, nNodes, &meshes, bvList);
+	else if (builderType == "SBVH")
+		bvhTree = BuildSBVH(params, nNodes, &meshes, bvList);
 	else if (builderType == "EMBREE_MORTON")
-		bvhTree = BuildEmbreeBVHMorton(params, &nNodes, &meshes, bvList);
+		bvhTree = BuildEmbreeBVHMorton(params, nNodes, &meshes, bvList);
 	else
-		throw runtime_error("Unknown BVH builder type in BVHAccel::Init(): " + builderType);
+		throw runtime_error("Unknown BVH builder type in BVHAccel::BuildBVHTree(): " + builderType);
 
 	LR_LOG(ctx, "BVH build hierarchy time: " << int((WallClockTime() - t1) * 1000) << "ms");
 
+	return bvhTree;
+}
+
+void BVHAccel::Init(const deque<const Mesh *> &ms, const u_longlong totVert,
+		const u_longlong totTri) {
+	assert (!initialized);
+
+	meshes = ms;
+	totalVertexCount = totVert;
+	totalTriangleCount = totTri;
+
+	// Handle the empty DataSet case
+	if (totalTriangleCount == 0) {
+		LR_LOG(ctx, "Empty BVH");
+		nNodes = 0;
+		bvhTree = NULL;
+		initialized = true;
+
+		return;
+	}
+
+	const double t0 = WallClockTime();
+
+	// Check if the tree is available in the persistent cache
+	string cacheKey;
+	if (cache && (totalTriangleCount >= cacheMinTriangleCount)) {
+		const string builderType = ctx->GetConfig().Get(Property("accelerator.bvh.builder.type")(
+			"EMBREE_BINNED_SAH"
+			)).Get<string>();
+		cacheKey = BVHCache::GetKey(params, builderType, meshes);
+
+		if (cacheKey.length() > 0)
+			bvhTreeFile = cache->Load(cacheKey, &bvhTree, &nNodes);
+	}
+
+	if (bvhTreeFile) {
+		LR_LOG(ctx, "BVH loaded from cache: " << cacheKey);
+	} else {
+		bvhTree = BuildBVHTree(ctx, params, meshes, totalTriangleCount, &nNodes);
+
+		if (cacheKey.length() > 0)
+			cache->Save(cacheKey, bvhTree, nNodes);
+	}
+
 	//--------------------------------------------------------------------------
 	// Done
 	//--------------------------------------------------------------------------
@@ -161,6 +247,384 @@ void BVHAccel::Init(const deque<const Mesh *> &ms, const u_longlong totVert,
 	LR_LOG(ctx, "Total BVH memory usage: " << nNodes * sizeof(luxrays::ocl::BVHArrayNode) / 1024 << "Kbytes");
 
 	initialized = true;
+
+	// Some statistic used to compare the builders: the number of triangle
+	// references is greater than the number of triangles if some triangle
+	// has been split (i.e. SBVH) and the SAH cost estimates the traversal cost
+	u_int leafCount = 0;
+	for (u_int i = 0; i < nNodes; ++i) {
+		if (BVHNodeData_IsLeaf(bvhTree[i].nodeData))
+			++leafCount;
+	}
+	LR_LOG(ctx, "BVH triangle references: " << leafCount << " (" <<
+			leafCount / float(totalTriangleCount) << " per triangle)");
+	LR_LOG(ctx, "BVH SAH cost: " << GetSAHCost());
+
+	//--------------------------------------------------------------------------
+	// Build the quantized tree if required
+	//--------------------------------------------------------------------------
+
+	if (nodeFormat != BVH_NODE_FLOAT) {
+		const double t1 = WallClockTime();
+
+		const luxrays::ocl::BVHArrayNode &root = bvhTree[0];
+		if (!BVHNodeData_IsLeaf(root.nodeData))
+			rootBBox = BBox(*reinterpret_cast<const Point *>(&root.bvhNode.bboxMin[0]),
+					*reinterpret_cast<const Point *>(&root.bvhNode.bboxMax[0]));
+
+		size_t quantizedSize;
+		if (nodeFormat == BVH_NODE_QUANTIZED16) {
+			quantizedTree16 = BuildQuantizedBVHTree<u_short>();
+			quantizedSize = quantizedTree16 ? (nNodes * sizeof(BVHQuantizedNode<u_short>)) : 0;
+		} else {
+			quantizedTree8 = BuildQuantizedBVHTree<u_char>();
+			quantizedSize = quantizedTree8 ? (nNodes * sizeof(BVHQuantizedNode<u_char>)) : 0;
+		}
+
+		if (quantizedSize > 0) {
+			const size_t floatSize = nNodes * sizeof(luxrays::ocl::BVHArrayNode);
+			LR_LOG(ctx, "BVH quantized nodes build time: " << int((WallClockTime() - t1) * 1000) << "ms");
+			LR_LOG(ctx, "Total BVH quantized memory usage: " << quantizedSize / 1024 << "Kbytes (" <<
+					(100.f * (floatSize - quantizedSize)) / floatSize << "% saved)");
+
+			// The float nodes are not used anymore
+			if (bvhTreeFile) {
+				delete bvhTreeFile;
+				bvhTreeFile = NULL;
+			} else
+				delete[] bvhTree;
+			bvhTree = NULL;
+		} else {
+			LR_LOG(ctx, "BVH is too deep for quantized nodes, using float nodes");
+			nodeFormat = BVH_NODE_FLOAT;
+		}
+	}
+}
+
+size_t BVHAccel::GetMemoryUsage() const {
+	switch (nodeFormat) {
+		case BVH_NODE_QUANTIZED16:
+			return nNodes * sizeof(BVHQuantizedNode<u_short>);
+		case BVH_NODE_QUANTIZED8:
+			return nNodes * sizeof(BVHQuantizedNode<u_char>);
+		default:
+			return nNodes * sizeof(luxrays::ocl::BVHArrayNode);
+	}
+}
+
+//------------------------------------------------------------------------------
+// Quantized nodes
+//------------------------------------------------------------------------------
+
+// The min. is relative to the parent min. and the max. to the parent max. so
+// the end points of the parent range are decoded without rounding errors
+template<class T> static inline void DecodeQuantizedBBox(
+		const float *parentMin, const float *parentMax,
+		const T *qMin, const T *qMax,
+		float *bboxMin, float *bboxMax) {
+	const float maxValue = numeric_limits<T>::max();
+
+	for (u_int axis = 0; axis < 3; ++axis) {
+		const float scale = (parentMax[axis] - parentMin[axis]) * (1.f / maxValue);
+		bboxMin[axis] = parentMin[axis] + qMin[axis] * scale;
+		bboxMax[axis] = parentMax[axis] - (maxValue - qMax[axis]) * scale;
+	}
+}
+
+template<class T> static void EncodeQuantizedBBox(
+		const float *parentMin, const float *parentMax,
+		const float *bboxMin, const float *bboxMax,
+		T *qMin, T *qMax) {
+	const int maxValue = numeric_limits<T>::max();
+
+	for (u_int axis = 0; axis < 3; ++axis) {
+		const float extent = parentMax[axis] - parentMin[axis];
+
+		if (extent > 0.f) {
+			qMin[axis] = static_cast<T>(Clamp(Floor2Int((bboxMin[axis] - parentMin[axis]) / extent * maxValue), 0, maxValue));
+			qMax[axis] = static_cast<T>(Clamp(Ceil2Int((bboxMax[axis] - parentMin[axis]) / extent * maxValue), 0, maxValue));
+		} else {
+			qMin[axis] = 0;
+			qMax[axis] = static_cast<T>(maxValue);
+		}
+	}
+
+	// Fix the rounding errors: the decoded bounding box has to include the
+	// original one or some ray could miss the node
+	for (;;) {
+		float decodedMin[3], decodedMax[3];
+		DecodeQuantizedBBox(parentMin, parentMax, qMin, qMax, decodedMin, decodedMax);
+
+		bool done = true;
+		for (u_int axis = 0; axis < 3; ++axis) {
+			if ((decodedMin[axis] > bboxMin[axis]) && (qMin[axis] > 0)) {
+				--qMin[axis];
+				done = false;
+			}
+			if ((decodedMax[axis] < bboxMax[axis]) && (qMax[axis] < maxValue)) {
+				++qMax[axis];
+				done = false;
+			}
+		}
+
+		if (done)
+			break;
+	}
+}
+
+template<class T> BVHQuantizedNode<T> *BVHAccel::BuildQuantizedBVHTree() const {
+	BVHQuantizedNode<T> *tree = new BVHQuantizedNode<T>[nNodes];
+
+	// The decoded bounding boxes of the ancestors of the current node and the
+	// indices where their sub-trees end. The traversal decodes exactly the
+	// same values.
+	vector<BBox> frames(1, rootBBox);
+	vector<u_int> skipIndices;
+	for (u_int i = 0; i < nNodes; ++i) {
+		while (!skipIndices.empty() && (i >= skipIndices.back())) {
+			skipIndices.pop_back();
+			frames.pop_back();
+		}
+
+		const luxrays::ocl::BVHArrayNode &node = bvhTree[i];
+		BVHQuantizedNode<T> &quantizedNode = tree[i];
+
+		quantizedNode.nodeData = node.nodeData;
+		if (BVHNodeData_IsLeaf(node.nodeData)) {
+			quantizedNode.triangleLeaf.meshIndex = node.triangleLeaf.meshIndex;
+			quantizedNode.triangleLeaf.triangleIndex = node.triangleLeaf.triangleIndex;
+		} else {
+			const u_int depth = skipIndices.size();
+			if (depth >= BVH_QUANTIZED_MAX_DEPTH) {
+				delete[] tree;
+				return NULL;
+			}
+
+			const BBox &parentBBox = frames.back();
+			EncodeQuantizedBBox(&parentBBox.pMin.x, &parentBBox.pMax.x,
+					node.bvhNode.bboxMin, node.bvhNode.bboxMax,
+					quantizedNode.bvhNode.bboxMin, quantizedNode.bvhNode.bboxMax);
+			quantizedNode.bvhNode.depth = static_cast<T>(depth);
+
+			BBox bbox;
+			DecodeQuantizedBBox(&parentBBox.pMin.x, &parentBBox.pMax.x,
+					quantizedNode.bvhNode.bboxMin, quantizedNode.bvhNode.bboxMax,
+					&bbox.pMin.x, &bbox.pMax.x);
+			frames.push_back(bbox);
+			skipIndices.push_back(node.nodeData);
+		}
+	}
+
+	return tree;
+}
+
+template<class T> bool BVHAccel::IntersectQuantized(const BVHQuantizedNode<T> *tree,
+		const Ray *initialRay, RayHit *rayHit) const {
+	Ray ray(*initialRay);
+
+	// The decoded bounding boxes of the ancestors: the bounding box of a node
+	// at depth N is relative to frame N and the decoded one is frame N + 1
+	float frameMin[BVH_QUANTIZED_MAX_DEPTH + 1][3], frameMax[BVH_QUANTIZED_MAX_DEPTH + 1][3];
+	for (u_int axis = 0; axis < 3; ++axis) {
+		frameMin[0][axis] = rootBBox.pMin[axis];
+		frameMax[0][axis] = rootBBox.pMax[axis];
+	}
+
+	u_int currentNode = 0; // Root Node
+	const u_int stopNode = BVHNodeData_GetSkipIndex(tree[0].nodeData); // Non-existent
+
+	float t, b1, b2;
+	while (currentNode < stopNode) {
+		const BVHQuantizedNode<T> &node = tree[currentNode];
+
+		const u_int nodeData = node.nodeData;
+		if (BVHNodeData_IsLeaf(nodeData)) {
+			// It is a leaf, check the triangle
+			const Mesh *mesh = meshes[node.triangleLeaf.meshIndex];
+			const Triangle &tri = mesh->GetTriangles()[node.triangleLeaf.triangleIndex];
+			bool hit;
+			if (tri.v[2] == SEGMENT_PRIMITIVE_MARKER)
+				hit = mesh->IntersectSegment(ray, tri.v[0], tri.v[1], &t, &b1, &b2);
+			else {
+				const Point p0 = mesh->GetVertex(0.f, tri.v[0]);
+				const Point p1 = mesh->GetVertex(0.f, tri.v[1]);
+				const Point p2 = mesh->GetVertex(0.f, tri.v[2]);
+				hit = Triangle::Intersect(ray, p0, p1, p2, &t, &b1, &b2);
+			}
+
+			if (hit) {
+				if (t < rayHit->t) {
+					ray.maxt = t;
+					rayHit->t = t;
+					rayHit->b1 = b1;
+					rayHit->b2 = b2;
+					rayHit->meshIndex = node.triangleLeaf.meshIndex;
+					rayHit->triangleIndex = node.triangleLeaf.triangleIndex;
+					// Continue testing for closer intersections
+				}
+			}
+
+			++currentNode;
+		} else {
+			// It is a node, decode and check the bounding box
+			const u_int depth = node.bvhNode.depth;
+			float *bboxMin = frameMin[depth + 1];
+			float *bboxMax = frameMax[depth + 1];
+			DecodeQuantizedBBox(frameMin[depth], frameMax[depth],
+					node.bvhNode.bboxMin, node.bvhNode.bboxMax,
+					bboxMin, bboxMax);
+
+			if (BBox::IntersectP(ray,
+					*reinterpret_cast<const Point *>(bboxMin),
+					*reinterpret_cast<const Point *>(bboxMax)))
+				++currentNode;
+			else {
+				// I don't need to use BVHNodeData_GetSkipIndex() here because
+				// I already know the leaf flag is 0
+				currentNode = nodeData;
+			}
+		}
+	}
+
+	return !rayHit->Miss();
+}
+
+template<class T> bool BVHAccel::OccludedQuantized(const BVHQuantizedNode<T> *tree,
+		const Ray *ray) const {
+	float frameMin[BVH_QUANTIZED_MAX_DEPTH + 1][3], frameMax[BVH_QUANTIZED_MAX_DEPTH + 1][3];
+	for (u_int axis = 0; axis < 3; ++axis) {
+		frameMin[0][axis] = rootBBox.pMin[axis];
+		frameMax[0][axis] = rootBBox.pMax[axis];
+	}
+
+	u_int currentNode = 0; // Root Node
+	const u_int stopNode = BVHNodeData_GetSkipIndex(tree[0].nodeData); // Non-existent
+
+	float t, b1, b2;
+	while (currentNode < stopNode) {
+		const BVHQuantizedNode<T> &node = tree[currentNode];
+
+		const u_int nodeData = node.nodeData;
+		if (BVHNodeData_IsLeaf(nodeData)) {
+			// It is a leaf, check the triangle
+			const Mesh *mesh = meshes[node.triangleLeaf.meshIndex];
+			const Triangle &tri = mesh->GetTriangles()[node.triangleLeaf.triangleIndex];
+			bool hit;
+			if (tri.v[2] == SEGMENT_PRIMITIVE_MARKER)
+				hit = mesh->IntersectSegment(*ray, tri.v[0], tri.v[1], &t, &b1, &b2);
+			else {
+				const Point p0 = mesh->GetVertex(0.f, tri.v[0]);
+				const Point p1 = mesh->GetVertex(0.f, tri.v[1]);
+				const Point p2 = mesh->GetVertex(0.f, tri.v[2]);
+				hit = Triangle::Intersect(*ray, p0, p1, p2, &t, &b1, &b2);
+			}
+
+			// Any intersection is good enough
+			if (hit)
+				return true;
+
+			++currentNode;
+		} else {
+			// It is a node, decode and check the bounding box
+			const u_int depth = node.bvhNode.depth;
+			float *bboxMin = frameMin[depth + 1];
+			float *bboxMax = frameMax[depth + 1];
+			DecodeQuantizedBBox(frameMin[depth], frameMax[depth],
+					node.bvhNode.bboxMin, node.bvhNode.bboxMax,
+					bboxMin, bboxMax);
+
+			if (BBox::IntersectP(*ray,
+					*reinterpret_cast<const Point *>(bboxMin),
+					*reinterpret_cast<const Point *>(bboxMax)))
+				++currentNode;
+			else {
+				// I don't need to use BVHNodeData_GetSkipIndex() here because
+				// I already know the leaf flag is 0
+				currentNode = nodeData;
+			}
+		}
+	}
+
+	return false;
+}
+
+void BVHAccel::Refit() {
+	assert (initialized);
+	assert (nodeFormat == BVH_NODE_FLOAT);
+
+	if (!nNodes)
+		return;
+
+	// In the depth-first array, the children of a node have always an index
+	// greater than their parent so a reverse scan is a bottom-up visit
+	vector<BBox> bboxes(nNodes);
+	for (int i = nNodes - 1; i >= 0; --i) {
+		luxrays::ocl::BVHArrayNode &node = bvhTree[i];
+
+		const u_int nodeData = node.nodeData;
+		if (BVHNodeData_IsLeaf(nodeData)) {
+			const Mesh *mesh = meshes[node.triangleLeaf.meshIndex];
+
+			BBox &bbox = bboxes[i];
+			if (node.triangleLeaf.v[2] == SEGMENT_PRIMITIVE_MARKER)
+				bbox = mesh->GetSegmentBBox(node.triangleLeaf.v[0], node.triangleLeaf.v[1]);
+			else
+				bbox = Union(
+						BBox(mesh->GetVertex(0.f, node.triangleLeaf.v[0]), mesh->GetVertex(0.f, node.triangleLeaf.v[1])),
+						mesh->GetVertex(0.f, node.triangleLeaf.v[2]));
+			// NOTE - Ratow - Expand bbox a little to make sure rays collide
+			bbox.Expand(MachineEpsilon::E(bbox));
+		} else {
+			// The children are stored from i + 1 up to the skip index of the node
+			BBox bbox;
+			for (u_int child = i + 1; child < nodeData;
+					child = BVHNodeData_GetSkipIndex(bvhTree[child].nodeData))
+				bbox = Union(bbox, bboxes[child]);
+
+			bboxes[i] = bbox;
+			node.bvhNode.bboxMin[0] = bbox.pMin.x;
+			node.bvhNode.bboxMin[1] = bbox.pMin.y;
+			node.bvhNode.bboxMin[2] = bbox.pMin.z;
+			node.bvhNode.bboxMax[0] = bbox.pMax.x;
+			node.bvhNode.bboxMax[1] = bbox.pMax.y;
+			node.bvhNode.bboxMax[2] = bbox.pMax.z;
+		}
+	}
+}
+
+void BVHAccel::Rebuild() {
+	assert (initialized);
+	assert (nodeFormat == BVH_NODE_FLOAT);
+
+	if (!nNodes)
+		return;
+
+	FreeBVHTree();
+	bvhTree = BuildBVHTree(ctx, params, meshes, totalTriangleCount, &nNodes);
+}
+
+float BVHAccel::GetSAHCost() const {
+	assert (initialized);
+
+	if (!nNodes || BVHNodeData_IsLeaf(bvhTree[0].nodeData))
+		return 0.f;
+
+	float totalArea = 0.f;
+	for (u_int i = 0; i < nNodes; ++i) {
+		const luxrays::ocl::BVHArrayNode &node = bvhTree[i];
+
+		if (!BVHNodeData_IsLeaf(node.nodeData)) {
+			const BBox bbox(*reinterpret_cast<const Point *>(&node.bvhNode.bboxMin[0]),
+					*reinterpret_cast<const Point *>(&node.bvhNode.bboxMax[0]));
+			totalArea += bbox.SurfaceArea();
+		}
+	}
+
+	const luxrays::ocl::BVHArrayNode &root = bvhTree[0];
+	const float rootArea = BBox(*reinterpret_cast<const Point *>(&root.bvhNode.bboxMin[0]),
+			*reinterpret_cast<const Point *>(&root.bvhNode.bboxMax[0])).SurfaceArea();
+
+	return (rootArea > 0.f) ? (totalArea / rootArea) : 0.f;
 }
 
 bool BVHAccel::Intersect(const Ray *initialRay, RayHit *rayHit) const {
@@ -171,6 +635,11 @@ bool BVHAccel::Intersect(const Ray *initialRay, RayHit *rayHit) const {
 	if (!nNodes)
 		return false;
 
+	if (nodeFormat == BVH_NODE_QUANTIZED16)
+		return IntersectQuantized(quantizedTree16, initialRay, rayHit);
+	else if (nodeFormat == BVH_NODE_QUANTIZED8)
+		return IntersectQuantized(quantizedTree8, initialRay, rayHit);
+
 	Ray ray(*initialRay);
 
 	u_int currentNode = 0; // Root Node
@@ -184,11 +653,17 @@ bool BVHAccel::Intersect(const Ray *initialRay, RayHit *rayHit) const {
 		if (BVHNodeData_IsLeaf(nodeData)) {
 			// It is a leaf, check the triangle
 			const Mesh *mesh = meshes[node.triangleLeaf.meshIndex];
-			const Point p0 = mesh->GetVertex(0.f, node.triangleLeaf.v[0]);
-			const Point p1 = mesh->GetVertex(0.f, node.triangleLeaf.v[1]);
-			const Point p2 = mesh->GetVertex(0.f, node.triangleLeaf.v[2]);
+			bool hit;
+			if (node.triangleLeaf.v[2] == SEGMENT_PRIMITIVE_MARKER)
+				hit = mesh->IntersectSegment(ray, node.triangleLeaf.v[0], node.triangleLeaf.v[1], &t, &b1, &b2);
+			else {
+				const Point p0 = mesh->GetVertex(0.f, node.triangleLeaf.v[0]);
+				const Point p1 = mesh->GetVertex(0.f, node.triangleLeaf.v[1]);
+				const Point p2 = mesh->GetVertex(0.f, node.triangleLeaf.v[2]);
+				hit = Triangle::Intersect(ray, p0, p1, p2, &t, &b1, &b2);
+			}
 
-			if (Triangle::Intersect(ray, p0, p1, p2, &t, &b1, &b2)) {
+			if (hit) {
 				if (t < rayHit->t) {
 					ray.maxt = t;
 					rayHit->t = t;
@@ -218,4 +693,236 @@ bool BVHAccel::Intersect(const Ray *initialRay, RayHit *rayHit) const {
 	return !rayHit->Miss();
 }
 
+//------------------------------------------------------------------------------
+// Packet traversal
+//------------------------------------------------------------------------------
+
+// The size of the stack of ray masks, deeper nodes just use the mask of the
+// last pushed ancestor (it is a super-set of the right one)
+#define BVH_PACKET_STACK_SIZE 64
+
+bool BVHAccel::IsCoherentPacket(const Ray *rays, const u_int count) {
+	for (u_int i = 1; i < count; ++i) {
+		if (((rays[i].d.x < 0.f) != (rays[0].d.x < 0.f)) ||
+				((rays[i].d.y < 0.f) != (rays[0].d.y < 0.f)) ||
+				((rays[i].d.z < 0.f) != (rays[0].d.z < 0.f)))
+			return false;
+	}
+
+	return true;
+}
+
+void BVHAccel::IntersectPacket(const luxrays::ocl::BVHArrayNode *bvhTree,
+		const deque<const Mesh *> &meshes, const u_int meshOffset,
+		const bool useLocalVertices, const Ray *rays, const int rayMask,
+		RayHit *hits) {
+	// Transpose the rays in SSE registers, not used lanes are masked anyway
+	Ray packetRays[BVH_PACKET_SIZE];
+	float rayOrigs[3][BVH_PACKET_SIZE], rayInvDirs[3][BVH_PACKET_SIZE];
+	float rayMinTs[BVH_PACKET_SIZE], rayMaxTs[BVH_PACKET_SIZE];
+	for (u_int i = 0; i < BVH_PACKET_SIZE; ++i) {
+		if (rayMask & (1 << i)) {
+			packetRays[i] = rays[i];
+			packetRays[i].maxt = hits[i].t;
+
+			for (u_int axis = 0; axis < 3; ++axis) {
+				rayOrigs[axis][i] = rays[i].o[axis];
+				rayInvDirs[axis][i] = 1.f / rays[i].d[axis];
+			}
+			rayMinTs[i] = rays[i].mint;
+			rayMaxTs[i] = hits[i].t;
+		} else {
+			for (u_int axis = 0; axis < 3; ++axis) {
+				rayOrigs[axis][i] = 0.f;
+				rayInvDirs[axis][i] = 1.f;
+			}
+			rayMinTs[i] = 1.f;
+			rayMaxTs[i] = 0.f;
+		}
+	}
+
+	__m128 rayOrig[3], rayInvDir[3], rayDirIsNeg[3];
+	for (u_int axis = 0; axis < 3; ++axis) {
+		rayOrig[axis] = _mm_loadu_ps(rayOrigs[axis]);
+		rayInvDir[axis] = _mm_loadu_ps(rayInvDirs[axis]);
+		rayDirIsNeg[axis] = _mm_cmplt_ps(rayInvDir[axis], _mm_setzero_ps());
+	}
+	const __m128 rayMinT = _mm_loadu_ps(rayMinTs);
+
+	// The stack of the masks of the rays entering each inner node, with
+	// the index of the node where the sub-tree ends
+	u_int stackSkipIndex[BVH_PACKET_STACK_SIZE];
+	int stackRayMask[BVH_PACKET_STACK_SIZE];
+	int stackSize = 0;
+
+	u_int currentNode = 0; // Root Node
+	const u_int stopNode = BVHNodeData_GetSkipIndex(bvhTree[0].nodeData); // Non-existent
+
+	float t, b1, b2;
+	while (currentNode < stopNode) {
+		// Pop the sub-trees I have left
+		while ((stackSize > 0) && (currentNode >= stackSkipIndex[stackSize - 1]))
+			--stackSize;
+		const int currentRayMask = (stackSize > 0) ? stackRayMask[stackSize - 1] : rayMask;
+
+		const luxrays::ocl::BVHArrayNode &node = bvhTree[currentNode];
+
+		const u_int nodeData = node.nodeData;
+		if (BVHNodeData_IsLeaf(nodeData)) {
+			// It is a leaf, check the triangle with all rays
+			const u_int meshIndex = node.triangleLeaf.meshIndex + meshOffset;
+			const Mesh *mesh = meshes[meshIndex];
+			// A segment has only 2 vertices and a radius for each of them
+			const bool isSegment = (node.triangleLeaf.v[2] == SEGMENT_PRIMITIVE_MARKER);
+			Point p0, p1, p2;
+			if (useLocalVertices) {
+				const Point *vertices = mesh->GetVertices();
+				p0 = vertices[node.triangleLeaf.v[0]];
+				p1 = vertices[node.triangleLeaf.v[1]];
+				if (!isSegment)
+					p2 = vertices[node.triangleLeaf.v[2]];
+			} else {
+				p0 = mesh->GetVertex(0.f, node.triangleLeaf.v[0]);
+				p1 = mesh->GetVertex(0.f, node.triangleLeaf.v[1]);
+				if (!isSegment)
+					p2 = mesh->GetVertex(0.f, node.triangleLeaf.v[2]);
+			}
+			float r0 = 0.f, r1 = 0.f;
+			if (isSegment) {
+				const float *radii = mesh->GetRadii();
+				r0 = radii[node.triangleLeaf.v[0]];
+				r1 = radii[node.triangleLeaf.v[1]];
+			}
+
+			for (u_int i = 0; i < BVH_PACKET_SIZE; ++i) {
+				if ((currentRayMask & (1 << i)) &&
+						(isSegment ?
+							Segment::Intersect(packetRays[i], p0, p1, r0, r1, &t, &b1, &b2) :
+							Triangle::Intersect(packetRays[i], p0, p1, p2, &t, &b1, &b2)) &&
+						(t < hits[i].t)) {
+					packetRays[i].maxt = t;
+					rayMaxTs[i] = t;
+					hits[i].t = t;
+					hits[i].b1 = b1;
+					hits[i].b2 = b2;
+					hits[i].meshIndex = meshIndex;
+					hits[i].triangleIndex = node.triangleLeaf.triangleIndex;
+					// Continue testing for closer intersections
+				}
+			}
+
+			++currentNode;
+		} else {
+			// It is a node, check the bounding box with all rays at once
+			__m128 tNear = rayMinT;
+			__m128 tFar = _mm_loadu_ps(rayMaxTs);
+			for (u_int axis = 0; axis < 3; ++axis) {
+				const __m128 bboxMin = _mm_set1_ps(node.bvhNode.bboxMin[axis]);
+				const __m128 bboxMax = _mm_set1_ps(node.bvhNode.bboxMax[axis]);
+				const __m128 nearPlane = _mm_or_ps(_mm_and_ps(rayDirIsNeg[axis], bboxMax),
+						_mm_andnot_ps(rayDirIsNeg[axis], bboxMin));
+				const __m128 farPlane = _mm_or_ps(_mm_and_ps(rayDirIsNeg[axis], bboxMin),
+						_mm_andnot_ps(rayDirIsNeg[axis], bboxMax));
+
+				// NOTE: _mm_max_ps()/_mm_min_ps() return the second operand
+				// if one of the operands is a NaN
+				tNear = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(nearPlane, rayOrig[axis]), rayInvDir[axis]), tNear);
+				tFar = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(farPlane, rayOrig[axis]), rayInvDir[axis]), tFar);
+			}
+
+			const int hitRayMask = _mm_movemask_ps(_mm_cmple_ps(tNear, tFar)) & currentRayMask;
+			if (hitRayMask) {
+				// Only the rays hitting the bounding box have to visit the sub-tree
+				if ((hitRayMask != currentRayMask) && (stackSize < BVH_PACKET_STACK_SIZE)) {
+					stackSkipIndex[stackSize] = nodeData;
+					stackRayMask[stackSize] = hitRayMask;
+					++stackSize;
+				}
+
+				++currentNode;
+			} else {
+				// I don't need to use BVHNodeData_GetSkipIndex() here because
+				// I already know the leaf flag is 0
+				currentNode = nodeData;
+			}
+		}
+	}
+}
+
+void BVHAccel::IntersectStream(const Ray *rays, RayHit *hits, const size_t count) const {
+	assert (initialized);
+
+	for (size_t i = 0; i < count; i += BVH_PACKET_SIZE) {
+		const u_int packetSize = Min<size_t>(BVH_PACKET_SIZE, count - i);
+
+		// Incoherent rays are faster to trace one by one
+		if (!nNodes || (nodeFormat != BVH_NODE_FLOAT) || (packetSize == 1) ||
+				!IsCoherentPacket(&rays[i], packetSize)) {
+			for (u_int j = 0; j < packetSize; ++j)
+				Intersect(&rays[i + j], &hits[i + j]);
+		} else {
+			for (u_int j = 0; j < packetSize; ++j) {
+				hits[i + j].t = rays[i + j].maxt;
+				hits[i + j].SetMiss();
+			}
+
+			IntersectPacket(bvhTree, meshes, 0, false, &rays[i], (1 << packetSize) - 1, &hits[i]);
+		}
+	}
+}
+
+bool BVHAccel::Occluded(const Ray *ray) const {
+	assert (initialized);
+
+	if (!nNodes)
+		return false;
+
+	if (nodeFormat == BVH_NODE_QUANTIZED16)
+		return OccludedQuantized(quantizedTree16, ray);
+	else if (nodeFormat == BVH_NODE_QUANTIZED8)
+		return OccludedQuantized(quantizedTree8, ray);
+
+	u_int currentNode = 0; // Root Node
+	const u_int stopNode = BVHNodeData_GetSkipIndex(bvhTree[0].nodeData); // Non-existent
+
+	float t, b1, b2;
+	while (currentNode < stopNode) {
+		const luxrays::ocl::BVHArrayNode &node = bvhTree[currentNode];
+
+		const u_int nodeData = node.nodeData;
+		if (BVHNodeData_IsLeaf(nodeData)) {
+			// It is a leaf, check the triangle
+			const Mesh *mesh = meshes[node.triangleLeaf.meshIndex];
+			bool hit;
+			if (node.triangleLeaf.v[2] == SEGMENT_PRIMITIVE_MARKER)
+				hit = mesh->IntersectSegment(*ray, node.triangleLeaf.v[0], node.triangleLeaf.v[1], &t, &b1, &b2);
+			else {
+				const Point p0 = mesh->GetVertex(0.f, node.triangleLeaf.v[0]);
+				const Point p1 = mesh->GetVertex(0.f, node.triangleLeaf.v[1]);
+				const Point p2 = mesh->GetVertex(0.f, node.triangleLeaf.v[2]);
+				hit = Triangle::Intersect(*ray, p0, p1, p2, &t, &b1, &b2);
+			}
+
+			// Any intersection is good enough
+			if (hit)
+				return true;
+
+			++currentNode;
+		} else {
+			// It is a node, check the bounding box
+			if (BBox::IntersectP(*ray,
+					*reinterpret_cast<const Point *>(&node.bvhNode.bboxMin[0]),
+					*reinterpret_cast<const Point *>(&node.bvhNode.bboxMax[0])))
+				++currentNode;
+			else {
+				// I don't need to use BVHNodeData_GetSkipIndex() here because
+				// I already know the leaf flag is 0
+				currentNode = nodeData;
+			}
+		}
+	}
+
+	return false;
+}
+
 }
@@ -129,6 +129,46 @@ u_int EmbreeAccel::ExportMotionTriangleMesh(const RTCScene embreeScene, const Mo
 	return geomID;
 }
 
+// Ignore the hits closer than the strand radius, like Segment::Intersect(), in
+// order to avoid self-intersections of the rays leaving the strand
+static void StrandsFilterFunc(void *userData, RTCRay &ray) {
+	const Mesh *mesh = (const Mesh *)userData;
+	const Triangle &seg = mesh->GetTriangles()[ray.primID];
+	const float *radii = mesh->GetRadii();
+	const float r = Lerp(ray.u, radii[seg.v[0]], radii[seg.v[1]]);
+
+	const float dLength2 = ray.dir[0] * ray.dir[0] + ray.dir[1] * ray.dir[1] + ray.dir[2] * ray.dir[2];
+	if (ray.tfar * ray.tfar * dLength2 < r * r)
+		ray.geomID = RTC_INVALID_GEOMETRY_ID;
+}
+
+u_int EmbreeAccel::ExportStrandsMesh(const RTCScene embreeScene, const Mesh *mesh) const {
+	const u_int geomID = rtcNewLineSegments(embreeScene, RTC_GEOMETRY_STATIC,
+			mesh->GetTotalTriangleCount(), mesh->GetTotalVertexCount(), 1);
+
+	// Copy the vertices with their radius
+	const Point *meshVerts = mesh->GetVertices();
+	const float *meshRadii = mesh->GetRadii();
+	float *vertices = (float *)rtcMapBuffer(embreeScene, geomID, RTC_VERTEX_BUFFER);
+	for (u_int i = 0; i < mesh->GetTotalVertexCount(); ++i) {
+		*vertices++ = meshVerts[i].x;
+		*vertices++ = meshVerts[i].y;
+		*vertices++ = meshVerts[i].z;
+		*vertices++ = meshRadii[i];
+	}
+	rtcUnmapBuffer(embreeScene, geomID, RTC_VERTEX_BUFFER);
+
+	// Share the segments, Embree uses only the index of the first vertex
+	Triangle *meshSegs = mesh->GetTriangles();
+	rtcSetBuffer(embreeScene, geomID, RTC_INDEX_BUFFER, meshSegs, 0, sizeof(Triangle));
+
+	rtcSetUserData(embreeScene, geomID, (void *)mesh);
+	rtcSetIntersectionFilterFunction(embreeScene, geomID, StrandsFilterFunc);
+	rtcSetOcclusionFilterFunction(embreeScene, geomID, StrandsFilterFunc);
+
+	return geomID;
+}
+
 void EmbreeAccel::Init(const std::deque<const Mesh *> &meshes,
 		const u_longlong totalVertexCount,
 		const u_longlong totalTriangleCount) {
@@ -205,6 +245,9 @@ void EmbreeAccel::Init(const std::deque<const Mesh *> &meshes,
 				ExportMotionTriangleMesh(embreeScene, mtm);
 				break;
 			}
+			case TYPE_EXT_STRANDS:
+				ExportStrandsMesh(embreeScene, mesh);
+				break;
 			default:
 				throw std::runtime_error("Unknown Mesh type in EmbreeAccel::Init(): " + ToString(mesh->GetType()));
 		}
@@ -274,4 +317,30 @@ bool EmbreeAccel::Intersect(const Ray *ray, RayHit *hit) const {
 		return false;
 }
 
+bool EmbreeAccel::Occluded(const Ray *ray) const {
+	RTCRay embreeRay;
+
+	embreeRay.org[0] = ray->o.x;
+	embreeRay.org[1] = ray->o.y;
+	embreeRay.org[2] = ray->o.z;
+
+	embreeRay.dir[0] = ray->d.x;
+	embreeRay.dir[1] = ray->d.y;
+	embreeRay.dir[2] = ray->d.z;
+
+	embreeRay.tnear = ray->mint;
+	embreeRay.tfar = ray->maxt;
+
+	embreeRay.geomID = RTC_INVALID_GEOMETRY_ID;
+	embreeRay.primID = RTC_INVALID_GEOMETRY_ID;
+	embreeRay.instID = RTC_INVALID_GEOMETRY_ID;
+	embreeRay.mask = 0xFFFFFFFF;
+	embreeRay.time = (ray->time - minTime) * timeScale;
+
+	rtcOccluded(embreeScene, embreeRay);
+
+	// Embree sets geomID to 0 if there is an intersection
+	return (embreeRay.geomID != RTC_INVALID_GEOMETRY_ID);
+}
+
 }
@@ -20,14 +20,18 @@
 // Based of "Efficiency Issues for Ray Tracing" by Brian Smits
 // Available at http://www.cs.utah.edu/~bes/papers/fastRT/paper.html
 
+#include <xmmintrin.h>
 #include <iostream>
 #include <functional>
 #include <algorithm>
 #include <limits>
 #include <boost/foreach.hpp>
+#include <boost/bind.hpp>
 
 #include "luxrays/accelerators/mbvhaccel.h"
 #include "luxrays/utils/utils.h"
+#include "luxrays/utils/atomic.h"
+#include "luxrays/utils/taskscheduler.h"
 #include "luxrays/core/context.h"
 #include "luxrays/core/exttrianglemesh.h"
 
@@ -35,10 +39,55 @@ using namespace std;
 
 namespace luxrays {
 
+namespace {
+
+// Used to build the BVH of the MBVH unique leafs with the TaskScheduler
+class UniqueLeafsBuilder {
+public:
+	UniqueLeafsBuilder(const Context *context, const vector<const Mesh *> &meshes,
+			vector<BVHAccel *> &bvhs) : ctx(context), leafsMesh(meshes), leafs(bvhs),
+			leafsDone(0), lastPrint(WallClockTime()) {
+	}
+
+	void Build(const u_int first, const u_int last) {
+		for (u_int i = first; i < last; ++i) {
+			const Mesh *mesh = leafsMesh[i];
+
+			deque<const Mesh *> mlist(1, mesh);
+			leafs[i]->Init(mlist, mesh->GetTotalVertexCount(), mesh->GetTotalTriangleCount());
+
+			boost::unique_lock<boost::mutex> lock(progressMutex);
+			++leafsDone;
+
+			const double now = WallClockTime();
+			if (now - lastPrint > 2.0) {
+				LR_LOG(ctx, "Building BVH for MBVH leaf: " << leafsDone << "/" << leafsMesh.size());
+				lastPrint = now;
+			}
+		}
+	}
+
+private:
+	const Context *ctx;
+	const vector<const Mesh *> &leafsMesh;
+	vector<BVHAccel *> &leafs;
+
+	boost::mutex progressMutex;
+	u_int leafsDone;
+	double lastPrint;
+};
+
+}
+
 // MBVHAccel Method Definitions
 
-MBVHAccel::MBVHAccel(const Context *context) : ctx(context) {
+MBVHAccel::MBVHAccel(const Context *context) : uniqueLeafIndexByMesh(MeshPtrCompare),
+		refitCount(0), ctx(context) {
 	params = BVHAccel::ToBVHParams(ctx->GetConfig());
+	refitMaxCostRatio = Max(1.f, ctx->GetConfig().Get(Property("accelerator.mbvh.refit.maxcostratio")(1.5f)).Get<float>());
+	motionTimeSegments = Max(1u, ctx->GetConfig().Get(Property("accelerator.mbvh.motionblur.timesegments")(8u)).Get<u_int>());
+	rootRefitEnabled = ctx->GetConfig().Get(Property("accelerator.mbvh.rootrefit.enable")(true)).Get<bool>();
+	rootRefitMaxCostRatio = Max(1.f, ctx->GetConfig().Get(Property("accelerator.mbvh.rootrefit.maxcostratio")(1.2f)).Get<float>());
 
 	initialized = false;
 }
@@ -86,28 +135,19 @@ void MBVHAccel::Init(const deque<const Mesh *> &ms, const u_longlong totalVertex
 
 	leafsIndex.reserve(nLeafs);
 
-	map<const Mesh *, u_int, bool (*)(const Mesh *, const Mesh *)> uniqueLeafIndexByMesh(MeshPtrCompare);
+	// The list of the meshes requiring a BVH, they are built later in parallel
+	vector<const Mesh *> uniqueLeafsMesh;
 
-	double lastPrint = WallClockTime();
 	for (u_int i = 0; i < nLeafs; ++i) {
-		const double now = WallClockTime();
-		if (now - lastPrint > 2.0) {
-			LR_LOG(ctx, "Building BVH for MBVH leaf: " << i << "/" << nLeafs);
-			lastPrint = now;
-		}
-
 		const Mesh *mesh = meshes[i];
 
 		switch (mesh->GetType()) {
 			case TYPE_TRIANGLE:
-			case TYPE_EXT_TRIANGLE: {
-				BVHAccel *leaf = new BVHAccel(ctx);
-				deque<const Mesh *> mlist(1, mesh);
-				leaf->Init(mlist, mesh->GetTotalVertexCount(), mesh->GetTotalTriangleCount());
-
-				const u_int uniqueLeafIndex = uniqueLeafs.size();
+			case TYPE_EXT_TRIANGLE:
+			case TYPE_EXT_STRANDS: {
+				const u_int uniqueLeafIndex = uniqueLeafsMesh.size();
 				uniqueLeafIndexByMesh[mesh] = uniqueLeafIndex;
-				uniqueLeafs.push_back(leaf);
+				uniqueLeafsMesh.push_back(mesh);
 				leafsIndex.push_back(uniqueLeafIndex);
 				leafsTransformIndex.push_back(NULL_INDEX);
 				leafsMotionSystemIndex.push_back(NULL_INDEX);
@@ -118,20 +158,16 @@ void MBVHAccel::Init(const deque<const Mesh *> &ms, const u_longlong totalVertex
 				const InstanceTriangleMesh *itm = dynamic_cast<const InstanceTriangleMesh *>(mesh);
 
 				// Check if a BVH has already been created
-				map<const Mesh *, u_int, bool (*)(const Mesh *, const Mesh *)>::iterator it =
+				LeafIndexByMeshMap::iterator it =
 						uniqueLeafIndexByMesh.find(itm->GetTriangleMesh());
 
 				if (it == uniqueLeafIndexByMesh.end()) {
 					TriangleMesh *instancedMesh = itm->GetTriangleMesh();
 
 					// Create a new BVH
-					BVHAccel *leaf = new BVHAccel(ctx);
-					deque<const Mesh *> mlist(1, instancedMesh);
-					leaf->Init(mlist, instancedMesh->GetTotalVertexCount(), instancedMesh->GetTotalTriangleCount());
-
-					const u_int uniqueLeafIndex = uniqueLeafs.size();
+					const u_int uniqueLeafIndex = uniqueLeafsMesh.size();
 					uniqueLeafIndexByMesh[instancedMesh] = uniqueLeafIndex;
-					uniqueLeafs.push_back(leaf);
+					uniqueLeafsMesh.push_back(instancedMesh);
 					leafsIndex.push_back(uniqueLeafIndex);
 				} else {
 					//LR_LOG(ctx, "Cached BVH leaf");
@@ -148,20 +184,16 @@ void MBVHAccel::Init(const deque<const Mesh *> &ms, const u_longlong totalVertex
 				const MotionTriangleMesh *mtm = dynamic_cast<const MotionTriangleMesh *>(mesh);
 
 				// Check if a BVH has already been created
-				map<const Mesh *, u_int, bool (*)(const Mesh *, const Mesh *)>::iterator it =
+				LeafIndexByMeshMap::iterator it =
 						uniqueLeafIndexByMesh.find(mtm->GetTriangleMesh());
 
 				if (it == uniqueLeafIndexByMesh.end()) {
 					TriangleMesh *motionMesh = mtm->GetTriangleMesh();
 
 					// Create a new BVH
-					BVHAccel *leaf = new BVHAccel(ctx);
-					deque<const Mesh *> mlist(1, motionMesh);
-					leaf->Init(mlist, motionMesh->GetTotalVertexCount(), motionMesh->GetTotalTriangleCount());
-
-					const u_int uniqueLeafIndex = uniqueLeafs.size();
+					const u_int uniqueLeafIndex = uniqueLeafsMesh.size();
 					uniqueLeafIndexByMesh[motionMesh] = uniqueLeafIndex;
-					uniqueLeafs.push_back(leaf);
+					uniqueLeafsMesh.push_back(motionMesh);
 					leafsIndex.push_back(uniqueLeafIndex);
 				} else {
 					//LR_LOG(ctx, "Cached BVH leaf");
@@ -178,12 +210,49 @@ void MBVHAccel::Init(const deque<const Mesh *> &ms, const u_longlong totalVertex
 		}
 	}
 
+	//--------------------------------------------------------------------------
+	// Build the BVH of all unique leafs in parallel
+	//--------------------------------------------------------------------------
+
+	const double tLeafs = WallClockTime();
+
+	const u_int nUniqueLeafs = uniqueLeafsMesh.size();
+	LR_LOG(ctx, "Building BVH for MBVH unique leafs: " << nUniqueLeafs);
+
+	vector<BVHAccel *> leafs(nUniqueLeafs);
+	for (u_int i = 0; i < nUniqueLeafs; ++i) {
+		leafs[i] = new BVHAccel(ctx);
+		// The MBVH traversal reads directly the float nodes of the leafs
+		leafs[i]->nodeFormat = BVH_NODE_FLOAT;
+	}
+
+	// The leafs are built anyway before to report an error so they can be
+	// deleted in the usual way
+	string buildError;
+	UniqueLeafsBuilder leafsBuilder(ctx, uniqueLeafsMesh, leafs);
+	try {
+		// One leaf for each task: the leafs can have very different sizes
+		ParallelFor(0, nUniqueLeafs, 1, boost::bind(&UniqueLeafsBuilder::Build, &leafsBuilder, _1, _2));
+	} catch (runtime_error &err) {
+		buildError = err.what();
+	}
+
+	uniqueLeafs.insert(uniqueLeafs.end(), leafs.begin(), leafs.end());
+	uniqueLeafsBuildCost.resize(nUniqueLeafs, 0.f);
+
+	if (buildError.length() > 0)
+		throw runtime_error(buildError);
+
+	LR_LOG(ctx, "MBVH leafs build time: " << int((WallClockTime() - tLeafs) * 1000) << "ms");
+
 	//--------------------------------------------------------------------------
 	// Build the root BVH
 	//--------------------------------------------------------------------------
 
 	LR_LOG(ctx, "Building Multilevel Bounding Volume Hierarchy root tree");
 
+	const double tRoot = WallClockTime();
+
 	bvhLeafs.resize(nLeafs);
 	bvhLeafsList.resize(nLeafs, NULL);
 	for (u_int i = 0; i < nLeafs; ++i) {
@@ -201,6 +270,9 @@ void MBVHAccel::Init(const deque<const Mesh *> &ms, const u_longlong totalVertex
 
 	bvhRootTree = NULL;
 	UpdateRootBVH();
+	UpdateRootMotionBBoxes();
+
+	LR_LOG(ctx, "MBVH root tree build time: " << int((WallClockTime() - tRoot) * 1000) << "ms");
 
 	LR_LOG(ctx, "MBVH build time: " << int((WallClockTime() - t0) * 1000) << "ms");
 
@@ -226,27 +298,286 @@ void MBVHAccel::UpdateRootBVH() {
 		bvhRootTree = BuildBVH(params, &nRootNodes, NULL, bvhLeafsList);
 	else if (builderType == "EMBREE_BINNED_SAH")
 		bvhRootTree = BuildEmbreeBVHBinnedSAH(params, &nRootNodes, NULL, bvhLeafsList);
+	else if (builderType == "PARALLEL_BINNED_SAH")
+		bvhRootTree = BuildParallelBVHBinnedSAH(params, &nRootNodes, NULL, bvhLeafsList);
+	else if (builderType == "SBVH") {
+		// Spatial splits are not available for a tree of BVHs, only object
+		// splits are used
+		bvhRootTree = BuildSBVH(params, &nRootNodes, NULL, bvhLeafsList);
+	}
 	else if (builderType == "EMBREE_MORTON")
 		bvhRootTree = BuildEmbreeBVHMorton(params, &nRootNodes, NULL, bvhLeafsList);
 	else
 		throw runtime_error("Unknown BVH builder type in MBVHAccel::UpdateRootBVH(): " + builderType);
+
+	UpdateRootBVHIndices();
+}
+
+size_t MBVHAccel::GetMemoryUsage() const {
+	size_t size = nRootNodes * sizeof(luxrays::ocl::BVHArrayNode) +
+			bvhRootMotionBBoxIndex.size() * sizeof(u_int) +
+			bvhRootMotionBBoxes.size() * sizeof(BBox);
+	BOOST_FOREACH(const BVHAccel *bvh, uniqueLeafs)
+		size += bvh->GetMemoryUsage();
+
+	return size;
+}
+
+BBox MBVHAccel::GetRootNodeBBox(const u_int index) const {
+	const luxrays::ocl::BVHArrayNode &node = bvhRootTree[index];
+
+	// The root tree leafs have no bounding box
+	if (BVHNodeData_IsLeaf(node.nodeData))
+		return bvhLeafs[node.bvhLeaf.meshOffsetIndex].bbox;
+	else
+		return BBox(*reinterpret_cast<const Point *>(&node.bvhNode.bboxMin[0]),
+				*reinterpret_cast<const Point *>(&node.bvhNode.bboxMax[0]));
+}
+
+float MBVHAccel::GetRootSAHCost() const {
+	if (!nRootNodes)
+		return 0.f;
+
+	const float rootArea = GetRootNodeBBox(0).SurfaceArea();
+
+	return (rootArea > 0.f) ? float(bvhRootInnerArea / rootArea) : 0.f;
+}
+
+void MBVHAccel::UpdateRootBVHIndices() {
+	bvhRootParents.resize(nRootNodes);
+	bvhRootLeafNodes.resize(bvhLeafs.size());
+	bvhRootInnerArea = 0.0;
+
+	// The stack of the ancestors of the current node
+	vector<u_int> ancestors;
+	for (u_int i = 0; i < nRootNodes; ++i) {
+		while (!ancestors.empty() && (i >= bvhRootTree[ancestors.back()].nodeData))
+			ancestors.pop_back();
+
+		const luxrays::ocl::BVHArrayNode &node = bvhRootTree[i];
+		bvhRootParents[i] = ancestors.empty() ? NULL_INDEX : ancestors.back();
+
+		if (BVHNodeData_IsLeaf(node.nodeData))
+			bvhRootLeafNodes[node.bvhLeaf.meshOffsetIndex] = i;
+		else {
+			bvhRootInnerArea += GetRootNodeBBox(i).SurfaceArea();
+			ancestors.push_back(i);
+		}
+	}
+
+	bvhRootBuildCost = GetRootSAHCost();
+}
+
+void MBVHAccel::UpdateRootMotionBBoxes() {
+	bvhRootMotionBBoxIndex.clear();
+	bvhRootMotionBBoxes.clear();
+
+	if ((motionTimeSegments <= 1) || uniqueLeafsMotionSystem.empty() || !nRootNodes)
+		return;
+
+	// The time interval of all motion systems
+	float motionEndTime = -numeric_limits<float>::infinity();
+	motionStartTime = numeric_limits<float>::infinity();
+	BOOST_FOREACH(const MotionSystem *ms, uniqueLeafsMotionSystem) {
+		motionStartTime = Min(motionStartTime, ms->StartTime());
+		motionEndTime = Max(motionEndTime, ms->EndTime());
+	}
+	if (motionEndTime <= motionStartTime)
+		return;
+
+	const float segmentLength = (motionEndTime - motionStartTime) / motionTimeSegments;
+	motionTimeScale = 1.f / segmentLength;
+
+	// The children of a node have always an index greater than their parent
+	// so a visit in reverse index order is bottom-up
+	bvhRootMotionBBoxIndex.resize(nRootNodes, NULL_INDEX);
+	for (int i = nRootNodes - 1; i >= 0; --i) {
+		const luxrays::ocl::BVHArrayNode &node = bvhRootTree[i];
+
+		if (BVHNodeData_IsLeaf(node.nodeData)) {
+			if (node.bvhLeaf.motionIndex == NULL_INDEX)
+				continue;
+
+			const MotionSystem *ms = uniqueLeafsMotionSystem[node.bvhLeaf.motionIndex];
+			const MotionTriangleMesh *mtm = dynamic_cast<const MotionTriangleMesh *>(meshes[node.bvhLeaf.meshOffsetIndex]);
+			const BBox localBBox = mtm->GetTriangleMesh()->GetBBox();
+
+			bvhRootMotionBBoxIndex[i] = bvhRootMotionBBoxes.size();
+			for (u_int segment = 0; segment < motionTimeSegments; ++segment) {
+				const float segmentStartTime = motionStartTime + segment * segmentLength;
+				BBox bbox = ms->Bound(localBBox, true, segmentStartTime, segmentStartTime + segmentLength);
+				bbox.Expand(MachineEpsilon::E(bbox));
+
+				bvhRootMotionBBoxes.push_back(bbox);
+			}
+		} else {
+			// Check if there is any motion in the sub-tree
+			bool hasMotion = false;
+			for (u_int child = i + 1; child < node.nodeData;
+					child = BVHNodeData_GetSkipIndex(bvhRootTree[child].nodeData)) {
+				if (bvhRootMotionBBoxIndex[child] != NULL_INDEX) {
+					hasMotion = true;
+					break;
+				}
+			}
+			if (!hasMotion)
+				continue;
+
+			const u_int index = bvhRootMotionBBoxes.size();
+			bvhRootMotionBBoxIndex[i] = index;
+			bvhRootMotionBBoxes.resize(index + motionTimeSegments);
+
+			// The children are stored from i + 1 up to the skip index of the node
+			for (u_int child = i + 1; child < node.nodeData;
+					child = BVHNodeData_GetSkipIndex(bvhRootTree[child].nodeData)) {
+				const u_int childIndex = bvhRootMotionBBoxIndex[child];
+
+				if (childIndex == NULL_INDEX) {
+					const BBox childBBox = GetRootNodeBBox(child);
+					for (u_int segment = 0; segment < motionTimeSegments; ++segment)
+						bvhRootMotionBBoxes[index + segment] = Union(bvhRootMotionBBoxes[index + segment], childBBox);
+				} else {
+					for (u_int segment = 0; segment < motionTimeSegments; ++segment)
+						bvhRootMotionBBoxes[index + segment] = Union(bvhRootMotionBBoxes[index + segment],
+								bvhRootMotionBBoxes[childIndex + segment]);
+				}
+			}
+		}
+	}
+
+	LR_LOG(ctx, "MBVH motion blur time segments: " << motionTimeSegments <<
+			" (bounding boxes: " << bvhRootMotionBBoxes.size() << ")");
+}
+
+void MBVHAccel::RefitRootBVH(const vector<u_int> &editedLeafs) {
+	// Look for all the ancestors of the edited leafs
+	vector<u_int> nodes;
+	BOOST_FOREACH(const u_int leafIndex, editedLeafs) {
+		for (u_int i = bvhRootParents[bvhRootLeafNodes[leafIndex]]; i != NULL_INDEX; i = bvhRootParents[i])
+			nodes.push_back(i);
+	}
+
+	// The children of a node have always an index greater than their parent
+	// so a visit in reverse index order is bottom-up
+	sort(nodes.begin(), nodes.end(), greater<u_int>());
+	nodes.erase(unique(nodes.begin(), nodes.end()), nodes.end());
+
+	BOOST_FOREACH(const u_int i, nodes) {
+		luxrays::ocl::BVHArrayNode &node = bvhRootTree[i];
+
+		// The children are stored from i + 1 up to the skip index of the node
+		BBox bbox;
+		for (u_int child = i + 1; child < node.nodeData;
+				child = BVHNodeData_GetSkipIndex(bvhRootTree[child].nodeData))
+			bbox = Union(bbox, GetRootNodeBBox(child));
+
+		bvhRootInnerArea += bbox.SurfaceArea() - GetRootNodeBBox(i).SurfaceArea();
+
+		node.bvhNode.bboxMin[0] = bbox.pMin.x;
+		node.bvhNode.bboxMin[1] = bbox.pMin.y;
+		node.bvhNode.bboxMin[2] = bbox.pMin.z;
+		node.bvhNode.bboxMax[0] = bbox.pMax.x;
+		node.bvhNode.bboxMax[1] = bbox.pMax.y;
+		node.bvhNode.bboxMax[2] = bbox.pMax.z;
+	}
 }
 
 void MBVHAccel::Update() {
-	// Update the BVH leaf bounding box
+	const double t0 = WallClockTime();
+
+	// Update the BVH leaf bounding boxes and look for the edited ones
+	vector<u_int> editedLeafs;
 	const u_int nLeafs = meshes.size();
 	for (u_int i = 0; i < nLeafs; ++i) {
 		BVHTreeNode *bvhLeaf = &bvhLeafs[i];
 		// Get the bounding box from the mesh so it is in global coordinates
-		bvhLeaf->bbox = meshes[i]->GetBBox();
+		const BBox bbox = meshes[i]->GetBBox();
+
+		if ((bbox.pMin != bvhLeaf->bbox.pMin) || (bbox.pMax != bvhLeaf->bbox.pMax)) {
+			bvhLeaf->bbox = bbox;
+			editedLeafs.push_back(i);
+		}
 	}
 
-	// Update the root BVH tree
-	UpdateRootBVH();
-	
+	// Update the root BVH tree. Only the bounding boxes of the leafs are
+	// used by the root tree so nothing has to be done if they are unchanged.
+	if (editedLeafs.size() > 0) {
+		if (rootRefitEnabled && (nRootNodes > 0)) {
+			RefitRootBVH(editedLeafs);
+
+			// Check if the quality of the tree has degraded too much
+			const float cost = GetRootSAHCost();
+			if (cost > bvhRootBuildCost * rootRefitMaxCostRatio) {
+				LR_LOG(ctx, "MBVH root tree SAH cost: " << cost << " (after build: " << bvhRootBuildCost << "), rebuilding");
+				UpdateRootBVH();
+			} else {
+				LR_LOG(ctx, "MBVH root tree refitted leafs: " << editedLeafs.size() << "/" << nLeafs);
+			}
+		} else
+			UpdateRootBVH();
+
+		UpdateRootMotionBBoxes();
+	}
+
+	LR_LOG(ctx, "MBVH root tree update time: " << int((WallClockTime() - t0) * 1000) << "ms");
+
 	// Nothing else to do because uniqueLeafsTransform is a list of pointers
 }
 
+void MBVHAccel::Refit(const vector<const Mesh *> &refitMeshes) {
+	assert (initialized);
+
+	const double t0 = WallClockTime();
+
+	// Look for the unique leafs to refit (more meshes can share the same leaf)
+	vector<u_int> leafIndices;
+	BOOST_FOREACH(const Mesh *mesh, refitMeshes) {
+		LeafIndexByMeshMap::const_iterator it = uniqueLeafIndexByMesh.find(mesh);
+		if (it == uniqueLeafIndexByMesh.end())
+			throw runtime_error("Unknown mesh in MBVHAccel::Refit()");
+
+		leafIndices.push_back(it->second);
+	}
+	sort(leafIndices.begin(), leafIndices.end());
+	leafIndices.erase(unique(leafIndices.begin(), leafIndices.end()), leafIndices.end());
+
+	u_int rebuildCount = 0;
+	ParallelFor(0, leafIndices.size(), 1, boost::bind(&MBVHAccel::RefitUniqueLeafs,
+			this, _1, _2, boost::cref(leafIndices), &rebuildCount));
+
+	LR_LOG(ctx, "MBVH refitted leafs: " << leafIndices.size() << " (rebuilt: " << rebuildCount << ")");
+	LR_LOG(ctx, "MBVH leafs refit time: " << int((WallClockTime() - t0) * 1000) << "ms");
+
+	++refitCount;
+
+	// Update the root BVH tree too
+	Update();
+}
+
+void MBVHAccel::RefitUniqueLeafs(const u_int first, const u_int last,
+		const vector<u_int> &leafIndices, u_int *rebuildCount) {
+	for (u_int i = first; i < last; ++i) {
+		const u_int leafIndex = leafIndices[i];
+		BVHAccel *leaf = uniqueLeafs[leafIndex];
+
+		// The cost of the tree as it was built, it is computed lazily before
+		// the first refit because the node bounding boxes are still the
+		// original ones at this point
+		float &buildCost = uniqueLeafsBuildCost[leafIndex];
+		if (buildCost == 0.f)
+			buildCost = leaf->GetSAHCost();
+
+		leaf->Refit();
+
+		// Check if the quality of the tree has degraded too much
+		if (leaf->GetSAHCost() > buildCost * refitMaxCostRatio) {
+			leaf->Rebuild();
+			buildCost = leaf->GetSAHCost();
+			AtomicInc(rebuildCount);
+		}
+	}
+}
+
 bool MBVHAccel::Intersect(const Ray *ray, RayHit *rayHit) const {
 	assert (initialized);
 
@@ -265,6 +596,10 @@ bool MBVHAccel::Intersect(const Ray *ray, RayHit *rayHit) const {
 
 	Ray currentRay(*ray);
 
+	// The time segment of the ray, used if the root tree has motion
+	const bool useMotionBBoxes = !bvhRootMotionBBoxIndex.empty();
+	const u_int motionTimeSegment = useMotionBBoxes ? GetMotionTimeSegment(ray->time) : 0;
+
 	for (;;) {
 		if (currentNode >= currentStopNode) {
 			if (insideLeafTree) {
@@ -298,10 +633,19 @@ bool MBVHAccel::Intersect(const Ray *ray, RayHit *rayHit) const {
 				const Point *vertices = currentMesh->GetVertices();
 				const Point &p0 = vertices[node.triangleLeaf.v[0]];
 				const Point &p1 = vertices[node.triangleLeaf.v[1]];
-				const Point &p2 = vertices[node.triangleLeaf.v[2]];
 
 				float t, b1, b2;
-				if (Triangle::Intersect(currentRay, p0, p1, p2, &t, &b1, &b2)) {
+				bool hit;
+				if (node.triangleLeaf.v[2] == SEGMENT_PRIMITIVE_MARKER) {
+					const float *radii = currentMesh->GetRadii();
+					hit = Segment::Intersect(currentRay, p0, p1,
+							radii[node.triangleLeaf.v[0]], radii[node.triangleLeaf.v[1]], &t, &b1, &b2);
+				} else {
+					const Point &p2 = vertices[node.triangleLeaf.v[2]];
+					hit = Triangle::Intersect(currentRay, p0, p1, p2, &t, &b1, &b2);
+				}
+
+				if (hit) {
 					if (t < rayHit->t) {
 						currentRay.maxt = t;
 						rayHit->t = t;
@@ -313,6 +657,10 @@ bool MBVHAccel::Intersect(const Ray *ray, RayHit *rayHit) const {
 					}
 				}
 
+				++currentNode;
+			} else if (useMotionBBoxes && (bvhRootMotionBBoxIndex[currentNode] != NULL_INDEX) &&
+					!bvhRootMotionBBoxes[bvhRootMotionBBoxIndex[currentNode] + motionTimeSegment].IntersectP(currentRay)) {
+				// The ray misses the moving leaf at its time
 				++currentNode;
 			} else {
 				// I have to check a leaf tree
@@ -338,10 +686,17 @@ bool MBVHAccel::Intersect(const Ray *ray, RayHit *rayHit) const {
 				insideLeafTree = true;
 			}
 		} else {
-			// It is a node, check the bounding box
-			if (BBox::IntersectP(currentRay,
-					*reinterpret_cast<const Point *>(&node.bvhNode.bboxMin[0]),
-					*reinterpret_cast<const Point *>(&node.bvhNode.bboxMax[0])))
+			// It is a node, check the bounding box (the one of the ray time
+			// segment if the node has motion)
+			bool hit;
+			if (!insideLeafTree && useMotionBBoxes && (bvhRootMotionBBoxIndex[currentNode] != NULL_INDEX))
+				hit = bvhRootMotionBBoxes[bvhRootMotionBBoxIndex[currentNode] + motionTimeSegment].IntersectP(currentRay);
+			else
+				hit = BBox::IntersectP(currentRay,
+						*reinterpret_cast<const Point *>(&node.bvhNode.bboxMin[0]),
+						*reinterpret_cast<const Point *>(&node.bvhNode.bboxMax[0]));
+
+			if (hit)
 				++currentNode;
 			else {
 				// I don't need to use BVHNodeData_GetSkipIndex() here because
@@ -354,4 +709,273 @@ bool MBVHAccel::Intersect(const Ray *ray, RayHit *rayHit) const {
 	return !rayHit->Miss();
 }
 
+//------------------------------------------------------------------------------
+// Packet traversal
+//------------------------------------------------------------------------------
+
+// The size of the stack of ray masks, deeper nodes just use the mask of the
+// last pushed ancestor (it is a super-set of the right one)
+#define MBVH_PACKET_STACK_SIZE 64
+
+void MBVHAccel::IntersectPacket(const Ray *rays, const int rayMask, RayHit *hits) const {
+	// Transpose the rays in SSE registers, not used lanes are masked anyway
+	float rayOrigs[3][BVH_PACKET_SIZE], rayInvDirs[3][BVH_PACKET_SIZE];
+	float rayMinTs[BVH_PACKET_SIZE], rayMaxTs[BVH_PACKET_SIZE];
+	for (u_int i = 0; i < BVH_PACKET_SIZE; ++i) {
+		if (rayMask & (1 << i)) {
+			for (u_int axis = 0; axis < 3; ++axis) {
+				rayOrigs[axis][i] = rays[i].o[axis];
+				rayInvDirs[axis][i] = 1.f / rays[i].d[axis];
+			}
+			rayMinTs[i] = rays[i].mint;
+			rayMaxTs[i] = hits[i].t;
+		} else {
+			for (u_int axis = 0; axis < 3; ++axis) {
+				rayOrigs[axis][i] = 0.f;
+				rayInvDirs[axis][i] = 1.f;
+			}
+			rayMinTs[i] = 1.f;
+			rayMaxTs[i] = 0.f;
+		}
+	}
+
+	__m128 rayOrig[3], rayInvDir[3], rayDirIsNeg[3];
+	for (u_int axis = 0; axis < 3; ++axis) {
+		rayOrig[axis] = _mm_loadu_ps(rayOrigs[axis]);
+		rayInvDir[axis] = _mm_loadu_ps(rayInvDirs[axis]);
+		rayDirIsNeg[axis] = _mm_cmplt_ps(rayInvDir[axis], _mm_setzero_ps());
+	}
+	const __m128 rayMinT = _mm_loadu_ps(rayMinTs);
+
+	// The stack of the masks of the rays entering each inner node, with
+	// the index of the node where the sub-tree ends
+	u_int stackSkipIndex[MBVH_PACKET_STACK_SIZE];
+	int stackRayMask[MBVH_PACKET_STACK_SIZE];
+	int stackSize = 0;
+
+	u_int currentNode = 0; // Root Node
+	const u_int stopNode = BVHNodeData_GetSkipIndex(bvhRootTree[0].nodeData); // Non-existent
+
+	Ray localRays[BVH_PACKET_SIZE];
+	while (currentNode < stopNode) {
+		// Pop the sub-trees I have left
+		while ((stackSize > 0) && (currentNode >= stackSkipIndex[stackSize - 1]))
+			--stackSize;
+		const int currentRayMask = (stackSize > 0) ? stackRayMask[stackSize - 1] : rayMask;
+
+		const luxrays::ocl::BVHArrayNode &node = bvhRootTree[currentNode];
+
+		const u_int nodeData = node.nodeData;
+		if (BVHNodeData_IsLeaf(nodeData)) {
+			// I have to check a leaf tree, transform the rays in the local
+			// coordinate system
+			if (node.bvhLeaf.transformIndex != NULL_INDEX) {
+				const Transform invTrans = Inverse(*uniqueLeafsTransform[node.bvhLeaf.transformIndex]);
+				for (u_int i = 0; i < BVH_PACKET_SIZE; ++i) {
+					if (currentRayMask & (1 << i))
+						localRays[i] = Ray(invTrans * rays[i]);
+				}
+			} else if (node.bvhLeaf.motionIndex != NULL_INDEX) {
+				const MotionSystem *ms = uniqueLeafsMotionSystem[node.bvhLeaf.motionIndex];
+				for (u_int i = 0; i < BVH_PACKET_SIZE; ++i) {
+					if (currentRayMask & (1 << i))
+						localRays[i] = Ray(ms->Sample(rays[i].time) * rays[i]);
+				}
+			} else {
+				for (u_int i = 0; i < BVH_PACKET_SIZE; ++i) {
+					if (currentRayMask & (1 << i))
+						localRays[i] = rays[i];
+				}
+			}
+
+			BVHAccel::IntersectPacket(uniqueLeafs[node.bvhLeaf.leafIndex]->bvhTree,
+					meshes, node.bvhLeaf.meshOffsetIndex, true,
+					localRays, currentRayMask, hits);
+
+			for (u_int i = 0; i < BVH_PACKET_SIZE; ++i) {
+				if (currentRayMask & (1 << i))
+					rayMaxTs[i] = hits[i].t;
+			}
+
+			++currentNode;
+		} else {
+			// It is a node, check the bounding box with all rays at once
+			__m128 tNear = rayMinT;
+			__m128 tFar = _mm_loadu_ps(rayMaxTs);
+			for (u_int axis = 0; axis < 3; ++axis) {
+				const __m128 bboxMin = _mm_set1_ps(node.bvhNode.bboxMin[axis]);
+				const __m128 bboxMax = _mm_set1_ps(node.bvhNode.bboxMax[axis]);
+				const __m128 nearPlane = _mm_or_ps(_mm_and_ps(rayDirIsNeg[axis], bboxMax),
+						_mm_andnot_ps(rayDirIsNeg[axis], bboxMin));
+				const __m128 farPlane = _mm_or_ps(_mm_and_ps(rayDirIsNeg[axis], bboxMin),
+						_mm_andnot_ps(rayDirIsNeg[axis], bboxMax));
+
+				// NOTE: _mm_max_ps()/_mm_min_ps() return the second operand
+				// if one of the operands is a NaN
+				tNear = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(nearPlane, rayOrig[axis]), rayInvDir[axis]), tNear);
+				tFar = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(farPlane, rayOrig[axis]), rayInvDir[axis]), tFar);
+			}
+
+			const int hitRayMask = _mm_movemask_ps(_mm_cmple_ps(tNear, tFar)) & currentRayMask;
+			if (hitRayMask) {
+				// Only the rays hitting the bounding box have to visit the sub-tree
+				if ((hitRayMask != currentRayMask) && (stackSize < MBVH_PACKET_STACK_SIZE)) {
+					stackSkipIndex[stackSize] = nodeData;
+					stackRayMask[stackSize] = hitRayMask;
+					++stackSize;
+				}
+
+				++currentNode;
+			} else {
+				// I don't need to use BVHNodeData_GetSkipIndex() here because
+				// I already know the leaf flag is 0
+				currentNode = nodeData;
+			}
+		}
+	}
+}
+
+void MBVHAccel::IntersectStream(const Ray *rays, RayHit *hits, const size_t count) const {
+	assert (initialized);
+
+	for (size_t i = 0; i < count; i += BVH_PACKET_SIZE) {
+		const u_int packetSize = Min<size_t>(BVH_PACKET_SIZE, count - i);
+
+		// Incoherent rays are faster to trace one by one. The packet traversal
+		// doesn't use the motion bounding boxes, the rays can have different
+		// times.
+		if (!nRootNodes || (packetSize == 1) || !bvhRootMotionBBoxIndex.empty() ||
+				!BVHAccel::IsCoherentPacket(&rays[i], packetSize)) {
+			for (u_int j = 0; j < packetSize; ++j)
+				Intersect(&rays[i + j], &hits[i + j]);
+		} else {
+			for (u_int j = 0; j < packetSize; ++j) {
+				hits[i + j].t = rays[i + j].maxt;
+				hits[i + j].SetMiss();
+			}
+
+			IntersectPacket(&rays[i], (1 << packetSize) - 1, &hits[i]);
+		}
+	}
+}
+
+bool MBVHAccel::Occluded(const Ray *ray) const {
+	assert (initialized);
+
+	if (!nRootNodes)
+		return false;
+
+	bool insideLeafTree = false;
+	u_int currentRootNode = 0;
+	const u_int rootStopNode = BVHNodeData_GetSkipIndex(bvhRootTree[0].nodeData); // Non-existent
+	u_int currentNode = currentRootNode;
+	u_int currentStopNode = rootStopNode; // Non-existent
+	u_int currentMeshOffset = 0;
+	luxrays::ocl::BVHArrayNode *currentTree = bvhRootTree;
+
+	Ray currentRay(*ray);
+
+	// The time segment of the ray, used if the root tree has motion
+	const bool useMotionBBoxes = !bvhRootMotionBBoxIndex.empty();
+	const u_int motionTimeSegment = useMotionBBoxes ? GetMotionTimeSegment(ray->time) : 0;
+
+	for (;;) {
+		if (currentNode >= currentStopNode) {
+			if (insideLeafTree) {
+				// Go back to the root tree
+				currentTree = bvhRootTree;
+				currentNode = currentRootNode;
+				currentStopNode = rootStopNode;
+				currentRay = *ray;
+				insideLeafTree = false;
+
+				// Check if the leaf was the very last root node
+				if (currentNode >= currentStopNode)
+					break;
+			} else {
+				// Done
+				break;
+			}
+		}
+
+		const luxrays::ocl::BVHArrayNode &node = currentTree[currentNode];
+
+		const u_int nodeData = node.nodeData;
+		if (BVHNodeData_IsLeaf(nodeData)) {
+			if (insideLeafTree) {
+				// I'm inside a leaf tree, I have to check the triangle
+				const Mesh *currentMesh = meshes[node.triangleLeaf.meshIndex + currentMeshOffset];
+				// I use currentMesh->GetVertices() in order to have access to not
+				// transformed vertices in the case of instances
+				const Point *vertices = currentMesh->GetVertices();
+				const Point &p0 = vertices[node.triangleLeaf.v[0]];
+				const Point &p1 = vertices[node.triangleLeaf.v[1]];
+
+				float t, b1, b2;
+				bool hit;
+				if (node.triangleLeaf.v[2] == SEGMENT_PRIMITIVE_MARKER) {
+					const float *radii = currentMesh->GetRadii();
+					hit = Segment::Intersect(currentRay, p0, p1,
+							radii[node.triangleLeaf.v[0]], radii[node.triangleLeaf.v[1]], &t, &b1, &b2);
+				} else {
+					const Point &p2 = vertices[node.triangleLeaf.v[2]];
+					hit = Triangle::Intersect(currentRay, p0, p1, p2, &t, &b1, &b2);
+				}
+
+				// Any intersection is good enough
+				if (hit)
+					return true;
+
+				++currentNode;
+			} else if (useMotionBBoxes && (bvhRootMotionBBoxIndex[currentNode] != NULL_INDEX) &&
+					!bvhRootMotionBBoxes[bvhRootMotionBBoxIndex[currentNode] + motionTimeSegment].IntersectP(currentRay)) {
+				// The ray misses the moving leaf at its time
+				++currentNode;
+			} else {
+				// I have to check a leaf tree
+				currentTree = uniqueLeafs[node.bvhLeaf.leafIndex]->bvhTree;
+
+				// Transform the ray in the local coordinate system
+				if (node.bvhLeaf.transformIndex != NULL_INDEX)
+					currentRay = Ray(Inverse(*uniqueLeafsTransform[node.bvhLeaf.transformIndex]) * (*ray));
+				else if (node.bvhLeaf.motionIndex != NULL_INDEX)
+					currentRay = Ray(uniqueLeafsMotionSystem[node.bvhLeaf.motionIndex]->Sample(ray->time) * (*ray));
+				else
+					currentRay = (*ray);
+
+				currentRay.maxt = ray->maxt;
+
+				currentMeshOffset = node.bvhLeaf.meshOffsetIndex;
+
+				currentRootNode = currentNode + 1;
+				currentNode = 0;
+				currentStopNode = BVHNodeData_GetSkipIndex(currentTree[0].nodeData);
+
+				// Now, I'm inside a leaf tree
+				insideLeafTree = true;
+			}
+		} else {
+			// It is a node, check the bounding box (the one of the ray time
+			// segment if the node has motion)
+			bool hit;
+			if (!insideLeafTree && useMotionBBoxes && (bvhRootMotionBBoxIndex[currentNode] != NULL_INDEX))
+				hit = bvhRootMotionBBoxes[bvhRootMotionBBoxIndex[currentNode] + motionTimeSegment].IntersectP(currentRay);
+			else
+				hit = BBox::IntersectP(currentRay,
+						*reinterpret_cast<const Point *>(&node.bvhNode.bboxMin[0]),
+						*reinterpret_cast<const Point *>(&node.bvhNode.bboxMax[0]));
+
+			if (hit)
+				++currentNode;
+			else {
+				// I don't need to use BVHNodeData_GetSkipIndex() here because
+				// I already know the leaf flag is 0
+				currentNode = nodeData;
+			}
+		}
+	}
+
+	return false;
+}
+
 }
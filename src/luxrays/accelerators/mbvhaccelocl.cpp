@@ -48,7 +48,7 @@ public:
 	OpenCLMBVHKernels(OpenCLIntersectionDevice *dev, const u_int kernelCount, const MBVHAccel *ac) :
 			OpenCLKernels(dev, kernelCount), mbvh(ac),
 			uniqueLeafsTransformBuff(NULL), uniqueLeafsMotionSystemBuff(NULL),
-			uniqueLeafsInterpolatedTransformBuff(NULL) {
+			uniqueLeafsInterpolatedTransformBuff(NULL), vertsRefitCount(0) {
 		const Context *deviceContext = device->GetContext();
 		const std::string &deviceName(device->GetName());
 		cl::Context &oclContext = device->GetOpenCLContext();
@@ -56,76 +56,11 @@ public:
 
 		u_int pageNodeCount = 0;
 		if (mbvh->nRootNodes) {
-			// Check the max. number of vertices I can store in a single page
-			const size_t maxMemAlloc = device->GetDeviceDesc()->GetMaxMemoryAllocSize();
-
 			//------------------------------------------------------------------
 			// Allocate vertex buffers
 			//------------------------------------------------------------------
 
-			// Check how many pages I have to allocate
-			const size_t maxVertCount = maxMemAlloc / sizeof(Point);
-			vertOffsetPerLeafMesh.resize(mbvh->uniqueLeafs.size());
-			u_int totalVertCount = 0;
-			for (u_int i = 0; i < mbvh->uniqueLeafs.size(); ++i) {
-				const BVHAccel *leaf = mbvh->uniqueLeafs[i];
-
-				for (u_int j = 0; j < leaf->meshes.size(); ++j) {
-					vertOffsetPerLeafMesh[i].push_back(totalVertCount);
-					totalVertCount += leaf->meshes[j]->GetTotalVertexCount();
-				}
-			}
-
-			// Allocate a temporary buffer for the copy of the BVH vertices
-			const u_int pageVertCount = Min<size_t>(totalVertCount, maxVertCount);
-			vector<Point> tmpVerts(pageVertCount);
-			u_int tmpVertIndex = 0;
-
-			u_int currentLeafIndex = 0;
-			u_int currentMeshIndex = 0;
-			u_int currentMeshVertIndex = 0;
-
-			while (currentLeafIndex < mbvh->uniqueLeafs.size()) {
-				const u_int tmpLeftVertCount = pageVertCount - tmpVertIndex;
-
-				// Check if there is enough space in the temporary buffer for all vertices
-				const Mesh *currentMesh = mbvh->uniqueLeafs[currentLeafIndex]->meshes[currentMeshIndex];
-				const u_int toCopy = currentMesh->GetTotalVertexCount() - currentMeshVertIndex;
-				if (tmpLeftVertCount >= toCopy) {
-					// There is enough space for all mesh vertices
-					memcpy(&tmpVerts[tmpVertIndex], &(currentMesh->GetVertices()[currentMeshVertIndex]),
-							sizeof(Point) * toCopy);
-					tmpVertIndex += toCopy;
-
-					// Move to the next mesh
-					++currentMeshIndex;
-					if (currentMeshIndex >= mbvh->uniqueLeafs[currentLeafIndex]->meshes.size()) {
-						// Move to the next leaf
-						++currentLeafIndex;
-						currentMeshIndex = 0;
-					}
-					currentMeshVertIndex = 0;
-				} else {
-					// There isn't enough space for all mesh vertices. Fill the current buffer.
-					memcpy(&tmpVerts[tmpVertIndex], &(currentMesh->GetVertices()[currentMeshVertIndex]),
-							sizeof(Point) * tmpLeftVertCount);
-
-					tmpVertIndex += tmpLeftVertCount;
-					currentMeshVertIndex += tmpLeftVertCount;
-				}
-
-				if ((tmpVertIndex >= pageVertCount) || (currentLeafIndex >=  mbvh->uniqueLeafs.size())) {
-					// The temporary buffer is full, send the data to the OpenCL device
-					vertsBuffs.push_back(NULL);
-					if (vertsBuffs.size() > 8)
-						throw std::runtime_error("Too many vertex pages required in OpenCLMBVHKernels()");
-
-					device->AllocBufferRO(&vertsBuffs.back(), &tmpVerts[0], sizeof(Point) * tmpVertIndex,
-							"MBVH mesh vertices");
-
-					tmpVertIndex = 0;
-				}
-			}
+			UpdateVertices();
 
 			//------------------------------------------------------------------
 			// Allocate BVH node buffers
@@ -288,6 +223,7 @@ public:
 		device->FreeBuffer(&uniqueLeafsInterpolatedTransformBuff);
 	}
 
+	void UpdateVertices();
 	void UpdateBVHNodes();
 	virtual void Update(const DataSet *newDataSet);
 	virtual void EnqueueRayBuffer(cl::CommandQueue &oclQueue, const u_int kernelIndex,
@@ -307,8 +243,86 @@ public:
 
 	// Used to update BVH node buffers
 	vector<std::vector<u_int> > vertOffsetPerLeafMesh;
+	// Used to check if the vertices have been edited by a refit
+	u_int vertsRefitCount;
 };
 
+void OpenCLMBVHKernels::UpdateVertices() {
+	// Free old buffers
+	for (u_int i = 0; i < vertsBuffs.size(); ++i)
+		device->FreeBuffer(&vertsBuffs[i]);
+	vertsBuffs.resize(0);
+	vertOffsetPerLeafMesh.clear();
+
+	const size_t maxMemAlloc = device->GetDeviceDesc()->GetMaxMemoryAllocSize();
+
+	// Check how many pages I have to allocate
+	const size_t maxVertCount = maxMemAlloc / sizeof(Point);
+	vertOffsetPerLeafMesh.resize(mbvh->uniqueLeafs.size());
+	u_int totalVertCount = 0;
+	for (u_int i = 0; i < mbvh->uniqueLeafs.size(); ++i) {
+		const BVHAccel *leaf = mbvh->uniqueLeafs[i];
+
+		for (u_int j = 0; j < leaf->meshes.size(); ++j) {
+			vertOffsetPerLeafMesh[i].push_back(totalVertCount);
+			totalVertCount += leaf->meshes[j]->GetTotalVertexCount();
+		}
+	}
+
+	// Allocate a temporary buffer for the copy of the BVH vertices
+	const u_int pageVertCount = Min<size_t>(totalVertCount, maxVertCount);
+	vector<Point> tmpVerts(pageVertCount);
+	u_int tmpVertIndex = 0;
+
+	u_int currentLeafIndex = 0;
+	u_int currentMeshIndex = 0;
+	u_int currentMeshVertIndex = 0;
+
+	while (currentLeafIndex < mbvh->uniqueLeafs.size()) {
+		const u_int tmpLeftVertCount = pageVertCount - tmpVertIndex;
+
+		// Check if there is enough space in the temporary buffer for all vertices
+		const Mesh *currentMesh = mbvh->uniqueLeafs[currentLeafIndex]->meshes[currentMeshIndex];
+		const u_int toCopy = currentMesh->GetTotalVertexCount() - currentMeshVertIndex;
+		if (tmpLeftVertCount >= toCopy) {
+			// There is enough space for all mesh vertices
+			memcpy(&tmpVerts[tmpVertIndex], &(currentMesh->GetVertices()[currentMeshVertIndex]),
+					sizeof(Point) * toCopy);
+			tmpVertIndex += toCopy;
+
+			// Move to the next mesh
+			++currentMeshIndex;
+			if (currentMeshIndex >= mbvh->uniqueLeafs[currentLeafIndex]->meshes.size()) {
+				// Move to the next leaf
+				++currentLeafIndex;
+				currentMeshIndex = 0;
+			}
+			currentMeshVertIndex = 0;
+		} else {
+			// There isn't enough space for all mesh vertices. Fill the current buffer.
+			memcpy(&tmpVerts[tmpVertIndex], &(currentMesh->GetVertices()[currentMeshVertIndex]),
+					sizeof(Point) * tmpLeftVertCount);
+
+			tmpVertIndex += tmpLeftVertCount;
+			currentMeshVertIndex += tmpLeftVertCount;
+		}
+
+		if ((tmpVertIndex >= pageVertCount) || (currentLeafIndex >=  mbvh->uniqueLeafs.size())) {
+			// The temporary buffer is full, send the data to the OpenCL device
+			vertsBuffs.push_back(NULL);
+			if (vertsBuffs.size() > 8)
+				throw std::runtime_error("Too many vertex pages required in OpenCLMBVHKernels()");
+
+			device->AllocBufferRO(&vertsBuffs.back(), &tmpVerts[0], sizeof(Point) * tmpVertIndex,
+					"MBVH mesh vertices");
+
+			tmpVertIndex = 0;
+		}
+	}
+
+	vertsRefitCount = mbvh->refitCount;
+}
+
 void OpenCLMBVHKernels::UpdateBVHNodes() {
 	// Free old buffers
 	for (u_int i = 0; i < nodeBuffs.size(); ++i)
@@ -447,6 +461,10 @@ void OpenCLMBVHKernels::Update(const DataSet *newDataSet) {
 	if (!mbvh->nRootNodes)
 		return;
 
+	// The vertices are changed only if some leaf has been refitted
+	if (vertsRefitCount != mbvh->refitCount)
+		UpdateVertices();
+
 	// The root BVH nodes are changed. Update the BVH node buffers.
 	UpdateBVHNodes();
 
@@ -0,0 +1,433 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+// Wide (4 or 8 children) Bounding Volume Hierarchy accelerator. The tree is
+// built with the same builders of BVHAccel (with a tree type equal to the
+// width) and than converted in a structure of arrays layout so all children
+// bounding boxes of a node are tested at the same time with SSE.
+
+#include <xmmintrin.h>
+#include <limits>
+
+#include "luxrays/accelerators/widebvhaccel.h"
+#include "luxrays/accelerators/bvhaccel.h"
+#include "luxrays/utils/utils.h"
+#include "luxrays/utils/memory.h"
+#include "luxrays/core/context.h"
+
+using namespace std;
+
+namespace luxrays {
+
+// WideBVHAccel Method Definitions
+
+template<u_int WIDTH> WideBVHAccel<WIDTH>::WideBVHAccel(const Context *context) : ctx(context) {
+	params = BVHAccel::ToBVHParams(ctx->GetConfig());
+	// The tree type must match the width of the nodes
+	params.treeType = WIDTH;
+
+	initialized = false;
+}
+
+template<u_int WIDTH> WideBVHAccel<WIDTH>::~WideBVHAccel() {
+	if (initialized) {
+		FreeAligned(nodes);
+		FreeAligned(leafs);
+	}
+}
+
+template<> AcceleratorType WideBVHAccel<4>::GetType() const {
+	return ACCEL_BVH4;
+}
+
+template<> AcceleratorType WideBVHAccel<8>::GetType() const {
+	return ACCEL_BVH8;
+}
+
+template<u_int WIDTH> BBox WideBVHAccel<WIDTH>::GetTriangleLeafBBox(const WideBVHTriangleLeaf &leaf) const {
+	const Mesh *mesh = meshes[leaf.meshIndex];
+
+	BBox bbox;
+	if (leaf.v[2] == SEGMENT_PRIMITIVE_MARKER)
+		bbox = mesh->GetSegmentBBox(leaf.v[0], leaf.v[1]);
+	else
+		bbox = Union(
+				BBox(mesh->GetVertex(0.f, leaf.v[0]), mesh->GetVertex(0.f, leaf.v[1])),
+				mesh->GetVertex(0.f, leaf.v[2]));
+	// NOTE - Ratow - Expand bbox a little to make sure rays collide
+	bbox.Expand(MachineEpsilon::E(bbox));
+
+	return bbox;
+}
+
+template<u_int WIDTH> u_int WideBVHAccel<WIDTH>::BuildWideBVHNodes(
+		const luxrays::ocl::BVHArrayNode *bvhTree,
+		const u_int bvhNodeIndex, const u_int depth,
+		vector<WideBVHNode<WIDTH> > &wideNodes,
+		vector<WideBVHTriangleLeaf> &wideLeafs) {
+	maxDepth = Max(maxDepth, depth);
+
+	const luxrays::ocl::BVHArrayNode &bvhNode = bvhTree[bvhNodeIndex];
+
+	if (BVHNodeData_IsLeaf(bvhNode.nodeData)) {
+		// It is a leaf
+		WideBVHTriangleLeaf leaf;
+		leaf.v[0] = bvhNode.triangleLeaf.v[0];
+		leaf.v[1] = bvhNode.triangleLeaf.v[1];
+		leaf.v[2] = bvhNode.triangleLeaf.v[2];
+		leaf.meshIndex = bvhNode.triangleLeaf.meshIndex;
+		leaf.triangleIndex = bvhNode.triangleLeaf.triangleIndex;
+
+		const u_int leafIndex = wideLeafs.size();
+		wideLeafs.push_back(leaf);
+
+		return leafIndex | 0x80000000u;
+	}
+
+	// It is an inner node
+	const u_int nodeIndex = wideNodes.size();
+	wideNodes.push_back(WideBVHNode<WIDTH>());
+
+	u_int children[WIDTH];
+	BBox childrenBBox[WIDTH];
+	u_int childCount = 0;
+
+	// Children are stored after their parent and linked by the skip index
+	const u_int stopIndex = BVHNodeData_GetSkipIndex(bvhNode.nodeData);
+	u_int childIndex = bvhNodeIndex + 1;
+	while (childIndex < stopIndex) {
+		if (childCount >= WIDTH)
+			throw runtime_error("Too many children in WideBVHAccel::BuildWideBVHNodes(): " + ToString(childCount));
+
+		const luxrays::ocl::BVHArrayNode &childNode = bvhTree[childIndex];
+
+		// wideNodes can be reallocated by the recursive call so I can not keep
+		// a reference to the current node
+		children[childCount] = BuildWideBVHNodes(bvhTree, childIndex, depth + 1,
+				wideNodes, wideLeafs);
+
+		if (BVHNodeData_IsLeaf(childNode.nodeData))
+			childrenBBox[childCount] = GetTriangleLeafBBox(wideLeafs[WideBVHChild_GetIndex(children[childCount])]);
+		else {
+			childrenBBox[childCount].pMin = *reinterpret_cast<const Point *>(&childNode.bvhNode.bboxMin[0]);
+			childrenBBox[childCount].pMax = *reinterpret_cast<const Point *>(&childNode.bvhNode.bboxMax[0]);
+		}
+
+		++childCount;
+		childIndex = BVHNodeData_GetSkipIndex(childNode.nodeData);
+	}
+
+	WideBVHNode<WIDTH> &node = wideNodes[nodeIndex];
+	for (u_int i = 0; i < WIDTH; ++i) {
+		if (i < childCount) {
+			for (u_int axis = 0; axis < 3; ++axis) {
+				node.bboxMin[axis][i] = childrenBBox[i].pMin[axis];
+				node.bboxMax[axis][i] = childrenBBox[i].pMax[axis];
+			}
+			node.children[i] = children[i];
+		} else {
+			// An empty slot
+			for (u_int axis = 0; axis < 3; ++axis) {
+				node.bboxMin[axis][i] = INFINITY;
+				node.bboxMax[axis][i] = -INFINITY;
+			}
+			node.children[i] = WIDEBVH_EMPTY_CHILD;
+		}
+	}
+
+	return nodeIndex;
+}
+
+template<u_int WIDTH> void WideBVHAccel<WIDTH>::Init(const deque<const Mesh *> &ms,
+		const u_longlong totVert, const u_longlong totTri) {
+	assert (!initialized);
+
+	meshes = ms;
+	totalVertexCount = totVert;
+	totalTriangleCount = totTri;
+
+	nNodes = 0;
+	nLeafs = 0;
+	maxDepth = 0;
+	nodes = NULL;
+	leafs = NULL;
+	rootChild = WIDEBVH_EMPTY_CHILD;
+
+	// Handle the empty DataSet case
+	if (totalTriangleCount == 0) {
+		LR_LOG(ctx, "Empty BVH" << WIDTH);
+		initialized = true;
+
+		return;
+	}
+
+	const double t0 = WallClockTime();
+
+	//--------------------------------------------------------------------------
+	// Build the binary BVH
+	//--------------------------------------------------------------------------
+
+	u_int nBVHNodes;
+	luxrays::ocl::BVHArrayNode *bvhTree = BVHAccel::BuildBVHTree(ctx, params,
+			meshes, totalTriangleCount, &nBVHNodes);
+
+	//--------------------------------------------------------------------------
+	// Convert the tree in the wide format
+	//--------------------------------------------------------------------------
+
+	const double t1 = WallClockTime();
+
+	vector<WideBVHNode<WIDTH> > wideNodes;
+	vector<WideBVHTriangleLeaf> wideLeafs;
+	wideNodes.reserve(nBVHNodes / WIDTH + 1);
+	wideLeafs.reserve(totalTriangleCount);
+
+	rootChild = BuildWideBVHNodes(bvhTree, 0, 0, wideNodes, wideLeafs);
+	delete[] bvhTree;
+
+	nNodes = wideNodes.size();
+	nLeafs = wideLeafs.size();
+
+	// Copy the data in aligned memory for SSE loads
+	nodes = AllocAligned<WideBVHNode<WIDTH> >(Max<u_int>(nNodes, 1));
+	if (nNodes)
+		copy(wideNodes.begin(), wideNodes.end(), nodes);
+	leafs = AllocAligned<WideBVHTriangleLeaf>(nLeafs);
+	copy(wideLeafs.begin(), wideLeafs.end(), leafs);
+
+	LR_LOG(ctx, "BVH" << WIDTH << " conversion time: " << int((WallClockTime() - t1) * 1000) << "ms");
+
+	//--------------------------------------------------------------------------
+	// Done
+	//--------------------------------------------------------------------------
+
+	LR_LOG(ctx, "BVH" << WIDTH << " total build time: " << int((WallClockTime() - t0) * 1000) << "ms");
+	LR_LOG(ctx, "BVH" << WIDTH << " nodes: " << nNodes << " leafs: " << nLeafs << " depth: " << maxDepth);
+	LR_LOG(ctx, "Total BVH" << WIDTH << " memory usage: " <<
+			(nNodes * sizeof(WideBVHNode<WIDTH>) + nLeafs * sizeof(WideBVHTriangleLeaf)) / 1024 << "Kbytes");
+
+	initialized = true;
+}
+
+template<u_int WIDTH> bool WideBVHAccel<WIDTH>::Intersect(const Ray *initialRay, RayHit *rayHit) const {
+	assert (initialized);
+
+	rayHit->t = initialRay->maxt;
+	rayHit->SetMiss();
+	if (!nLeafs)
+		return false;
+
+	Ray ray(*initialRay);
+
+	// Ray data used by the SSE bounding box tests
+	const __m128 rayOrig[3] = {
+		_mm_set1_ps(ray.o.x), _mm_set1_ps(ray.o.y), _mm_set1_ps(ray.o.z)
+	};
+	const __m128 rayInvDir[3] = {
+		_mm_set1_ps(1.f / ray.d.x), _mm_set1_ps(1.f / ray.d.y), _mm_set1_ps(1.f / ray.d.z)
+	};
+	const __m128 rayMinT = _mm_set1_ps(ray.mint);
+
+	// The near plane is the max. one if the direction is negative
+	int dirIsNeg[3];
+	ray.GetDirectionSigns(dirIsNeg);
+
+	// Each visited level of the tree can push at most WIDTH entries
+	const u_int stackSize = (maxDepth + 1) * WIDTH;
+	u_int *todoChild = (u_int *)alloca(stackSize * sizeof(u_int));
+	float *todoT = (float *)alloca(stackSize * sizeof(float));
+
+	u_int todoCount = 0;
+	todoChild[todoCount] = rootChild;
+	todoT[todoCount++] = ray.mint;
+
+	float t, b1, b2;
+	while (todoCount) {
+		--todoCount;
+
+		// Check if a closer intersection has been found in the mean time
+		if (todoT[todoCount] > ray.maxt)
+			continue;
+
+		const u_int child = todoChild[todoCount];
+		if (WideBVHChild_IsLeaf(child)) {
+			// It is a leaf, check the triangle
+			const WideBVHTriangleLeaf &leaf = leafs[WideBVHChild_GetIndex(child)];
+			const Mesh *mesh = meshes[leaf.meshIndex];
+			bool hit;
+			if (leaf.v[2] == SEGMENT_PRIMITIVE_MARKER)
+				hit = mesh->IntersectSegment(ray, leaf.v[0], leaf.v[1], &t, &b1, &b2);
+			else {
+				const Point p0 = mesh->GetVertex(0.f, leaf.v[0]);
+				const Point p1 = mesh->GetVertex(0.f, leaf.v[1]);
+				const Point p2 = mesh->GetVertex(0.f, leaf.v[2]);
+				hit = Triangle::Intersect(ray, p0, p1, p2, &t, &b1, &b2);
+			}
+
+			if (hit) {
+				if (t < rayHit->t) {
+					ray.maxt = t;
+					rayHit->t = t;
+					rayHit->b1 = b1;
+					rayHit->b2 = b2;
+					rayHit->meshIndex = leaf.meshIndex;
+					rayHit->triangleIndex = leaf.triangleIndex;
+					// Continue testing for closer intersections
+				}
+			}
+		} else {
+			// It is a node, check all children bounding boxes
+			const WideBVHNode<WIDTH> &node = nodes[child];
+			const __m128 rayMaxT = _mm_set1_ps(ray.maxt);
+
+			u_int hitChildren[WIDTH];
+			float hitT[WIDTH];
+			u_int hitCount = 0;
+
+			for (u_int group = 0; group < WIDTH; group += 4) {
+				__m128 tNear = rayMinT;
+				__m128 tFar = rayMaxT;
+				for (u_int axis = 0; axis < 3; ++axis) {
+					const __m128 nearPlane = _mm_load_ps(dirIsNeg[axis] ?
+						&node.bboxMax[axis][group] : &node.bboxMin[axis][group]);
+					const __m128 farPlane = _mm_load_ps(dirIsNeg[axis] ?
+						&node.bboxMin[axis][group] : &node.bboxMax[axis][group]);
+
+					// NOTE: _mm_max_ps()/_mm_min_ps() return the second operand
+					// if any of the two is a NaN so degenerate slabs are ignored
+					tNear = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(nearPlane, rayOrig[axis]), rayInvDir[axis]), tNear);
+					tFar = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(farPlane, rayOrig[axis]), rayInvDir[axis]), tFar);
+				}
+
+				const int mask = _mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+				if (mask) {
+					float tNears[4];
+					_mm_storeu_ps(tNears, tNear);
+
+					for (u_int i = 0; i < 4; ++i) {
+						if (mask & (1 << i)) {
+							// Insertion sort by decreasing distance so the
+							// closest child is the first to be popped
+							u_int j = hitCount++;
+							while ((j > 0) && (hitT[j - 1] < tNears[i])) {
+								hitChildren[j] = hitChildren[j - 1];
+								hitT[j] = hitT[j - 1];
+								--j;
+							}
+							hitChildren[j] = node.children[group + i];
+							hitT[j] = tNears[i];
+						}
+					}
+				}
+			}
+
+			for (u_int i = 0; i < hitCount; ++i) {
+				todoChild[todoCount] = hitChildren[i];
+				todoT[todoCount++] = hitT[i];
+			}
+		}
+	}
+
+	return !rayHit->Miss();
+}
+
+template<u_int WIDTH> bool WideBVHAccel<WIDTH>::Occluded(const Ray *ray) const {
+	assert (initialized);
+
+	if (!nLeafs)
+		return false;
+
+	// Ray data used by the SSE bounding box tests
+	const __m128 rayOrig[3] = {
+		_mm_set1_ps(ray->o.x), _mm_set1_ps(ray->o.y), _mm_set1_ps(ray->o.z)
+	};
+	const __m128 rayInvDir[3] = {
+		_mm_set1_ps(1.f / ray->d.x), _mm_set1_ps(1.f / ray->d.y), _mm_set1_ps(1.f / ray->d.z)
+	};
+	const __m128 rayMinT = _mm_set1_ps(ray->mint);
+	const __m128 rayMaxT = _mm_set1_ps(ray->maxt);
+
+	// The near plane is the max. one if the direction is negative
+	int dirIsNeg[3];
+	ray->GetDirectionSigns(dirIsNeg);
+
+	// Each visited level of the tree can push at most WIDTH entries
+	const u_int stackSize = (maxDepth + 1) * WIDTH;
+	u_int *todoChild = (u_int *)alloca(stackSize * sizeof(u_int));
+
+	u_int todoCount = 0;
+	todoChild[todoCount++] = rootChild;
+
+	float t, b1, b2;
+	while (todoCount) {
+		const u_int child = todoChild[--todoCount];
+		if (WideBVHChild_IsLeaf(child)) {
+			// It is a leaf, check the triangle
+			const WideBVHTriangleLeaf &leaf = leafs[WideBVHChild_GetIndex(child)];
+			const Mesh *mesh = meshes[leaf.meshIndex];
+			bool hit;
+			if (leaf.v[2] == SEGMENT_PRIMITIVE_MARKER)
+				hit = mesh->IntersectSegment(*ray, leaf.v[0], leaf.v[1], &t, &b1, &b2);
+			else {
+				const Point p0 = mesh->GetVertex(0.f, leaf.v[0]);
+				const Point p1 = mesh->GetVertex(0.f, leaf.v[1]);
+				const Point p2 = mesh->GetVertex(0.f, leaf.v[2]);
+				hit = Triangle::Intersect(*ray, p0, p1, p2, &t, &b1, &b2);
+			}
+
+			// Any intersection is good enough
+			if (hit)
+				return true;
+		} else {
+			// It is a node, check all children bounding boxes. The order of
+			// visit doesn't matter for an any-hit query so there is no sort.
+			const WideBVHNode<WIDTH> &node = nodes[child];
+
+			for (u_int group = 0; group < WIDTH; group += 4) {
+				__m128 tNear = rayMinT;
+				__m128 tFar = rayMaxT;
+				for (u_int axis = 0; axis < 3; ++axis) {
+					const __m128 nearPlane = _mm_load_ps(dirIsNeg[axis] ?
+						&node.bboxMax[axis][group] : &node.bboxMin[axis][group]);
+					const __m128 farPlane = _mm_load_ps(dirIsNeg[axis] ?
+						&node.bboxMin[axis][group] : &node.bboxMax[axis][group]);
+
+					tNear = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(nearPlane, rayOrig[axis]), rayInvDir[axis]), tNear);
+					tFar = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(farPlane, rayOrig[axis]), rayInvDir[axis]), tFar);
+				}
+
+				const int mask = _mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+				for (u_int i = 0; i < 4; ++i) {
+					if (mask & (1 << i))
+						todoChild[todoCount++] = node.children[group + i];
+				}
+			}
+		}
+	}
+
+	return false;
+}
+
+//------------------------------------------------------------------------------
+// Explicit instantiations
+//------------------------------------------------------------------------------
+
+template class WideBVHAccel<4>;
+template class WideBVHAccel<8>;
+
+}
@@ -31,6 +31,10 @@ string Accelerator::AcceleratorType2String(const AcceleratorType type) {
 			return "MBVH";
 		case ACCEL_EMBREE:
 			return "EMBREE";
+		case ACCEL_BVH4:
+			return "BVH4";
+		case ACCEL_BVH8:
+			return "BVH8";
 		default:
 			throw runtime_error("Unknown accelerator type in AcceleratorType2String(): " + ToString(type));
 	}
@@ -45,6 +49,10 @@ AcceleratorType Accelerator::String2AcceleratorType(const string &type) {
 		return ACCEL_MBVH;
 	else if (type == "EMBREE")
 		return ACCEL_EMBREE;
+	else if (type == "BVH4")
+		return ACCEL_BVH4;
+	else if (type == "BVH8")
+		return ACCEL_BVH8;
 	else
 		throw runtime_error("Unknown accelerator type in String2AcceleratorType(): " + type);
 }
@@ -0,0 +1,230 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <boost/foreach.hpp>
+
+#include "luxrays/core/bvh/bvhcache.h"
+#include "luxrays/core/context.h"
+#include "luxrays/utils/utils.h"
+
+using namespace std;
+
+namespace luxrays {
+
+//------------------------------------------------------------------------------
+// Cache file format
+//------------------------------------------------------------------------------
+
+#define BVHCACHE_MAGIC "LXBVHC"
+#define BVHCACHE_VERSION 1u
+
+typedef struct {
+	char magic[8];
+	u_int version;
+	// Used to check if the file has been written by a build with a different
+	// node layout
+	u_int nodeSize;
+	u_int nNodes;
+	u_int pad;
+	u_longlong checksum;
+} BVHCacheHeader;
+
+//------------------------------------------------------------------------------
+// 64bit FNV-1a hash, processing 4 bytes at time
+//------------------------------------------------------------------------------
+
+#define FNV_OFFSET_BASIS 14695981039346656037ull
+#define FNV_PRIME 1099511628211ull
+
+static u_longlong HashBin(u_longlong hash, const void *data, const size_t size) {
+	const size_t wordCount = size / sizeof(u_int);
+
+	const u_int *words = (const u_int *)data;
+	for (size_t i = 0; i < wordCount; ++i) {
+		hash ^= words[i];
+		hash *= FNV_PRIME;
+	}
+
+	const unsigned char *bytes = (const unsigned char *)data;
+	for (size_t i = wordCount * sizeof(u_int); i < size; ++i) {
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+template <class T> static u_longlong HashValue(const u_longlong hash, const T &v) {
+	return HashBin(hash, &v, sizeof(T));
+}
+
+//------------------------------------------------------------------------------
+// BVHCache
+//------------------------------------------------------------------------------
+
+BVHCache::BVHCache(const Context *context, const string &dir) : ctx(context),
+		cacheDir(dir) {
+}
+
+BVHCache::~BVHCache() {
+}
+
+string BVHCache::GetDefaultCacheDir() {
+#if defined(__linux__)
+	// boost::filesystem::temp_directory_path() is usually mapped to /tmp and
+	// the content of the directory is often delete at each reboot
+	const char *home = getenv("HOME");
+	boost::filesystem::path bvhCacheDir = home ? boost::filesystem::path(home) :
+		boost::filesystem::temp_directory_path();
+	bvhCacheDir = bvhCacheDir / ".config" / "luxcorerender.org";
+#else
+	boost::filesystem::path bvhCacheDir = boost::filesystem::temp_directory_path();
+#endif
+
+	return (bvhCacheDir / "bvh_cache").generic_string();
+}
+
+string BVHCache::GetKey(const BVHParams &params, const string &builderType,
+		const deque<const Mesh *> &meshes) {
+	u_longlong hash = FNV_OFFSET_BASIS;
+	u_longlong totalTriangleCount = 0;
+
+	hash = HashBin(hash, builderType.c_str(), builderType.length());
+	hash = HashValue(hash, params.treeType);
+	hash = HashValue(hash, params.costSamples);
+	hash = HashValue(hash, params.isectCost);
+	hash = HashValue(hash, params.traversalCost);
+	hash = HashValue(hash, params.emptyBonus);
+	// The other builders ignore the SBVH parameters
+	if (builderType == "SBVH") {
+		hash = HashValue(hash, params.sbvhMemoryBudget);
+		hash = HashValue(hash, params.sbvhAlpha);
+	}
+
+	BOOST_FOREACH(const Mesh *mesh, meshes) {
+		// Only meshes where GetVertices() returns the vertices used by the
+		// BVH can be cached (i.e. no instances or motion blur)
+		const MeshType type = mesh->GetType();
+		if ((type != TYPE_TRIANGLE) && (type != TYPE_EXT_TRIANGLE) && (type != TYPE_EXT_STRANDS))
+			return "";
+
+		const u_int vertCount = mesh->GetTotalVertexCount();
+		const u_int triCount = mesh->GetTotalTriangleCount();
+		hash = HashValue(hash, vertCount);
+		hash = HashValue(hash, triCount);
+		hash = HashBin(hash, mesh->GetVertices(), sizeof(Point) * vertCount);
+		hash = HashBin(hash, mesh->GetTriangles(), sizeof(Triangle) * triCount);
+		if (mesh->GetRadii())
+			hash = HashBin(hash, mesh->GetRadii(), sizeof(float) * vertCount);
+
+		totalTriangleCount += triCount;
+	}
+
+	char buf[64];
+	sprintf(buf, "%016llx-%llu", hash, totalTriangleCount);
+
+	return string(buf);
+}
+
+boost::iostreams::mapped_file *BVHCache::Load(const string &key,
+		luxrays::ocl::BVHArrayNode **nodes, u_int *nNodes) const {
+	const boost::filesystem::path filePath = cacheDir / (key + ".bvh");
+
+	try {
+		if (!boost::filesystem::exists(filePath))
+			return NULL;
+
+		const size_t fileSize = boost::filesystem::file_size(filePath);
+		if (fileSize < sizeof(BVHCacheHeader))
+			throw runtime_error("truncated file");
+
+		boost::iostreams::mapped_file_params mapParams(filePath.string());
+		mapParams.flags = boost::iostreams::mapped_file::priv;
+		boost::iostreams::mapped_file *mappedFile = new boost::iostreams::mapped_file(mapParams);
+
+		const BVHCacheHeader *header = (const BVHCacheHeader *)mappedFile->const_data();
+		luxrays::ocl::BVHArrayNode *mappedNodes = (luxrays::ocl::BVHArrayNode *)
+			(mappedFile->data() + sizeof(BVHCacheHeader));
+
+		if (memcmp(header->magic, BVHCACHE_MAGIC, sizeof(BVHCACHE_MAGIC)) ||
+				(header->version != BVHCACHE_VERSION) ||
+				(header->nodeSize != sizeof(luxrays::ocl::BVHArrayNode)) ||
+				(fileSize != sizeof(BVHCacheHeader) + header->nNodes * sizeof(luxrays::ocl::BVHArrayNode)) ||
+				(header->checksum != HashBin(FNV_OFFSET_BASIS, mappedNodes, header->nNodes * sizeof(luxrays::ocl::BVHArrayNode)))) {
+			delete mappedFile;
+			throw runtime_error("wrong header or checksum");
+		}
+
+		*nodes = mappedNodes;
+		*nNodes = header->nNodes;
+
+		return mappedFile;
+	} catch (exception &err) {
+		// Something wrong in the file, remove the file and build the tree again
+		LR_LOG(ctx, "Error while loading BVH cache file " << filePath.generic_string() << ": " << err.what());
+
+		boost::system::error_code ec;
+		boost::filesystem::remove(filePath, ec);
+
+		return NULL;
+	}
+}
+
+void BVHCache::Save(const string &key,
+		const luxrays::ocl::BVHArrayNode *nodes, const u_int nNodes) const {
+	const boost::filesystem::path filePath = cacheDir / (key + ".bvh");
+
+	try {
+		boost::filesystem::create_directories(cacheDir);
+
+		BVHCacheHeader header;
+		memset(&header, 0, sizeof(BVHCacheHeader));
+		strcpy(header.magic, BVHCACHE_MAGIC);
+		header.version = BVHCACHE_VERSION;
+		header.nodeSize = sizeof(luxrays::ocl::BVHArrayNode);
+		header.nNodes = nNodes;
+		header.checksum = HashBin(FNV_OFFSET_BASIS, nodes, nNodes * sizeof(luxrays::ocl::BVHArrayNode));
+
+		// The file is written with a temporary name and than renamed so other
+		// processes sharing the same cache never read a partial file
+		const boost::filesystem::path tmpFilePath = cacheDir /
+			boost::filesystem::unique_path("%%%%-%%%%-%%%%-%%%%.tmp");
+		{
+			BOOST_OFSTREAM file(tmpFilePath.string().c_str(), ios_base::out | ios_base::binary);
+			file.write((const char *)&header, sizeof(BVHCacheHeader));
+			file.write((const char *)nodes, nNodes * sizeof(luxrays::ocl::BVHArrayNode));
+
+			if (file.fail()) {
+				file.close();
+				boost::filesystem::remove(tmpFilePath);
+				throw runtime_error("unable to write the file");
+			}
+		}
+
+		boost::filesystem::rename(tmpFilePath, filePath);
+	} catch (exception &err) {
+		LR_LOG(ctx, "Error while saving BVH cache file " << filePath.generic_string() << ": " << err.what());
+	}
+}
+
+}
@@ -0,0 +1,451 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+
+// Multi-threaded binned SAH BVH builder. The build is split in tasks by
+// running the sub-trees as TaskScheduler tasks while the top level splits,
+// where there is a single task, use all threads to fill the bins.
+
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <boost/bind.hpp>
+
+#include "luxrays/core/bvh/bvhbuild.h"
+#include "luxrays/utils/taskscheduler.h"
+
+using namespace std;
+
+namespace luxrays {
+
+// Max. number of bins used to evaluate the SAH
+#define PARALLELBVH_MAX_BIN_COUNT 32
+// Default number of bins
+#define PARALLELBVH_DEFAULT_BIN_COUNT 16
+// Sub-trees with less primitives are always built by the current thread
+#define PARALLELBVH_MIN_TASK_SIZE 4096
+// Ranges with more primitives fill the bins with all threads
+#define PARALLELBVH_MIN_PARALLEL_BINNING_SIZE (64 * 1024)
+// Size of the chunks used by the parallel binning
+#define PARALLELBVH_BINNING_CHUNK_SIZE (16 * 1024)
+
+namespace {
+
+typedef struct {
+	u_int begin, end;
+	BBox bbox, centroidBBox;
+} BuildRange;
+
+// Inlined versions of Union(), they are used in the inner loops
+
+inline void ExpandBBox(BBox &bbox, const BBox &b) {
+	bbox.pMin.x = Min(bbox.pMin.x, b.pMin.x);
+	bbox.pMin.y = Min(bbox.pMin.y, b.pMin.y);
+	bbox.pMin.z = Min(bbox.pMin.z, b.pMin.z);
+	bbox.pMax.x = Max(bbox.pMax.x, b.pMax.x);
+	bbox.pMax.y = Max(bbox.pMax.y, b.pMax.y);
+	bbox.pMax.z = Max(bbox.pMax.z, b.pMax.z);
+}
+
+inline void ExpandBBox(BBox &bbox, const Point &p) {
+	bbox.pMin.x = Min(bbox.pMin.x, p.x);
+	bbox.pMin.y = Min(bbox.pMin.y, p.y);
+	bbox.pMin.z = Min(bbox.pMin.z, p.z);
+	bbox.pMax.x = Max(bbox.pMax.x, p.x);
+	bbox.pMax.y = Max(bbox.pMax.y, p.y);
+	bbox.pMax.z = Max(bbox.pMax.z, p.z);
+}
+
+class BinsData {
+public:
+	BinsData() { }
+
+	void Init(const u_int binCount) {
+		for (u_int axis = 0; axis < 3; ++axis) {
+			for (u_int i = 0; i < binCount; ++i) {
+				bbox[axis][i] = BBox();
+				count[axis][i] = 0;
+			}
+		}
+	}
+
+	void Merge(const BinsData &bins, const u_int binCount) {
+		for (u_int axis = 0; axis < 3; ++axis) {
+			for (u_int i = 0; i < binCount; ++i) {
+				ExpandBBox(bbox[axis][i], bins.bbox[axis][i]);
+				count[axis][i] += bins.count[axis][i];
+			}
+		}
+	}
+
+	BBox bbox[3][PARALLELBVH_MAX_BIN_COUNT];
+	u_int count[3][PARALLELBVH_MAX_BIN_COUNT];
+};
+
+class ParallelBVHBuilder {
+public:
+	ParallelBVHBuilder(const BVHParams &p, vector<BVHTreeNode *> &list) :
+		params(p), leafList(list) {
+		binCount = (params.costSamples > 1) ?
+			Clamp<u_int>(params.costSamples, 2, PARALLELBVH_MAX_BIN_COUNT) :
+			PARALLELBVH_DEFAULT_BIN_COUNT;
+
+		// Each task level doubles (at least) the number of tasks
+		const u_int threadCount = TaskScheduler::GetInstance().GetThreadCount();
+		maxTaskDepth = 1;
+		while ((1u << maxTaskDepth) < threadCount)
+			++maxTaskDepth;
+		// Some more task to improve the load balancing
+		maxTaskDepth += 1;
+	}
+
+	BVHTreeNode *Build() {
+		BuildRange range;
+		range.begin = 0;
+		range.end = leafList.size();
+		ComputeBBoxes(0, leafList.size(), true, &range.bbox, &range.centroidBBox);
+
+		BVHTreeNode *root;
+		BuildTask(range, 0, &root);
+
+		return root;
+	}
+
+private:
+	static Point GetCentroid(const BVHTreeNode *node) {
+		return (node->bbox.pMin + node->bbox.pMax) * .5f;
+	}
+
+	void ComputeBBoxes(const u_int begin, const u_int end, const bool useAllThreads,
+			BBox *bbox, BBox *centroidBBox) const {
+		if (useAllThreads && (end - begin >= PARALLELBVH_MIN_PARALLEL_BINNING_SIZE)) {
+			const int chunkCount = (end - begin + PARALLELBVH_BINNING_CHUNK_SIZE - 1) / PARALLELBVH_BINNING_CHUNK_SIZE;
+			vector<BBox> chunkBBoxes(chunkCount);
+			vector<BBox> chunkCentroidBBoxes(chunkCount);
+
+			ParallelFor(0, chunkCount, 1, boost::bind(&ParallelBVHBuilder::ComputeChunkBBoxes,
+					this, _1, _2, begin, end, &chunkBBoxes[0], &chunkCentroidBBoxes[0]));
+
+			*bbox = BBox();
+			*centroidBBox = BBox();
+			for (int c = 0; c < chunkCount; ++c) {
+				ExpandBBox(*bbox, chunkBBoxes[c]);
+				ExpandBBox(*centroidBBox, chunkCentroidBBoxes[c]);
+			}
+		} else {
+			*bbox = BBox();
+			*centroidBBox = BBox();
+			for (u_int i = begin; i < end; ++i) {
+				ExpandBBox(*bbox, leafList[i]->bbox);
+				ExpandBBox(*centroidBBox, GetCentroid(leafList[i]));
+			}
+		}
+	}
+
+	void ComputeChunkBBoxes(const u_int firstChunk, const u_int lastChunk,
+			const u_int begin, const u_int end,
+			BBox *chunkBBoxes, BBox *chunkCentroidBBoxes) const {
+		for (u_int c = firstChunk; c < lastChunk; ++c) {
+			const u_int chunkBegin = begin + c * PARALLELBVH_BINNING_CHUNK_SIZE;
+			const u_int chunkEnd = Min<u_int>(chunkBegin + PARALLELBVH_BINNING_CHUNK_SIZE, end);
+
+			ComputeBBoxes(chunkBegin, chunkEnd, false, &chunkBBoxes[c], &chunkCentroidBBoxes[c]);
+		}
+	}
+
+	static u_int GetBinIndex(const float centroid, const float centroidMin,
+			const float binScale, const u_int nBins) {
+		// The value is never negative so the cast is a faster floor()
+		const int index = static_cast<int>((centroid - centroidMin) * binScale);
+
+		return Clamp<int>(index, 0, nBins - 1);
+	}
+
+	void FillBins(const u_int begin, const u_int end, const BBox &centroidBBox,
+			const float binScale[3], const u_int nBins, BinsData &bins) const {
+		bins.Init(nBins);
+
+		for (u_int i = begin; i < end; ++i) {
+			const BVHTreeNode *node = leafList[i];
+			const Point centroid = GetCentroid(node);
+
+			for (u_int axis = 0; axis < 3; ++axis) {
+				const u_int binIndex = GetBinIndex(centroid[axis], centroidBBox.pMin[axis], binScale[axis], nBins);
+
+				ExpandBBox(bins.bbox[axis][binIndex], node->bbox);
+				bins.count[axis][binIndex] += 1;
+			}
+		}
+	}
+
+	void FillChunkBins(const u_int firstChunk, const u_int lastChunk,
+			const BuildRange &range, const BBox &centroidBBox,
+			const float binScale[3], const u_int nBins, BinsData *chunkBins) const {
+		for (u_int c = firstChunk; c < lastChunk; ++c) {
+			const u_int chunkBegin = range.begin + c * PARALLELBVH_BINNING_CHUNK_SIZE;
+			const u_int chunkEnd = Min<u_int>(chunkBegin + PARALLELBVH_BINNING_CHUNK_SIZE, range.end);
+
+			FillBins(chunkBegin, chunkEnd, centroidBBox, binScale, nBins, chunkBins[c]);
+		}
+	}
+
+	// Split the range with the binned SAH. It returns false if the range
+	// can not be split.
+	bool SplitRange(const BuildRange &range, const bool useAllThreads,
+			BinsData &bins, BuildRange *left, BuildRange *right) {
+		const u_int count = range.end - range.begin;
+		if (count < 2)
+			return false;
+
+		const BBox &centroidBBox = range.centroidBBox;
+		const Vector centroidExtent = centroidBBox.pMax - centroidBBox.pMin;
+
+		// Small ranges don't need all the bins
+		const u_int nBins = Min(binCount, count);
+
+		float binScale[3];
+		for (u_int axis = 0; axis < 3; ++axis)
+			binScale[axis] = (centroidExtent[axis] > 0.f) ? (nBins / centroidExtent[axis]) : 0.f;
+
+		//----------------------------------------------------------------------
+		// Fill the bins
+		//----------------------------------------------------------------------
+
+		if (useAllThreads && (count >= PARALLELBVH_MIN_PARALLEL_BINNING_SIZE)) {
+			const int chunkCount = (count + PARALLELBVH_BINNING_CHUNK_SIZE - 1) / PARALLELBVH_BINNING_CHUNK_SIZE;
+			vector<BinsData> chunkBins(chunkCount);
+
+			ParallelFor(0, chunkCount, 1, boost::bind(&ParallelBVHBuilder::FillChunkBins,
+					this, _1, _2, boost::cref(range), boost::cref(centroidBBox),
+					binScale, nBins, &chunkBins[0]));
+
+			bins.Init(nBins);
+			for (int c = 0; c < chunkCount; ++c)
+				bins.Merge(chunkBins[c], nBins);
+		} else
+			FillBins(range.begin, range.end, centroidBBox, binScale, nBins, bins);
+
+		//----------------------------------------------------------------------
+		// Look for the split with the lowest cost
+		//----------------------------------------------------------------------
+
+		const float invTotalSA = 1.f / range.bbox.SurfaceArea();
+
+		float bestCost = INFINITY;
+		int bestAxis = -1;
+		u_int bestBin = 0;
+		BBox bestLeftBBox, bestRightBBox;
+		for (u_int axis = 0; axis < 3; ++axis) {
+			if (binScale[axis] == 0.f)
+				continue;
+
+			// Sweep from the right to have the area and count on the right
+			// of each split
+			float rightSA[PARALLELBVH_MAX_BIN_COUNT];
+			u_int rightCount[PARALLELBVH_MAX_BIN_COUNT];
+			BBox rightBBox[PARALLELBVH_MAX_BIN_COUNT];
+			BBox bbox;
+			u_int n = 0;
+			for (u_int i = nBins - 1; i > 0; --i) {
+				ExpandBBox(bbox, bins.bbox[axis][i]);
+				n += bins.count[axis][i];
+				rightBBox[i] = bbox;
+				rightSA[i] = (n > 0) ? bbox.SurfaceArea() : 0.f;
+				rightCount[i] = n;
+			}
+
+			// Sweep from the left and evaluate the cost of each split
+			bbox = BBox();
+			n = 0;
+			for (u_int i = 0; i < nBins - 1; ++i) {
+				ExpandBBox(bbox, bins.bbox[axis][i]);
+				n += bins.count[axis][i];
+
+				// Both sides have to be non empty
+				if ((n == 0) || (rightCount[i + 1] == 0))
+					continue;
+
+				const float cost = params.traversalCost + params.isectCost *
+					(bbox.SurfaceArea() * n + rightSA[i + 1] * rightCount[i + 1]) * invTotalSA;
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = i;
+					bestLeftBBox = bbox;
+					bestRightBBox = rightBBox[i + 1];
+				}
+			}
+		}
+
+		//----------------------------------------------------------------------
+		// Partition the primitives
+		//----------------------------------------------------------------------
+
+		u_int middle;
+		if (bestAxis == -1) {
+			// All centroids are coincident, split in half
+			middle = range.begin + count / 2;
+			ComputeBBoxes(range.begin, middle, useAllThreads, &left->bbox, &left->centroidBBox);
+			ComputeBBoxes(middle, range.end, useAllThreads, &right->bbox, &right->centroidBBox);
+		} else {
+			const float centroidMin = centroidBBox.pMin[bestAxis];
+			const float scale = binScale[bestAxis];
+
+			// The centroid bounding boxes of the 2 sides are computed
+			// while partitioning
+			left->centroidBBox = BBox();
+			right->centroidBBox = BBox();
+
+			u_int i = range.begin;
+			u_int j = range.end;
+			while (i < j) {
+				const Point centroid = GetCentroid(leafList[i]);
+
+				if (GetBinIndex(centroid[bestAxis], centroidMin, scale, nBins) <= bestBin) {
+					ExpandBBox(left->centroidBBox, centroid);
+					++i;
+				} else {
+					ExpandBBox(right->centroidBBox, centroid);
+					swap(leafList[i], leafList[--j]);
+				}
+			}
+			middle = i;
+
+			left->bbox = bestLeftBBox;
+			right->bbox = bestRightBBox;
+		}
+
+		left->begin = range.begin;
+		left->end = middle;
+		right->begin = middle;
+		right->end = range.end;
+
+		return true;
+	}
+
+	// Entry point of each task: it has its own bins
+	void BuildTask(const BuildRange &range, const u_int depth, BVHTreeNode **result) {
+		BinsData bins;
+		BuildNode(range, depth, bins, result);
+	}
+
+	void BuildNode(const BuildRange &range, const u_int depth, BinsData &bins,
+			BVHTreeNode **result) {
+		if (range.end - range.begin == 1) {
+			// Only a single item in list so return it
+			BVHTreeNode *node = new BVHTreeNode();
+			*node = *(leafList[range.begin]);
+			node->leftChild = NULL;
+			node->rightSibling = NULL;
+
+			*result = node;
+			return;
+		}
+
+		// Only the root node, where there is a single task running,
+		// uses all threads to fill the bins
+		const bool useAllThreads = (depth == 0);
+
+		// Split the range according the tree type, always splitting the child
+		// with the largest surface area
+		BuildRange childRanges[8];
+		u_int childCount = 1;
+		childRanges[0] = range;
+		while (childCount < params.treeType) {
+			int bestChild = -1;
+			float bestSA = -1.f;
+			for (u_int i = 0; i < childCount; ++i) {
+				if (childRanges[i].end - childRanges[i].begin < 2)
+					continue;
+
+				const float sa = childRanges[i].bbox.SurfaceArea();
+				if (sa > bestSA) {
+					bestSA = sa;
+					bestChild = i;
+				}
+			}
+
+			if (bestChild == -1)
+				break;
+
+			BuildRange left, right;
+			SplitRange(childRanges[bestChild], useAllThreads, bins, &left, &right);
+
+			for (u_int i = childCount; i > (u_int)bestChild + 1; --i)
+				childRanges[i] = childRanges[i - 1];
+			childRanges[bestChild] = left;
+			childRanges[bestChild + 1] = right;
+			++childCount;
+		}
+
+		// Build the children
+		BVHTreeNode *children[8];
+		if ((depth < maxTaskDepth) && (range.end - range.begin >= PARALLELBVH_MIN_TASK_SIZE)) {
+			// Large sub-trees at the top of the tree are built by other threads
+			TaskGroup tasks;
+			for (u_int i = 0; i < childCount; ++i) {
+				const BuildRange &childRange = childRanges[i];
+
+				if ((i < childCount - 1) && (childRange.end - childRange.begin >= PARALLELBVH_MIN_TASK_SIZE)) {
+					tasks.Run(boost::bind(&ParallelBVHBuilder::BuildTask, this,
+							childRange, depth + 1, &children[i]));
+				} else
+					BuildNode(childRange, depth + 1, bins, &children[i]);
+			}
+			tasks.Wait();
+		} else {
+			for (u_int i = 0; i < childCount; ++i)
+				BuildNode(childRanges[i], depth + 1, bins, &children[i]);
+		}
+
+		BVHTreeNode *parent = new BVHTreeNode();
+		parent->leftChild = children[0];
+		parent->rightSibling = NULL;
+		parent->bbox = children[0]->bbox;
+		for (u_int i = 1; i < childCount; ++i) {
+			children[i - 1]->rightSibling = children[i];
+			ExpandBBox(parent->bbox, children[i]->bbox);
+		}
+
+		*result = parent;
+	}
+
+	const BVHParams &params;
+	vector<BVHTreeNode *> &leafList;
+
+	u_int binCount, maxTaskDepth;
+};
+
+}
+
+luxrays::ocl::BVHArrayNode *BuildParallelBVHBinnedSAH(const BVHParams &params,
+		u_int *nNodes, const std::deque<const Mesh *> *meshes,
+		std::vector<BVHTreeNode *> &leafList) {
+	ParallelBVHBuilder builder(params, leafList);
+	BVHTreeNode *rootNode = builder.Build();
+
+	*nNodes = CountBVHNodes(rootNode);
+
+	luxrays::ocl::BVHArrayNode *bvhArrayTree = new luxrays::ocl::BVHArrayNode[*nNodes];
+	BuildBVHArray(meshes, rootNode, 0, bvhArrayTree);
+	FreeBVH(rootNode);
+
+	return bvhArrayTree;
+}
+
+}
@@ -0,0 +1,601 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+
+// Spatial split BVH builder, based on "Spatial Splits in Bounding Volume
+// Hierarchies" by Martin Stich, Heiko Friedrich and Andreas Dietrich (2009).
+// A triangle crossing a split plane can be referenced by both children, each
+// one with a clipped bounding box, when this lowers the SAH cost. It reduces
+// the node overlap produced by long thin triangles. The number of additional
+// references is bounded by a memory budget.
+
+#include <vector>
+#include <deque>
+#include <algorithm>
+
+#include "luxrays/core/bvh/bvhbuild.h"
+#include "luxrays/core/epsilon.h"
+
+using namespace std;
+
+namespace luxrays {
+
+// Max. number of bins used to evaluate the SAH
+#define SBVH_MAX_BIN_COUNT 32
+// Default number of bins
+#define SBVH_DEFAULT_BIN_COUNT 16
+
+namespace {
+
+typedef struct {
+	BBox bbox;
+	// The index of the primitive in the leaf list
+	u_int leafIndex;
+} Reference;
+
+// Inlined versions of Union(), they are used in the inner loops
+
+inline void ExpandBBox(BBox &bbox, const BBox &b) {
+	bbox.pMin.x = Min(bbox.pMin.x, b.pMin.x);
+	bbox.pMin.y = Min(bbox.pMin.y, b.pMin.y);
+	bbox.pMin.z = Min(bbox.pMin.z, b.pMin.z);
+	bbox.pMax.x = Max(bbox.pMax.x, b.pMax.x);
+	bbox.pMax.y = Max(bbox.pMax.y, b.pMax.y);
+	bbox.pMax.z = Max(bbox.pMax.z, b.pMax.z);
+}
+
+inline void ExpandBBox(BBox &bbox, const Point &p) {
+	bbox.pMin.x = Min(bbox.pMin.x, p.x);
+	bbox.pMin.y = Min(bbox.pMin.y, p.y);
+	bbox.pMin.z = Min(bbox.pMin.z, p.z);
+	bbox.pMax.x = Max(bbox.pMax.x, p.x);
+	bbox.pMax.y = Max(bbox.pMax.y, p.y);
+	bbox.pMax.z = Max(bbox.pMax.z, p.z);
+}
+
+inline BBox Intersection(const BBox &a, const BBox &b) {
+	BBox bbox;
+	bbox.pMin.x = Max(a.pMin.x, b.pMin.x);
+	bbox.pMin.y = Max(a.pMin.y, b.pMin.y);
+	bbox.pMin.z = Max(a.pMin.z, b.pMin.z);
+	bbox.pMax.x = Min(a.pMax.x, b.pMax.x);
+	bbox.pMax.y = Min(a.pMax.y, b.pMax.y);
+	bbox.pMax.z = Min(a.pMax.z, b.pMax.z);
+
+	return bbox;
+}
+
+class SBVHBuilder {
+public:
+	SBVHBuilder(const BVHParams &p, const deque<const Mesh *> *ms,
+			vector<BVHTreeNode *> &list) : params(p), meshes(ms), leafList(list) {
+		binCount = (params.costSamples > 1) ?
+			Clamp<u_int>(params.costSamples, 2, SBVH_MAX_BIN_COUNT) :
+			SBVH_DEFAULT_BIN_COUNT;
+
+		// Spatial splits require the triangles to clip, they are not
+		// available when building a BVH of BVHs (i.e. MBVH root)
+		spatialSplitsEnabled = (meshes != NULL) && (params.sbvhMemoryBudget > 0.f);
+
+		referenceCount = leafList.size();
+		maxReferenceCount = leafList.size() + static_cast<u_int>(
+				Max(0.f, params.sbvhMemoryBudget) * leafList.size());
+		spatialSplitCount = 0;
+	}
+
+	BVHTreeNode *Build() {
+		vector<Reference> refs(leafList.size());
+		BBox bbox;
+		for (u_int i = 0; i < leafList.size(); ++i) {
+			refs[i].bbox = leafList[i]->bbox;
+			refs[i].leafIndex = i;
+			ExpandBBox(bbox, refs[i].bbox);
+		}
+
+		// Spatial splits are used only if the children overlap is
+		// significant compared to the size of the whole tree
+		minOverlapSA = params.sbvhAlpha * bbox.SurfaceArea();
+
+		return BuildNode(refs, bbox);
+	}
+
+	u_int GetReferenceCount() const { return referenceCount; }
+	u_int GetSpatialSplitCount() const { return spatialSplitCount; }
+
+private:
+	static Point GetCentroid(const BBox &bbox) {
+		return (bbox.pMin + bbox.pMax) * .5f;
+	}
+
+	static u_int GetBinIndex(const float value, const float minValue,
+			const float binScale, const u_int nBins) {
+		const int index = static_cast<int>((value - minValue) * binScale);
+
+		return Clamp<int>(index, 0, nBins - 1);
+	}
+
+	float GetCost(const float leftSA, const u_int leftCount,
+			const float rightSA, const u_int rightCount, const float invTotalSA) const {
+		return params.traversalCost + params.isectCost *
+			(leftSA * leftCount + rightSA * rightCount) * invTotalSA;
+	}
+
+	// Clip the bounding box of the part of a triangle inside the slab
+	// [minValue, maxValue] along the axis
+	BBox ClipReference(const Reference &ref, const u_int axis,
+			const float minValue, const float maxValue) const {
+		const BVHTreeNode *leaf = leafList[ref.leafIndex];
+		const Mesh *mesh = (*meshes)[leaf->triangleLeaf.meshIndex];
+		const Triangle &tri = mesh->GetTriangles()[leaf->triangleLeaf.triangleIndex];
+
+		if (tri.v[2] == SEGMENT_PRIMITIVE_MARKER) {
+			// Segments are not clipped, only their bounding box
+			BBox bbox = ref.bbox;
+			bbox.pMin[axis] = Max(bbox.pMin[axis], minValue);
+			bbox.pMax[axis] = Min(bbox.pMax[axis], maxValue);
+
+			return bbox;
+		}
+
+		const Point p[3] = {
+			mesh->GetVertex(0.f, tri.v[0]),
+			mesh->GetVertex(0.f, tri.v[1]),
+			mesh->GetVertex(0.f, tri.v[2])
+		};
+
+		BBox bbox;
+		for (u_int i = 0; i < 3; ++i) {
+			const Point &v0 = p[i];
+			const Point &v1 = p[(i + 1) % 3];
+			const float a0 = v0[axis];
+			const float a1 = v1[axis];
+
+			if ((a0 >= minValue) && (a0 <= maxValue))
+				ExpandBBox(bbox, v0);
+
+			// Add the intersections of the edge with the 2 planes
+			if (((a0 < minValue) && (a1 > minValue)) || ((a0 > minValue) && (a1 < minValue)))
+				ExpandBBox(bbox, v0 + (v1 - v0) * ((minValue - a0) / (a1 - a0)));
+			if (((a0 < maxValue) && (a1 > maxValue)) || ((a0 > maxValue) && (a1 < maxValue)))
+				ExpandBBox(bbox, v0 + (v1 - v0) * ((maxValue - a0) / (a1 - a0)));
+		}
+
+		// NOTE - Ratow - Expand bbox a little to make sure rays collide
+		bbox.Expand(MachineEpsilon::E(bbox));
+
+		bbox = Intersection(bbox, ref.bbox);
+		bbox.pMin[axis] = Max(bbox.pMin[axis], minValue);
+		bbox.pMax[axis] = Min(bbox.pMax[axis], maxValue);
+
+		return bbox;
+	}
+
+	//--------------------------------------------------------------------------
+	// Object split
+	//--------------------------------------------------------------------------
+
+	typedef struct {
+		float cost;
+		int axis;
+		u_int bin;
+		float centroidMin, binScale;
+		u_int nBins;
+		BBox leftBBox, rightBBox;
+	} ObjectSplit;
+
+	void FindObjectSplit(const vector<Reference> &refs, const BBox &bbox,
+			ObjectSplit *split) const {
+		split->cost = INFINITY;
+		split->axis = -1;
+
+		BBox centroidBBox;
+		for (u_int i = 0; i < refs.size(); ++i)
+			ExpandBBox(centroidBBox, GetCentroid(refs[i].bbox));
+		const Vector centroidExtent = centroidBBox.pMax - centroidBBox.pMin;
+
+		// Small nodes don't need all the bins
+		const u_int nBins = Min<u_int>(binCount, refs.size());
+		const float invTotalSA = 1.f / bbox.SurfaceArea();
+
+		for (u_int axis = 0; axis < 3; ++axis) {
+			if (centroidExtent[axis] <= 0.f)
+				continue;
+			const float binScale = nBins / centroidExtent[axis];
+
+			BBox binBBox[SBVH_MAX_BIN_COUNT];
+			u_int binCounts[SBVH_MAX_BIN_COUNT];
+			for (u_int i = 0; i < nBins; ++i)
+				binCounts[i] = 0;
+
+			for (u_int i = 0; i < refs.size(); ++i) {
+				const u_int binIndex = GetBinIndex(GetCentroid(refs[i].bbox)[axis],
+						centroidBBox.pMin[axis], binScale, nBins);
+				ExpandBBox(binBBox[binIndex], refs[i].bbox);
+				++binCounts[binIndex];
+			}
+
+			EvaluateSplits(binBBox, binCounts, binCounts, nBins, invTotalSA, axis,
+					&split->cost, &split->axis, &split->bin, &split->leftBBox, &split->rightBBox);
+			if (split->axis == (int)axis) {
+				split->centroidMin = centroidBBox.pMin[axis];
+				split->binScale = binScale;
+				split->nBins = nBins;
+			}
+		}
+	}
+
+	// Sweep the bins and look for the split with the lowest cost. The number
+	// of references on the left of a split is the sum of leftCounts, on the
+	// right the sum of rightCounts (they are different for spatial splits).
+	void EvaluateSplits(const BBox *binBBox, const u_int *leftCounts,
+			const u_int *rightCounts, const u_int nBins, const float invTotalSA,
+			const u_int axis, float *bestCost, int *bestAxis, u_int *bestBin,
+			BBox *bestLeftBBox, BBox *bestRightBBox) const {
+		// Sweep from the right to have the area and count on the right
+		// of each split
+		float rightSA[SBVH_MAX_BIN_COUNT];
+		u_int rightCount[SBVH_MAX_BIN_COUNT];
+		BBox rightBBox[SBVH_MAX_BIN_COUNT];
+		BBox b;
+		u_int n = 0;
+		for (u_int i = nBins - 1; i > 0; --i) {
+			ExpandBBox(b, binBBox[i]);
+			n += rightCounts[i];
+			rightBBox[i] = b;
+			rightSA[i] = (n > 0) ? b.SurfaceArea() : 0.f;
+			rightCount[i] = n;
+		}
+
+		// Sweep from the left and evaluate the cost of each split
+		b = BBox();
+		n = 0;
+		for (u_int i = 0; i < nBins - 1; ++i) {
+			ExpandBBox(b, binBBox[i]);
+			n += leftCounts[i];
+
+			// Both sides have to be non empty
+			if ((n == 0) || (rightCount[i + 1] == 0))
+				continue;
+
+			const float cost = GetCost(b.SurfaceArea(), n, rightSA[i + 1], rightCount[i + 1], invTotalSA);
+			if (cost < *bestCost) {
+				*bestCost = cost;
+				*bestAxis = axis;
+				*bestBin = i;
+				*bestLeftBBox = b;
+				*bestRightBBox = rightBBox[i + 1];
+			}
+		}
+	}
+
+	void DoObjectSplit(vector<Reference> &refs, const ObjectSplit &split,
+			vector<Reference> &left, vector<Reference> &right) const {
+		if (split.axis == -1) {
+			// All centroids are coincident, split in half
+			const u_int middle = refs.size() / 2;
+			left.assign(refs.begin(), refs.begin() + middle);
+			right.assign(refs.begin() + middle, refs.end());
+		} else {
+			for (u_int i = 0; i < refs.size(); ++i) {
+				const Reference &ref = refs[i];
+				if (GetBinIndex(GetCentroid(ref.bbox)[split.axis], split.centroidMin,
+						split.binScale, split.nBins) <= split.bin)
+					left.push_back(ref);
+				else
+					right.push_back(ref);
+			}
+		}
+	}
+
+	//--------------------------------------------------------------------------
+	// Spatial split
+	//--------------------------------------------------------------------------
+
+	typedef struct {
+		float cost;
+		int axis;
+		float pos;
+		BBox leftBBox, rightBBox;
+		u_int leftCount, rightCount;
+	} SpatialSplit;
+
+	void FindSpatialSplit(const vector<Reference> &refs, const BBox &bbox,
+			SpatialSplit *split) const {
+		split->cost = INFINITY;
+		split->axis = -1;
+
+		const Vector extent = bbox.pMax - bbox.pMin;
+		const float invTotalSA = 1.f / bbox.SurfaceArea();
+		const u_int nBins = binCount;
+
+		for (u_int axis = 0; axis < 3; ++axis) {
+			if (extent[axis] <= 0.f)
+				continue;
+			const float binWidth = extent[axis] / nBins;
+			const float binScale = 1.f / binWidth;
+
+			BBox binBBox[SBVH_MAX_BIN_COUNT];
+			u_int binEntries[SBVH_MAX_BIN_COUNT];
+			u_int binExits[SBVH_MAX_BIN_COUNT];
+			for (u_int i = 0; i < nBins; ++i) {
+				binEntries[i] = 0;
+				binExits[i] = 0;
+			}
+
+			for (u_int i = 0; i < refs.size(); ++i) {
+				const Reference &ref = refs[i];
+				const u_int firstBin = GetBinIndex(ref.bbox.pMin[axis], bbox.pMin[axis], binScale, nBins);
+				const u_int lastBin = Max(firstBin, GetBinIndex(ref.bbox.pMax[axis], bbox.pMin[axis], binScale, nBins));
+
+				if (firstBin == lastBin)
+					ExpandBBox(binBBox[firstBin], ref.bbox);
+				else {
+					// Add the clipped part of the triangle to each bin
+					for (u_int b = firstBin; b <= lastBin; ++b) {
+						const float binMin = bbox.pMin[axis] + b * binWidth;
+						const float binMax = (b == nBins - 1) ? bbox.pMax[axis] : (binMin + binWidth);
+						const BBox clippedBBox = ClipReference(ref, axis, binMin, binMax);
+
+						if (clippedBBox.IsValid())
+							ExpandBBox(binBBox[b], clippedBBox);
+					}
+				}
+
+				++binEntries[firstBin];
+				++binExits[lastBin];
+			}
+
+			u_int bestBin;
+			int bestAxis = -1;
+			EvaluateSplits(binBBox, binEntries, binExits, nBins, invTotalSA, axis,
+					&split->cost, &bestAxis, &bestBin, &split->leftBBox, &split->rightBBox);
+			if (bestAxis == (int)axis) {
+				split->axis = axis;
+				split->pos = bbox.pMin[axis] + (bestBin + 1) * binWidth;
+
+				split->leftCount = 0;
+				for (u_int i = 0; i <= bestBin; ++i)
+					split->leftCount += binEntries[i];
+				split->rightCount = 0;
+				for (u_int i = bestBin + 1; i < nBins; ++i)
+					split->rightCount += binExits[i];
+			}
+		}
+	}
+
+	// Returns false if the split doesn't reduce the number of references on
+	// both sides (it could never end)
+	bool DoSpatialSplit(vector<Reference> &refs, const SpatialSplit &split,
+			vector<Reference> &left, vector<Reference> &right) {
+		const u_int axis = split.axis;
+		const float pos = split.pos;
+
+		BBox leftBBox = split.leftBBox;
+		BBox rightBBox = split.rightBBox;
+		u_int leftCount = split.leftCount;
+		u_int rightCount = split.rightCount;
+
+		u_int newReferenceCount = 0;
+		for (u_int i = 0; i < refs.size(); ++i) {
+			const Reference &ref = refs[i];
+
+			if (ref.bbox.pMax[axis] <= pos)
+				left.push_back(ref);
+			else if (ref.bbox.pMin[axis] >= pos)
+				right.push_back(ref);
+			else {
+				// Reference unsplitting: check if it is cheaper to put the
+				// whole triangle only on one side
+				const float splitCost = leftBBox.SurfaceArea() * leftCount +
+						rightBBox.SurfaceArea() * rightCount;
+				const float leftOnlyCost = Union(leftBBox, ref.bbox).SurfaceArea() * leftCount +
+						rightBBox.SurfaceArea() * (rightCount - 1);
+				const float rightOnlyCost = leftBBox.SurfaceArea() * (leftCount - 1) +
+						Union(rightBBox, ref.bbox).SurfaceArea() * rightCount;
+
+				if ((leftOnlyCost < splitCost) && (leftOnlyCost <= rightOnlyCost)) {
+					left.push_back(ref);
+					ExpandBBox(leftBBox, ref.bbox);
+					--rightCount;
+				} else if (rightOnlyCost < splitCost) {
+					right.push_back(ref);
+					ExpandBBox(rightBBox, ref.bbox);
+					--leftCount;
+				} else {
+					Reference leftRef, rightRef;
+					leftRef.leafIndex = ref.leafIndex;
+					leftRef.bbox = ClipReference(ref, axis, ref.bbox.pMin[axis], pos);
+					rightRef.leafIndex = ref.leafIndex;
+					rightRef.bbox = ClipReference(ref, axis, pos, ref.bbox.pMax[axis]);
+
+					// Because of the numerical precision, one of the 2
+					// parts can be empty
+					if (leftRef.bbox.IsValid() && rightRef.bbox.IsValid()) {
+						left.push_back(leftRef);
+						right.push_back(rightRef);
+						++newReferenceCount;
+					} else if (leftRef.bbox.IsValid())
+						left.push_back(ref);
+					else
+						right.push_back(ref);
+				}
+			}
+		}
+
+		if ((left.size() == 0) || (right.size() == 0) ||
+				(left.size() == refs.size()) || (right.size() == refs.size())) {
+			left.clear();
+			right.clear();
+			return false;
+		}
+
+		referenceCount += newReferenceCount;
+		++spatialSplitCount;
+
+		return true;
+	}
+
+	//--------------------------------------------------------------------------
+	// Tree build
+	//--------------------------------------------------------------------------
+
+	static BBox ComputeBBox(const vector<Reference> &refs) {
+		BBox bbox;
+		for (u_int i = 0; i < refs.size(); ++i)
+			ExpandBBox(bbox, refs[i].bbox);
+
+		return bbox;
+	}
+
+	void Split(vector<Reference> &refs, const BBox &bbox,
+			vector<Reference> &left, BBox *leftBBox,
+			vector<Reference> &right, BBox *rightBBox) {
+		ObjectSplit objectSplit;
+		FindObjectSplit(refs, bbox, &objectSplit);
+
+		// Check if a spatial split is worth to be tested: the object split
+		// children have to overlap and there must be some memory budget left
+		bool useSpatialSplit = false;
+		if (spatialSplitsEnabled && (referenceCount < maxReferenceCount)) {
+			bool testSpatialSplit;
+			if (objectSplit.axis == -1)
+				testSpatialSplit = true;
+			else {
+				const BBox overlap = Intersection(objectSplit.leftBBox, objectSplit.rightBBox);
+				testSpatialSplit = overlap.IsValid() && (overlap.SurfaceArea() > minOverlapSA);
+			}
+
+			if (testSpatialSplit) {
+				SpatialSplit spatialSplit;
+				FindSpatialSplit(refs, bbox, &spatialSplit);
+
+				const u_int newReferenceCount = (spatialSplit.axis != -1) ?
+					(spatialSplit.leftCount + spatialSplit.rightCount - refs.size()) : 0;
+				if ((spatialSplit.axis != -1) && (spatialSplit.cost < objectSplit.cost) &&
+						(referenceCount + newReferenceCount <= maxReferenceCount))
+					useSpatialSplit = DoSpatialSplit(refs, spatialSplit, left, right);
+			}
+		}
+
+		if (!useSpatialSplit)
+			DoObjectSplit(refs, objectSplit, left, right);
+
+		*leftBBox = ComputeBBox(left);
+		*rightBBox = ComputeBBox(right);
+	}
+
+	BVHTreeNode *BuildNode(vector<Reference> &refs, const BBox &bbox) {
+		if (refs.size() == 1) {
+			// Only a single item in list so return it
+			BVHTreeNode *node = new BVHTreeNode();
+			*node = *(leafList[refs[0].leafIndex]);
+			node->bbox = refs[0].bbox;
+			node->leftChild = NULL;
+			node->rightSibling = NULL;
+
+			return node;
+		}
+
+		// Split the references according the tree type, always splitting
+		// the child with the largest surface area
+		vector<Reference> childRefs[8];
+		BBox childBBoxes[8];
+		u_int childCount = 1;
+		childRefs[0].swap(refs);
+		childBBoxes[0] = bbox;
+		while (childCount < params.treeType) {
+			int bestChild = -1;
+			float bestSA = -1.f;
+			for (u_int i = 0; i < childCount; ++i) {
+				if (childRefs[i].size() < 2)
+					continue;
+
+				const float sa = childBBoxes[i].SurfaceArea();
+				if (sa > bestSA) {
+					bestSA = sa;
+					bestChild = i;
+				}
+			}
+
+			if (bestChild == -1)
+				break;
+
+			vector<Reference> left, right;
+			BBox leftBBox, rightBBox;
+			Split(childRefs[bestChild], childBBoxes[bestChild], left, &leftBBox, right, &rightBBox);
+
+			for (u_int i = childCount; i > (u_int)bestChild + 1; --i) {
+				childRefs[i].swap(childRefs[i - 1]);
+				childBBoxes[i] = childBBoxes[i - 1];
+			}
+			childRefs[bestChild].swap(left);
+			childBBoxes[bestChild] = leftBBox;
+			childRefs[bestChild + 1].swap(right);
+			childBBoxes[bestChild + 1] = rightBBox;
+			++childCount;
+		}
+
+		// Build the children
+		BVHTreeNode *children[8];
+		for (u_int i = 0; i < childCount; ++i) {
+			children[i] = BuildNode(childRefs[i], childBBoxes[i]);
+			// Free the memory as soon as possible
+			vector<Reference>().swap(childRefs[i]);
+		}
+
+		BVHTreeNode *parent = new BVHTreeNode();
+		parent->leftChild = children[0];
+		parent->rightSibling = NULL;
+		parent->bbox = children[0]->bbox;
+		for (u_int i = 1; i < childCount; ++i) {
+			children[i - 1]->rightSibling = children[i];
+			ExpandBBox(parent->bbox, children[i]->bbox);
+		}
+
+		return parent;
+	}
+
+	const BVHParams &params;
+	const deque<const Mesh *> *meshes;
+	vector<BVHTreeNode *> &leafList;
+
+	u_int binCount;
+	bool spatialSplitsEnabled;
+	float minOverlapSA;
+
+	u_int referenceCount, maxReferenceCount, spatialSplitCount;
+};
+
+}
+
+luxrays::ocl::BVHArrayNode *BuildSBVH(const BVHParams &params,
+		u_int *nNodes, const std::deque<const Mesh *> *meshes,
+		std::vector<BVHTreeNode *> &leafList) {
+	SBVHBuilder builder(params, meshes, leafList);
+	BVHTreeNode *rootNode = builder.Build();
+
+	*nNodes = CountBVHNodes(rootNode);
+
+	luxrays::ocl::BVHArrayNode *bvhArrayTree = new luxrays::ocl::BVHArrayNode[*nNodes];
+	BuildBVHArray(meshes, rootNode, 0, bvhArrayTree);
+	FreeBVH(rootNode);
+
+	return bvhArrayTree;
+}
+
+}
@@ -29,6 +29,7 @@
 #include "luxrays/accelerators/bvhaccel.h"
 #include "luxrays/accelerators/mbvhaccel.h"
 #include "luxrays/accelerators/embreeaccel.h"
+#include "luxrays/accelerators/widebvhaccel.h"
 #include "luxrays/core/geometry/bsphere.h"
 
 using namespace luxrays;
@@ -46,6 +47,7 @@ DataSet::DataSet(const Context *luxRaysContext) {
 
 	totalVertexCount = 0;
 	totalTriangleCount = 0;
+	accelsBuildTime = 0.0;
 
 	preprocessed = false;
 	hasInstances = false;
@@ -132,11 +134,19 @@ const Accelerator *DataSet::GetAccelerator(const AcceleratorType accelType) {
 			case ACCEL_EMBREE:
 				accel = new EmbreeAccel(context);
 				break;
+			case ACCEL_BVH4:
+				accel = new BVH4Accel(context);
+				break;
+			case ACCEL_BVH8:
+				accel = new BVH8Accel(context);
+				break;
 			default:
 				throw runtime_error("Unknown AcceleratorType in DataSet::AddAccelerator()");
 		}
 
+		const double t0 = WallClockTime();
 		accel->Init(meshes, totalVertexCount, totalTriangleCount);
+		accelsBuildTime += WallClockTime() - t0;
 
 		accels[accelType] = accel;
 
@@ -154,11 +164,29 @@ bool DataSet::DoesAllAcceleratorsSupportUpdate() const {
 	return true;
 }
 
+bool DataSet::DoesAllAcceleratorsSupportRefit() const {
+	for (boost::unordered_map<AcceleratorType, Accelerator *>::const_iterator it = accels.begin(); it != accels.end(); ++it) {
+		if (!it->second->DoesSupportRefit())
+			return false;
+	}
+
+	return true;
+}
+
 void DataSet::UpdateAccelerators() {
 	for (boost::unordered_map<AcceleratorType, Accelerator *>::const_iterator it = accels.begin(); it != accels.end(); ++it) {
 		assert(it->second->DoesSupportUpdate());
-		it->second->Update();
+
+		const double t0 = WallClockTime();
+		if (refitMeshes.size() > 0) {
+			assert(it->second->DoesSupportRefit());
+			it->second->Refit(refitMeshes);
+		} else
+			it->second->Update();
+		accelsBuildTime += WallClockTime() - t0;
 	}
+
+	refitMeshes.clear();
 }
 
 bool DataSet::IsEqual(const DataSet *dataSet) const {
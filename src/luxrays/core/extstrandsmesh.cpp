@@ -0,0 +1,230 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+#include <boost/filesystem.hpp>
+
+#include "luxrays/core/extstrandsmesh.h"
+#include "luxrays/utils/serializationutils.h"
+
+using namespace std;
+using namespace luxrays;
+
+//------------------------------------------------------------------------------
+// ExtStrandsMesh
+//------------------------------------------------------------------------------
+
+BOOST_CLASS_EXPORT_IMPLEMENT(luxrays::ExtStrandsMesh)
+
+ExtStrandsMesh::ExtStrandsMesh(const u_int meshVertCount, const u_int meshSegmentCount,
+		Point *meshVertices, float *meshRadii, const u_int *meshSegments,
+		UV *meshUV, Spectrum *meshCols, float *meshAlpha) {
+	assert (meshVertCount > 0);
+	assert (meshSegmentCount > 0);
+	assert (meshVertices != NULL);
+	assert (meshRadii != NULL);
+	assert (meshSegments != NULL);
+
+	// Check the indices before allocating anything, the buffers are still
+	// owned by the caller if the constructor throws
+	for (u_int i = 0; i < meshSegmentCount; ++i) {
+		if (meshSegments[i] + 1 >= meshVertCount)
+			throw runtime_error("Wrong vertex index in ExtStrandsMesh segment: " + ToString(i));
+	}
+
+	vertCount = meshVertCount;
+	segmentCount = meshSegmentCount;
+	vertices = meshVertices;
+	radii = meshRadii;
+	uvs = meshUV;
+	cols = meshCols;
+	alphas = meshAlpha;
+
+	segments = new Triangle[segmentCount];
+	for (u_int i = 0; i < segmentCount; ++i) {
+		const u_int v0 = meshSegments[i];
+		segments[i] = Triangle(v0, v0 + 1, SEGMENT_PRIMITIVE_MARKER);
+	}
+
+	Preprocess();
+}
+
+void ExtStrandsMesh::Preprocess() {
+	// Compute the mesh area
+	area = 0.f;
+	for (u_int i = 0; i < segmentCount; ++i)
+		area += GetTriangleArea(0.f, i);
+
+	cachedBBoxValid = false;
+}
+
+BBox ExtStrandsMesh::GetBBox() const {
+	if (!cachedBBoxValid) {
+		BBox bbox;
+		for (u_int i = 0; i < segmentCount; ++i) {
+			const Triangle &seg = segments[i];
+			bbox = Union(bbox, Segment::WorldBound(vertices[seg.v[0]], vertices[seg.v[1]],
+					radii[seg.v[0]], radii[seg.v[1]]));
+		}
+		cachedBBox = bbox;
+
+		cachedBBoxValid = true;
+	}
+
+	return cachedBBox;
+}
+
+Normal ExtStrandsMesh::GetGeometryNormal(const float time, const u_int segIndex) const {
+	const Triangle &seg = segments[segIndex];
+	const Vector e = vertices[seg.v[1]] - vertices[seg.v[0]];
+	if (e.LengthSquared() == 0.f)
+		return Normal(0.f, 0.f, 1.f);
+
+	Vector v1, v2;
+	CoordinateSystem(Normalize(e), &v1, &v2);
+
+	return Normal(v1);
+}
+
+void ExtStrandsMesh::GetHitPointNormals(const Ray &ray, const u_int segIndex, const float b1,
+		const Point &hitPoint, Normal *geometryN, Normal *shadeN) const {
+	const Triangle &seg = segments[segIndex];
+	const Point &p0 = vertices[seg.v[0]];
+	const Point &p1 = vertices[seg.v[1]];
+
+	const Vector e = p1 - p0;
+	const Vector dir = Normalize(-ray.d);
+	Vector facing = dir;
+	Vector tangent;
+	if (e.LengthSquared() > 0.f) {
+		tangent = Normalize(e);
+		facing -= Dot(dir, tangent) * tangent;
+	}
+
+	if (facing.LengthSquared() == 0.f) {
+		// The ray is parallel to the segment
+		*geometryN = Normal(dir);
+		*shadeN = *geometryN;
+		return;
+	}
+	facing = Normalize(facing);
+	*geometryN = Normal(facing);
+
+	// Use the offset of the hit point from the segment axis, across the
+	// ribbon, to bend the normal like on a cylinder
+	const Vector side = Cross(tangent, facing);
+	const float r = Lerp(b1, radii[seg.v[0]], radii[seg.v[1]]);
+	const float offset = (r > 0.f) ?
+		Clamp(Dot(hitPoint - Lerp(b1, p0, p1), side) / r, -1.f, 1.f) : 0.f;
+
+	*shadeN = Normal(Normalize(offset * side + sqrtf(1.f - offset * offset) * facing));
+}
+
+bool ExtStrandsMesh::GetTriBaryCoords(const float time, const u_int segIndex,
+		const Point &hitPoint, float *b1, float *b2) const {
+	const Triangle &seg = segments[segIndex];
+	const Point &p0 = vertices[seg.v[0]];
+	const Vector e = vertices[seg.v[1]] - p0;
+
+	const float eLength2 = e.LengthSquared();
+	*b1 = (eLength2 > 0.f) ? Clamp(Dot(hitPoint - p0, e) / eLength2, 0.f, 1.f) : 0.f;
+	*b2 = 0.f;
+
+	return true;
+}
+
+void ExtStrandsMesh::GetDifferentials(const float time, const u_int segIndex, const Normal &shadeNormal,
+		Vector *dpdu, Vector *dpdv,
+		Normal *dndu, Normal *dndv) const {
+	// v runs along the strand and u across it
+	const Triangle &seg = segments[segIndex];
+	const Vector e = vertices[seg.v[1]] - vertices[seg.v[0]];
+
+	const Vector geometryDpDv = Cross(shadeNormal, Cross(e, shadeNormal));
+	if (geometryDpDv.LengthSquared() == 0.f)
+		CoordinateSystem(Vector(shadeNormal), dpdu, dpdv);
+	else {
+		*dpdv = Normalize(geometryDpDv);
+		*dpdu = Cross(*dpdv, shadeNormal);
+	}
+
+	*dndu = Normal();
+	*dndv = Normal();
+}
+
+void ExtStrandsMesh::ApplyTransform(const Transform &trans) {
+	for (u_int i = 0; i < vertCount; ++i)
+		vertices[i] *= trans;
+
+	// Radii are scaled by the average scale of the transformation
+	const float scale = ((trans * Vector(1.f, 0.f, 0.f)).Length() +
+			(trans * Vector(0.f, 1.f, 0.f)).Length() +
+			(trans * Vector(0.f, 0.f, 1.f)).Length()) * (1.f / 3.f);
+	for (u_int i = 0; i < vertCount; ++i)
+		radii[i] *= scale;
+
+	Preprocess();
+}
+
+float ExtStrandsMesh::GetTriangleArea(const float time, const unsigned int segIndex) const {
+	const Triangle &seg = segments[segIndex];
+
+	return Distance(vertices[seg.v[0]], vertices[seg.v[1]]) *
+			(radii[seg.v[0]] + radii[seg.v[1]]);
+}
+
+void ExtStrandsMesh::Sample(const float time, const u_int segIndex, const float u0, const float u1,
+		Point *p, float *b0, float *b1, float *b2) const {
+	const Triangle &seg = segments[segIndex];
+
+	*p = Lerp(u0, vertices[seg.v[0]], vertices[seg.v[1]]);
+	*b0 = 1.f - u0;
+	*b1 = u0;
+	*b2 = 0.f;
+}
+
+void ExtStrandsMesh::Save(const string &fileName) const {
+	const boost::filesystem::path ext = boost::filesystem::path(fileName).extension();
+	if (ext != ".bpy")
+		throw runtime_error("Strands meshes can be saved only in the serialized format: " + fileName);
+
+	SerializationOutputFile sof(fileName);
+
+	const ExtStrandsMesh *mesh = this;
+	sof.GetArchive() << mesh;
+
+	if (!sof.IsGood())
+		throw runtime_error("Error while saving serialized mesh: " + fileName);
+
+	sof.Flush();
+}
+
+ExtStrandsMesh *ExtStrandsMesh::Load(const string &fileName) {
+	const boost::filesystem::path ext = boost::filesystem::path(fileName).extension();
+	if (ext != ".bpy")
+		throw runtime_error("Strands meshes can be loaded only from the serialized format: " + fileName);
+
+	SerializationInputFile sif(fileName);
+
+	ExtStrandsMesh *mesh;
+	sif.GetArchive() >> mesh;
+
+	if (!sif.IsGood())
+		throw runtime_error("Error while loading serialized strands mesh: " + fileName);
+
+	return mesh;
+}
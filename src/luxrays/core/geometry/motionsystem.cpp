@@ -344,6 +344,31 @@ BBox MotionSystem::Bound(BBox ibox, const bool storingGlobal2Local) const {;
 	return result;
 }
 
+BBox MotionSystem::Bound(BBox ibox, const bool storingGlobal2Local,
+		const float startTime, const float endTime) const {
+	// Compute total bounding box by naive unions, the knots inside the
+	// interval are always included
+	BBox result;
+	const float N = 128.f;
+	for (float i = 0; i <= N; ++i) {
+		Matrix4x4 m = Sample(Lerp(i / N, startTime, endTime));
+		if (storingGlobal2Local)
+			m = m.Inverse();
+		result = Union(result, m * ibox);
+	}
+
+	BOOST_FOREACH(const float t, times) {
+		if ((t > startTime) && (t < endTime)) {
+			Matrix4x4 m = Sample(t);
+			if (storingGlobal2Local)
+				m = m.Inverse();
+			result = Union(result, m * ibox);
+		}
+	}
+
+	return result;
+}
+
 void MotionSystem::ApplyTransform(const Transform &trans) {
 	const vector<float> t = times;
 	vector<Transform> transforms;
@@ -0,0 +1,319 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+#include <boost/thread/thread.hpp>
+
+#include "luxrays/core/geometry/raybuffer.h"
+
+using namespace luxrays;
+using namespace std;
+
+//------------------------------------------------------------------------------
+// RayBufferQueueM2MLockFree
+//------------------------------------------------------------------------------
+
+// Number of failed attempts before to start to yield and to block
+#define LOCKFREE_SPIN_COUNT 64
+#define LOCKFREE_YIELD_COUNT 128
+
+RayBufferQueueM2MLockFree::RayBufferQueueM2MLockFree(const size_t consumersCount,
+		const size_t buffersCount) : toDoEnqueuePos(0), toDoDequeuePos(0),
+		doneSize(0), waitingThreads(0), waitTime(0) {
+	const size_t queueBufferCount = RoundUpPow2(Max<size_t>(buffersCount, 1));
+
+	// The to-do ring must be able to hold all the buffers of all queues
+	const size_t toDoSize = RoundUpPow2(Max<size_t>(consumersCount, 1) * queueBufferCount);
+	toDoMask = toDoSize - 1;
+	toDoRing = new ToDoCell[toDoSize];
+	for (size_t i = 0; i < toDoSize; ++i) {
+		toDoRing[i].sequence.store(i, boost::memory_order_relaxed);
+		toDoRing[i].rayBuffer = NULL;
+	}
+
+	doneRings.resize(consumersCount);
+	for (size_t i = 0; i < consumersCount; ++i) {
+		DoneRing &ring = doneRings[i];
+
+		ring.slots = new boost::atomic<RayBuffer *>[queueBufferCount];
+		for (size_t j = 0; j < queueBufferCount; ++j)
+			ring.slots[j].store(NULL, boost::memory_order_relaxed);
+		ring.mask = queueBufferCount - 1;
+		ring.toDoCounter = 0;
+		ring.doneCounter = 0;
+	}
+}
+
+RayBufferQueueM2MLockFree::~RayBufferQueueM2MLockFree() {
+	delete[] toDoRing;
+	for (size_t i = 0; i < doneRings.size(); ++i)
+		delete[] doneRings[i].slots;
+}
+
+void RayBufferQueueM2MLockFree::Clear() {
+	// NOTE: this method is not thread safe like all the others
+	while (TryPopToDo()) ;
+
+	for (size_t i = 0; i < doneRings.size(); ++i) {
+		DoneRing &ring = doneRings[i];
+
+		for (size_t j = 0; j <= ring.mask; ++j)
+			ring.slots[j].store(NULL, boost::memory_order_relaxed);
+		ring.toDoCounter = 0;
+		ring.doneCounter = 0;
+	}
+	doneSize.store(0);
+}
+
+size_t RayBufferQueueM2MLockFree::GetSizeToDo() {
+	const size_t dequeuePos = toDoDequeuePos.load(boost::memory_order_relaxed);
+	const size_t enqueuePos = toDoEnqueuePos.load(boost::memory_order_relaxed);
+
+	// It is only an estimation while other threads are working on the queue
+	return (enqueuePos > dequeuePos) ? (enqueuePos - dequeuePos) : 0;
+}
+
+size_t RayBufferQueueM2MLockFree::GetSizeDone() {
+	return doneSize.load(boost::memory_order_relaxed);
+}
+
+//------------------------------------------------------------------------------
+// To-do ring
+//------------------------------------------------------------------------------
+
+bool RayBufferQueueM2MLockFree::TryPushToDo(RayBuffer *rayBuffer) {
+	size_t pos = toDoEnqueuePos.load(boost::memory_order_relaxed);
+
+	for (;;) {
+		ToDoCell &cell = toDoRing[pos & toDoMask];
+		const size_t seq = cell.sequence.load(boost::memory_order_acquire);
+		const ptrdiff_t delta = (ptrdiff_t)seq - (ptrdiff_t)pos;
+
+		if (delta == 0) {
+			// The cell is free, try to reserve it
+			if (toDoEnqueuePos.compare_exchange_weak(pos, pos + 1, boost::memory_order_relaxed)) {
+				cell.rayBuffer = rayBuffer;
+				cell.sequence.store(pos + 1, boost::memory_order_release);
+
+				return true;
+			}
+		} else if (delta < 0) {
+			// The ring is full
+			return false;
+		} else {
+			// Another thread has reserved the cell
+			pos = toDoEnqueuePos.load(boost::memory_order_relaxed);
+		}
+	}
+}
+
+RayBuffer *RayBufferQueueM2MLockFree::TryPopToDo() {
+	size_t pos = toDoDequeuePos.load(boost::memory_order_relaxed);
+
+	for (;;) {
+		ToDoCell &cell = toDoRing[pos & toDoMask];
+		const size_t seq = cell.sequence.load(boost::memory_order_acquire);
+		const ptrdiff_t delta = (ptrdiff_t)seq - (ptrdiff_t)(pos + 1);
+
+		if (delta == 0) {
+			// The cell is full, try to reserve it
+			if (toDoDequeuePos.compare_exchange_weak(pos, pos + 1, boost::memory_order_relaxed)) {
+				RayBuffer *rayBuffer = cell.rayBuffer;
+				// Mark the cell as free for the next lap of the ring
+				cell.sequence.store(pos + toDoMask + 1, boost::memory_order_release);
+
+				return rayBuffer;
+			}
+		} else if (delta < 0) {
+			// The ring is empty
+			return NULL;
+		} else {
+			// Another thread has reserved the cell
+			pos = toDoDequeuePos.load(boost::memory_order_relaxed);
+		}
+	}
+}
+
+void RayBufferQueueM2MLockFree::PushToDo(RayBuffer *rayBuffer, const size_t queueIndex) {
+	DoneRing &ring = doneRings[queueIndex];
+
+	rayBuffer->PushUserData(ring.toDoCounter);
+	rayBuffer->PushUserData(queueIndex);
+	++(ring.toDoCounter);
+
+	if (!TryPushToDo(rayBuffer)) {
+		u_int attempt = 0;
+		double startTime = 0.0;
+		do {
+			Wait(WAIT_TODO_NOT_FULL, queueIndex, 0, attempt, startTime);
+		} while (!TryPushToDo(rayBuffer));
+		EndWait(startTime);
+	}
+
+	WakeUpWaiters();
+}
+
+RayBuffer *RayBufferQueueM2MLockFree::PopToDo() {
+	RayBuffer *rayBuffer = TryPopToDo();
+
+	if (!rayBuffer) {
+		u_int attempt = 0;
+		double startTime = 0.0;
+		do {
+			Wait(WAIT_TODO_NOT_EMPTY, 0, 0, attempt, startTime);
+		} while (!(rayBuffer = TryPopToDo()));
+		EndWait(startTime);
+	}
+
+	WakeUpWaiters();
+
+	return rayBuffer;
+}
+
+//------------------------------------------------------------------------------
+// Done rings
+//------------------------------------------------------------------------------
+
+void RayBufferQueueM2MLockFree::PushDone(RayBuffer *rayBuffer) {
+	const size_t queueIndex = rayBuffer->GetUserData(0);
+	const size_t progressive = rayBuffer->GetUserData(1);
+
+	boost::atomic<RayBuffer *> &slot = doneRings[queueIndex].slots[progressive & doneRings[queueIndex].mask];
+
+	RayBuffer *expected = NULL;
+	if (!slot.compare_exchange_strong(expected, rayBuffer, boost::memory_order_release)) {
+		// The slot is still used by a buffer of the previous lap of the ring
+		u_int attempt = 0;
+		double startTime = 0.0;
+		do {
+			Wait(WAIT_DONE_SLOT_FREE, queueIndex, progressive, attempt, startTime);
+			expected = NULL;
+		} while (!slot.compare_exchange_strong(expected, rayBuffer, boost::memory_order_release));
+		EndWait(startTime);
+	}
+	++doneSize;
+
+	WakeUpWaiters();
+}
+
+RayBuffer *RayBufferQueueM2MLockFree::PopDone(const size_t queueIndex) {
+	DoneRing &ring = doneRings[queueIndex];
+	boost::atomic<RayBuffer *> &slot = ring.slots[ring.doneCounter & ring.mask];
+
+	RayBuffer *rayBuffer = slot.load(boost::memory_order_acquire);
+	if (!rayBuffer) {
+		u_int attempt = 0;
+		double startTime = 0.0;
+		do {
+			Wait(WAIT_DONE_SLOT_READY, queueIndex, ring.doneCounter, attempt, startTime);
+		} while (!(rayBuffer = slot.load(boost::memory_order_acquire)));
+		EndWait(startTime);
+	}
+	slot.store(NULL, boost::memory_order_release);
+	--doneSize;
+	++(ring.doneCounter);
+
+	rayBuffer->PopUserData();
+	rayBuffer->PopUserData();
+
+	WakeUpWaiters();
+
+	return rayBuffer;
+}
+
+//------------------------------------------------------------------------------
+// Waiting
+//------------------------------------------------------------------------------
+
+bool RayBufferQueueM2MLockFree::IsReady(const WaitCondition condition,
+		const size_t queueIndex, const size_t progressive) const {
+	switch (condition) {
+		case WAIT_TODO_NOT_FULL: {
+			const size_t pos = toDoEnqueuePos.load(boost::memory_order_relaxed);
+			return (toDoRing[pos & toDoMask].sequence.load(boost::memory_order_acquire) == pos);
+		}
+		case WAIT_TODO_NOT_EMPTY: {
+			const size_t pos = toDoDequeuePos.load(boost::memory_order_relaxed);
+			return (toDoRing[pos & toDoMask].sequence.load(boost::memory_order_acquire) == pos + 1);
+		}
+		case WAIT_DONE_SLOT_FREE: {
+			const DoneRing &ring = doneRings[queueIndex];
+			return !ring.slots[progressive & ring.mask].load(boost::memory_order_acquire);
+		}
+		case WAIT_DONE_SLOT_READY: {
+			const DoneRing &ring = doneRings[queueIndex];
+			return ring.slots[progressive & ring.mask].load(boost::memory_order_acquire);
+		}
+		default:
+			throw runtime_error("Unknown wait condition in RayBufferQueueM2MLockFree::IsReady(): " + ToString(condition));
+	}
+}
+
+void RayBufferQueueM2MLockFree::Wait(const WaitCondition condition,
+		const size_t queueIndex, const size_t progressive,
+		u_int &attempt, double &startTime) {
+	if (attempt == 0)
+		startTime = WallClockTime();
+	++attempt;
+
+	if (attempt < LOCKFREE_SPIN_COUNT) {
+		// Just spin
+		boost::this_thread::interruption_point();
+	} else if (attempt < LOCKFREE_YIELD_COUNT) {
+		boost::this_thread::interruption_point();
+		boost::this_thread::yield();
+	} else {
+		// Block until somebody else works on the queue. The timeout is only
+		// a safety net: the condition is checked again after having
+		// registered as waiter so no wake up can be lost.
+		boost::unique_lock<boost::mutex> lock(waitMutex);
+		++waitingThreads;
+		if (!IsReady(condition, queueIndex, progressive)) {
+			try {
+				waitCondition.timed_wait(lock, boost::posix_time::milliseconds(10));
+			} catch (...) {
+				--waitingThreads;
+				throw;
+			}
+		}
+		--waitingThreads;
+	}
+}
+
+void RayBufferQueueM2MLockFree::EndWait(const double startTime) {
+	waitTime += (u_longlong)((WallClockTime() - startTime) * 1000000000.0);
+}
+
+void RayBufferQueueM2MLockFree::WakeUpWaiters() {
+	// The fence orders the previous update of the queue with the read of
+	// waitingThreads (a waiter does the opposite)
+	boost::atomic_thread_fence(boost::memory_order_seq_cst);
+	if (waitingThreads.load(boost::memory_order_relaxed) > 0) {
+		// Acquiring the mutex avoids to notify a thread between its last
+		// check of the condition and the wait
+		boost::unique_lock<boost::mutex> lock(waitMutex);
+		waitCondition.notify_all();
+	}
+}
+
+double RayBufferQueueM2MLockFree::GetWaitTime() {
+	return waitTime.load() / 1000000000.0;
+}
+
+void RayBufferQueueM2MLockFree::ResetWaitTime() {
+	waitTime.store(0);
+}
@@ -24,6 +24,7 @@
 #include "luxrays/utils/atomic.h"
 #include "luxrays/utils/thread.h"
 
+using namespace std;
 using namespace luxrays;
 
 #define RAYBUFFER_DEFAULT_NATIVE_SIZE 512
@@ -72,7 +73,14 @@ void NativeThreadIntersectionDevice::Start() {
 	threadDeviceTotalTime.clear();
 	if (dataParallelSupport) {
 		// Create all the required queues
-		rayBufferQueue = new RayBufferQueueM2M(queueCount);
+		const string queueType = deviceContext->GetConfig().Get(
+				Property("context.native.raybufferqueue.type")("LOCKFREE")).Get<string>();
+		if (queueType == "LOCKFREE")
+			rayBufferQueue = new RayBufferQueueM2MLockFree(queueCount, bufferCount);
+		else if (queueType == "MUTEX")
+			rayBufferQueue = new RayBufferQueueM2M(queueCount);
+		else
+			throw runtime_error("Unknown ray buffer queue type in NativeThreadIntersectionDevice::Start(): " + queueType);
 
 		// Create all threads for the rendering
 		for (u_int i = 0; i < threadCount; ++i) {
@@ -157,10 +165,7 @@ void NativeThreadIntersectionDevice::IntersectionThread(NativeThreadIntersection
 			const Ray *rb = rayBuffer->GetRayBuffer();
 			RayHit *hb = rayBuffer->GetHitBuffer();
 			const size_t rayCount = rayBuffer->GetRayCount();
-			for (unsigned int i = 0; i < rayCount; ++i) {
-				hb[i].SetMiss();
-				renderDevice->accel->Intersect(&rb[i], &hb[i]);
-			}
+			renderDevice->accel->IntersectStream(rb, hb, rayCount);
 			renderDevice->threadTotalDataParallelRayCount[threadIndex] += rayCount;
 			queue->PushDone(rayBuffer);
 
@@ -216,9 +221,16 @@ double NativeThreadIntersectionDevice::GetDataParallelPerformance() const {
 	return HardwareIntersectionDevice::GetDataParallelPerformance();
 }
 
+double NativeThreadIntersectionDevice::GetQueueWaitTime() const {
+	return rayBufferQueue ? rayBufferQueue->GetWaitTime() : 0.0;
+}
+
 void NativeThreadIntersectionDevice::ResetPerformaceStats() {
 	HardwareIntersectionDevice::ResetPerformaceStats();
 
+	if (rayBufferQueue)
+		rayBufferQueue->ResetWaitTime();
+
 	BOOST_FOREACH(double &idelTime, threadDeviceIdleTime)
 			idelTime = 0.0;
 	BOOST_FOREACH(double &rayCount, threadTotalDataParallelRayCount)
@@ -177,6 +177,14 @@ double VirtualIntersectionDevice::GetLoad() const {
 	return tot;
 }
 
+double VirtualIntersectionDevice::GetQueueWaitTime() const {
+	double tot = 0.0;
+	BOOST_FOREACH(IntersectionDevice *device, realDevices)
+		tot += device->GetQueueWaitTime();
+
+	return tot;
+}
+
 void VirtualIntersectionDevice::ResetPerformaceStats() {
 	BOOST_FOREACH(IntersectionDevice *device, realDevices)
 		device->ResetPerformaceStats();
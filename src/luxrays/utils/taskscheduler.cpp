@@ -0,0 +1,303 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+#include <stdexcept>
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+
+#include "luxrays/utils/taskscheduler.h"
+#include "luxrays/utils/utils.h"
+
+using namespace std;
+using namespace luxrays;
+
+//------------------------------------------------------------------------------
+// TaskScheduler
+//------------------------------------------------------------------------------
+
+TaskScheduler::TaskScheduler(const u_int threadCount) :
+		queuedTaskCount(0), sleepingWorkerCount(0), activeWorkerCount(0),
+		executedTaskCount(0), stolenTaskCount(0), done(false) {
+	const u_int hwThreadCount = Max<u_int>(boost::thread::hardware_concurrency(), 1);
+	const u_int count = (threadCount == 0) ? hwThreadCount : threadCount;
+	const u_int maxWorkerCount = Max(hwThreadCount, count) - 1;
+
+	// The queues are never reallocated so the workers can read them without locks
+	for (u_int i = 0; i < maxWorkerCount + 1; ++i)
+		queues.push_back(new TaskQueue());
+
+	SetThreadCount(count);
+
+	for (u_int i = 0; i < maxWorkerCount; ++i)
+		workers.push_back(new boost::thread(boost::bind(&TaskScheduler::WorkerThread, this, i)));
+}
+
+TaskScheduler::~TaskScheduler() {
+	{
+		boost::unique_lock<boost::mutex> lock(sleepMutex);
+		done = true;
+	}
+	sleepCondition.notify_all();
+	parkCondition.notify_all();
+
+	BOOST_FOREACH(boost::thread *worker, workers) {
+		worker->join();
+		delete worker;
+	}
+
+	BOOST_FOREACH(TaskQueue *queue, queues)
+		delete queue;
+}
+
+TaskScheduler &TaskScheduler::GetInstance() {
+	static TaskScheduler instance;
+
+	return instance;
+}
+
+void TaskScheduler::SetThreadCount(const u_int threadCount) {
+	const u_int maxWorkerCount = queues.size() - 1;
+	const u_int workerCount = Min(Max(threadCount, 1u) - 1, maxWorkerCount);
+
+	{
+		boost::unique_lock<boost::mutex> lock(sleepMutex);
+		activeWorkerCount = workerCount;
+	}
+	// Wake up the parked workers or let the extra ones to park
+	parkCondition.notify_all();
+	sleepCondition.notify_all();
+}
+
+int TaskScheduler::GetCurrentQueueIndex() const {
+	const u_int *index = currentWorkerIndex.get();
+
+	// Non worker threads use the last queue
+	return index ? *index : (queues.size() - 1);
+}
+
+void TaskScheduler::Submit(TaskGroup *group, const TaskFunc &func) {
+	Task task;
+	task.func = func;
+	task.group = group;
+
+	TaskQueue *queue = queues[GetCurrentQueueIndex()];
+	{
+		boost::unique_lock<boost::mutex> lock(queue->queueMutex);
+		queue->tasks.push_back(task);
+	}
+	++queuedTaskCount;
+
+	// queuedTaskCount is incremented before to check sleepingWorkerCount and
+	// WorkerThread() does the opposite so a wake up can not be lost
+	if (sleepingWorkerCount > 0) {
+		boost::unique_lock<boost::mutex> lock(sleepMutex);
+		sleepCondition.notify_one();
+	}
+}
+
+bool TaskScheduler::PopTask(TaskQueue *queue, const TaskGroup *group,
+		const bool fromBack, Task &task) {
+	boost::unique_lock<boost::mutex> lock(queue->queueMutex);
+
+	deque<Task> &tasks = queue->tasks;
+	const size_t taskCount = tasks.size();
+	for (size_t i = 0; i < taskCount; ++i) {
+		const size_t index = fromBack ? (taskCount - 1 - i) : i;
+
+		if (!group || (tasks[index].group == group)) {
+			task = tasks[index];
+			tasks.erase(tasks.begin() + index);
+			--queuedTaskCount;
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool TaskScheduler::GetTask(Task &task, const TaskGroup *group) {
+	if (queuedTaskCount == 0)
+		return false;
+
+	const u_int queueCount = queues.size();
+	const u_int currentIndex = GetCurrentQueueIndex();
+
+	// Look in the own queue first, the most recent task is the one with the
+	// hottest data in the caches
+	if (PopTask(queues[currentIndex], group, true, task))
+		return true;
+
+	// Steal the oldest task from the other queues
+	for (u_int i = 1; i < queueCount; ++i) {
+		if (PopTask(queues[(currentIndex + i) % queueCount], group, false, task)) {
+			++stolenTaskCount;
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void TaskScheduler::Execute(Task &task) {
+	// Exceptions are forwarded to the thread waiting the TaskGroup
+	string error;
+	bool failed = false;
+	try {
+		task.func();
+	} catch (exception &err) {
+		error = err.what();
+		failed = true;
+	} catch (...) {
+		error = "Unknown exception in a TaskScheduler task";
+		failed = true;
+	}
+	// Release the resources bound to the task
+	task.func.clear();
+
+	++executedTaskCount;
+	task.group->TaskDone(failed ? &error : NULL);
+}
+
+bool TaskScheduler::RunPendingTask(const TaskGroup *group) {
+	Task task;
+	if (!GetTask(task, group))
+		return false;
+
+	Execute(task);
+
+	return true;
+}
+
+void TaskScheduler::WorkerThread(const u_int index) {
+	currentWorkerIndex.reset(new u_int(index));
+
+	for (;;) {
+		if (index >= activeWorkerCount) {
+			// This worker is not used at the moment
+			boost::unique_lock<boost::mutex> lock(sleepMutex);
+			while (!done && (index >= activeWorkerCount))
+				parkCondition.wait(lock);
+
+			if (done)
+				return;
+			continue;
+		}
+
+		if (RunPendingTask())
+			continue;
+
+		// Nothing to do, wait for a new task
+		boost::unique_lock<boost::mutex> lock(sleepMutex);
+		++sleepingWorkerCount;
+		while (!done && (queuedTaskCount == 0) && (index < activeWorkerCount))
+			sleepCondition.wait(lock);
+		--sleepingWorkerCount;
+
+		if (done)
+			return;
+	}
+}
+
+//------------------------------------------------------------------------------
+// TaskGroup
+//------------------------------------------------------------------------------
+
+TaskGroup::TaskGroup(TaskScheduler &s) : scheduler(s), pendingTaskCount(0),
+		hasTaskError(false) {
+}
+
+TaskGroup::~TaskGroup() {
+	// The tasks have a reference to the group so I can not leave before they are done
+	if (pendingTaskCount > 0) {
+		try {
+			Wait();
+		} catch (...) {
+		}
+	}
+}
+
+void TaskGroup::Run(const TaskFunc &func) {
+	++pendingTaskCount;
+	scheduler.Submit(this, func);
+}
+
+void TaskGroup::Wait() {
+	while (pendingTaskCount > 0) {
+		// Help to run the tasks of this group instead of blocking. The tasks
+		// of the other groups are not run here: the caller may own locks
+		// (for instance the film mutex) an unrelated task could try to acquire.
+		if (scheduler.RunPendingTask(this))
+			continue;
+
+		// All the tasks are running on other threads. The time out is there
+		// to check for the new tasks they may submit.
+		boost::unique_lock<boost::mutex> lock(groupMutex);
+		if (pendingTaskCount > 0)
+			groupCondition.timed_wait(lock, boost::posix_time::milliseconds(1));
+	}
+
+	// TaskDone() may still own the mutex
+	boost::unique_lock<boost::mutex> lock(groupMutex);
+	if (hasTaskError) {
+		hasTaskError = false;
+		throw runtime_error(taskError);
+	}
+}
+
+void TaskGroup::TaskDone(const string *error) {
+	boost::unique_lock<boost::mutex> lock(groupMutex);
+
+	if (error && !hasTaskError) {
+		taskError = *error;
+		hasTaskError = true;
+	}
+
+	if (--pendingTaskCount == 0)
+		groupCondition.notify_all();
+}
+
+//------------------------------------------------------------------------------
+// ParallelFor
+//------------------------------------------------------------------------------
+
+void luxrays::ParallelFor(const u_int begin, const u_int end, const u_int grainSize,
+		const boost::function<void (u_int, u_int)> &func, TaskScheduler &scheduler) {
+	if (begin >= end)
+		return;
+
+	const u_int count = end - begin;
+	const u_int threadCount = scheduler.GetThreadCount();
+	// A few chunks for each thread to balance the load
+	const u_int grain = (grainSize > 0) ? grainSize : Max(count / (threadCount * 4), 1u);
+
+	if ((threadCount == 1) || (count <= grain)) {
+		func(begin, end);
+		return;
+	}
+
+	TaskGroup group(scheduler);
+	for (u_int chunkBegin = begin; chunkBegin < end;) {
+		const u_int chunkEnd = (end - chunkBegin > grain) ? (chunkBegin + grain) : end;
+
+		group.Run(boost::bind(func, chunkBegin, chunkEnd));
+		chunkBegin = chunkEnd;
+	}
+	group.Wait();
+}
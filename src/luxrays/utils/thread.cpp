@@ -0,0 +1,230 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+#if defined (__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "luxrays/utils/thread.h"
+
+using namespace std;
+
+namespace luxrays {
+
+//------------------------------------------------------------------------------
+// Thread affinity
+//------------------------------------------------------------------------------
+
+ThreadAffinityType String2ThreadAffinityType(const string &type) {
+	if (type == "NONE")
+		return THREAD_AFFINITY_NONE;
+	else if (type == "COMPACT")
+		return THREAD_AFFINITY_COMPACT;
+	else if (type == "SCATTER")
+		return THREAD_AFFINITY_SCATTER;
+	else
+		throw runtime_error("Unknown thread affinity type: " + type);
+}
+
+string ThreadAffinityType2String(const ThreadAffinityType type) {
+	switch (type) {
+		case THREAD_AFFINITY_NONE:
+			return "NONE";
+		case THREAD_AFFINITY_COMPACT:
+			return "COMPACT";
+		case THREAD_AFFINITY_SCATTER:
+			return "SCATTER";
+		default:
+			throw runtime_error("Unknown thread affinity type: " + ToString(type));
+	}
+}
+
+bool SetCurrentThreadAffinity(const u_int cpuIndex) {
+#if defined (__linux__)
+	cpu_set_t cpuSet;
+	CPU_ZERO(&cpuSet);
+	CPU_SET(cpuIndex, &cpuSet);
+
+	return (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuSet) == 0);
+#elif defined (WIN32)
+	if (cpuIndex >= sizeof(DWORD_PTR) * 8)
+		return false;
+
+	return (SetThreadAffinityMask(GetCurrentThread(), ((DWORD_PTR)1) << cpuIndex) != 0);
+#else
+	// Not supported (i.e. MacOS has only affinity hints)
+	return false;
+#endif
+}
+
+//------------------------------------------------------------------------------
+// NUMATopology
+//------------------------------------------------------------------------------
+
+#if defined (__linux__)
+// Parses a Linux CPU/node list like "0-7,16-23"
+static vector<u_int> ParseLinuxList(const string &list) {
+	vector<u_int> result;
+
+	istringstream ss(list);
+	string range;
+	while (getline(ss, range, ',')) {
+		u_int first, last;
+		const int count = sscanf(range.c_str(), "%u-%u", &first, &last);
+		if (count == 1)
+			result.push_back(first);
+		else if (count == 2) {
+			for (u_int i = first; i <= last; ++i)
+				result.push_back(i);
+		}
+	}
+
+	return result;
+}
+
+static string ReadLinuxFirstLine(const string &fileName) {
+	ifstream file(fileName.c_str());
+
+	string line;
+	if (file.good())
+		getline(file, line);
+
+	return line;
+}
+#endif
+
+NUMATopology::NUMATopology() {
+#if defined (__linux__)
+	const vector<u_int> nodes = ParseLinuxList(ReadLinuxFirstLine("/sys/devices/system/node/online"));
+	for (u_int i = 0; i < nodes.size(); ++i) {
+		const vector<u_int> cpus = ParseLinuxList(ReadLinuxFirstLine(
+				"/sys/devices/system/node/node" + ToString(nodes[i]) + "/cpulist"));
+
+		// Nodes with only memory are not useful to place threads
+		if (cpus.size() > 0)
+			nodeCPUs.push_back(cpus);
+	}
+#elif defined (WIN32)
+	ULONG highestNode;
+	if (GetNumaHighestNodeNumber(&highestNode)) {
+		for (ULONG node = 0; node <= highestNode; ++node) {
+			ULONGLONG mask;
+			if (!GetNumaNodeProcessorMask((UCHAR)node, &mask))
+				continue;
+
+			vector<u_int> cpus;
+			for (u_int i = 0; i < 64; ++i) {
+				if (mask & (((ULONGLONG)1) << i))
+					cpus.push_back(i);
+			}
+
+			if (cpus.size() > 0)
+				nodeCPUs.push_back(cpus);
+		}
+	}
+#endif
+
+	if (nodeCPUs.size() == 0) {
+		// Unknown topology, a single node with all CPUs
+		vector<u_int> cpus(Max(1u, boost::thread::hardware_concurrency()));
+		for (u_int i = 0; i < cpus.size(); ++i)
+			cpus[i] = i;
+
+		nodeCPUs.push_back(cpus);
+	}
+}
+
+u_int NUMATopology::GetCPUNode(const u_int cpuIndex) const {
+	for (u_int i = 0; i < nodeCPUs.size(); ++i) {
+		if (find(nodeCPUs[i].begin(), nodeCPUs[i].end(), cpuIndex) != nodeCPUs[i].end())
+			return i;
+	}
+
+	return 0;
+}
+
+vector<u_int> NUMATopology::GetThreadCPUs(const u_int threadCount,
+		const ThreadAffinityType type) const {
+	// The order used to assign the CPUs to the threads
+	vector<u_int> cpus;
+	switch (type) {
+		case THREAD_AFFINITY_NONE:
+			return vector<u_int>();
+		case THREAD_AFFINITY_COMPACT:
+			for (u_int i = 0; i < nodeCPUs.size(); ++i)
+				cpus.insert(cpus.end(), nodeCPUs[i].begin(), nodeCPUs[i].end());
+			break;
+		case THREAD_AFFINITY_SCATTER: {
+			u_int maxNodeCPUs = 0;
+			for (u_int i = 0; i < nodeCPUs.size(); ++i)
+				maxNodeCPUs = Max<u_int>(maxNodeCPUs, nodeCPUs[i].size());
+
+			for (u_int j = 0; j < maxNodeCPUs; ++j) {
+				for (u_int i = 0; i < nodeCPUs.size(); ++i) {
+					if (j < nodeCPUs[i].size())
+						cpus.push_back(nodeCPUs[i][j]);
+				}
+			}
+			break;
+		}
+		default:
+			throw runtime_error("Unknown thread affinity type in NUMATopology::GetThreadCPUs(): " + ToString(type));
+	}
+
+	// With more threads than CPUs, the CPUs are reused in the same order
+	vector<u_int> threadCPUs(threadCount);
+	for (u_int i = 0; i < threadCount; ++i)
+		threadCPUs[i] = cpus[i % cpus.size()];
+
+	return threadCPUs;
+}
+
+void NUMATopology::GetPageAllocationCounts(u_longlong *localPages, u_longlong *remotePages) const {
+	*localPages = 0;
+	*remotePages = 0;
+
+#if defined (__linux__)
+	const vector<u_int> nodes = ParseLinuxList(ReadLinuxFirstLine("/sys/devices/system/node/online"));
+	for (u_int i = 0; i < nodes.size(); ++i) {
+		ifstream file(("/sys/devices/system/node/node" + ToString(nodes[i]) + "/numastat").c_str());
+
+		string name;
+		u_longlong value;
+		while (file >> name >> value) {
+			if (name == "local_node")
+				*localPages += value;
+			else if (name == "other_node")
+				*remotePages += value;
+		}
+	}
+#endif
+}
+
+const NUMATopology &NUMATopology::GetInstance() {
+	static NUMATopology instance;
+
+	return instance;
+}
+
+}
@@ -16,6 +16,7 @@
  * limitations under the License.                                          *
  ***************************************************************************/
 
+#include "luxrays/core/extstrandsmesh.h"
 #include "slg/bsdf/bsdf.h"
 #include "slg/scene/scene.h"
 
@@ -44,8 +45,16 @@ void BSDF::Init(const bool fixedFromLight, const Scene &scene, const Ray &ray,
 	material = sceneObject->GetMaterial();
 
 	// Interpolate face normal
-	hitPoint.geometryN = mesh->GetGeometryNormal(ray.time, rayHit.triangleIndex);
-	hitPoint.shadeN = mesh->InterpolateTriNormal(ray.time, rayHit.triangleIndex, rayHit.b1, rayHit.b2);
+	if (mesh->GetType() == TYPE_EXT_STRANDS) {
+		// Native strands segments have no fixed orientation: the normals
+		// depend on the ray direction
+		static_cast<const ExtStrandsMesh *>(mesh)->GetHitPointNormals(ray,
+				rayHit.triangleIndex, rayHit.b1, hitPoint.p,
+				&hitPoint.geometryN, &hitPoint.shadeN);
+	} else {
+		hitPoint.geometryN = mesh->GetGeometryNormal(ray.time, rayHit.triangleIndex);
+		hitPoint.shadeN = mesh->InterpolateTriNormal(ray.time, rayHit.triangleIndex, rayHit.b1, rayHit.b2);
+	}
 	hitPoint.intoObject = (Dot(ray.d, hitPoint.geometryN) < 0.f);
 
 	// Set interior and exterior volumes
@@ -90,11 +90,9 @@ void BiDirCPURenderThread::ConnectVertices(const float time,
 					p2pDistance,
 					time);
 			p2pRay.UpdateMinMaxWithEpsilon();
-			RayHit p2pRayHit;
-			BSDF bsdfConn;
 			Spectrum connectionThroughput;
 			PathVolumeInfo volInfo = eyeVertex.volInfo; // I need to use a copy here
-			if (!scene->Intersect(device, true, &volInfo, u0, &p2pRay, &p2pRayHit, &bsdfConn,
+			if (!scene->Occluded(device, true, &volInfo, u0, &p2pRay,
 					&connectionThroughput)) {
 				// Nothing was hit, the light path vertex is visible
 
@@ -161,12 +159,10 @@ void BiDirCPURenderThread::ConnectToEye(const float time,
 			Ray traceRay(lightVertex.bsdf.hitPoint.p, -eyeRay.d,
 					0.f, eyeRay.maxt);
 			traceRay.UpdateMinMaxWithEpsilon();
-			RayHit traceRayHit;
 
-			BSDF bsdfConn;
 			Spectrum connectionThroughput;
 			PathVolumeInfo volInfo = lightVertex.volInfo; // I need to use a copy here
-			if (!scene->Intersect(device, true, &volInfo, u0, &traceRay, &traceRayHit, &bsdfConn,
+			if (!scene->Occluded(device, true, &volInfo, u0, &traceRay,
 					&connectionThroughput)) {
 				// Nothing was hit, the light path vertex is visible
 
@@ -235,12 +231,10 @@ void BiDirCPURenderThread::DirectLightSampling(const float time,
 							distance,
 							time);
 					shadowRay.UpdateMinMaxWithEpsilon();
-					RayHit shadowRayHit;
-					BSDF shadowBsdf;
 					Spectrum connectionThroughput;
 					PathVolumeInfo volInfo = eyeVertex.volInfo; // I need to use a copy here
 					// Check if the light source is visible
-					if (!scene->Intersect(device, false, &volInfo, u4, &shadowRay, &shadowRayHit, &shadowBsdf, &connectionThroughput)) {
+					if (!scene->Occluded(device, false, &volInfo, u4, &shadowRay, &connectionThroughput)) {
 						// I'm ignoring volume emission because it is not sampled in
 						// direct light step.
 
@@ -18,6 +18,7 @@
 
 #include <boost/format.hpp>
 
+#include "luxrays/utils/thread.h"
 #include "slg/engines/cpurenderengine.h"
 
 using namespace std;
@@ -62,6 +63,21 @@ void CPURenderThread::Stop() {
 	started = false;
 }
 
+boost::thread *CPURenderThread::AllocPinnedRenderThread(const boost::function<void()> &renderFunc) {
+	return new boost::thread(boost::bind(&CPURenderThread::PinnedRenderFunc, this, renderFunc));
+}
+
+void CPURenderThread::PinnedRenderFunc(const boost::function<void()> renderFunc) {
+	// Pin the thread before the render function allocates anything
+	if (renderEngine->threadCPUs.size() > 0) {
+		const u_int cpuIndex = renderEngine->threadCPUs[threadIndex];
+		if (!SetCurrentThreadAffinity(cpuIndex))
+			SLG_LOG("[CPURenderThread::" << threadIndex << "] Unable to set the thread affinity to CPU " << cpuIndex);
+	}
+
+	renderFunc();
+}
+
 void CPURenderThread::StartRenderThread() {
 	// Create the thread for the rendering
 	renderThread = AllocRenderThread();
@@ -100,6 +116,10 @@ void CPURenderThread::WaitForDone() const {
 CPURenderEngine::CPURenderEngine(const RenderConfig *cfg, Film *flm, boost::mutex *flmMutex) :
 	RenderEngine(cfg, flm, flmMutex) {
 	const size_t renderThreadCount =  Max<u_longlong>(1, cfg->cfg.Get(GetDefaultProps().Get("native.threads.count")).Get<u_longlong>());
+	threadAffinity = String2ThreadAffinityType(cfg->cfg.Get(GetDefaultProps().Get("native.threads.affinity")).Get<string>());
+
+	startLocalPages = 0;
+	startRemotePages = 0;
 
 	//--------------------------------------------------------------------------
 	// Allocate devices
@@ -126,6 +146,14 @@ CPURenderEngine::CPURenderEngine(const RenderConfig *cfg, Film *flm, boost::mute
 
 	SLG_LOG("Configuring "<< renderThreadCount << " CPU render threads");
 	renderThreads.resize(renderThreadCount, NULL);
+
+	const NUMATopology &numaTopology = NUMATopology::GetInstance();
+	SLG_LOG("NUMA nodes: " << numaTopology.GetNodeCount());
+	SLG_LOG("CPU render threads affinity: " << ThreadAffinityType2String(threadAffinity));
+
+	threadCPUs = numaTopology.GetThreadCPUs(renderThreadCount, threadAffinity);
+	for (size_t i = 0; i < threadCPUs.size(); ++i)
+		SLG_LOG("  Render thread " << i << ": CPU " << threadCPUs[i] << " (NUMA node " << numaTopology.GetCPUNode(threadCPUs[i]) << ")");
 }
 
 CPURenderEngine::~CPURenderEngine() {
@@ -139,6 +167,8 @@ CPURenderEngine::~CPURenderEngine() {
 }
 
 void CPURenderEngine::StartLockLess() {
+	NUMATopology::GetInstance().GetPageAllocationCounts(&startLocalPages, &startRemotePages);
+
 	for (size_t i = 0; i < renderThreads.size(); ++i) {
 		if (!renderThreads[i])
 			renderThreads[i] = NewRenderThread(i, intersectionDevices[i]);
@@ -183,15 +213,32 @@ void CPURenderEngine::WaitForDone() const {
 		renderThreads[i]->WaitForDone();
 }
 
+u_int CPURenderEngine::GetNUMANodeCount() const {
+	return NUMATopology::GetInstance().GetNodeCount();
+}
+
+double CPURenderEngine::GetSystemRemoteMemoryRatio() const {
+	u_longlong localPages, remotePages;
+	NUMATopology::GetInstance().GetPageAllocationCounts(&localPages, &remotePages);
+
+	// The counters are system wide and can be reset only by a reboot
+	const u_longlong local = (localPages > startLocalPages) ? (localPages - startLocalPages) : 0;
+	const u_longlong remote = (remotePages > startRemotePages) ? (remotePages - startRemotePages) : 0;
+
+	return (local + remote > 0) ? (remote / (double)(local + remote)) : 0.0;
+}
+
 Properties CPURenderEngine::ToProperties(const Properties &cfg) {
 	return Properties() <<
-			cfg.Get(GetDefaultProps().Get("native.threads.count"));
+			cfg.Get(GetDefaultProps().Get("native.threads.count")) <<
+			cfg.Get(GetDefaultProps().Get("native.threads.affinity"));
 }
 
 const Properties &CPURenderEngine::GetDefaultProps() {
 	static Properties props = Properties() <<
 			RenderEngine::GetDefaultProps() <<
-			Property("native.threads.count")(boost::thread::hardware_concurrency());
+			Property("native.threads.count")(boost::thread::hardware_concurrency()) <<
+			Property("native.threads.affinity")("NONE");
 
 	return props;
 }
@@ -206,12 +253,21 @@ CPUNoTileRenderThread::CPUNoTileRenderThread(CPUNoTileRenderEngine *engine,
 }
 
 CPUNoTileRenderThread::~CPUNoTileRenderThread() {
-	delete threadFilm;
+	if (!((CPUNoTileRenderEngine *)renderEngine)->useSharedFilm)
+		delete threadFilm;
 }
 
 void CPUNoTileRenderThread::StartRenderThread() {
 	CPUNoTileRenderEngine *cpuNoTileEngine = (CPUNoTileRenderEngine *)renderEngine;
 
+	if (cpuNoTileEngine->useSharedFilm) {
+		// The engine film is used directly, the start film is already there
+		threadFilm = cpuNoTileEngine->film;
+
+		CPURenderThread::StartRenderThread();
+		return;
+	}
+
 	const u_int filmWidth = cpuNoTileEngine->film->GetWidth();
 	const u_int filmHeight = cpuNoTileEngine->film->GetHeight();
 	const u_int *filmSubRegion = cpuNoTileEngine->film->GetSubRegion();
@@ -239,7 +295,11 @@ void CPUNoTileRenderThread::StartRenderThread() {
 CPUNoTileRenderEngine::CPUNoTileRenderEngine(const RenderConfig *cfg, Film *flm, boost::mutex *flmMutex) :
 	CPURenderEngine(cfg, flm, flmMutex) {
 	samplerSharedData = NULL;
+	useSharedFilm = cfg->cfg.Get(GetDefaultProps().Get("native.film.shared.enable")).Get<bool>();
 	hasStartFilm = false;
+
+	if (useSharedFilm)
+		SLG_LOG("CPU render threads use a shared film");
 }
 
 CPUNoTileRenderEngine::~CPUNoTileRenderEngine() {
@@ -248,18 +308,45 @@ CPUNoTileRenderEngine::~CPUNoTileRenderEngine() {
 
 void CPUNoTileRenderEngine::StartLockLess() {
 	samplerSharedData = renderConfig->AllocSamplerSharedData(&seedBaseGenerator, film);
-	
+
+	if (useSharedFilm) {
+		boost::unique_lock<boost::mutex> lock(*filmMutex);
+
+		film->SetThreadSafeFlag(true);
+		if (!hasStartFilm)
+			film->Reset();
+	}
+
 	CPURenderEngine::StartLockLess();
 }
 
 void CPUNoTileRenderEngine::StopLockLess() {
 	CPURenderEngine::StopLockLess();
 
+	if (useSharedFilm)
+		film->SetThreadSafeFlag(false);
+
 	delete samplerSharedData;
 	samplerSharedData = NULL;
 }
 
+void CPUNoTileRenderEngine::EndSceneEditLockLess(const EditActionList &editActions) {
+	if (useSharedFilm) {
+		// All render threads are stopped at this point
+		boost::unique_lock<boost::mutex> lock(*filmMutex);
+
+		film->Reset();
+	}
+
+	CPURenderEngine::EndSceneEditLockLess(editActions);
+}
+
 void CPUNoTileRenderEngine::UpdateFilmLockLess() {
+	if (useSharedFilm) {
+		// Nothing to merge, the render threads splat directly on the film
+		return;
+	}
+
 	boost::unique_lock<boost::mutex> lock(*filmMutex);
 
 	film->Reset();
@@ -291,11 +378,14 @@ void CPUNoTileRenderEngine::UpdateCounters() {
 }
 
 Properties CPUNoTileRenderEngine::ToProperties(const Properties &cfg) {
-	return CPURenderEngine::ToProperties(cfg);
+	return CPURenderEngine::ToProperties(cfg) <<
+			cfg.Get(GetDefaultProps().Get("native.film.shared.enable"));
 }
 
 const Properties &CPUNoTileRenderEngine::GetDefaultProps() {
-	static Properties props;
+	static Properties props = Properties() <<
+			Property("native.film.shared.enable")(false);
+
 	return props;
 }
 
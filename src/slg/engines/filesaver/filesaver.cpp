@@ -146,7 +146,7 @@ void FileSaverRenderEngine::SaveScene() {
 			ExtMesh *mesh = meshes[i];
 			// The only meshes I need to save are the real one. The others (instances, etc.)
 			// will reference only true one.
-			if (mesh->GetType() != TYPE_EXT_TRIANGLE)
+			if ((mesh->GetType() != TYPE_EXT_TRIANGLE) && (mesh->GetType() != TYPE_EXT_STRANDS))
 				continue;
 
 			const string fileName = (dirPath / renderConfig->scene->extMeshCache.GetSequenceFileName(mesh)).generic_string();
@@ -77,11 +77,9 @@ void LightCPURenderThread::ConnectToEye(const float u0, const LightSource &light
 			Ray traceRay(bsdf.hitPoint.p, -eyeRay.d,
 					0.f, eyeRay.maxt);
 			traceRay.UpdateMinMaxWithEpsilon();
-			RayHit traceRayHit;
 
-			BSDF bsdfConn;
 			Spectrum connectionThroughput;
-			if (!scene->Intersect(device, true, &volInfo, u0, &traceRay, &traceRayHit, &bsdfConn,
+			if (!scene->Occluded(device, true, &volInfo, u0, &traceRay,
 					&connectionThroughput)) {
 				// Nothing was hit, the light path vertex is visible
 
@@ -72,6 +72,9 @@ void CompiledScene::CompileGeometry() {
 	slg::ocl::Mesh currentMeshDesc;
 	for (u_int i = 0; i < objCount; ++i) {
 		const ExtMesh *mesh = scene->objDefs.GetSceneObject(i)->GetExtMesh();
+		if (mesh->GetType() == TYPE_EXT_STRANDS)
+			throw runtime_error("Native strands are not supported by OpenCL render engines: " +
+					scene->objDefs.GetSceneObject(i)->GetName());
 
 		bool isExistingInstance;
 		// TODO: Motion blur is not supported here (!)
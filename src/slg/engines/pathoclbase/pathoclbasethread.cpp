@@ -1087,6 +1087,9 @@ void PathOCLBaseRenderThread::InitKernels() {
 			break;
 		case ACCEL_EMBREE:
 			throw runtime_error("EMBREE accelerator is not supported in PathOCLBaseRenderThread::InitKernels()");
+		case ACCEL_BVH4:
+		case ACCEL_BVH8:
+			throw runtime_error("BVH4/BVH8 accelerators are not supported in PathOCLBaseRenderThread::InitKernels()");
 		default:
 			throw runtime_error("Unknown accelerator in PathOCLBaseRenderThread::InitKernels()");
 	}
@@ -94,6 +94,108 @@ void PathTracer::InitSampleResults(const Film *film, vector<SampleResult> &sampl
 	sampleResult.useFilmSplat = false;
 }
 
+bool PathTracer::GenerateDirectLightRay(const Scene *scene,
+		const float time,
+		const float u0, const float u1, const float u2,
+		const float u3, const BSDF &bsdf, const u_int pathVertexCount,
+		const SampleResult &sampleResult,
+		Ray *shadowRay, DirectLightSample *directLightSample) const {
+	if (bsdf.IsDelta())
+		return false;
+
+	// Select the light strategy to use
+	const LightStrategy *lightStrategy;
+	if (bsdf.IsShadowCatcherOnlyInfiniteLights())
+		lightStrategy = scene->lightDefs.GetInfiniteLightStrategy();
+	else
+		lightStrategy = scene->lightDefs.GetIlluminateLightStrategy();
+
+	// Pick a light source to sample
+	float lightPickPdf;
+	const LightSource *light = lightStrategy->SampleLights(u0, &lightPickPdf);
+	if (!light)
+		return false;
+
+	Vector lightRayDir;
+	float distance, directPdfW;
+	Spectrum lightRadiance = light->Illuminate(*scene, bsdf.hitPoint.p,
+			u1, u2, u3, &lightRayDir, &distance, &directPdfW);
+	assert (!lightRadiance.IsNaN() && !lightRadiance.IsInf());
+	if (lightRadiance.Black())
+		return false;
+	assert (!isnan(directPdfW) && !isinf(directPdfW));
+
+	BSDFEvent event;
+	float bsdfPdfW;
+	Spectrum bsdfEval = bsdf.Evaluate(lightRayDir, &event, &bsdfPdfW);
+	assert (!bsdfEval.IsNaN() && !bsdfEval.IsInf());
+	if (bsdfEval.Black())
+		return false;
+	assert (!isnan(bsdfPdfW) && !isinf(bsdfPdfW));
+
+	*shadowRay = Ray(bsdf.hitPoint.p, lightRayDir,
+			0.f,
+			distance,
+			time);
+	shadowRay->UpdateMinMaxWithEpsilon();
+
+	// Add the light contribution only if it is not a shadow catcher
+	// (because, if the light is visible, the material will be
+	// transparent in the case of a shadow catcher).
+	directLightSample->addContribution = !bsdf.IsShadowCatcher();
+	directLightSample->addIrradiance = false;
+	if (directLightSample->addContribution) {
+		// I'm ignoring volume emission because it is not sampled in
+		// direct light step.
+		const float directLightSamplingPdfW = directPdfW * lightPickPdf;
+		const float factor = 1.f / directLightSamplingPdfW;
+
+		// The +1 is there to account the current path vertex used for DL
+		if (pathVertexCount + 1 >= rrDepth) {
+			// Russian Roulette
+			bsdfPdfW *= RenderEngine::RussianRouletteProb(bsdfEval, rrImportanceCap);
+		}
+
+		// MIS between direct light sampling and BSDF sampling
+		//
+		// Note: I have to avoid MIS on the last path vertex
+		const float weight = (!sampleResult.lastPathVertex &&  (light->IsEnvironmental() || light->IsIntersectable())) ? 
+			PowerHeuristic(directLightSamplingPdfW, bsdfPdfW) : 1.f;
+
+		directLightSample->lightID = light->GetID();
+		directLightSample->event = event;
+		directLightSample->incomingRadiance = bsdfEval * (weight * factor) * lightRadiance;
+
+		// The first path vertex is not handled by AddDirectLight(). This is valid
+		// for irradiance AOV only if it is not a SPECULAR material.
+		//
+		// Note: irradiance samples the light sources only here (i.e. no
+		// direct hit, no MIS, it would be useless)
+		//
+		// Note: RR is ignored here because it can not happen on first path vertex
+		if ((sampleResult.firstPathVertex) && !(bsdf.GetEventTypes() & SPECULAR)) {
+			directLightSample->addIrradiance = true;
+			directLightSample->irradiance =
+					(INV_PI * fabsf(Dot(bsdf.hitPoint.shadeN, shadowRay->d)) *
+					factor) * lightRadiance;
+		}
+	}
+
+	return true;
+}
+
+void PathTracer::AddDirectLightSample(const DirectLightSample &directLightSample,
+		const Spectrum &pathThroughput, const Spectrum &connectionThroughput,
+		SampleResult *sampleResult) const {
+	if (directLightSample.addContribution) {
+		sampleResult->AddDirectLight(directLightSample.lightID, directLightSample.event,
+				pathThroughput, directLightSample.incomingRadiance * connectionThroughput, 1.f);
+
+		if (directLightSample.addIrradiance)
+			sampleResult->irradiance = directLightSample.irradiance * connectionThroughput;
+	}
+}
+
 bool PathTracer::DirectLightSampling(
 		luxrays::IntersectionDevice *device, const Scene *scene,
 		const float time,
@@ -102,90 +204,18 @@ bool PathTracer::DirectLightSampling(
 		const Spectrum &pathThroughput, const BSDF &bsdf,
 		PathVolumeInfo volInfo, const u_int pathVertexCount,
 		SampleResult *sampleResult) const {
-	if (!bsdf.IsDelta()) {
-		// Select the light strategy to use
-		const LightStrategy *lightStrategy;
-		if (bsdf.IsShadowCatcherOnlyInfiniteLights())
-			lightStrategy = scene->lightDefs.GetInfiniteLightStrategy();
-		else
-			lightStrategy = scene->lightDefs.GetIlluminateLightStrategy();
-		
-		// Pick a light source to sample
-		float lightPickPdf;
-		const LightSource *light = lightStrategy->SampleLights(u0, &lightPickPdf);
-
-		if (light) {
-			Vector lightRayDir;
-			float distance, directPdfW;
-			Spectrum lightRadiance = light->Illuminate(*scene, bsdf.hitPoint.p,
-					u1, u2, u3, &lightRayDir, &distance, &directPdfW);
-			assert (!lightRadiance.IsNaN() && !lightRadiance.IsInf());
-
-			if (!lightRadiance.Black()) {
-				assert (!isnan(directPdfW) && !isinf(directPdfW));
-
-				BSDFEvent event;
-				float bsdfPdfW;
-				Spectrum bsdfEval = bsdf.Evaluate(lightRayDir, &event, &bsdfPdfW);
-				assert (!bsdfEval.IsNaN() && !bsdfEval.IsInf());
-
-				if (!bsdfEval.Black()) {
-					assert (!isnan(bsdfPdfW) && !isinf(bsdfPdfW));
-
-					Ray shadowRay(bsdf.hitPoint.p, lightRayDir,
-							0.f,
-							distance,
-							time);
-					shadowRay.UpdateMinMaxWithEpsilon();
-					RayHit shadowRayHit;
-					BSDF shadowBsdf;
-					Spectrum connectionThroughput;
-					// Check if the light source is visible
-					if (!scene->Intersect(device, false, &volInfo, u4, &shadowRay,
-							&shadowRayHit, &shadowBsdf, &connectionThroughput)) {
-						// Add the light contribution only if it is not a shadow catcher
-						// (because, if the light is visible, the material will be
-						// transparent in the case of a shadow catcher).
-
-						if (!bsdf.IsShadowCatcher()) {
-							// I'm ignoring volume emission because it is not sampled in
-							// direct light step.
-							const float directLightSamplingPdfW = directPdfW * lightPickPdf;
-							const float factor = 1.f / directLightSamplingPdfW;
-
-							// The +1 is there to account the current path vertex used for DL
-							if (pathVertexCount + 1 >= rrDepth) {
-								// Russian Roulette
-								bsdfPdfW *= RenderEngine::RussianRouletteProb(bsdfEval, rrImportanceCap);
-							}
-
-							// MIS between direct light sampling and BSDF sampling
-							//
-							// Note: I have to avoid MIS on the last path vertex
-							const float weight = (!sampleResult->lastPathVertex &&  (light->IsEnvironmental() || light->IsIntersectable())) ? 
-								PowerHeuristic(directLightSamplingPdfW, bsdfPdfW) : 1.f;
-
-							const Spectrum incomingRadiance = bsdfEval * (weight * factor) * connectionThroughput * lightRadiance;
-
-							sampleResult->AddDirectLight(light->GetID(), event, pathThroughput, incomingRadiance, 1.f);
-
-							// The first path vertex is not handled by AddDirectLight(). This is valid
-							// for irradiance AOV only if it is not a SPECULAR material.
-							//
-							// Note: irradiance samples the light sources only here (i.e. no
-							// direct hit, no MIS, it would be useless)
-							//
-							// Note: RR is ignored here because it can not happen on first path vertex
-							if ((sampleResult->firstPathVertex) && !(bsdf.GetEventTypes() & SPECULAR))
-								sampleResult->irradiance =
-										(INV_PI * fabsf(Dot(bsdf.hitPoint.shadeN, shadowRay.d)) *
-										factor) * connectionThroughput * lightRadiance;
-						}
-
-						return true;
-					}
-				}
-			}
+	Ray shadowRay;
+	DirectLightSample directLightSample;
+	if (GenerateDirectLightRay(scene, time, u0, u1, u2, u3, bsdf,
+			pathVertexCount, *sampleResult, &shadowRay, &directLightSample)) {
+		Spectrum connectionThroughput;
+		// Check if the light source is visible
+		if (!scene->Occluded(device, false, &volInfo, u4, &shadowRay,
+				&connectionThroughput)) {
+			AddDirectLightSample(directLightSample, pathThroughput,
+					connectionThroughput, sampleResult);
+
+			return true;
 		}
 	}
 
@@ -257,10 +287,7 @@ void PathTracer::GenerateEyeRay(const Camera *camera, const Film *film, Ray &eye
 		sampler->GetSample(2), sampler->GetSample(3), sampler->GetSample(4));
 }
 
-void PathTracer::RenderSample(luxrays::IntersectionDevice *device, const Scene *scene, const Film *film,
-		Sampler *sampler, vector<SampleResult> &sampleResults) const {
-	SampleResult &sampleResult = sampleResults[0];
-
+void PathTracer::ClearSampleResult(SampleResult &sampleResult) const {
 	// Set to 0.0 all result colors
 	sampleResult.emission = Spectrum();
 	for (u_int i = 0; i < sampleResult.radiance.size(); ++i)
@@ -274,6 +301,136 @@ void PathTracer::RenderSample(luxrays::IntersectionDevice *device, const Scene *
 	sampleResult.indirectShadowMask = 1.f;
 	sampleResult.irradiance = Spectrum();
 	sampleResult.passThroughPath = true;
+}
+
+void PathTracer::HitNothing(const Scene *scene, const BSDFEvent lastBSDFEvent,
+		const Spectrum &pathThroughput, const Vector &eyeDir, const float lastPdfW,
+		SampleResult &sampleResult) const {
+	// Nothing was hit, look for env. lights
+	if (!forceBlackBackground || !sampleResult.passThroughPath)
+		DirectHitInfiniteLight(scene, lastBSDFEvent, pathThroughput, eyeDir,
+				lastPdfW, &sampleResult);
+
+	if (sampleResult.firstPathVertex) {
+		sampleResult.alpha = 0.f;
+		sampleResult.depth = std::numeric_limits<float>::infinity();
+		sampleResult.position = Point(
+				std::numeric_limits<float>::infinity(),
+				std::numeric_limits<float>::infinity(),
+				std::numeric_limits<float>::infinity());
+		sampleResult.geometryNormal = Normal(
+				std::numeric_limits<float>::infinity(),
+				std::numeric_limits<float>::infinity(),
+				std::numeric_limits<float>::infinity());
+		sampleResult.shadingNormal = Normal(
+				std::numeric_limits<float>::infinity(),
+				std::numeric_limits<float>::infinity(),
+				std::numeric_limits<float>::infinity());
+		sampleResult.materialID = std::numeric_limits<u_int>::max();
+		sampleResult.objectID = std::numeric_limits<u_int>::max();
+		sampleResult.uv = UV(std::numeric_limits<float>::infinity(),
+				std::numeric_limits<float>::infinity());
+	}
+}
+
+void PathTracer::HitObject(const Scene *scene, const BSDFEvent lastBSDFEvent,
+		const Spectrum &pathThroughput, const float distance, const BSDF &bsdf,
+		const float lastPdfW, const PathDepthInfo &depthInfo,
+		SampleResult &sampleResult) const {
+	// Something was hit
+	if (sampleResult.firstPathVertex) {
+		// The alpha value can be changed if the material is a shadow catcher (see below)
+		sampleResult.alpha = 1.f;
+		sampleResult.depth = distance;
+		sampleResult.position = bsdf.hitPoint.p;
+		sampleResult.geometryNormal = bsdf.hitPoint.geometryN;
+		sampleResult.shadingNormal = bsdf.hitPoint.shadeN;
+		sampleResult.materialID = bsdf.GetMaterialID();
+		sampleResult.objectID = bsdf.GetObjectID();
+		sampleResult.uv = bsdf.hitPoint.uv;
+	}
+	sampleResult.lastPathVertex = depthInfo.IsLastPathVertex(maxPathDepth, bsdf.GetEventTypes());
+
+	// Check if it is a light source
+	if (bsdf.IsLightSource()) {
+		DirectHitFiniteLight(scene, lastBSDFEvent, pathThroughput, distance,
+				bsdf, lastPdfW, &sampleResult);
+	}
+}
+
+bool PathTracer::GenerateNextVertexRay(Sampler *sampler, const u_int sampleOffset,
+		const BSDF &bsdf, const bool isLightVisible, Ray *eyeRay,
+		Spectrum *pathThroughput, float *lastPdfW, BSDFEvent *lastBSDFEvent,
+		PathVolumeInfo *volInfo, PathDepthInfo *depthInfo,
+		SampleResult &sampleResult) const {
+	Vector sampledDir;
+	float cosSampledDir;
+	Spectrum bsdfSample;
+	if (bsdf.IsShadowCatcher() && isLightVisible) {
+		bsdfSample = bsdf.ShadowCatcherSample(&sampledDir, lastPdfW, &cosSampledDir, lastBSDFEvent);
+
+		if (sampleResult.firstPathVertex) {
+			// In this case I have also to set the value of the alpha channel to 0.0
+			sampleResult.alpha = 0.f;
+		}
+	} else {
+		bsdfSample = bsdf.Sample(&sampledDir,
+				sampler->GetSample(sampleOffset + 6),
+				sampler->GetSample(sampleOffset + 7),
+				lastPdfW, &cosSampledDir, lastBSDFEvent);
+		sampleResult.passThroughPath = false;
+	}
+
+	assert (!bsdfSample.IsNaN() && !bsdfSample.IsInf());
+	if (bsdfSample.Black())
+		return false;
+	assert (!isnan(*lastPdfW) && !isinf(*lastPdfW));
+
+	if (sampleResult.firstPathVertex)
+		sampleResult.firstPathVertexEvent = *lastBSDFEvent;
+
+	Spectrum throughputFactor(1.f);
+	const float rrProb = RenderEngine::RussianRouletteProb(bsdfSample, rrImportanceCap);
+	if (depthInfo->diffuseDepth + depthInfo->glossyDepth + 1 >= rrDepth) {
+		// Russian Roulette
+		if (rrProb < sampler->GetSample(sampleOffset + 8))
+			return false;
+
+		// Increase path contribution
+		throughputFactor /= rrProb;
+	}
+
+	throughputFactor *= bsdfSample;
+
+	*pathThroughput *= throughputFactor;
+	assert (!pathThroughput->IsNaN() && !pathThroughput->IsInf());
+
+	// This is valid for irradiance AOV only if it is not a SPECULAR material and
+	// first path vertex. Set or update sampleResult.irradiancePathThroughput
+	if (sampleResult.firstPathVertex) {
+		if (!(bsdf.GetEventTypes() & SPECULAR))
+			sampleResult.irradiancePathThroughput = INV_PI * fabsf(Dot(bsdf.hitPoint.shadeN, sampledDir)) / rrProb;
+		else
+			sampleResult.irradiancePathThroughput = Spectrum();
+	} else
+		sampleResult.irradiancePathThroughput *= throughputFactor;
+
+	// Update volume information
+	volInfo->Update(*lastBSDFEvent, bsdf);
+
+	// Increment path depth informations
+	depthInfo->IncDepths(*lastBSDFEvent);
+
+	eyeRay->Update(bsdf.hitPoint.p, sampledDir);
+
+	return true;
+}
+
+void PathTracer::RenderSample(luxrays::IntersectionDevice *device, const Scene *scene, const Film *film,
+		Sampler *sampler, vector<SampleResult> &sampleResults) const {
+	SampleResult &sampleResult = sampleResults[0];
+
+	ClearSampleResult(sampleResult);
 
 	// To keep track of the number of rays traced
 	const double deviceRayCount = device->GetTotalRaysCount();
@@ -301,53 +458,13 @@ void PathTracer::RenderSample(luxrays::IntersectionDevice *device, const Scene *
 		// Note: pass-through check is done inside Scene::Intersect()
 
 		if (!hit) {
-			// Nothing was hit, look for env. lights
-			if (!forceBlackBackground || !sampleResult.passThroughPath)
-				DirectHitInfiniteLight(scene, lastBSDFEvent, pathThroughput, eyeRay.d,
-						lastPdfW, &sampleResult);
-
-			if (sampleResult.firstPathVertex) {
-				sampleResult.alpha = 0.f;
-				sampleResult.depth = std::numeric_limits<float>::infinity();
-				sampleResult.position = Point(
-						std::numeric_limits<float>::infinity(),
-						std::numeric_limits<float>::infinity(),
-						std::numeric_limits<float>::infinity());
-				sampleResult.geometryNormal = Normal(
-						std::numeric_limits<float>::infinity(),
-						std::numeric_limits<float>::infinity(),
-						std::numeric_limits<float>::infinity());
-				sampleResult.shadingNormal = Normal(
-						std::numeric_limits<float>::infinity(),
-						std::numeric_limits<float>::infinity(),
-						std::numeric_limits<float>::infinity());
-				sampleResult.materialID = std::numeric_limits<u_int>::max();
-				sampleResult.objectID = std::numeric_limits<u_int>::max();
-				sampleResult.uv = UV(std::numeric_limits<float>::infinity(),
-						std::numeric_limits<float>::infinity());
-			}
+			HitNothing(scene, lastBSDFEvent, pathThroughput, eyeRay.d,
+					lastPdfW, sampleResult);
 			break;
 		}
 
-		// Something was hit
-		if (sampleResult.firstPathVertex) {
-			// The alpha value can be changed if the material is a shadow catcher (see below)
-			sampleResult.alpha = 1.f;
-			sampleResult.depth = eyeRayHit.t;
-			sampleResult.position = bsdf.hitPoint.p;
-			sampleResult.geometryNormal = bsdf.hitPoint.geometryN;
-			sampleResult.shadingNormal = bsdf.hitPoint.shadeN;
-			sampleResult.materialID = bsdf.GetMaterialID();
-			sampleResult.objectID = bsdf.GetObjectID();
-			sampleResult.uv = bsdf.hitPoint.uv;
-		}
-		sampleResult.lastPathVertex = depthInfo.IsLastPathVertex(maxPathDepth, bsdf.GetEventTypes());
-
-		// Check if it is a light source
-		if (bsdf.IsLightSource()) {
-			DirectHitFiniteLight(scene, lastBSDFEvent, pathThroughput, eyeRayHit.t,
-					bsdf, lastPdfW, &sampleResult);
-		}
+		HitObject(scene, lastBSDFEvent, pathThroughput, eyeRayHit.t,
+				bsdf, lastPdfW, depthInfo, sampleResult);
 
 		//------------------------------------------------------------------
 		// Direct light sampling
@@ -377,65 +494,10 @@ void PathTracer::RenderSample(luxrays::IntersectionDevice *device, const Scene *
 		// Build the next vertex path ray
 		//------------------------------------------------------------------
 
-		Vector sampledDir;
-		float cosSampledDir;
-		Spectrum bsdfSample;
-		if (bsdf.IsShadowCatcher() && isLightVisible) {
-			bsdfSample = bsdf.ShadowCatcherSample(&sampledDir, &lastPdfW, &cosSampledDir, &lastBSDFEvent);
-
-			if (sampleResult.firstPathVertex) {
-				// In this case I have also to set the value of the alpha channel to 0.0
-				sampleResult.alpha = 0.f;
-			}
-		} else {
-			bsdfSample = bsdf.Sample(&sampledDir,
-					sampler->GetSample(sampleOffset + 6),
-					sampler->GetSample(sampleOffset + 7),
-					&lastPdfW, &cosSampledDir, &lastBSDFEvent);
-			sampleResult.passThroughPath = false;
-		}
-
-		assert (!bsdfSample.IsNaN() && !bsdfSample.IsInf());
-		if (bsdfSample.Black())
+		if (!GenerateNextVertexRay(sampler, sampleOffset, bsdf, isLightVisible,
+				&eyeRay, &pathThroughput, &lastPdfW, &lastBSDFEvent,
+				&volInfo, &depthInfo, sampleResult))
 			break;
-		assert (!isnan(lastPdfW) && !isinf(lastPdfW));
-
-		if (sampleResult.firstPathVertex)
-			sampleResult.firstPathVertexEvent = lastBSDFEvent;
-
-		Spectrum throughputFactor(1.f);
-		const float rrProb = RenderEngine::RussianRouletteProb(bsdfSample, rrImportanceCap);
-		if (depthInfo.diffuseDepth + depthInfo.glossyDepth + 1 >= rrDepth) {
-			// Russian Roulette
-			if (rrProb < sampler->GetSample(sampleOffset + 8))
-				break;
-
-			// Increase path contribution
-			throughputFactor /= rrProb;
-		}
-
-		throughputFactor *= bsdfSample;
-
-		pathThroughput *= throughputFactor;
-		assert (!pathThroughput.IsNaN() && !pathThroughput.IsInf());
-
-		// This is valid for irradiance AOV only if it is not a SPECULAR material and
-		// first path vertex. Set or update sampleResult.irradiancePathThroughput
-		if (sampleResult.firstPathVertex) {
-			if (!(bsdf.GetEventTypes() & SPECULAR))
-				sampleResult.irradiancePathThroughput = INV_PI * fabsf(Dot(bsdf.hitPoint.shadeN, sampledDir)) / rrProb;
-			else
-				sampleResult.irradiancePathThroughput = Spectrum();
-		} else
-			sampleResult.irradiancePathThroughput *= throughputFactor;
-
-		// Update volume information
-		volInfo.Update(lastBSDFEvent, bsdf);
-
-		// Increment path depth informations
-		depthInfo.IncDepths(lastBSDFEvent);
-
-		eyeRay.Update(bsdf.hitPoint.p, sampledDir);
 	}
 
 	sampleResult.rayCount = (float)(device->GetTotalRaysCount() - deviceRayCount);
@@ -18,6 +18,7 @@
 
 #include <limits>
 #include <boost/format.hpp>
+#include <boost/bind.hpp>
 #include <boost/thread/condition_variable.hpp>
 
 #include "slg/renderconfig.h"
@@ -48,6 +49,7 @@ RenderEngine::RenderEngine(const RenderConfig *cfg, Film *flm, boost::mutex *flm
 	pixelFilter = NULL;
 	film = flm;
 	filmMutex = flmMutex;
+	convergenceTestThread = NULL;
 	started = false;
 	editMode = false;
 	pauseMode = false;
@@ -130,6 +132,11 @@ void RenderEngine::Stop() {
 
 	ctx->Stop();
 
+	// The convergence test thread uses the film and the engine: it has to be
+	// done before to update the film, to edit it (BeginFilmEdit()) or to
+	// delete the engine
+	JoinConvergenceTestThread();
+
 	UpdateFilmLockLess();
 
 	delete pixelFilter;
@@ -156,7 +163,9 @@ void RenderEngine::EndSceneEdit(const EditActionList &editActions) {
 	bool contextStopped;
 	if (editActions.Has(GEOMETRY_EDIT) ||
 			(editActions.Has(GEOMETRY_TRANS_EDIT) &&
-			!renderConfig->scene->dataSet->DoesAllAcceleratorsSupportUpdate())) {
+			!renderConfig->scene->dataSet->DoesAllAcceleratorsSupportUpdate()) ||
+			(editActions.Has(GEOMETRY_REFIT_EDIT) &&
+			!renderConfig->scene->dataSet->DoesAllAcceleratorsSupportRefit())) {
 		// Stop all intersection devices
 		ctx->Stop();
 
@@ -177,7 +186,7 @@ void RenderEngine::EndSceneEdit(const EditActionList &editActions) {
 		// Restart all intersection devices
 		ctx->Start();
 	} else if (renderConfig->scene->dataSet->DoesAllAcceleratorsSupportUpdate() &&
-			editActions.Has(GEOMETRY_TRANS_EDIT)) {
+			(editActions.Has(GEOMETRY_TRANS_EDIT) || editActions.Has(GEOMETRY_REFIT_EDIT))) {
 		// Update the DataSet
 		ctx->UpdateDataSet();
 	}
@@ -246,11 +255,42 @@ Properties RenderEngine::ToProperties() const {
 }
 
 void RenderEngine::ResetConvergenceTest() {
+	// The result of a test still running is discarded
+	JoinConvergenceTestThread();
+
 	if (film->GetConvTestFlag())
 		film->ResetConvergenceTest();
 	convergence = 0.f;
 	lastConvergenceTestTime = WallClockTime();
 	lastConvergenceTestSamplesCount = 0;
+	convergenceTestTime = 0.0;
+	convergenceTestTotalTime = 0.0;
+}
+
+void RenderEngine::ConvergenceTestThread(const float threshold) {
+	const double startTime = WallClockTime();
+
+	{
+		// The test executes the image pipeline and writes the CONVERGENCE
+		// channel so it owns the film for its whole duration, like the film
+		// merge and the readers of the film. The engines merging per thread
+		// films in UpdateFilmLockLess() wait for the end of the test, only
+		// the ones rendering on a shared film keep going.
+		boost::unique_lock<boost::mutex> lock(*filmMutex);
+
+		convergenceTestTodoPixelsCount = film->RunConvergenceTest(threshold);
+	}
+
+	convergenceTestThreadTime = WallClockTime() - startTime;
+	convergenceTestDone = true;
+}
+
+void RenderEngine::JoinConvergenceTestThread() {
+	if (convergenceTestThread) {
+		convergenceTestThread->join();
+		delete convergenceTestThread;
+		convergenceTestThread = NULL;
+	}
 }
 
 void RenderEngine::RunConvergenceTest() {
@@ -258,10 +298,23 @@ void RenderEngine::RunConvergenceTest() {
 		const float haltthreshold = renderConfig->GetProperty("batch.haltthreshold").Get<float>();
 
 		if (haltthreshold >= 0.f) {
-			// Check if it is time to run the convergence test again
 			const u_int imgWidth = film->GetWidth();
 			const u_int imgHeight = film->GetHeight();
 			const u_int pixelCount = imgWidth * imgHeight;
+
+			if (convergenceTestThread) {
+				// Nothing to do until the last test is done
+				if (!convergenceTestDone)
+					return;
+
+				JoinConvergenceTestThread();
+
+				convergence = 1.f - convergenceTestTodoPixelsCount / (float)pixelCount;
+				convergenceTestTime = convergenceTestThreadTime;
+				convergenceTestTotalTime += convergenceTestTime;
+			}
+
+			// Check if it is time to run the convergence test again
 			const double now = WallClockTime();
 
 			// Do not run the test if we don't have at least batch.haltthreshold.step new samples per pixel
@@ -269,9 +322,12 @@ void RenderEngine::RunConvergenceTest() {
 
 			if ((samplesCount  - lastConvergenceTestSamplesCount > pixelCount * testStep) &&
 					((now - lastConvergenceTestTime) * 1000.0 >= renderConfig->GetProperty("screen.refresh.interval").Get<u_int>())) {
-				convergence = 1.f - film->RunConvergenceTest(haltthreshold) / (float)pixelCount;
 				lastConvergenceTestTime = now;
 				lastConvergenceTestSamplesCount = samplesCount;
+
+				convergenceTestDone = false;
+				convergenceTestThread = new boost::thread(boost::bind(&RenderEngine::ConvergenceTestThread,
+						this, haltthreshold));
 			}
 		}
 	}
@@ -360,4 +416,5 @@ OBJECTSTATICREGISTRY_REGISTER(RenderEngineRegistry, TilePathCPURenderEngine);
 OBJECTSTATICREGISTRY_REGISTER(RenderEngineRegistry, TilePathOCLRenderEngine);
 #endif
 OBJECTSTATICREGISTRY_REGISTER(RenderEngineRegistry, RTPathCPURenderEngine);
+OBJECTSTATICREGISTRY_REGISTER(RenderEngineRegistry, WavefrontPathCPURenderEngine);
 // Just add here any new RenderEngine (don't forget in the .h too)
@@ -0,0 +1,100 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+#include "slg/slg.h"
+#include "slg/engines/wavefrontpathcpu/wavefrontpathcpu.h"
+
+using namespace std;
+using namespace luxrays;
+using namespace slg;
+
+//------------------------------------------------------------------------------
+// WavefrontPathCPURenderEngine
+//------------------------------------------------------------------------------
+
+WavefrontPathCPURenderEngine::WavefrontPathCPURenderEngine(const RenderConfig *rcfg, Film *flm, boost::mutex *flmMutex) :
+		PathCPURenderEngine(rcfg, flm, flmMutex) {
+	const Properties &cfg = renderConfig->cfg;
+	pathCount = Max(1u, cfg.Get(GetDefaultProps().Get("wavefrontpathcpu.paths.count")).Get<u_int>());
+	groupCount = Min(pathCount, Max(1u, cfg.Get(GetDefaultProps().Get("wavefrontpathcpu.groups.count")).Get<u_int>()));
+
+	// Each render thread has its own intersection thread, busy tracing a group
+	// of paths while the render thread shades another one: use half of the
+	// native.threads.count render threads so the total number of busy threads
+	// stays the same
+	const size_t renderThreadCount = Max<size_t>(1, renderThreads.size() / 2);
+	renderThreads.resize(renderThreadCount, NULL);
+	threadCPUs.resize(renderThreadCount);
+	SLG_LOG("Wavefront render threads: " << renderThreadCount << " (plus one intersection thread each)");
+
+	// The rays are traced with the data parallel interface of the devices. The
+	// devices of the dropped render threads keep the data parallel support
+	// disabled so they don't start any intersection thread.
+	for (size_t i = 0; i < renderThreadCount; ++i) {
+		NativeThreadIntersectionDevice *device = (NativeThreadIntersectionDevice *)intersectionDevices[i];
+
+		device->SetDataParallelSupport(true);
+		// One intersection thread for each render thread is enough: a group of
+		// paths is shaded while the rays of the others are traced
+		device->SetThreadCount(1);
+		device->SetQueueCount(1);
+		device->SetBufferCount(groupCount);
+	}
+}
+
+WavefrontPathCPURenderEngine::~WavefrontPathCPURenderEngine() {
+}
+
+void WavefrontPathCPURenderEngine::StartLockLess() {
+	SLG_LOG("Wavefront paths for each render thread: " << pathCount << " (in " << groupCount << " groups)");
+
+	PathCPURenderEngine::StartLockLess();
+}
+
+//------------------------------------------------------------------------------
+// Static methods used by RenderEngineRegistry
+//------------------------------------------------------------------------------
+
+Properties WavefrontPathCPURenderEngine::ToProperties(const Properties &cfg) {
+	return PathCPURenderEngine::ToProperties(cfg) <<
+			//------------------------------------------------------------------
+			// Overwrite some PathCPURenderEngine property
+			//------------------------------------------------------------------
+			cfg.Get(GetDefaultProps().Get("renderengine.type")) <<
+			//------------------------------------------------------------------
+			cfg.Get(GetDefaultProps().Get("wavefrontpathcpu.paths.count")) <<
+			cfg.Get(GetDefaultProps().Get("wavefrontpathcpu.groups.count"));
+}
+
+RenderEngine *WavefrontPathCPURenderEngine::FromProperties(const RenderConfig *rcfg, Film *flm, boost::mutex *flmMutex) {
+	return new WavefrontPathCPURenderEngine(rcfg, flm, flmMutex);
+}
+
+const Properties &WavefrontPathCPURenderEngine::GetDefaultProps() {
+	static Properties props = Properties() <<
+			PathCPURenderEngine::GetDefaultProps() <<
+			//------------------------------------------------------------------
+			// Overwrite some PathCPURenderEngine property
+			//------------------------------------------------------------------
+			Property("renderengine.type")(GetObjectTag()) <<
+			//------------------------------------------------------------------
+			Property("wavefrontpathcpu.paths.count")(2048u) <<
+			Property("wavefrontpathcpu.groups.count")(2u);
+
+	return props;
+}
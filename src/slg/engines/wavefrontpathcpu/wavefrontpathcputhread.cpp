@@ -0,0 +1,386 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+#include <algorithm>
+
+#include "slg/slg.h"
+#include "slg/engines/wavefrontpathcpu/wavefrontpathcpu.h"
+#include "slg/volumes/volume.h"
+
+using namespace std;
+using namespace luxrays;
+using namespace slg;
+
+//------------------------------------------------------------------------------
+// WavefrontPathCPURenderThread
+//------------------------------------------------------------------------------
+
+WavefrontPathCPURenderThread::WavefrontPathCPURenderThread(WavefrontPathCPURenderEngine *engine,
+		const u_int index, IntersectionDevice *device) :
+		PathCPURenderThread(engine, index, device), groupSize(0), samplesCount(0) {
+}
+
+WavefrontPathCPURenderThread::~WavefrontPathCPURenderThread() {
+	FreePaths();
+}
+
+void WavefrontPathCPURenderThread::InitPaths(RandomGenerator *rndGen) {
+	WavefrontPathCPURenderEngine *engine = (WavefrontPathCPURenderEngine *)renderEngine;
+	const PathTracer &pathTracer = engine->pathTracer;
+
+	groupSize = Max(1u, engine->pathCount / engine->groupCount);
+
+	// Each path has its own sampler because many samples are rendered at
+	// the same time
+	paths.resize(groupSize * engine->groupCount);
+	for (u_int i = 0; i < paths.size(); ++i) {
+		WavefrontPath &path = paths[i];
+
+		path.state = GENERATE_CAMERA_RAY;
+		path.sampler = engine->renderConfig->AllocSampler(rndGen, threadFilm, NULL,
+				engine->samplerSharedData);
+		path.sampler->RequestSamples(pathTracer.sampleSize);
+		path.sampleResults.resize(1);
+		pathTracer.InitSampleResults(engine->film, path.sampleResults);
+	}
+
+	pathIndices.resize(groupSize);
+
+	rayBuffers.resize(engine->groupCount);
+	for (u_int i = 0; i < engine->groupCount; ++i)
+		rayBuffers[i] = device->NewRayBuffer(groupSize);
+
+	samplesCount = 0;
+}
+
+void WavefrontPathCPURenderThread::FreePaths() {
+	for (u_int i = 0; i < paths.size(); ++i)
+		delete paths[i].sampler;
+	paths.clear();
+
+	for (u_int i = 0; i < rayBuffers.size(); ++i)
+		delete rayBuffers[i];
+	rayBuffers.clear();
+}
+
+void WavefrontPathCPURenderThread::SetNextVertexRay(WavefrontPath &path) {
+	const PathTracer &pathTracer = ((WavefrontPathCPURenderEngine *)renderEngine)->pathTracer;
+
+	path.sampleResults[0].firstPathVertex = (path.depthInfo.depth == 0);
+	path.passThrough = path.sampler->GetSample(pathTracer.sampleBootSize +
+			path.depthInfo.depth * pathTracer.sampleStepSize);
+	path.originalMaxT = path.ray.maxt;
+	path.connectionThroughput = Spectrum(1.f);
+
+	path.state = RT_NEXT_VERTEX;
+}
+
+//------------------------------------------------------------------------------
+// Evaluation of the path finite state machine.
+//
+// From: RT_NEXT_VERTEX
+// To: HIT_NOTHING or HIT_OBJECT or RT_NEXT_VERTEX
+//
+// From: RT_DL
+// To: SPLAT_SAMPLE or GENERATE_NEXT_VERTEX_RAY or RT_DL
+//------------------------------------------------------------------------------
+
+void WavefrontPathCPURenderThread::EvaluateRayHit(WavefrontPath &path, RayHit &rayHit) {
+	WavefrontPathCPURenderEngine *engine = (WavefrontPathCPURenderEngine *)renderEngine;
+	const Scene *scene = engine->renderConfig->scene;
+	SampleResult &sampleResult = path.sampleResults[0];
+
+	switch (path.state) {
+		case RT_NEXT_VERTEX: {
+			bool hit;
+			if (scene->EvaluateTracedRay(false, &path.volInfo, &path.passThrough,
+					path.originalMaxT, &path.ray, &rayHit, &path.bsdf,
+					&path.connectionThroughput, &path.pathThroughput,
+					&sampleResult, &hit)) {
+				// I have to trace the ray again (i.e. pass-through material)
+				break;
+			}
+			path.pathThroughput *= path.connectionThroughput;
+			path.hitDistance = rayHit.t;
+
+			path.state = hit ? HIT_OBJECT : HIT_NOTHING;
+			break;
+		}
+		case RT_DL: {
+			bool occluded;
+			if (path.dlAnyHit)
+				occluded = !rayHit.Miss();
+			else if (scene->EvaluateTracedRay(false, &path.dlVolInfo, &path.dlPassThrough,
+					path.dlOriginalMaxT, &path.shadowRay, &rayHit, &dlBSDF,
+					&path.dlConnectionThroughput, NULL, NULL, &occluded)) {
+				// I have to trace the shadow ray again (i.e. pass-through material)
+				break;
+			}
+
+			path.isLightVisible = !occluded;
+			if (path.isLightVisible)
+				engine->pathTracer.AddDirectLightSample(path.directLightSample,
+						path.pathThroughput, path.dlConnectionThroughput, &sampleResult);
+
+			path.state = sampleResult.lastPathVertex ? SPLAT_SAMPLE : GENERATE_NEXT_VERTEX_RAY;
+			break;
+		}
+		default:
+			throw runtime_error("Unknown path state in WavefrontPathCPURenderThread::EvaluateRayHit(): " + ToString(path.state));
+	}
+}
+
+//------------------------------------------------------------------------------
+// Evaluation of the path finite state machine until the path needs a new ray
+// to be traced.
+//
+// From: any state
+// To: RT_NEXT_VERTEX or RT_DL
+//------------------------------------------------------------------------------
+
+const Ray &WavefrontPathCPURenderThread::AdvancePath(WavefrontPath &path,
+		VarianceClamping &varianceClamping) {
+	WavefrontPathCPURenderEngine *engine = (WavefrontPathCPURenderEngine *)renderEngine;
+	const PathTracer &pathTracer = engine->pathTracer;
+	const Scene *scene = engine->renderConfig->scene;
+	SampleResult &sampleResult = path.sampleResults[0];
+
+	for (;;) {
+		const u_int sampleOffset = pathTracer.sampleBootSize + path.depthInfo.depth * pathTracer.sampleStepSize;
+
+		switch (path.state) {
+			case RT_NEXT_VERTEX:
+				++(path.rayCount);
+				return path.ray;
+			case RT_DL:
+				++(path.rayCount);
+				return path.shadowRay;
+			case HIT_NOTHING:
+				pathTracer.HitNothing(scene, path.lastBSDFEvent, path.pathThroughput,
+						path.ray.d, path.lastPdfW, sampleResult);
+
+				path.state = SPLAT_SAMPLE;
+				break;
+			case HIT_OBJECT: {
+				pathTracer.HitObject(scene, path.lastBSDFEvent, path.pathThroughput,
+						path.hitDistance, path.bsdf, path.lastPdfW, path.depthInfo,
+						sampleResult);
+
+				// I avoid to do DL on the last vertex otherwise it introduces a lot of
+				// noise because I can not use MIS (see PathTracer::RenderSample())
+				if (sampleResult.lastPathVertex && !sampleResult.firstPathVertex) {
+					path.state = SPLAT_SAMPLE;
+					break;
+				}
+
+				if (pathTracer.GenerateDirectLightRay(scene, path.ray.time,
+						path.sampler->GetSample(sampleOffset + 1),
+						path.sampler->GetSample(sampleOffset + 2),
+						path.sampler->GetSample(sampleOffset + 3),
+						path.sampler->GetSample(sampleOffset + 4),
+						path.bsdf, path.depthInfo.depth + 1, sampleResult,
+						&path.shadowRay, &path.directLightSample)) {
+					path.dlVolInfo = path.volInfo;
+					path.dlPassThrough = path.sampler->GetSample(sampleOffset + 5);
+					path.dlOriginalMaxT = path.shadowRay.maxt;
+					path.dlConnectionThroughput = Spectrum(1.f);
+					// Any hit is an opaque one when there are no volumes and
+					// pass-through materials (see Scene::Occluded())
+					path.dlAnyHit = scene->UseAnyHitShadowRays() && !path.dlVolInfo.GetCurrentVolume();
+
+					path.state = RT_DL;
+				} else {
+					path.isLightVisible = false;
+					path.state = sampleResult.lastPathVertex ? SPLAT_SAMPLE : GENERATE_NEXT_VERTEX_RAY;
+				}
+				break;
+			}
+			case GENERATE_NEXT_VERTEX_RAY:
+				if (pathTracer.GenerateNextVertexRay(path.sampler, sampleOffset,
+						path.bsdf, path.isLightVisible, &path.ray,
+						&path.pathThroughput, &path.lastPdfW, &path.lastBSDFEvent,
+						&path.volInfo, &path.depthInfo, sampleResult))
+					SetNextVertexRay(path);
+				else
+					path.state = SPLAT_SAMPLE;
+				break;
+			case SPLAT_SAMPLE:
+				sampleResult.rayCount = path.rayCount;
+
+				// Variance clamping
+				if (varianceClamping.hasClamping())
+					varianceClamping.Clamp(*threadFilm, sampleResult);
+
+				path.sampler->NextSample(path.sampleResults);
+				++samplesCount;
+
+				path.state = GENERATE_CAMERA_RAY;
+				break;
+			case GENERATE_CAMERA_RAY:
+				pathTracer.ClearSampleResult(sampleResult);
+				pathTracer.GenerateEyeRay(scene->camera, threadFilm, path.ray,
+						path.sampler, sampleResult);
+
+				path.lastBSDFEvent = SPECULAR; // SPECULAR is required to avoid MIS
+				path.lastPdfW = 1.f;
+				path.pathThroughput = Spectrum(1.f);
+				path.volInfo = PathVolumeInfo();
+				path.depthInfo = PathDepthInfo();
+				path.rayCount = 0;
+
+				SetNextVertexRay(path);
+				break;
+			default:
+				throw runtime_error("Unknown path state in WavefrontPathCPURenderThread::AdvancePath(): " + ToString(path.state));
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+// Used to sort the paths of a group by state and by material so the paths
+// running the same code are shaded together
+//------------------------------------------------------------------------------
+
+class WavefrontPathCPURenderThread::PathShadingOrder {
+public:
+	PathShadingOrder(const WavefrontPath *p) : paths(p) { }
+
+	bool operator()(const u_int a, const u_int b) const {
+		return GetKey(paths[a]) < GetKey(paths[b]);
+	}
+
+private:
+	static u_int GetKey(const WavefrontPath &path) {
+		return (path.state == HIT_OBJECT) ?
+			((path.state << 16) | path.bsdf.GetMaterialType()) : (path.state << 16);
+	}
+
+	const WavefrontPath *paths;
+};
+
+void WavefrontPathCPURenderThread::FillRayBuffer(const u_int group, RayBuffer *rayBuffer,
+		VarianceClamping &varianceClamping) {
+	WavefrontPath *groupPaths = &paths[group * groupSize];
+
+	for (u_int i = 0; i < groupSize; ++i)
+		pathIndices[i] = i;
+	sort(pathIndices.begin(), pathIndices.end(), PathShadingOrder(groupPaths));
+
+	// Each path has always exactly one ray to trace and the rays are stored
+	// in the RayBuffer with the same order of the paths
+	rayBuffer->Reset();
+	Ray *rays = rayBuffer->GetRayBuffer();
+	for (u_int i = 0; i < groupSize; ++i) {
+		const u_int pathIndex = pathIndices[i];
+
+		rays[pathIndex] = AdvancePath(groupPaths[pathIndex], varianceClamping);
+		rayBuffer->ReserveRay();
+	}
+}
+
+void WavefrontPathCPURenderThread::WavefrontRenderFunc() {
+	//SLG_LOG("[WavefrontPathCPURenderEngine::" << threadIndex << "] Rendering thread started");
+
+	//--------------------------------------------------------------------------
+	// Initialization
+	//--------------------------------------------------------------------------
+
+	WavefrontPathCPURenderEngine *engine = (WavefrontPathCPURenderEngine *)renderEngine;
+	const PathTracer &pathTracer = engine->pathTracer;
+	// (engine->seedBase + 1) seed is used for sharedRndGen
+	RandomGenerator *rndGen = new RandomGenerator(engine->seedBase + 1 + threadIndex);
+
+	InitPaths(rndGen);
+
+	VarianceClamping varianceClamping(pathTracer.sqrtVarianceClampMaxValue);
+
+	//--------------------------------------------------------------------------
+	// Trace paths
+	//--------------------------------------------------------------------------
+
+	// I can not use engine->renderConfig->GetProperty() here because the
+	// RenderConfig properties cache is not thread safe
+	const u_int filmWidth = threadFilm->GetWidth();
+	const u_int filmHeight = threadFilm->GetHeight();
+	const u_int haltDebug = engine->renderConfig->cfg.Get(Property("batch.haltdebug")(0u)).Get<u_int>() *
+		filmWidth * filmHeight;
+
+	// Start to trace the rays of all groups
+	for (u_int i = 0; i < rayBuffers.size(); ++i) {
+		FillRayBuffer(i, rayBuffers[i], varianceClamping);
+		device->PushRayBuffer(rayBuffers[i]);
+	}
+	u_int pendingRayBuffers = rayBuffers.size();
+
+	try {
+		while (!boost::this_thread::interruption_requested()) {
+			// Check if we are in pause mode
+			if (engine->pauseMode) {
+				// Check every 100ms if I have to continue the rendering
+				while (!boost::this_thread::interruption_requested() && engine->pauseMode)
+					boost::this_thread::sleep(boost::posix_time::millisec(100));
+
+				if (boost::this_thread::interruption_requested())
+					break;
+			}
+
+			// The RayBuffers are returned in the same order they were pushed
+			for (u_int i = 0; i < rayBuffers.size(); ++i) {
+				RayBuffer *rayBuffer = device->PopRayBuffer();
+				--pendingRayBuffers;
+				assert (rayBuffer == rayBuffers[i]);
+
+				// Shade the group while the rays of the other groups are traced
+				WavefrontPath *groupPaths = &paths[i * groupSize];
+				RayHit *rayHits = rayBuffer->GetHitBuffer();
+				for (u_int j = 0; j < groupSize; ++j)
+					EvaluateRayHit(groupPaths[j], rayHits[j]);
+
+				FillRayBuffer(i, rayBuffer, varianceClamping);
+
+				device->PushRayBuffer(rayBuffer);
+				++pendingRayBuffers;
+			}
+
+#ifdef WIN32
+			// Work around Windows bad scheduling
+			renderThread->yield();
+#endif
+
+			// Check halt conditions
+			if ((haltDebug > 0u) && (samplesCount >= haltDebug))
+				break;
+			if (engine->convergence == 1.f)
+				break;
+		}
+	} catch (boost::thread_interrupted) {
+		// Nothing to do, I have just to wait for the pending RayBuffers
+	}
+
+	// The RayBuffers can be freed only after the device has done with them
+	{
+		boost::this_thread::disable_interruption disableInterruption;
+		for (; pendingRayBuffers > 0; --pendingRayBuffers)
+			device->PopRayBuffer();
+	}
+
+	FreePaths();
+	delete rndGen;
+
+	//SLG_LOG("[WavefrontPathCPURenderEngine::" << threadIndex << "] Rendering thread halted");
+}
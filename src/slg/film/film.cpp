@@ -22,9 +22,11 @@
 
 #include <boost/lexical_cast.hpp>
 #include <boost/foreach.hpp>
+#include <boost/bind.hpp>
 
 #include "luxrays/core/geometry/point.h"
 #include "luxrays/utils/properties.h"
+#include "luxrays/utils/taskscheduler.h"
 #include "slg/film/film.h"
 #include "slg/film/sampleresult.h"
 #include "slg/editaction.h"
@@ -70,11 +72,22 @@ Film::Film() {
 	channel_IRRADIANCE = NULL;
 	channel_OBJECT_ID = NULL;
 	channel_FRAMEBUFFER_MASK = NULL;
+	channel_CONVERGENCE = NULL;
 
 	convTest = NULL;
+	asyncImagePipeline = NULL;
+
+	tileLocks = NULL;
+	tileLocksCountX = 0;
+
+	dirtyTileSerials = NULL;
+	dirtyTilesCountX = 0;
+	dirtyTilesCountY = 0;
+	dirtyTilesTracking = false;
 
 	enabledConvTest = false;
 	enabledOverlappedScreenBufferUpdate = true;
+	enabledAsyncImagePipeline = false;
 
 	// Initialize variables to NULL
 	SetUpOCL();
@@ -117,17 +130,31 @@ Film::Film(const u_int w, const u_int h, const u_int *sr) {
 	channel_IRRADIANCE = NULL;
 	channel_OBJECT_ID = NULL;
 	channel_FRAMEBUFFER_MASK = NULL;
+	channel_CONVERGENCE = NULL;
 
 	convTest = NULL;
+	asyncImagePipeline = NULL;
+
+	tileLocks = NULL;
+	tileLocksCountX = 0;
+
+	dirtyTileSerials = NULL;
+	dirtyTilesCountX = 0;
+	dirtyTilesCountY = 0;
+	dirtyTilesTracking = false;
 
 	enabledConvTest = false;
 	enabledOverlappedScreenBufferUpdate = true;
+	enabledAsyncImagePipeline = false;
 
 	// Initialize variables to NULL
 	SetUpOCL();
 }
 
 Film::~Film() {
+	// The worker thread has to be stopped before to free anything
+	DeleteAsyncImagePipeline();
+
 	BOOST_FOREACH(ImagePipeline *ip, imagePipelines)
 		delete ip;
 
@@ -138,6 +165,8 @@ Film::~Film() {
 #endif
 
 	delete convTest;
+	delete[] tileLocks;
+	delete[] dirtyTileSerials;
 
 	FreeChannels();
 }
@@ -176,9 +205,148 @@ void Film::FreeChannels() {
 	for (u_int i = 0; i < channel_BY_OBJECT_IDs.size(); ++i)
 		delete channel_BY_OBJECT_IDs[i];
 	delete channel_FRAMEBUFFER_MASK;
+	delete channel_CONVERGENCE;
+}
+
+void Film::AllocTileLocks() {
+	delete[] tileLocks;
+
+	tileLocksCountX = (width + THREADSAFE_TILE_SIZE - 1) / THREADSAFE_TILE_SIZE;
+	const u_int tileLocksCountY = (height + THREADSAFE_TILE_SIZE - 1) / THREADSAFE_TILE_SIZE;
+	tileLocks = new boost::mutex[Max(1u, tileLocksCountX * tileLocksCountY)];
+}
+
+void Film::LockTileRows(const u_int firstRow, const u_int lastRow) const {
+	if (!tileLocks || (firstRow >= lastRow))
+		return;
+
+	// Always in the same order, so concurrent readers can not deadlock. The
+	// writers own only one lock at time.
+	const u_int first = (firstRow / THREADSAFE_TILE_SIZE) * tileLocksCountX;
+	const u_int last = ((lastRow - 1) / THREADSAFE_TILE_SIZE + 1) * tileLocksCountX;
+	for (u_int i = first; i < last; ++i)
+		tileLocks[i].lock();
+}
+
+void Film::UnlockTileRows(const u_int firstRow, const u_int lastRow) const {
+	if (!tileLocks || (firstRow >= lastRow))
+		return;
+
+	const u_int first = (firstRow / THREADSAFE_TILE_SIZE) * tileLocksCountX;
+	const u_int last = ((lastRow - 1) / THREADSAFE_TILE_SIZE + 1) * tileLocksCountX;
+	for (u_int i = first; i < last; ++i)
+		tileLocks[i].unlock();
+}
+
+void Film::AllocDirtyTiles() {
+	dirtyTilesCountX = (width + IMAGEPIPELINE_TILE_SIZE - 1) / IMAGEPIPELINE_TILE_SIZE;
+	dirtyTilesCountY = (height + IMAGEPIPELINE_TILE_SIZE - 1) / IMAGEPIPELINE_TILE_SIZE;
+	const u_int tileCount = Max(1u, dirtyTilesCountX * dirtyTilesCountY);
+
+	delete[] dirtyTileSerials;
+	dirtyTileSerials = new boost::atomic<u_int>[tileCount];
+	for (u_int i = 0; i < tileCount; ++i)
+		dirtyTileSerials[i] = 0;
+
+	InvalidateImagePipelines();
+}
+
+void Film::DeleteAsyncImagePipeline() {
+	// The snapshot used by the worker has to be created again with the new
+	// film settings
+	delete asyncImagePipeline;
+	asyncImagePipeline = NULL;
+}
+
+void Film::MarkDirtyRegion(const u_int xStart, const u_int xEnd,
+		const u_int yStart, const u_int yEnd) {
+	if (!dirtyTilesTracking || (xStart >= xEnd) || (yStart >= yEnd))
+		return;
+
+	const u_int tileXEnd = (xEnd - 1) / IMAGEPIPELINE_TILE_SIZE;
+	const u_int tileYEnd = (yEnd - 1) / IMAGEPIPELINE_TILE_SIZE;
+	for (u_int tileY = yStart / IMAGEPIPELINE_TILE_SIZE; tileY <= tileYEnd; ++tileY) {
+		for (u_int tileX = xStart / IMAGEPIPELINE_TILE_SIZE; tileX <= tileXEnd; ++tileX)
+			++dirtyTileSerials[tileY * dirtyTilesCountX + tileX];
+	}
+}
+
+bool Film::GetDirtyRegions(const u_int index, vector<u_int> &regions) {
+	if (index >= imagePipelineTileSerials.size())
+		imagePipelineTileSerials.resize(index + 1);
+	vector<u_int> &lastSerials = imagePipelineTileSerials[index];
+
+	// The serials are read before the pixels are merged: the pixels modified
+	// from now on will be processed by the next execution
+	const u_int tileCount = dirtyTilesCountX * dirtyTilesCountY;
+	if (lastSerials.size() != tileCount) {
+		// The first execution merges all the pixels so the tracking can
+		// start now
+		dirtyTilesTracking = true;
+
+		lastSerials.resize(tileCount);
+		for (u_int i = 0; i < tileCount; ++i)
+			lastSerials[i] = dirtyTileSerials[i];
+
+		return false;
+	}
+
+	// Each region is a run of consecutive dirty tiles of the same row of tiles
+	regions.clear();
+	u_int dirtyTileCount = 0;
+	for (u_int tileY = 0; tileY < dirtyTilesCountY; ++tileY) {
+		const boost::atomic<u_int> *serials = &dirtyTileSerials[tileY * dirtyTilesCountX];
+		u_int *rowLastSerials = &lastSerials[tileY * dirtyTilesCountX];
+
+		u_int tileX = 0;
+		while (tileX < dirtyTilesCountX) {
+			u_int serial = serials[tileX];
+			if (serial == rowLastSerials[tileX]) {
+				++tileX;
+				continue;
+			}
+
+			const u_int runStart = tileX;
+			while (serial != rowLastSerials[tileX]) {
+				rowLastSerials[tileX] = serial;
+				if (++tileX == dirtyTilesCountX)
+					break;
+				serial = serials[tileX];
+			}
+			dirtyTileCount += tileX - runStart;
+
+			regions.push_back(runStart * IMAGEPIPELINE_TILE_SIZE);
+			regions.push_back(Min(tileX * IMAGEPIPELINE_TILE_SIZE, width));
+			regions.push_back(tileY * IMAGEPIPELINE_TILE_SIZE);
+			regions.push_back(Min((tileY + 1) * IMAGEPIPELINE_TILE_SIZE, height));
+		}
+	}
+
+	// It is not worth when most of the film has been modified
+	return (2 * dirtyTileCount <= dirtyTilesCountX * dirtyTilesCountY);
+}
+
+void Film::SetThreadSafeFlag(const bool enabled) {
+	if (enabled) {
+		if (!tileLocks)
+			AllocTileLocks();
+	} else {
+		delete[] tileLocks;
+		tileLocks = NULL;
+		tileLocksCountX = 0;
+	}
+}
+
+void Film::SetAsyncImagePipelineFlag(const bool enabled) {
+	enabledAsyncImagePipeline = enabled;
+
+	if (!enabled)
+		DeleteAsyncImagePipeline();
 }
 
 void Film::SetImagePipelines(ImagePipeline *newImagePiepeline) {
+	DeleteAsyncImagePipeline();
+
 	BOOST_FOREACH(ImagePipeline *ip, imagePipelines)
 		delete ip;
 
@@ -187,17 +355,28 @@ void Film::SetImagePipelines(ImagePipeline *newImagePiepeline) {
 		imagePipelines[0] = newImagePiepeline;
 	} else
 		imagePipelines.resize(0);
+
+	InvalidateImagePipelines();
 }
 
 void Film::SetImagePipelines(std::vector<ImagePipeline *> &newImagePiepelines) {
+	DeleteAsyncImagePipeline();
+
 	BOOST_FOREACH(ImagePipeline *ip, imagePipelines)
 		delete ip;
 
 	imagePipelines = newImagePiepelines;
+
+	InvalidateImagePipelines();
 }
 
 void Film::CopyDynamicSettings(const Film &film) {
+	DeleteAsyncImagePipeline();
+
 	channels = film.channels;
+	// The convergence test is run only on the engine film and the samplers
+	// read the CONVERGENCE channel from there
+	channels.erase(CONVERGENCE);
 	maskMaterialIDs = film.maskMaterialIDs;
 	byMaterialIDs = film.byMaterialIDs;
 	maskObjectIDs = film.maskObjectIDs;
@@ -255,6 +434,147 @@ void Film::RemoveChannel(const FilmChannelType type) {
 	channels.erase(type);
 }
 
+bool Film::IsChannelStorageSupported(const FilmChannelType type, const FrameBufferStorageType storage) {
+	switch (storage) {
+		case FRAMEBUFFER_STORAGE_FLOAT:
+			return true;
+		case FRAMEBUFFER_STORAGE_HALF:
+			switch (type) {
+				case ALPHA:
+				case GEOMETRY_NORMAL:
+				case SHADING_NORMAL:
+				case DIRECT_DIFFUSE:
+				case DIRECT_GLOSSY:
+				case EMISSION:
+				case INDIRECT_DIFFUSE:
+				case INDIRECT_GLOSSY:
+				case INDIRECT_SPECULAR:
+				case MATERIAL_ID_MASK:
+				case DIRECT_SHADOW_MASK:
+				case INDIRECT_SHADOW_MASK:
+				case UV:
+				case BY_MATERIAL_ID:
+				case IRRADIANCE:
+				case OBJECT_ID_MASK:
+				case BY_OBJECT_ID:
+					return true;
+				default:
+					return false;
+			}
+		case FRAMEBUFFER_STORAGE_BYTE:
+			switch (type) {
+				case MATERIAL_ID_MASK:
+				case DIRECT_SHADOW_MASK:
+				case INDIRECT_SHADOW_MASK:
+				case OBJECT_ID_MASK:
+					return true;
+				default:
+					return false;
+			}
+		default:
+			return false;
+	}
+}
+
+void Film::SetChannelStorage(const FilmChannelType type, const FrameBufferStorageType storage) {
+	if (!IsChannelStorageSupported(type, storage))
+		throw runtime_error("Film channel " + FilmChannelType2String(type) +
+				" doesn't support the storage type: " + FrameBufferStorageType2String(storage));
+
+	if (storage == FRAMEBUFFER_STORAGE_FLOAT)
+		channelStorages.erase(type);
+	else
+		channelStorages[type] = storage;
+
+	if (initialized)
+		ApplyChannelStorages();
+}
+
+FrameBufferStorageType Film::GetChannelStorage(const FilmChannelType type) const {
+	map<FilmChannelType, FrameBufferStorageType>::const_iterator it = channelStorages.find(type);
+
+	return (it == channelStorages.end()) ? FRAMEBUFFER_STORAGE_FLOAT : it->second;
+}
+
+template<class T> static void SetStorageType(T *channel, const FrameBufferStorageType storage) {
+	if (channel)
+		channel->SetStorageType(storage);
+}
+
+template<class T> static void SetStorageType(vector<T *> &channels, const FrameBufferStorageType storage) {
+	for (u_int i = 0; i < channels.size(); ++i)
+		channels[i]->SetStorageType(storage);
+}
+
+void Film::ApplyChannelStorages() {
+	static const FilmChannelType types[] = {
+		ALPHA, GEOMETRY_NORMAL, SHADING_NORMAL, DIRECT_DIFFUSE, DIRECT_GLOSSY,
+		EMISSION, INDIRECT_DIFFUSE, INDIRECT_GLOSSY, INDIRECT_SPECULAR,
+		MATERIAL_ID_MASK, DIRECT_SHADOW_MASK, INDIRECT_SHADOW_MASK, UV,
+		BY_MATERIAL_ID, IRRADIANCE, OBJECT_ID_MASK, BY_OBJECT_ID
+	};
+
+	for (u_int i = 0; i < sizeof(types) / sizeof(types[0]); ++i) {
+		const FrameBufferStorageType storage = GetChannelStorage(types[i]);
+
+		switch (types[i]) {
+			case ALPHA:
+				SetStorageType(channel_ALPHA, storage);
+				break;
+			case GEOMETRY_NORMAL:
+				SetStorageType(channel_GEOMETRY_NORMAL, storage);
+				break;
+			case SHADING_NORMAL:
+				SetStorageType(channel_SHADING_NORMAL, storage);
+				break;
+			case DIRECT_DIFFUSE:
+				SetStorageType(channel_DIRECT_DIFFUSE, storage);
+				break;
+			case DIRECT_GLOSSY:
+				SetStorageType(channel_DIRECT_GLOSSY, storage);
+				break;
+			case EMISSION:
+				SetStorageType(channel_EMISSION, storage);
+				break;
+			case INDIRECT_DIFFUSE:
+				SetStorageType(channel_INDIRECT_DIFFUSE, storage);
+				break;
+			case INDIRECT_GLOSSY:
+				SetStorageType(channel_INDIRECT_GLOSSY, storage);
+				break;
+			case INDIRECT_SPECULAR:
+				SetStorageType(channel_INDIRECT_SPECULAR, storage);
+				break;
+			case MATERIAL_ID_MASK:
+				SetStorageType(channel_MATERIAL_ID_MASKs, storage);
+				break;
+			case DIRECT_SHADOW_MASK:
+				SetStorageType(channel_DIRECT_SHADOW_MASK, storage);
+				break;
+			case INDIRECT_SHADOW_MASK:
+				SetStorageType(channel_INDIRECT_SHADOW_MASK, storage);
+				break;
+			case UV:
+				SetStorageType(channel_UV, storage);
+				break;
+			case BY_MATERIAL_ID:
+				SetStorageType(channel_BY_MATERIAL_IDs, storage);
+				break;
+			case IRRADIANCE:
+				SetStorageType(channel_IRRADIANCE, storage);
+				break;
+			case OBJECT_ID_MASK:
+				SetStorageType(channel_OBJECT_ID_MASKs, storage);
+				break;
+			case BY_OBJECT_ID:
+				SetStorageType(channel_BY_OBJECT_IDs, storage);
+				break;
+			default:
+				break;
+		}
+	}
+}
+
 void Film::Init() {
 	if (initialized)
 		throw runtime_error("A Film can not be initialized multiple times");
@@ -266,6 +586,11 @@ void Film::Init() {
 	if (imagePipelines.size() > 0)
 		AddChannel(IMAGEPIPELINE);
 
+	// CONVERGENCE channel is written by the convergence test and it is
+	// required by adaptive samplers
+	if (enabledConvTest)
+		AddChannel(CONVERGENCE);
+
 	initialized = true;
 
 	Resize(width, height);
@@ -276,9 +601,15 @@ void Film::Resize(const u_int w, const u_int h) {
 	height = h;
 	pixelCount = w * h;
 
+	DeleteAsyncImagePipeline();
+
 	delete convTest;
 	convTest = NULL;
 
+	// The tile partitioning depends on the film size
+	if (tileLocks)
+		AllocTileLocks();
+
 	// Delete all already allocated channels
 	FreeChannels();
 
@@ -311,9 +642,6 @@ void Film::Resize(const u_int w, const u_int h) {
 			channel_IMAGEPIPELINEs[i] = new GenericFrameBuffer<3, 0, float>(width, height);
 			channel_IMAGEPIPELINEs[i]->Clear();
 		}
-
-		if (enabledConvTest)
-			convTest = new FilmConvTest(this);
 	}
 	if (HasChannel(DEPTH)) {
 		channel_DEPTH = new GenericFrameBuffer<1, 0, float>(width, height);
@@ -436,6 +764,18 @@ void Film::Resize(const u_int w, const u_int h) {
 		channel_FRAMEBUFFER_MASK = new GenericFrameBuffer<1, 0, u_int>(width, height);
 		channel_FRAMEBUFFER_MASK->Clear();
 	}
+	if (HasChannel(CONVERGENCE)) {
+		channel_CONVERGENCE = new GenericFrameBuffer<1, 0, float>(width, height);
+		channel_CONVERGENCE->Clear(numeric_limits<float>::infinity());
+	}
+
+	// The convergence test uses IMAGEPIPELINE and CONVERGENCE channels so it
+	// has to be allocated after them
+	if (HasChannel(IMAGEPIPELINE) && enabledConvTest)
+		convTest = new FilmConvTest(this);
+
+	ApplyChannelStorages();
+	AllocDirtyTiles();
 
 	// Initialize the statistics
 	statsTotalSampleCount = 0.0;
@@ -448,6 +788,9 @@ void Film::SetRadianceChannelScale(const u_int index, const RadianceChannelScale
 
 	radianceChannelScales[index] = scale;
 	radianceChannelScales[index].Init();
+
+	InvalidateImagePipelines();
+	DeleteAsyncImagePipeline();
 }
 
 void Film::Reset() {
@@ -514,11 +857,15 @@ void Film::Reset() {
 	if (HasChannel(FRAMEBUFFER_MASK))
 		channel_FRAMEBUFFER_MASK->Clear();
 
-	// convTest has to be reset explicitly
+	// convTest (and the CONVERGENCE channel) has to be reset explicitly
 
 	statsTotalSampleCount = 0.0;
 	statsAvgSampleSec = 0.0;
 	statsStartSampleTime = WallClockTime();
+
+	InvalidateImagePipelines();
+	if (asyncImagePipeline)
+		asyncImagePipeline->Invalidate();
 }
 
 void Film::VarianceClampFilm(const VarianceClamping &varianceClamping,
@@ -539,299 +886,208 @@ void Film::VarianceClampFilm(const VarianceClamping &varianceClamping,
 	}
 }
 
-void Film::AddFilm(const Film &film,
-		const u_int srcOffsetX, const u_int srcOffsetY,
-		const u_int srcWidth, const u_int srcHeight,
+//------------------------------------------------------------------------------
+// Film merge helpers: each one works on the rows [firstRow, lastRow) of a
+// region, one contiguous block of srcWidth pixels for each row
+//------------------------------------------------------------------------------
+
+template<u_int CHANNELS, u_int WEIGHT_CHANNELS, class T> static void AddRows(
+		GenericFrameBuffer<CHANNELS, WEIGHT_CHANNELS, T> *dst,
+		const GenericFrameBuffer<CHANNELS, WEIGHT_CHANNELS, T> *src,
+		const u_int srcOffsetX, const u_int srcOffsetY, const u_int srcWidth,
+		const u_int dstOffsetX, const u_int dstOffsetY,
+		const u_int firstRow, const u_int lastRow) {
+	for (u_int y = firstRow; y < lastRow; ++y)
+		dst->AddPixels(dstOffsetX, dstOffsetY + y, src->GetPixel(srcOffsetX, srcOffsetY + y), srcWidth);
+}
+
+// The source pixels are copied only where they are closer than the destination
+// ones if both films have a DEPTH channel, always otherwise
+template<u_int CHANNELS, u_int WEIGHT_CHANNELS, class T> static void SetRowsByDepth(
+		GenericFrameBuffer<CHANNELS, WEIGHT_CHANNELS, T> *dst,
+		const GenericFrameBuffer<CHANNELS, WEIGHT_CHANNELS, T> *src,
+		const GenericFrameBuffer<1, 0, float> *dstDepth,
+		const GenericFrameBuffer<1, 0, float> *srcDepth,
+		const u_int srcOffsetX, const u_int srcOffsetY, const u_int srcWidth,
+		const u_int dstOffsetX, const u_int dstOffsetY,
+		const u_int firstRow, const u_int lastRow) {
+	for (u_int y = firstRow; y < lastRow; ++y) {
+		const T *srcPixels = src->GetPixel(srcOffsetX, srcOffsetY + y);
+
+		if (dstDepth && srcDepth) {
+			const float *srcDepths = srcDepth->GetPixel(srcOffsetX, srcOffsetY + y);
+			const float *dstDepths = dstDepth->GetPixel(dstOffsetX, dstOffsetY + y);
+
+			for (u_int x = 0; x < srcWidth; ++x) {
+				if (srcDepths[x] < dstDepths[x])
+					dst->SetPixel(dstOffsetX + x, dstOffsetY + y, &srcPixels[x * CHANNELS]);
+			}
+		} else
+			dst->SetPixels(dstOffsetX, dstOffsetY + y, srcPixels, srcWidth);
+	}
+}
+
+void Film::AddFilmRows(const Film &film,
+		const u_int firstRow, const u_int lastRow,
+		const u_int srcOffsetX, const u_int srcOffsetY, const u_int srcWidth,
 		const u_int dstOffsetX, const u_int dstOffsetY) {
-	statsTotalSampleCount += film.statsTotalSampleCount;
+	if (!film.IsThreadSafe()) {
+		AddFilmRowsLockLess(film, firstRow, lastRow, srcOffsetX, srcOffsetY, srcWidth,
+				dstOffsetX, dstOffsetY);
+		return;
+	}
 
+	// The source film can be written by other threads: merge one row of tiles
+	// at time holding its locks
+	for (u_int y = firstRow; y < lastRow;) {
+		const u_int tileRowEnd = ((srcOffsetY + y) / THREADSAFE_TILE_SIZE + 1) * THREADSAFE_TILE_SIZE - srcOffsetY;
+		const u_int bandEnd = Min(lastRow, tileRowEnd);
+
+		film.LockTileRows(srcOffsetY + y, srcOffsetY + bandEnd);
+		AddFilmRowsLockLess(film, y, bandEnd, srcOffsetX, srcOffsetY, srcWidth,
+				dstOffsetX, dstOffsetY);
+		film.UnlockTileRows(srcOffsetY + y, srcOffsetY + bandEnd);
+
+		y = bandEnd;
+	}
+}
+
+void Film::AddFilmRowsLockLess(const Film &film,
+		const u_int firstRow, const u_int lastRow,
+		const u_int srcOffsetX, const u_int srcOffsetY, const u_int srcWidth,
+		const u_int dstOffsetX, const u_int dstOffsetY) {
 	if (HasChannel(RADIANCE_PER_PIXEL_NORMALIZED) && film.HasChannel(RADIANCE_PER_PIXEL_NORMALIZED)) {
 		for (u_int i = 0; i < Min(radianceGroupCount, film.radianceGroupCount); ++i) {
-			for (u_int y = 0; y < srcHeight; ++y) {
-				for (u_int x = 0; x < srcWidth; ++x) {
-					const float *srcPixel = film.channel_RADIANCE_PER_PIXEL_NORMALIZEDs[i]->GetPixel(srcOffsetX + x, srcOffsetY + y);
-					channel_RADIANCE_PER_PIXEL_NORMALIZEDs[i]->AddPixel(dstOffsetX + x, dstOffsetY + y, srcPixel);
-				}
-			}
+			AddRows(channel_RADIANCE_PER_PIXEL_NORMALIZEDs[i], film.channel_RADIANCE_PER_PIXEL_NORMALIZEDs[i],
+					srcOffsetX, srcOffsetY, srcWidth, dstOffsetX, dstOffsetY, firstRow, lastRow);
 		}
 	}
 
 	if (HasChannel(RADIANCE_PER_SCREEN_NORMALIZED) && film.HasChannel(RADIANCE_PER_SCREEN_NORMALIZED)) {
 		for (u_int i = 0; i < Min(radianceGroupCount, film.radianceGroupCount); ++i) {
-			for (u_int y = 0; y < srcHeight; ++y) {
-				for (u_int x = 0; x < srcWidth; ++x) {
-					const float *srcPixel = film.channel_RADIANCE_PER_SCREEN_NORMALIZEDs[i]->GetPixel(srcOffsetX + x, srcOffsetY + y);
-					channel_RADIANCE_PER_SCREEN_NORMALIZEDs[i]->AddPixel(dstOffsetX + x, dstOffsetY + y, srcPixel);
-				}
-			}
+			AddRows(channel_RADIANCE_PER_SCREEN_NORMALIZEDs[i], film.channel_RADIANCE_PER_SCREEN_NORMALIZEDs[i],
+					srcOffsetX, srcOffsetY, srcWidth, dstOffsetX, dstOffsetY, firstRow, lastRow);
 		}
 	}
 
 	if (HasChannel(ALPHA) && film.HasChannel(ALPHA)) {
-		for (u_int y = 0; y < srcHeight; ++y) {
-			for (u_int x = 0; x < srcWidth; ++x) {
-				const float *srcPixel = film.channel_ALPHA->GetPixel(srcOffsetX + x, srcOffsetY + y);
-				channel_ALPHA->AddPixel(dstOffsetX + x, dstOffsetY + y, srcPixel);
-			}
-		}
+		AddRows(channel_ALPHA, film.channel_ALPHA,
+				srcOffsetX, srcOffsetY, srcWidth, dstOffsetX, dstOffsetY, firstRow, lastRow);
 	}
 
+	// Used DEPTH information to merge Films
+	const bool useDepth = HasChannel(DEPTH) && film.HasChannel(DEPTH);
+	const GenericFrameBuffer<1, 0, float> *dstDepth = useDepth ? channel_DEPTH : NULL;
+	const GenericFrameBuffer<1, 0, float> *srcDepth = useDepth ? film.channel_DEPTH : NULL;
+
 	if (HasChannel(POSITION) && film.HasChannel(POSITION)) {
-		if (HasChannel(DEPTH) && film.HasChannel(DEPTH)) {
-			// Used DEPTH information to merge Films
-			for (u_int y = 0; y < srcHeight; ++y) {
-				for (u_int x = 0; x < srcWidth; ++x) {
-					if (film.channel_DEPTH->GetPixel(srcOffsetX + x, srcOffsetY + y)[0] < channel_DEPTH->GetPixel(dstOffsetX + x, dstOffsetY + y)[0]) {
-						const float *srcPixel = film.channel_POSITION->GetPixel(srcOffsetX + x, srcOffsetY + y);
-						channel_POSITION->SetPixel(dstOffsetX + x, dstOffsetY + y, srcPixel);
-					}
-				}
-			}
-		} else {
-			for (u_int y = 0; y < srcHeight; ++y) {
-				for (u_int x = 0; x < srcWidth; ++x) {
-					const float *srcPixel = film.channel_POSITION->GetPixel(srcOffsetX + x, srcOffsetY + y);
-					channel_POSITION->SetPixel(dstOffsetX + x, dstOffsetY + y, srcPixel);
-				}
-			}
-		}
+		SetRowsByDepth(channel_POSITION, film.channel_POSITION, dstDepth, srcDepth,
+				srcOffsetX, srcOffsetY, srcWidth, dstOffsetX, dstOffsetY, firstRow, lastRow);
 	}
 
 	if (HasChannel(GEOMETRY_NORMAL) && film.HasChannel(GEOMETRY_NORMAL)) {
-		if (HasChannel(DEPTH) && film.HasChannel(DEPTH)) {
-			// Used DEPTH information to merge Films
-			for (u_int y = 0; y < srcHeight; ++y) {
-				for (u_int x = 0; x < srcWidth; ++x) {
-					if (film.channel_DEPTH->GetPixel(srcOffsetX + x, srcOffsetY + y)[0] < channel_DEPTH->GetPixel(dstOffsetX + x, dstOffsetY + y)[0]) {
-						const float *srcPixel = film.channel_GEOMETRY_NORMAL->GetPixel(srcOffsetX + x, srcOffsetY + y);
-						channel_GEOMETRY_NORMAL->SetPixel(dstOffsetX + x, dstOffsetY + y, srcPixel);
-					}
-				}
-			}
-		} else {
-			for (u_int y = 0; y < srcHeight; ++y) {
-				for (u_int x = 0; x < srcWidth; ++x) {
-					const float *srcPixel = film.channel_GEOMETRY_NORMAL->GetPixel(srcOffsetX + x, srcOffsetY + y);
-					channel_GEOMETRY_NORMAL->SetPixel(dstOffsetX + x, dstOffsetY + y, srcPixel);
-				}
-			}
-		}
+		SetRowsByDepth(channel_GEOMETRY_NORMAL, film.channel_GEOMETRY_NORMAL, dstDepth, srcDepth,
+				srcOffsetX, srcOffsetY, srcWidth, dstOffsetX, dstOffsetY, firstRow, lastRow);
 	}
 
 	if (HasChannel(SHADING_NORMAL) && film.HasChannel(SHADING_NORMAL)) {
-		if (HasChannel(DEPTH) && film.HasChannel(DEPTH)) {
-			// Used DEPTH information to merge Films
-			for (u_int y = 0; y < srcHeight; ++y) {
-				for (u_int x = 0; x < srcWidth; ++x) {
-					if (film.channel_DEPTH->GetPixel(srcOffsetX + x, srcOffsetY + y)[0] < channel_DEPTH->GetPixel(dstOffsetX + x, dstOffsetY + y)[0]) {
-						const float *srcPixel = film.channel_SHADING_NORMAL->GetPixel(srcOffsetX + x, srcOffsetY + y);
-						channel_SHADING_NORMAL->SetPixel(dstOffsetX + x, dstOffsetY + y, srcPixel);
-					}
-				}
-			}
-		} else {
-			for (u_int y = 0; y < srcHeight; ++y) {
-				for (u_int x = 0; x < srcWidth; ++x) {
-					const float *srcPixel = film.channel_SHADING_NORMAL->GetPixel(srcOffsetX + x, srcOffsetY + y);
-					channel_SHADING_NORMAL->SetPixel(dstOffsetX + x, dstOffsetY + y, srcPixel);
-				}
-			}
-		}
+		SetRowsByDepth(channel_SHADING_NORMAL, film.channel_SHADING_NORMAL, dstDepth, srcDepth,
+				srcOffsetX, srcOffsetY, srcWidth, dstOffsetX, dstOffsetY, firstRow, lastRow);
 	}
 
 	if (HasChannel(MATERIAL_ID) && film.HasChannel(MATERIAL_ID)) {
-		if (HasChannel(DEPTH) && film.HasChannel(DEPTH)) {
-			// Used DEPTH information to merge Films
-			for (u_int y = 0; y < srcHeight; ++y) {
-				for (u_int x = 0; x < srcWidth; ++x) {
-					if (film.channel_DEPTH->GetPixel(srcOffsetX + x, srcOffsetY + y)[0] < channel_DEPTH->GetPixel(dstOffsetX + x, dstOffsetY + y)[0]) {
-						const u_int *srcPixel = film.channel_MATERIAL_ID->GetPixel(srcOffsetX + x, srcOffsetY + y);
-						channel_MATERIAL_ID->SetPixel(dstOffsetX + x, dstOffsetY + y, srcPixel);
-					}
-				}
-			}
-		} else {
-			for (u_int y = 0; y < srcHeight; ++y) {
-				for (u_int x = 0; x < srcWidth; ++x) {
-					const u_int *srcPixel = film.channel_MATERIAL_ID->GetPixel(srcOffsetX + x, srcOffsetY + y);
-					channel_MATERIAL_ID->SetPixel(dstOffsetX + x, dstOffsetY + y, srcPixel);
-				}
-			}
-		}
+		SetRowsByDepth(channel_MATERIAL_ID, film.channel_MATERIAL_ID, dstDepth, srcDepth,
+				srcOffsetX, srcOffsetY, srcWidth, dstOffsetX, dstOffsetY, firstRow, lastRow);
 	}
 
 	if (HasChannel(DIRECT_DIFFUSE) && film.HasChannel(DIRECT_DIFFUSE)) {
-		for (u_int y = 0; y < srcHeight; ++y) {
-			for (u_int x = 0; x < srcWidth; ++x) {
-				const float *srcPixel = film.channel_DIRECT_DIFFUSE->GetPixel(srcOffsetX + x, srcOffsetY + y);
-				channel_DIRECT_DIFFUSE->AddPixel(dstOffsetX + x, dstOffsetY + y, srcPixel);
-			}
-		}
+		AddRows(channel_DIRECT_DIFFUSE, film.channel_DIRECT_DIFFUSE,
+				srcOffsetX, srcOffsetY, srcWidth, dstOffsetX, dstOffsetY, firstRow, lastRow);
 	}
 
 	if (HasChannel(DIRECT_GLOSSY) && film.HasChannel(DIRECT_GLOSSY)) {
-		for (u_int y = 0; y < srcHeight; ++y) {
-			for (u_int x = 0; x < srcWidth; ++x) {
-				const float *srcPixel = film.channel_DIRECT_GLOSSY->GetPixel(srcOffsetX + x, srcOffsetY + y);
-				channel_DIRECT_GLOSSY->AddPixel(dstOffsetX + x, dstOffsetY + y, srcPixel);
-			}
-		}
+		AddRows(channel_DIRECT_GLOSSY, film.channel_DIRECT_GLOSSY,
+				srcOffsetX, srcOffsetY, srcWidth, dstOffsetX, dstOffsetY, firstRow, lastRow);
 	}
 
 	if (HasChannel(EMISSION) && film.HasChannel(EMISSION)) {
-		for (u_int y = 0; y < srcHeight; ++y) {
-			for (u_int x = 0; x < srcWidth; ++x) {
-				const float *srcPixel = film.channel_EMISSION->GetPixel(srcOffsetX + x, srcOffsetY + y);
-				channel_EMISSION->AddPixel(dstOffsetX + x, dstOffsetY + y, srcPixel);
-			}
-		}
+		AddRows(channel_EMISSION, film.channel_EMISSION,
+				srcOffsetX, srcOffsetY, srcWidth, dstOffsetX, dstOffsetY, firstRow, lastRow);
 	}
 
 	if (HasChannel(INDIRECT_DIFFUSE) && film.HasChannel(INDIRECT_DIFFUSE)) {
-		for (u_int y = 0; y < srcHeight; ++y) {
-			for (u_int x = 0; x < srcWidth; ++x) {
-				const float *srcPixel = film.channel_INDIRECT_DIFFUSE->GetPixel(srcOffsetX + x, srcOffsetY + y);
-				channel_INDIRECT_DIFFUSE->AddPixel(dstOffsetX + x, dstOffsetY + y, srcPixel);
-			}
-		}
+		AddRows(channel_INDIRECT_DIFFUSE, film.channel_INDIRECT_DIFFUSE,
+				srcOffsetX, srcOffsetY, srcWidth, dstOffsetX, dstOffsetY, firstRow, lastRow);
 	}
 
 	if (HasChannel(INDIRECT_GLOSSY) && film.HasChannel(INDIRECT_GLOSSY)) {
-		for (u_int y = 0; y < srcHeight; ++y) {
-			for (u_int x = 0; x < srcWidth; ++x) {
-				const float *srcPixel = film.channel_INDIRECT_GLOSSY->GetPixel(srcOffsetX + x, srcOffsetY + y);
-				channel_INDIRECT_GLOSSY->AddPixel(dstOffsetX + x, dstOffsetY + y, srcPixel);
-			}
-		}
+		AddRows(channel_INDIRECT_GLOSSY, film.channel_INDIRECT_GLOSSY,
+				srcOffsetX, srcOffsetY, srcWidth, dstOffsetX, dstOffsetY, firstRow, lastRow);
 	}
 
 	if (HasChannel(INDIRECT_SPECULAR) && film.HasChannel(INDIRECT_SPECULAR)) {
-		for (u_int y = 0; y < srcHeight; ++y) {
-			for (u_int x = 0; x < srcWidth; ++x) {
-				const float *srcPixel = film.channel_INDIRECT_SPECULAR->GetPixel(srcOffsetX + x, srcOffsetY + y);
-				channel_INDIRECT_SPECULAR->AddPixel(dstOffsetX + x, dstOffsetY + y, srcPixel);
-			}
-		}
+		AddRows(channel_INDIRECT_SPECULAR, film.channel_INDIRECT_SPECULAR,
+				srcOffsetX, srcOffsetY, srcWidth, dstOffsetX, dstOffsetY, firstRow, lastRow);
 	}
 
 	if (HasChannel(MATERIAL_ID_MASK) && film.HasChannel(MATERIAL_ID_MASK)) {
 		for (u_int i = 0; i < channel_MATERIAL_ID_MASKs.size(); ++i) {
 			for (u_int j = 0; j < film.maskMaterialIDs.size(); ++j) {
 				if (maskMaterialIDs[i] == film.maskMaterialIDs[j]) {
-					for (u_int y = 0; y < srcHeight; ++y) {
-						for (u_int x = 0; x < srcWidth; ++x) {
-							const float *srcPixel = film.channel_MATERIAL_ID_MASKs[j]->GetPixel(srcOffsetX + x, srcOffsetY + y);
-							channel_MATERIAL_ID_MASKs[i]->AddPixel(dstOffsetX + x, dstOffsetY + y, srcPixel);
-						}
-					}
+					AddRows(channel_MATERIAL_ID_MASKs[i], film.channel_MATERIAL_ID_MASKs[j],
+							srcOffsetX, srcOffsetY, srcWidth, dstOffsetX, dstOffsetY, firstRow, lastRow);
 				}
 			}
 		}
 	}
 
 	if (HasChannel(DIRECT_SHADOW_MASK) && film.HasChannel(DIRECT_SHADOW_MASK)) {
-		for (u_int y = 0; y < srcHeight; ++y) {
-			for (u_int x = 0; x < srcWidth; ++x) {
-				const float *srcPixel = film.channel_DIRECT_SHADOW_MASK->GetPixel(srcOffsetX + x, srcOffsetY + y);
-				channel_DIRECT_SHADOW_MASK->AddPixel(dstOffsetX + x, dstOffsetY + y, srcPixel);
-			}
-		}
+		AddRows(channel_DIRECT_SHADOW_MASK, film.channel_DIRECT_SHADOW_MASK,
+				srcOffsetX, srcOffsetY, srcWidth, dstOffsetX, dstOffsetY, firstRow, lastRow);
 	}
 
 	if (HasChannel(INDIRECT_SHADOW_MASK) && film.HasChannel(INDIRECT_SHADOW_MASK)) {
-		for (u_int y = 0; y < srcHeight; ++y) {
-			for (u_int x = 0; x < srcWidth; ++x) {
-				const float *srcPixel = film.channel_INDIRECT_SHADOW_MASK->GetPixel(srcOffsetX + x, srcOffsetY + y);
-				channel_INDIRECT_SHADOW_MASK->AddPixel(dstOffsetX + x, dstOffsetY + y, srcPixel);
-			}
-		}
+		AddRows(channel_INDIRECT_SHADOW_MASK, film.channel_INDIRECT_SHADOW_MASK,
+				srcOffsetX, srcOffsetY, srcWidth, dstOffsetX, dstOffsetY, firstRow, lastRow);
 	}
 
 	if (HasChannel(UV) && film.HasChannel(UV)) {
-		if (HasChannel(DEPTH) && film.HasChannel(DEPTH)) {
-			// Used DEPTH information to merge Films
-			for (u_int y = 0; y < srcHeight; ++y) {
-				for (u_int x = 0; x < srcWidth; ++x) {
-					if (film.channel_DEPTH->GetPixel(srcOffsetX + x, srcOffsetY + y)[0] < channel_DEPTH->GetPixel(dstOffsetX + x, dstOffsetY + y)[0]) {
-						const float *srcPixel = film.channel_UV->GetPixel(srcOffsetX + x, srcOffsetY + y);
-						channel_UV->SetPixel(dstOffsetX + x, dstOffsetY + y, srcPixel);
-					}
-				}
-			}
-		} else {
-			for (u_int y = 0; y < srcHeight; ++y) {
-				for (u_int x = 0; x < srcWidth; ++x) {
-					const float *srcPixel = film.channel_UV->GetPixel(srcOffsetX + x, srcOffsetY + y);
-					channel_UV->SetPixel(dstOffsetX + x, dstOffsetY + y, srcPixel);
-				}
-			}
-		}
+		SetRowsByDepth(channel_UV, film.channel_UV, dstDepth, srcDepth,
+				srcOffsetX, srcOffsetY, srcWidth, dstOffsetX, dstOffsetY, firstRow, lastRow);
 	}
 
 	if (HasChannel(RAYCOUNT) && film.HasChannel(RAYCOUNT)) {
-		for (u_int y = 0; y < srcHeight; ++y) {
-			for (u_int x = 0; x < srcWidth; ++x) {
-				const float *srcPixel = film.channel_RAYCOUNT->GetPixel(srcOffsetX + x, srcOffsetY + y);
-				channel_RAYCOUNT->AddPixel(dstOffsetX + x, dstOffsetY + y, srcPixel);
-			}
-		}
+		AddRows(channel_RAYCOUNT, film.channel_RAYCOUNT,
+				srcOffsetX, srcOffsetY, srcWidth, dstOffsetX, dstOffsetY, firstRow, lastRow);
 	}
 
 	if (HasChannel(BY_MATERIAL_ID) && film.HasChannel(BY_MATERIAL_ID)) {
 		for (u_int i = 0; i < channel_BY_MATERIAL_IDs.size(); ++i) {
 			for (u_int j = 0; j < film.byMaterialIDs.size(); ++j) {
 				if (byMaterialIDs[i] == film.byMaterialIDs[j]) {
-					for (u_int y = 0; y < srcHeight; ++y) {
-						for (u_int x = 0; x < srcWidth; ++x) {
-							const float *srcPixel = film.channel_BY_MATERIAL_IDs[j]->GetPixel(srcOffsetX + x, srcOffsetY + y);
-							channel_BY_MATERIAL_IDs[i]->AddPixel(dstOffsetX + x, dstOffsetY + y, srcPixel);
-						}
-					}
+					AddRows(channel_BY_MATERIAL_IDs[i], film.channel_BY_MATERIAL_IDs[j],
+							srcOffsetX, srcOffsetY, srcWidth, dstOffsetX, dstOffsetY, firstRow, lastRow);
 				}
 			}
 		}
 	}
 
 	if (HasChannel(IRRADIANCE) && film.HasChannel(IRRADIANCE)) {
-		for (u_int y = 0; y < srcHeight; ++y) {
-			for (u_int x = 0; x < srcWidth; ++x) {
-				const float *srcPixel = film.channel_IRRADIANCE->GetPixel(srcOffsetX + x, srcOffsetY + y);
-				channel_IRRADIANCE->AddPixel(dstOffsetX + x, dstOffsetY + y, srcPixel);
-			}
-		}
+		AddRows(channel_IRRADIANCE, film.channel_IRRADIANCE,
+				srcOffsetX, srcOffsetY, srcWidth, dstOffsetX, dstOffsetY, firstRow, lastRow);
 	}
 
 	if (HasChannel(OBJECT_ID) && film.HasChannel(OBJECT_ID)) {
-		if (HasChannel(DEPTH) && film.HasChannel(DEPTH)) {
-			// Used DEPTH information to merge Films
-			for (u_int y = 0; y < srcHeight; ++y) {
-				for (u_int x = 0; x < srcWidth; ++x) {
-					if (film.channel_DEPTH->GetPixel(srcOffsetX + x, srcOffsetY + y)[0] < channel_DEPTH->GetPixel(dstOffsetX + x, dstOffsetY + y)[0]) {
-						const u_int *srcPixel = film.channel_OBJECT_ID->GetPixel(srcOffsetX + x, srcOffsetY + y);
-						channel_OBJECT_ID->SetPixel(dstOffsetX + x, dstOffsetY + y, srcPixel);
-					}
-				}
-			}
-		} else {
-			for (u_int y = 0; y < srcHeight; ++y) {
-				for (u_int x = 0; x < srcWidth; ++x) {
-					const u_int *srcPixel = film.channel_OBJECT_ID->GetPixel(srcOffsetX + x, srcOffsetY + y);
-					channel_OBJECT_ID->SetPixel(dstOffsetX + x, dstOffsetY + y, srcPixel);
-				}
-			}
-		}
+		SetRowsByDepth(channel_OBJECT_ID, film.channel_OBJECT_ID, dstDepth, srcDepth,
+				srcOffsetX, srcOffsetY, srcWidth, dstOffsetX, dstOffsetY, firstRow, lastRow);
 	}
 
 	if (HasChannel(OBJECT_ID_MASK) && film.HasChannel(OBJECT_ID_MASK)) {
 		for (u_int i = 0; i < channel_OBJECT_ID_MASKs.size(); ++i) {
 			for (u_int j = 0; j < film.maskObjectIDs.size(); ++j) {
 				if (maskObjectIDs[i] == film.maskObjectIDs[j]) {
-					for (u_int y = 0; y < srcHeight; ++y) {
-						for (u_int x = 0; x < srcWidth; ++x) {
-							const float *srcPixel = film.channel_OBJECT_ID_MASKs[j]->GetPixel(srcOffsetX + x, srcOffsetY + y);
-							channel_OBJECT_ID_MASKs[i]->AddPixel(dstOffsetX + x, dstOffsetY + y, srcPixel);
-						}
-					}
+					AddRows(channel_OBJECT_ID_MASKs[i], film.channel_OBJECT_ID_MASKs[j],
+							srcOffsetX, srcOffsetY, srcWidth, dstOffsetX, dstOffsetY, firstRow, lastRow);
 				}
 			}
 		}
@@ -841,28 +1097,43 @@ void Film::AddFilm(const Film &film,
 		for (u_int i = 0; i < channel_BY_OBJECT_IDs.size(); ++i) {
 			for (u_int j = 0; j < film.byObjectIDs.size(); ++j) {
 				if (byObjectIDs[i] == film.byObjectIDs[j]) {
-					for (u_int y = 0; y < srcHeight; ++y) {
-						for (u_int x = 0; x < srcWidth; ++x) {
-							const float *srcPixel = film.channel_BY_OBJECT_IDs[j]->GetPixel(srcOffsetX + x, srcOffsetY + y);
-							channel_BY_OBJECT_IDs[i]->AddPixel(dstOffsetX + x, dstOffsetY + y, srcPixel);
-						}
-					}
+					AddRows(channel_BY_OBJECT_IDs[i], film.channel_BY_OBJECT_IDs[j],
+							srcOffsetX, srcOffsetY, srcWidth, dstOffsetX, dstOffsetY, firstRow, lastRow);
 				}
 			}
 		}
 	}
 
 	// NOTE: update DEPTH channel last because it is used to merge other channels
-	if (HasChannel(DEPTH) && film.HasChannel(DEPTH)) {
-		for (u_int y = 0; y < srcHeight; ++y) {
-			for (u_int x = 0; x < srcWidth; ++x) {
-				const float *srcPixel = film.channel_DEPTH->GetPixel(srcOffsetX + x, srcOffsetY + y);
-				channel_DEPTH->MinPixel(dstOffsetX + x, dstOffsetY + y, srcPixel);
-			}
+	if (useDepth) {
+		for (u_int y = firstRow; y < lastRow; ++y) {
+			channel_DEPTH->MinPixels(dstOffsetX, dstOffsetY + y,
+					film.channel_DEPTH->GetPixel(srcOffsetX, srcOffsetY + y), srcWidth);
 		}
 	}
 }
 
+void Film::AddFilm(const Film &film,
+		const u_int srcOffsetX, const u_int srcOffsetY,
+		const u_int srcWidth, const u_int srcHeight,
+		const u_int dstOffsetX, const u_int dstOffsetY) {
+	statsTotalSampleCount += film.statsTotalSampleCount;
+
+	if ((srcWidth == 0) || (srcHeight == 0))
+		return;
+
+	// Each task merges all channels of a block of rows. Small regions, like
+	// the tiles of tile rendering, are not worth the overhead of the tasks.
+	const u_int threadCount = TaskScheduler::GetInstance().GetThreadCount();
+	const u_int minRows = Max(1u, ADDFILM_MIN_TASK_PIXELS / srcWidth);
+	const u_int rowsPerTask = Max(srcHeight / (threadCount * 4), minRows);
+
+	ParallelFor(0, srcHeight, rowsPerTask, boost::bind(&Film::AddFilmRows, this, boost::cref(film),
+			_1, _2, srcOffsetX, srcOffsetY, srcWidth, dstOffsetX, dstOffsetY));
+
+	MarkDirtyRegion(dstOffsetX, dstOffsetX + srcWidth, dstOffsetY, dstOffsetY + srcHeight);
+}
+
 u_int Film::GetChannelCount(const FilmChannelType type) const {
 	switch (type) {
 		case RADIANCE_PER_PIXEL_NORMALIZED:
@@ -917,6 +1188,8 @@ u_int Film::GetChannelCount(const FilmChannelType type) const {
 			return channel_BY_OBJECT_IDs.size();
 		case FRAMEBUFFER_MASK:
 			return channel_FRAMEBUFFER_MASK ? 1 : 0;
+		case CONVERGENCE:
+			return channel_CONVERGENCE ? 1 : 0;
 		default:
 			throw runtime_error("Unknown FilmChannelType in Film::GetChannelCount(): " + ToString(type));
 	}
@@ -931,7 +1204,7 @@ template<> const float *Film::GetChannel<float>(const FilmChannelType type, cons
 		case ALPHA:
 			return channel_ALPHA->GetPixels();
 		case IMAGEPIPELINE: {
-			ExecuteImagePipeline(index);
+			RefreshImagePipeline(index);
 			return channel_IMAGEPIPELINEs[index]->GetPixels();
 		}
 		case DEPTH:
@@ -972,6 +1245,8 @@ template<> const float *Film::GetChannel<float>(const FilmChannelType type, cons
 			return channel_OBJECT_ID_MASKs[index]->GetPixels();
 		case BY_OBJECT_ID:
 			return channel_BY_OBJECT_IDs[index]->GetPixels();
+		case CONVERGENCE:
+			return channel_CONVERGENCE->GetPixels();
 		default:
 			throw runtime_error("Unknown FilmChannelType in Film::GetChannel<float>(): " + ToString(type));
 	}
@@ -1047,10 +1322,32 @@ void Film::ExecuteImagePipeline(const u_int index) {
 	}
 #endif
 
+	// Per-pixel image pipelines can be executed only on the modified regions.
+	// RADIANCE_PER_SCREEN_NORMALIZED pixels change with the total number of
+	// samples so they always require a complete execution.
+	vector<u_int> regions;
+#if !defined(LUXRAYS_DISABLE_OPENCL)
+	const bool useOpenCL = oclEnable && oclIntersectionDevice;
+#else
+	const bool useOpenCL = false;
+#endif
+	if (GetDirtyRegions(index, regions) && !useOpenCL &&
+			!HasChannel(RADIANCE_PER_SCREEN_NORMALIZED) &&
+			imagePipelines[index]->IsPerPixel()) {
+		const u_int regionCount = regions.size() / 4;
+
+		ParallelFor(0, regionCount, 0, boost::bind(&Film::MergeDirtyRegions,
+				this, index, boost::cref(regions), _1, _2));
+
+		imagePipelines[index]->ApplyRegions(*this, index, regions);
+
+		return;
+	}
+
 	// Merge all buffers
 	//const double t1 = WallClockTime();
 #if !defined(LUXRAYS_DISABLE_OPENCL)
-	if (oclEnable && oclIntersectionDevice)
+	if (useOpenCL)
 		MergeSampleBuffersOCL(index);
 	else
 		MergeSampleBuffers(index);
@@ -1073,80 +1370,108 @@ void Film::ExecuteImagePipeline(const u_int index) {
 	//SLG_LOG("Image pipeline " << index << " time: " << int((p2 - p1) * 1000.0) << "ms");
 }
 
+void Film::RefreshImagePipeline(const u_int index) {
+	if (enabledAsyncImagePipeline &&
+			(HasChannel(RADIANCE_PER_PIXEL_NORMALIZED) || HasChannel(RADIANCE_PER_SCREEN_NORMALIZED)) &&
+			HasChannel(IMAGEPIPELINE)) {
+		if (!asyncImagePipeline)
+			asyncImagePipeline = new FilmAsyncImagePipeline(this);
+
+		if (asyncImagePipeline->Refresh(index))
+			return;
+	}
+
+	ExecuteImagePipeline(index);
+}
+
 void Film::MergeSampleBuffers(const u_int index) {
 	Spectrum *p = (Spectrum *)channel_IMAGEPIPELINEs[index]->GetPixels();
-	
-	channel_FRAMEBUFFER_MASK->Clear();
 
-	// Merge RADIANCE_PER_PIXEL_NORMALIZED and RADIANCE_PER_SCREEN_NORMALIZED buffers
+	// Merge RADIANCE_PER_PIXEL_NORMALIZED and RADIANCE_PER_SCREEN_NORMALIZED
+	// buffers of all radiance groups with a single pass over the pixels. The
+	// FRAMEBUFFER_MASK channel is written for all pixels too.
+	const float screenFactor = HasChannel(RADIANCE_PER_SCREEN_NORMALIZED) ?
+		(pixelCount / statsTotalSampleCount) : 0.f;
 
-	if (HasChannel(RADIANCE_PER_PIXEL_NORMALIZED)) {
-		for (u_int i = 0; i < radianceGroupCount; ++i) {
-			if (radianceChannelScales[i].enabled) {
-				#pragma omp parallel for
-				for (
-						// Visual C++ 2013 supports only OpenMP 2.5
-#if _OPENMP >= 200805
-						unsigned
-#endif
-						int j = 0; j < pixelCount; ++j) {
-					const float *sp = channel_RADIANCE_PER_PIXEL_NORMALIZEDs[i]->GetPixel(j);
-
-					if (sp[3] > 0.f) {
-						Spectrum s(sp);
-						s /= sp[3];
-						s = radianceChannelScales[i].Scale(s);
-
-						u_int *fbMask = channel_FRAMEBUFFER_MASK->GetPixel(j);
-						if (*fbMask)
-							p[j] += s;
-						else
-							p[j] = s;
-						*fbMask = 1;
-					}
-				}
+	if (tileLocks) {
+		// Each task is a row of tiles
+		ParallelFor(0, height, THREADSAFE_TILE_SIZE, boost::bind(&Film::MergeRadianceRows,
+				this, _1, _2, screenFactor, p));
+	} else {
+		ParallelFor(0, pixelCount, 0, boost::bind(&Film::MergeRadianceGroups,
+				this, _1, _2, screenFactor, p));
+	}
+}
+
+void Film::MergeRadianceRows(const u_int firstRow, const u_int lastRow,
+		const float screenFactor, Spectrum *p) {
+	LockTileRows(firstRow, lastRow);
+	MergeRadianceGroups(firstRow * width, lastRow * width, screenFactor, p);
+	UnlockTileRows(firstRow, lastRow);
+}
+
+void Film::MergeDirtyRegions(const u_int index, const vector<u_int> &regions,
+		const u_int first, const u_int last) {
+	Spectrum *p = (Spectrum *)channel_IMAGEPIPELINEs[index]->GetPixels();
+
+	for (u_int i = first; i < last; ++i) {
+		const u_int *region = &regions[i * 4];
+
+		LockTileRows(region[2], region[3]);
+		for (u_int y = region[2]; y < region[3]; ++y)
+			MergeRadianceGroups(region[0] + y * width, region[1] + y * width, 0.f, p);
+		UnlockTileRows(region[2], region[3]);
+	}
+}
+
+void Film::MergeRadianceGroups(const u_int first, const u_int last,
+		const float screenFactor, Spectrum *p) {
+	const u_int perPixelCount = channel_RADIANCE_PER_PIXEL_NORMALIZEDs.size();
+	const u_int perScreenCount = channel_RADIANCE_PER_SCREEN_NORMALIZEDs.size();
+
+	for (u_int i = first; i < last; ++i) {
+		Spectrum c;
+		bool written = false;
+
+		for (u_int group = 0; group < perPixelCount; ++group) {
+			const RadianceChannelScale &scale = radianceChannelScales[group];
+			if (!scale.enabled)
+				continue;
+
+			const float *sp = channel_RADIANCE_PER_PIXEL_NORMALIZEDs[group]->GetPixel(i);
+			if (sp[3] > 0.f) {
+				Spectrum s(sp);
+				s /= sp[3];
+				c += scale.Scale(s);
+				written = true;
 			}
 		}
-	}
 
-	if (HasChannel(RADIANCE_PER_SCREEN_NORMALIZED)) {
-		const float factor = pixelCount / statsTotalSampleCount;
+		for (u_int group = 0; group < perScreenCount; ++group) {
+			const RadianceChannelScale &scale = radianceChannelScales[group];
+			if (!scale.enabled)
+				continue;
 
-		for (u_int i = 0; i < radianceGroupCount; ++i) {
-			if (radianceChannelScales[i].enabled) {
-				#pragma omp parallel for
-				for (
-						// Visual C++ 2013 supports only OpenMP 2.5
-#if _OPENMP >= 200805
-						unsigned
-#endif
-				int j = 0; j < pixelCount; ++j) {
-					Spectrum s(channel_RADIANCE_PER_SCREEN_NORMALIZEDs[i]->GetPixel(j));
-
-					if (!s.Black()) {
-						s = factor * radianceChannelScales[i].Scale(s);
-
-						u_int *fbMask = channel_FRAMEBUFFER_MASK->GetPixel(j);
-						if (*fbMask)
-							p[j] += s;
-						else
-							p[j] = s;
-						*fbMask = 1;
-					}
-				}
+			const Spectrum s(channel_RADIANCE_PER_SCREEN_NORMALIZEDs[group]->GetPixel(i));
+			if (!s.Black()) {
+				c += screenFactor * scale.Scale(s);
+				written = true;
 			}
 		}
-	}
 
-	if (!enabledOverlappedScreenBufferUpdate) {
-		for (u_int i = 0; i < pixelCount; ++i) {
-			if (!(*(channel_FRAMEBUFFER_MASK->GetPixel(i))))
+		u_int *fbMask = channel_FRAMEBUFFER_MASK->GetPixel(i);
+		if (written) {
+			p[i] = c;
+			*fbMask = 1;
+		} else {
+			if (!enabledOverlappedScreenBufferUpdate)
 				p[i] = Spectrum();
+			*fbMask = 0;
 		}
 	}
 }
 
-void Film::AddSampleResultColor(const u_int x, const u_int y,
+void Film::AddSampleResultColorLockLess(const u_int x, const u_int y,
 		const SampleResult &sampleResult, const float weight)  {
 	if ((channel_RADIANCE_PER_PIXEL_NORMALIZEDs.size() > 0) && sampleResult.HasChannel(RADIANCE_PER_PIXEL_NORMALIZED)) {
 		for (u_int i = 0; i < Min(sampleResult.radiance.size(), channel_RADIANCE_PER_PIXEL_NORMALIZEDs.size()); ++i) {
@@ -1270,7 +1595,7 @@ void Film::AddSampleResultColor(const u_int x, const u_int y,
 	}
 }
 
-void Film::AddSampleResultData(const u_int x, const u_int y,
+void Film::AddSampleResultDataLockLess(const u_int x, const u_int y,
 		const SampleResult &sampleResult)  {
 	bool depthWrite = true;
 
@@ -1309,11 +1634,43 @@ void Film::AddSampleResultData(const u_int x, const u_int y,
 		channel_RAYCOUNT->AddPixel(x, y, &sampleResult.rayCount);
 }
 
+void Film::AddSampleResultColor(const u_int x, const u_int y,
+		const SampleResult &sampleResult, const float weight)  {
+	if (tileLocks) {
+		boost::unique_lock<boost::mutex> lock(GetTileLock(x, y));
+		AddSampleResultColorLockLess(x, y, sampleResult, weight);
+	} else
+		AddSampleResultColorLockLess(x, y, sampleResult, weight);
+
+	MarkDirtyPixel(x, y);
+}
+
+void Film::AddSampleResultData(const u_int x, const u_int y,
+		const SampleResult &sampleResult)  {
+	if (tileLocks) {
+		boost::unique_lock<boost::mutex> lock(GetTileLock(x, y));
+		AddSampleResultDataLockLess(x, y, sampleResult);
+	} else
+		AddSampleResultDataLockLess(x, y, sampleResult);
+
+	MarkDirtyPixel(x, y);
+}
+
 void Film::AddSample(const u_int x, const u_int y,
 		const SampleResult &sampleResult, const float weight) {
-	AddSampleResultColor(x, y, sampleResult, weight);
-	if (hasDataChannel)
-		AddSampleResultData(x, y, sampleResult);
+	if (tileLocks) {
+		boost::unique_lock<boost::mutex> lock(GetTileLock(x, y));
+
+		AddSampleResultColorLockLess(x, y, sampleResult, weight);
+		if (hasDataChannel)
+			AddSampleResultDataLockLess(x, y, sampleResult);
+	} else {
+		AddSampleResultColorLockLess(x, y, sampleResult, weight);
+		if (hasDataChannel)
+			AddSampleResultDataLockLess(x, y, sampleResult);
+	}
+
+	MarkDirtyPixel(x, y);
 }
 
 void Film::ResetConvergenceTest() {
@@ -1383,6 +1740,8 @@ Film::FilmChannelType Film::String2FilmChannelType(const std::string &type) {
 		return OBJECT_ID_MASK;
 	else if (type == "BY_OBJECT_ID")
 		return BY_OBJECT_ID;
+	else if (type == "CONVERGENCE")
+		return CONVERGENCE;
 	else
 		throw runtime_error("Unknown film output type in Film::String2FilmChannelType(): " + type);
 }
@@ -1437,7 +1796,37 @@ const std::string Film::FilmChannelType2String(const Film::FilmChannelType type)
 			return "OBJECT_ID_MASK";
 		case Film::BY_OBJECT_ID:
 			return "BY_OBJECT_ID";
+		case Film::CONVERGENCE:
+			return "CONVERGENCE";
 		default:
 			throw runtime_error("Unknown film output type in Film::FilmChannelType2String(): " + ToString(type));
 	}
 }
+
+//------------------------------------------------------------------------------
+// FrameBufferStorageType
+//------------------------------------------------------------------------------
+
+FrameBufferStorageType slg::String2FrameBufferStorageType(const std::string &type) {
+	if (type == "FLOAT")
+		return FRAMEBUFFER_STORAGE_FLOAT;
+	else if (type == "HALF")
+		return FRAMEBUFFER_STORAGE_HALF;
+	else if (type == "BYTE")
+		return FRAMEBUFFER_STORAGE_BYTE;
+	else
+		throw runtime_error("Unknown frame buffer storage type in String2FrameBufferStorageType(): " + type);
+}
+
+const std::string slg::FrameBufferStorageType2String(const FrameBufferStorageType type) {
+	switch (type) {
+		case FRAMEBUFFER_STORAGE_FLOAT:
+			return "FLOAT";
+		case FRAMEBUFFER_STORAGE_HALF:
+			return "HALF";
+		case FRAMEBUFFER_STORAGE_BYTE:
+			return "BYTE";
+		default:
+			throw runtime_error("Unknown frame buffer storage type in FrameBufferStorageType2String(): " + ToString(type));
+	}
+}
@@ -0,0 +1,164 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+#include <algorithm>
+
+#include "slg/film/film.h"
+#include "slg/film/filmasyncimagepipeline.h"
+
+using namespace std;
+using namespace luxrays;
+using namespace slg;
+
+//------------------------------------------------------------------------------
+// FilmAsyncImagePipeline
+//------------------------------------------------------------------------------
+
+FilmAsyncImagePipeline::FilmAsyncImagePipeline(Film *flm) : film(flm) {
+	snapshot = new Film(film->GetWidth(), film->GetHeight(), film->GetSubRegion());
+	snapshot->CopyDynamicSettings(*film);
+
+	// The snapshot has only the channels read by the image pipelines, the
+	// other AOVs would double the memory and the time of each update
+	u_int requiredChannels = Film::RADIANCE_PER_PIXEL_NORMALIZED | Film::RADIANCE_PER_SCREEN_NORMALIZED |
+			Film::IMAGEPIPELINE | Film::FRAMEBUFFER_MASK;
+	for (u_int i = 0; i < film->channel_IMAGEPIPELINEs.size(); ++i)
+		requiredChannels |= film->GetImagePipeline(i)->GetRequiredChannels();
+	for (u_int type = Film::RADIANCE_PER_PIXEL_NORMALIZED; type <= Film::CONVERGENCE; type <<= 1) {
+		if (!(requiredChannels & type))
+			snapshot->RemoveChannel((Film::FilmChannelType)type);
+	}
+
+	snapshot->oclEnable = film->oclEnable;
+	snapshot->oclPlatformIndex = film->oclPlatformIndex;
+	snapshot->oclDeviceIndex = film->oclDeviceIndex;
+	snapshot->Init();
+
+	pendingIndex = -1;
+	completedIndex = -1;
+	snapshotSampleCount = 0.0;
+	working = false;
+	invalidated = false;
+	staleFrame = false;
+	done = false;
+
+	workerThread = new boost::thread(&FilmAsyncImagePipeline::WorkerThread, this);
+}
+
+FilmAsyncImagePipeline::~FilmAsyncImagePipeline() {
+	{
+		boost::unique_lock<boost::mutex> lock(workerMutex);
+
+		done = true;
+		workerCondition.notify_one();
+	}
+
+	workerThread->join();
+	delete workerThread;
+
+	delete snapshot;
+}
+
+void FilmAsyncImagePipeline::Invalidate() {
+	boost::unique_lock<boost::mutex> lock(workerMutex);
+
+	invalidated = true;
+}
+
+bool FilmAsyncImagePipeline::Refresh(const u_int index) {
+	boost::unique_lock<boost::mutex> lock(workerMutex);
+
+	if (index >= publishedFrames.size())
+		publishedFrames.resize(index + 1, false);
+
+	// The render engines merging the films of the render threads reset the
+	// film and add all samples again at each update: the frames are still
+	// valid if the film has at least the samples of the snapshot. Otherwise
+	// the rendering has been restarted and the frames show the old samples.
+	if (invalidated) {
+		if (film->GetTotalSampleCount() < snapshotSampleCount) {
+			// The frame in flight is dropped and the next one is executed
+			// by the caller
+			staleFrame = working;
+			completedIndex = -1;
+			fill(publishedFrames.begin(), publishedFrames.end(), false);
+		}
+
+		invalidated = false;
+	}
+
+	// The first frame is executed by the caller
+	if (!publishedFrames[index]) {
+		publishedFrames[index] = true;
+		return false;
+	}
+
+	if (!working) {
+		// Publish the completed frame
+		if (completedIndex >= 0) {
+			swap(film->channel_IMAGEPIPELINEs[completedIndex], snapshot->channel_IMAGEPIPELINEs[completedIndex]);
+			if (film->HasChannel(Film::FRAMEBUFFER_MASK))
+				swap(film->channel_FRAMEBUFFER_MASK, snapshot->channel_FRAMEBUFFER_MASK);
+
+			// The content of the film IMAGEPIPELINE channel has been replaced
+			film->InvalidateImagePipelines();
+			completedIndex = -1;
+		}
+
+		// Start a new execution on an updated snapshot of the film
+		snapshot->Reset();
+		snapshot->AddFilm(*film);
+		snapshotSampleCount = film->GetTotalSampleCount();
+
+		pendingIndex = index;
+		working = true;
+		workerCondition.notify_one();
+	}
+
+	return true;
+}
+
+void FilmAsyncImagePipeline::WorkerThread() {
+	boost::unique_lock<boost::mutex> lock(workerMutex);
+
+	for (;;) {
+		while (!done && (pendingIndex < 0))
+			workerCondition.wait(lock);
+		if (done)
+			break;
+
+		const u_int index = pendingIndex;
+		pendingIndex = -1;
+
+		// The film can be updated while the image pipeline is running
+		lock.unlock();
+		bool completed = true;
+		try {
+			snapshot->ExecuteImagePipeline(index);
+		} catch (exception &e) {
+			SLG_LOG("Error while executing the asynchronous image pipeline " << index << ": " << e.what());
+			completed = false;
+		}
+		lock.lock();
+
+		if (completed && !staleFrame)
+			completedIndex = index;
+		working = false;
+		staleFrame = false;
+	}
+}
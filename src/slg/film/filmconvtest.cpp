@@ -18,6 +18,9 @@
 
 #include <limits>
 
+#include <boost/bind.hpp>
+
+#include "luxrays/utils/taskscheduler.h"
 #include "slg/film/film.h"
 #include "slg/film/filmconvtest.h"
 
@@ -31,14 +34,17 @@ using namespace slg;
 
 FilmConvTest::FilmConvTest(const Film *flm) : film(flm) {
 	referenceImage = new GenericFrameBuffer<3, 0, float>(film->GetWidth(), film->GetHeight());
+	referenceWeights = new GenericFrameBuffer<1, 0, float>(film->GetWidth(), film->GetHeight());
 
 	Reset();
 }
 
-FilmConvTest::FilmConvTest() {
+FilmConvTest::FilmConvTest() : film(NULL), referenceImage(NULL), referenceWeights(NULL) {
 }
 
 FilmConvTest::~FilmConvTest() {
+	delete referenceImage;
+	delete referenceWeights;
 }
 
 void FilmConvTest::Reset() {
@@ -46,41 +52,212 @@ void FilmConvTest::Reset() {
 	maxError = numeric_limits<float>::infinity();
 
 	referenceImage->Clear(0.f);
+	referenceWeights->Clear(0.f);
 	firstTest = true;
+
+	// All pixels have to be sampled until the first test has been run
+	if (film->HasChannel(Film::CONVERGENCE))
+		film->channel_CONVERGENCE->Clear(numeric_limits<float>::infinity());
+}
+
+void FilmConvTest::WeightRows(const u_int firstRow, const u_int lastRow) {
+	const u_int width = film->GetWidth();
+	const GenericFrameBuffer<4, 1, float> *radiance = film->channel_RADIANCE_PER_PIXEL_NORMALIZEDs[0];
+
+	// The weights of a thread safe film can be written at the same time
+	film->LockTileRows(firstRow, lastRow);
+	for (u_int y = firstRow; y < lastRow; ++y) {
+		const float *pixel = radiance->GetPixel(y * width);
+		float *ref = referenceWeights->GetPixel(y * width);
+		float *weightDelta = &pixelErrors[y * width];
+
+		double rowDelta = 0.0;
+		for (u_int x = 0; x < width; ++x, pixel += 4) {
+			const float weight = pixel[3];
+			weightDelta[x] = weight - ref[x];
+			ref[x] = weight;
+
+			rowDelta += weightDelta[x];
+		}
+
+		rowWeightDelta[y] = rowDelta;
+	}
+	film->UnlockTileRows(firstRow, lastRow);
+}
+
+void FilmConvTest::TestRows(const u_int firstRow, const u_int lastRow, const float threshold,
+		const float meanWeightDelta) {
+	// The change of a pixel between 2 tests shrinks with the number of samples
+	// it has received in the meantime. Adaptive sampling gives less samples to
+	// some pixels so, to not mistake them for converged, the error of each
+	// pixel is rescaled to the mean weight added to the film pixels: the
+	// standard deviation of the change grows with the square root of the
+	// number of samples. A pixel without new samples can't be tested and it is
+	// left to do.
+	const bool normalize = (meanWeightDelta > 0.f);
+	const u_int width = film->GetWidth();
+	const GenericFrameBuffer<3, 0, float> *image = film->channel_IMAGEPIPELINEs[0];
+	const float inf = numeric_limits<float>::infinity();
+
+	for (u_int y = firstRow; y < lastRow; ++y) {
+		const float *img = image->GetPixel(y * width);
+		float *ref = referenceImage->GetPixel(y * width);
+		// The weight delta of each pixel is replaced by its error
+		float *errorRow = &pixelErrors[y * width];
+
+		u_int todo = 0;
+		float error = 0.f;
+		u_int x = 0;
+#if defined(SLG_FRAMEBUFFER_SSE)
+		// Number of bits set in a 4 bits mask
+		static const u_int bitCount[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+		const __m128 signMask = _mm_set1_ps(-0.f);
+		const __m128 thresholdVec = _mm_set1_ps(threshold);
+		const __m128 meanWeightDeltaVec = _mm_set1_ps(meanWeightDelta);
+		const __m128 zeroVec = _mm_setzero_ps();
+		const __m128 oneVec = _mm_set1_ps(1.f);
+		const __m128 infVec = _mm_set1_ps(inf);
+		__m128 errorVec = _mm_setzero_ps();
+
+		// 4 pixels (12 values) for each iteration
+		for (; x + 4 <= width; x += 4, img += 12, ref += 12) {
+			const __m128 i0 = _mm_loadu_ps(&img[0]);
+			const __m128 i1 = _mm_loadu_ps(&img[4]);
+			const __m128 i2 = _mm_loadu_ps(&img[8]);
+			const __m128 d0 = _mm_andnot_ps(signMask, _mm_sub_ps(i0, _mm_loadu_ps(&ref[0])));
+			const __m128 d1 = _mm_andnot_ps(signMask, _mm_sub_ps(i1, _mm_loadu_ps(&ref[4])));
+			const __m128 d2 = _mm_andnot_ps(signMask, _mm_sub_ps(i2, _mm_loadu_ps(&ref[8])));
+			_mm_storeu_ps(&ref[0], i0);
+			_mm_storeu_ps(&ref[4], i1);
+			_mm_storeu_ps(&ref[8], i2);
+
+			// From RGBR GBRG BRGB to RRRR GGGG BBBB
+			const __m128 r = _mm_shuffle_ps(d0, _mm_shuffle_ps(d1, d2, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+			const __m128 g = _mm_shuffle_ps(_mm_shuffle_ps(d0, d1, _MM_SHUFFLE(0, 0, 1, 1)),
+					_mm_shuffle_ps(d1, d2, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+			const __m128 b = _mm_shuffle_ps(_mm_shuffle_ps(d0, d1, _MM_SHUFFLE(1, 1, 2, 2)),
+					_mm_shuffle_ps(d2, d2, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+			__m128 pixelError = _mm_max_ps(_mm_max_ps(r, g), b);
+
+			__m128 noSamples = zeroVec;
+			if (normalize) {
+				const __m128 weightDelta = _mm_loadu_ps(&errorRow[x]);
+				noSamples = _mm_cmple_ps(weightDelta, zeroVec);
+				// The pixels without new samples would be divided by 0
+				const __m128 safeWeightDelta = _mm_or_ps(_mm_andnot_ps(noSamples, weightDelta), _mm_and_ps(noSamples, oneVec));
+				pixelError = _mm_andnot_ps(noSamples, _mm_mul_ps(pixelError,
+						_mm_sqrt_ps(_mm_div_ps(meanWeightDeltaVec, safeWeightDelta))));
+			}
+			errorVec = _mm_max_ps(errorVec, pixelError);
+
+			const __m128 pixelTodo = _mm_or_ps(_mm_cmpgt_ps(pixelError, thresholdVec), noSamples);
+			todo += bitCount[_mm_movemask_ps(pixelTodo)];
+
+			_mm_storeu_ps(&errorRow[x], _mm_or_ps(_mm_and_ps(noSamples, infVec),
+					_mm_and_ps(pixelTodo, pixelError)));
+		}
+
+		float errors[4];
+		_mm_storeu_ps(errors, errorVec);
+		error = Max(Max(errors[0], errors[1]), Max(errors[2], errors[3]));
+#endif
+		for (; x < width; ++x, img += 3, ref += 3) {
+			float pixelError = Max(Max(fabsf(img[0] - ref[0]), fabsf(img[1] - ref[1])), fabsf(img[2] - ref[2]));
+			ref[0] = img[0];
+			ref[1] = img[1];
+			ref[2] = img[2];
+
+			bool noSamples = false;
+			if (normalize) {
+				const float weightDelta = errorRow[x];
+				noSamples = (weightDelta <= 0.f);
+				pixelError = noSamples ? 0.f : (pixelError * sqrtf(meanWeightDelta / weightDelta));
+			}
+			error = Max(error, pixelError);
+
+			const bool pixelTodo = (pixelError > threshold) || noSamples;
+			todo += pixelTodo ? 1 : 0;
+
+			errorRow[x] = noSamples ? inf : (pixelTodo ? pixelError : 0.f);
+		}
+
+		rowTodoPixelsCount[y] = todo;
+		rowMaxError[y] = error;
+	}
+}
+
+void FilmConvTest::NormalizeRows(const u_int firstRow, const u_int lastRow, const float invMaxError) {
+	const u_int width = film->GetWidth();
+
+	for (u_int y = firstRow; y < lastRow; ++y) {
+		const float *errorRow = &pixelErrors[y * width];
+		float *convergenceRow = film->channel_CONVERGENCE->GetPixel(y * width);
+
+		// Converged pixels are 0.0 and the pixels without new samples (INFINITY)
+		// are clamped to 1.0
+		for (u_int x = 0; x < width; ++x)
+			convergenceRow[x] = Min(errorRow[x] * invMaxError, 1.f);
+	}
 }
 
 u_int FilmConvTest::Test(const float threshold) {
 	const u_int pixelsCount = film->GetWidth() * film->GetHeight();
+	const bool hasWeights = film->HasChannel(Film::RADIANCE_PER_PIXEL_NORMALIZED);
 
 	if (firstTest) {
-		// Copy the current image
+		// Copy the current image and pixel weights
 		referenceImage->Copy(film->channel_IMAGEPIPELINEs[0]);
+		if (hasWeights) {
+			const GenericFrameBuffer<4, 1, float> *radiance = film->channel_RADIANCE_PER_PIXEL_NORMALIZEDs[0];
+			film->LockTileRows(0, film->GetHeight());
+			for (u_int i = 0; i < pixelsCount; ++i)
+				*(referenceWeights->GetPixel(i)) = radiance->GetPixel(i)[3];
+			film->UnlockTileRows(0, film->GetHeight());
+		}
 		firstTest = false;
 
 		SLG_LOG("Convergence test first pass");
 
 		return pixelsCount;
 	} else {
-		// Check the number of pixels over the threshold
-		const float *ref = referenceImage->GetPixels();
-		const float *img = film->channel_IMAGEPIPELINEs[0]->GetPixels();
-		
+		const u_int height = film->GetHeight();
+		pixelErrors.resize(pixelsCount);
+		rowWeightDelta.resize(height);
+		rowTodoPixelsCount.resize(height);
+		rowMaxError.resize(height);
+
+		// The mean weight added to the pixels since the last test. The films
+		// without RADIANCE_PER_PIXEL_NORMALIZED (i.e. light tracing) are sampled
+		// uniformly and the error doesn't need to be rescaled.
+		float meanWeightDelta = 0.f;
+		if (hasWeights) {
+			ParallelFor(0, height, 0,
+					boost::bind(&FilmConvTest::WeightRows, this, _1, _2));
+
+			double weightDelta = 0.0;
+			for (u_int y = 0; y < height; ++y)
+				weightDelta += rowWeightDelta[y];
+			meanWeightDelta = (float)(weightDelta / pixelsCount);
+		}
+
+		// Check the number of pixels over the threshold, the reference image
+		// is updated at the same time
+		ParallelFor(0, height, 0,
+				boost::bind(&FilmConvTest::TestRows, this, _1, _2, threshold, meanWeightDelta));
+
 		todoPixelsCount = 0;
 		maxError = 0.f;
+		for (u_int y = 0; y < height; ++y) {
+			todoPixelsCount += rowTodoPixelsCount[y];
+			maxError = Max(maxError, rowMaxError[y]);
+		}
 
-		for (u_int i = 0; i < pixelsCount; ++i) {
-			const float dr = fabsf((*img++) - (*ref++));
-			const float dg = fabsf((*img++) - (*ref++));
-			const float db = fabsf((*img++) - (*ref++));
-			const float diff = Max(Max(dr, dg), db);
-			maxError = Max(maxError, diff);
-
-			if (diff > threshold)
-				++todoPixelsCount;
+		// Publish the CONVERGENCE channel, normalized in the [0.0, 1.0] range
+		if (film->HasChannel(Film::CONVERGENCE)) {
+			ParallelFor(0, height, 0,
+					boost::bind(&FilmConvTest::NormalizeRows, this, _1, _2,
+						(maxError > 0.f) ? (1.f / maxError) : 1.f));
 		}
-		
-		// Copy the current image
-		referenceImage->Copy(film->channel_IMAGEPIPELINEs[0]);
 
 		SLG_LOG("Convergence test: ToDo Pixels = " << todoPixelsCount << ", Max. Error = " << maxError << " [" << (256.f * maxError) << "/256]");
 
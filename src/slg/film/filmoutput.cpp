@@ -103,6 +103,8 @@ size_t Film::GetOutputSize(const FilmOutputs::FilmOutputType type) const {
 			return 3 * pixelCount;
 		case FilmOutputs::FRAMEBUFFER_MASK:
 			return pixelCount;
+		case FilmOutputs::CONVERGENCE:
+			return pixelCount;
 		default:
 			throw runtime_error("Unknown FilmOutputType in Film::GetOutputSize(): " + ToString(type));
 	}
@@ -166,11 +168,72 @@ bool Film::HasOutput(const FilmOutputs::FilmOutputType type) const {
 			return HasChannel(BY_OBJECT_ID);
 		case FilmOutputs::FRAMEBUFFER_MASK:
 			return HasChannel(FRAMEBUFFER_MASK);
+		case FilmOutputs::CONVERGENCE:
+			return HasChannel(CONVERGENCE);
 		default:
 			throw runtime_error("Unknown film output type in Film::HasOutput(): " + ToString(type));
 	}
 }
 
+bool Film::GetOutputChannelType(const FilmOutputs::FilmOutputType outputType,
+		FilmChannelType *channelType) {
+	switch (outputType) {
+		case FilmOutputs::ALPHA:
+			*channelType = ALPHA;
+			return true;
+		case FilmOutputs::GEOMETRY_NORMAL:
+			*channelType = GEOMETRY_NORMAL;
+			return true;
+		case FilmOutputs::SHADING_NORMAL:
+			*channelType = SHADING_NORMAL;
+			return true;
+		case FilmOutputs::DIRECT_DIFFUSE:
+			*channelType = DIRECT_DIFFUSE;
+			return true;
+		case FilmOutputs::DIRECT_GLOSSY:
+			*channelType = DIRECT_GLOSSY;
+			return true;
+		case FilmOutputs::EMISSION:
+			*channelType = EMISSION;
+			return true;
+		case FilmOutputs::INDIRECT_DIFFUSE:
+			*channelType = INDIRECT_DIFFUSE;
+			return true;
+		case FilmOutputs::INDIRECT_GLOSSY:
+			*channelType = INDIRECT_GLOSSY;
+			return true;
+		case FilmOutputs::INDIRECT_SPECULAR:
+			*channelType = INDIRECT_SPECULAR;
+			return true;
+		case FilmOutputs::MATERIAL_ID_MASK:
+			*channelType = MATERIAL_ID_MASK;
+			return true;
+		case FilmOutputs::DIRECT_SHADOW_MASK:
+			*channelType = DIRECT_SHADOW_MASK;
+			return true;
+		case FilmOutputs::INDIRECT_SHADOW_MASK:
+			*channelType = INDIRECT_SHADOW_MASK;
+			return true;
+		case FilmOutputs::UV:
+			*channelType = UV;
+			return true;
+		case FilmOutputs::BY_MATERIAL_ID:
+			*channelType = BY_MATERIAL_ID;
+			return true;
+		case FilmOutputs::IRRADIANCE:
+			*channelType = IRRADIANCE;
+			return true;
+		case FilmOutputs::OBJECT_ID_MASK:
+			*channelType = OBJECT_ID_MASK;
+			return true;
+		case FilmOutputs::BY_OBJECT_ID:
+			*channelType = BY_OBJECT_ID;
+			return true;
+		default:
+			return false;
+	}
+}
+
 void Film::Output() {
 	for (u_int i = 0; i < filmOutputs.GetCount(); ++i)
 		Output(filmOutputs.GetFileName(i), filmOutputs.GetType(i),&filmOutputs.GetProperties(i));
@@ -372,6 +435,11 @@ void Film::Output(const string &fileName,const FilmOutputs::FilmOutputType type,
 				return;
 			channelCount = 1;
 			break;
+		case FilmOutputs::CONVERGENCE:
+			if (!HasChannel(CONVERGENCE))
+				return;
+			channelCount = 1;
+			break;
 		default:
 			throw runtime_error("Unknown film output type in Film::Output(): " + ToString(type));
 	}
@@ -550,6 +618,10 @@ void Film::Output(const string &fileName,const FilmOutputs::FilmOutputType type,
 					channel_RAYCOUNT->GetWeightedPixel(x, y, pixel);
 					break;
 				}
+				case FilmOutputs::CONVERGENCE: {
+					channel_CONVERGENCE->GetWeightedPixel(x, y, pixel);
+					break;
+				}
 				case FilmOutputs::BY_MATERIAL_ID: {
 					channel_BY_MATERIAL_IDs[byMaterialIDsIndex]->GetWeightedPixel(x, y, pixel);
 					break;
@@ -579,6 +651,22 @@ void Film::Output(const string &fileName,const FilmOutputs::FilmOutputType type,
 		}
 	}
 	
+	// Channels with a compact storage type are written with the same precision
+	// (if the file format supports it)
+	FilmChannelType channelType;
+	if (GetOutputChannelType(type, &channelType)) {
+		switch (GetChannelStorage(channelType)) {
+			case FRAMEBUFFER_STORAGE_HALF:
+				buffer.set_write_format(TypeDesc::HALF);
+				break;
+			case FRAMEBUFFER_STORAGE_BYTE:
+				buffer.set_write_format(TypeDesc::UINT8);
+				break;
+			default:
+				break;
+		}
+	}
+
 	buffer.write(fileName);
 }
 
@@ -590,7 +678,7 @@ template<> void Film::GetOutput<float>(const FilmOutputs::FilmOutputType type, f
 			break;
 		}
 		case FilmOutputs::RGB_IMAGEPIPELINE:
-			ExecuteImagePipeline(index);
+			RefreshImagePipeline(index);
 
 			copy(channel_IMAGEPIPELINEs[index]->GetPixels(), channel_IMAGEPIPELINEs[index]->GetPixels() + pixelCount * 3, buffer);
 			break;
@@ -603,7 +691,7 @@ template<> void Film::GetOutput<float>(const FilmOutputs::FilmOutputType type, f
 			break;
 		}
 		case FilmOutputs::RGBA_IMAGEPIPELINE: {
-			ExecuteImagePipeline(index);
+			RefreshImagePipeline(index);
 
 			float *srcRGB = channel_IMAGEPIPELINEs[index]->GetPixels();
 			float *dst = buffer;
@@ -713,6 +801,9 @@ template<> void Film::GetOutput<float>(const FilmOutputs::FilmOutputType type, f
 		case FilmOutputs::RAYCOUNT:
 			copy(channel_RAYCOUNT->GetPixels(), channel_RAYCOUNT->GetPixels() + pixelCount, buffer);
 			break;
+		case FilmOutputs::CONVERGENCE:
+			copy(channel_CONVERGENCE->GetPixels(), channel_CONVERGENCE->GetPixels() + pixelCount, buffer);
+			break;
 		case FilmOutputs::BY_MATERIAL_ID: {
 			for (u_int i = 0; i < pixelCount; ++i)
 				channel_BY_MATERIAL_IDs[index]->GetWeightedPixel(i, &buffer[i * 3]);
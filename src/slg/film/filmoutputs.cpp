@@ -242,6 +242,13 @@ Properties FilmOutputs::ToProperties(const Properties &cfg) {
 					throw runtime_error("FrameBuffer Mask image can be saved only in non HDR formats: " + outputName);
 				break;
 			}
+			case CONVERGENCE: {
+				if (hdrImage)
+					props << type << fileName;
+				else
+					throw runtime_error("Convergence image can be saved only in HDR formats: " + outputName);
+				break;
+			}
 			default:
 				throw runtime_error("Unknown film output type: " + type.Get<string>());
 		}
@@ -307,6 +314,8 @@ FilmOutputs::FilmOutputType FilmOutputs::String2FilmOutputType(const string &typ
 		return BY_OBJECT_ID;
 	else if (type == "FRAMEBUFFER_MASK")
 		return FRAMEBUFFER_MASK;
+	else if (type == "CONVERGENCE")
+		return CONVERGENCE;
 	else
 		throw runtime_error("Unknown film output type: " + type);
 }
@@ -369,6 +378,8 @@ const string FilmOutputs::FilmOutputType2String(const FilmOutputs::FilmOutputTyp
 			return "BY_OBJECT_ID";
 		case FRAMEBUFFER_MASK:
 			return "FRAMEBUFFER_MASK";
+		case CONVERGENCE:
+			return "CONVERGENCE";
 		default:
 			throw runtime_error("Unknown film output type: " + ToString(type));
 	}
@@ -342,9 +342,25 @@ void Film::ParseOutputs(const Properties &props) {
 				filmOutputs.Add(FilmOutputs::FRAMEBUFFER_MASK, fileName);
 				break;
 			}
+			case FilmOutputs::CONVERGENCE: {
+				if (!initialized)
+					AddChannel(Film::CONVERGENCE);
+				filmOutputs.Add(FilmOutputs::CONVERGENCE, fileName);
+				break;
+			}
 			default:
 				throw runtime_error("Unknown type in film output: " + type);
 		}
+
+		// The (optional) storage type of the channel used by the output
+		const string storageTag = "film.outputs." + outputName + ".storage";
+		if (props.IsDefined(storageTag)) {
+			Film::FilmChannelType channelType;
+			if (!GetOutputChannelType(FilmOutputs::String2FilmOutputType(type), &channelType))
+				throw runtime_error("Film output " + outputName + " doesn't support a storage type");
+
+			SetChannelStorage(channelType, String2FrameBufferStorageType(props.Get(storageTag).Get<string>()));
+		}
 	}
 
 	// For compatibility with the past
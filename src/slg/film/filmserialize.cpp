@@ -22,6 +22,7 @@
 #include <boost/foreach.hpp>
 #include <boost/serialization/vector.hpp>
 #include <boost/serialization/set.hpp>
+#include <boost/serialization/map.hpp>
 
 #include "slg/film/film.h"
 
@@ -86,8 +87,12 @@ template<class Archive> void Film::load(Archive &ar, const u_int version) {
 	ar & channel_OBJECT_ID_MASKs;
 	ar & channel_BY_OBJECT_IDs;
 	ar & channel_FRAMEBUFFER_MASK;
+	if (version >= 10)
+		ar & channel_CONVERGENCE;
 
 	ar & channels;
+	if (version >= 9)
+		ar & channelStorages;
 	ar & width;
 	ar & height;
 	ar & subRegion[0];
@@ -113,6 +118,7 @@ template<class Archive> void Film::load(Archive &ar, const u_int version) {
 	ar & enabledConvTest;
 	ar & enabledOverlappedScreenBufferUpdate;
 
+	AllocDirtyTiles();
 	SetUpOCL();
 }
 
@@ -143,8 +149,10 @@ template<class Archive> void Film::save(Archive &ar, const u_int version) const
 	ar & channel_OBJECT_ID_MASKs;
 	ar & channel_BY_OBJECT_IDs;
 	ar & channel_FRAMEBUFFER_MASK;
+	ar & channel_CONVERGENCE;
 
 	ar & channels;
+	ar & channelStorages;
 	ar & width;
 	ar & height;
 	ar & subRegion[0];
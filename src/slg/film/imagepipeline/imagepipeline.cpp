@@ -17,8 +17,10 @@
  ***************************************************************************/
 
 #include <boost/foreach.hpp>
+#include <boost/bind.hpp>
 #include <boost/serialization/export.hpp>
 
+#include "luxrays/utils/taskscheduler.h"
 #include "slg/film/imagepipeline/imagepipeline.h"
 #include "slg/film/imagepipeline/plugins/gammacorrection.h"
 #include "slg/film/film.h"
@@ -75,6 +77,17 @@ float ImagePipelinePlugin::GetGammaCorrectionValue(const Film &film, const u_int
 	return gamma;
 }
 
+void ImagePipelinePlugin::ApplyPerPixel(Film &film, const u_int index) {
+	vector<u_int> regions(4);
+	regions[0] = 0;
+	regions[1] = film.GetWidth();
+	regions[2] = 0;
+	regions[3] = film.GetHeight();
+
+	ImagePipelinePlugin *plugin = this;
+	ImagePipeline::ApplyPerPixelPlugins(film, index, &plugin, 1, regions);
+}
+
 //------------------------------------------------------------------------------
 // ImagePipeline
 //------------------------------------------------------------------------------
@@ -83,6 +96,7 @@ BOOST_CLASS_EXPORT_IMPLEMENT(slg::ImagePipeline)
 
 ImagePipeline::ImagePipeline() {
 	canUseOpenCL = false;
+	isPerPixel = true;
 }
 
 ImagePipeline::~ImagePipeline() {
@@ -100,20 +114,49 @@ ImagePipeline *ImagePipeline::Copy() const {
 	return ip;
 }
 
+u_int ImagePipeline::GetRequiredChannels() const {
+	u_int channels = 0;
+	BOOST_FOREACH(ImagePipelinePlugin *plugin, pipeline)
+		channels |= plugin->GetRequiredChannels();
+
+	return channels;
+}
+
 void ImagePipeline::AddPlugin(ImagePipelinePlugin *plugin) {
 	pipeline.push_back(plugin);
 
 	canUseOpenCL |= plugin->CanUseOpenCL();
+	isPerPixel = isPerPixel && plugin->IsPerPixel();
+}
+
+bool ImagePipeline::IsFusible(const Film &film, const ImagePipelinePlugin *plugin) {
+#if !defined(LUXRAYS_DISABLE_OPENCL)
+	if (film.oclEnable && film.oclIntersectionDevice && plugin->CanUseOpenCL())
+		return false;
+#endif
+
+	return plugin->IsPerPixel();
 }
 
 void ImagePipeline::Apply(Film &film, const u_int index) {
 	//const double t1 = WallClockTime();
 
+	vector<u_int> filmRegion(4);
+	filmRegion[0] = 0;
+	filmRegion[1] = film.GetWidth();
+	filmRegion[2] = 0;
+	filmRegion[3] = film.GetHeight();
+
 #if !defined(LUXRAYS_DISABLE_OPENCL)
 	bool imageInCPURam = true;
-	BOOST_FOREACH(ImagePipelinePlugin *plugin, pipeline) {
+#endif
+	u_int i = 0;
+	while (i < pipeline.size()) {
 		//const double p1 = WallClockTime();
 
+		ImagePipelinePlugin *plugin = pipeline[i];
+
+#if !defined(LUXRAYS_DISABLE_OPENCL)
 		const bool useOpenCLApply = film.oclEnable && film.oclIntersectionDevice &&
 				plugin->CanUseOpenCL();
 
@@ -139,36 +182,110 @@ void ImagePipeline::Apply(Film &film, const u_int index) {
 		if (useOpenCLApply) {
 			plugin->ApplyOCL(film, index);
 			imageInCPURam = false;
+			++i;
+		} else
+#endif
+		if (IsFusible(film, plugin)) {
+			// Fuse all the following per-pixel plugins in a single pass
+			u_int last = i + 1;
+			while ((last < pipeline.size()) && IsFusible(film, pipeline[last]))
+				++last;
+
+			ApplyPerPixelPlugins(film, index, &pipeline[i], last - i, filmRegion);
+#if !defined(LUXRAYS_DISABLE_OPENCL)
+			imageInCPURam = true;
+#endif
+			i = last;
 		} else {
+			// The plugins reading the sample channels of a thread safe film
+			// have to own the tile locks
+			const bool lockTiles = plugin->GetRequiredChannels() && film.IsThreadSafe();
+			if (lockTiles)
+				film.LockTileRows(0, film.GetHeight());
 			plugin->Apply(film, index);
-			imageInCPURam = true;			
+			if (lockTiles)
+				film.UnlockTileRows(0, film.GetHeight());
+#if !defined(LUXRAYS_DISABLE_OPENCL)
+			imageInCPURam = true;
+#endif
+			++i;
 		}
-		
+
 		//const double p2 = WallClockTime();
 		//SLG_LOG("ImagePipeline plugin time: " << int((p2 - p1) * 1000.0) << "ms");
 	}
 
+#if !defined(LUXRAYS_DISABLE_OPENCL)
 	if (film.oclEnable && film.oclIntersectionDevice && canUseOpenCL) {
 		if (!imageInCPURam)
 			film.ReadOCLBuffer_IMAGEPIPELINE(index);
 
 		film.oclIntersectionDevice->GetOpenCLQueue().finish();
 	}
-#else
-	BOOST_FOREACH(ImagePipelinePlugin *plugin, pipeline) {
-		//const double p1 = WallClockTime();
-
-		plugin->Apply(film, index);
-		
-		//const double p2 = WallClockTime();
-		//SLG_LOG("ImagePipeline plugin time: " << int((p2 - p1) * 1000.0) << "ms");
-	}
 #endif
 
 	//const double t2 = WallClockTime();
 	//SLG_LOG("ImagePipeline time: " << int((t2 - t1) * 1000.0) << "ms");
 }
 
+void ImagePipeline::ApplyRegions(Film &film, const u_int index,
+		const vector<u_int> &regions) {
+	assert (isPerPixel);
+
+	if (pipeline.size() > 0)
+		ApplyPerPixelPlugins(film, index, &pipeline[0], pipeline.size(), regions);
+}
+
+void ImagePipeline::ApplyPerPixelPlugins(Film &film, const u_int index,
+		ImagePipelinePlugin *const *plugins, const u_int pluginCount,
+		const vector<u_int> &regions) {
+	// Split the regions in blocks of rows small enough to stay in the cache
+	vector<u_int> blocks;
+	for (u_int i = 0; i < regions.size(); i += 4) {
+		const u_int xStart = regions[i];
+		const u_int xEnd = regions[i + 1];
+		const u_int yStart = regions[i + 2];
+		const u_int yEnd = regions[i + 3];
+		if ((xStart >= xEnd) || (yStart >= yEnd))
+			continue;
+
+		const u_int blockHeight = Max(1u, PERPIXEL_BLOCK_PIXELS / (xEnd - xStart));
+		for (u_int y = yStart; y < yEnd; y += blockHeight) {
+			blocks.push_back(xStart);
+			blocks.push_back(xEnd);
+			blocks.push_back(y);
+			blocks.push_back(Min(y + blockHeight, yEnd));
+		}
+	}
+
+	// The plugins reading the sample channels of a thread safe film have to
+	// own the tile locks. The blocks of the same row of tiles are serialized
+	// so they are locked only if required.
+	bool readsSampleChannels = false;
+	for (u_int i = 0; i < pluginCount; ++i)
+		readsSampleChannels = readsSampleChannels || plugins[i]->GetRequiredChannels();
+	const bool lockTiles = readsSampleChannels && film.IsThreadSafe();
+
+	ParallelFor(0, blocks.size() / 4, 0, boost::bind(&ImagePipeline::ApplyPerPixelBlocks,
+			boost::ref(film), index, plugins, pluginCount, boost::cref(blocks), lockTiles, _1, _2));
+}
+
+void ImagePipeline::ApplyPerPixelBlocks(Film &film, const u_int index,
+		ImagePipelinePlugin *const *plugins, const u_int pluginCount,
+		const vector<u_int> &blocks, const bool lockTiles,
+		const u_int first, const u_int last) {
+	for (u_int i = first; i < last; ++i) {
+		const u_int *block = &blocks[i * 4];
+
+		if (lockTiles)
+			film.LockTileRows(block[2], block[3]);
+		for (u_int j = 0; j < pluginCount; ++j)
+			plugins[j]->ApplyRegion(film, index, block[0], block[1], block[2], block[3]);
+		if (lockTiles)
+			film.UnlockTileRows(block[2], block[3]);
+	}
+}
+
 const ImagePipelinePlugin *ImagePipeline::GetPlugin(const std::type_info &type) const {
 	BOOST_FOREACH(const ImagePipelinePlugin *plugin, pipeline) {
 		if (typeid(*plugin) == type)
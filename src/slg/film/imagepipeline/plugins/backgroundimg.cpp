@@ -78,6 +78,10 @@ ImagePipelinePlugin *BackgroundImgPlugin::Copy() const {
 	return new BackgroundImgPlugin(imgMap->Copy());
 }
 
+u_int BackgroundImgPlugin::GetRequiredChannels() const {
+	return Film::ALPHA;
+}
+
 void BackgroundImgPlugin::UpdateFilmImageMap(const Film &film) {
 	const u_int width = film.GetWidth();
 	const u_int height = film.GetHeight();
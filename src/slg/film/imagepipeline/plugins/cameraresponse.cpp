@@ -36,6 +36,8 @@ using namespace slg;
 
 BOOST_CLASS_EXPORT_IMPLEMENT(slg::CameraResponsePlugin)
 
+const float CameraResponsePlugin::LUT_MAX_ERROR = 1e-4f;
+
 // Estimates gamma in y = x^gamma using Gauss-Newton iterations
 static float EstimateGamma(const vector<float> &x, const vector<float> &y, float *rmse) {
 	const size_t n = x.size();
@@ -134,6 +136,8 @@ CameraResponsePlugin::CameraResponsePlugin(const string &name) {
 	AdjustGamma(greenI, greenB, 1.f / sourceGamma);
 	AdjustGamma(blueI, blueB, 1.f / sourceGamma);
 
+	InitLUTs();
+
 #if !defined(LUXRAYS_DISABLE_OPENCL)
 	oclIntersectionDevice = NULL;
 	oclRedI = NULL;
@@ -185,6 +189,7 @@ ImagePipelinePlugin *CameraResponsePlugin::Copy() const {
 	crp->greenB = greenB;
 	crp->blueI = blueI;
 	crp->blueB = blueB;
+	crp->InitLUTs();
 
 	return crp;
 }
@@ -194,12 +199,83 @@ ImagePipelinePlugin *CameraResponsePlugin::Copy() const {
 //------------------------------------------------------------------------------
 
 void CameraResponsePlugin::Apply(Film &film, const u_int index) {
-	Spectrum *pixels = (Spectrum *)film.channel_IMAGEPIPELINEs[index]->GetPixels();
-	const u_int pixelCount = film.GetWidth() * film.GetHeight();
+	ApplyPerPixel(film, index);
+}
+
+// The point is clamped to the LUT range instead of being tested, so the look
+// up can be inlined in the pixel loops of ApplyRegion()
+static inline float LookUpLUT(const float *values, const float start,
+		const float invStep, const u_int intervals, const float point) {
+	// Max() first so NaN is mapped to the start of the LUT
+	const float t = Min(Max((point - start) * invStep, 0.f), (float)intervals);
+	const u_int i = Min((u_int)t, intervals - 1);
+
+	return Lerp(t - i, values[i], values[i + 1]);
+}
+
+void CameraResponsePlugin::ApplyRegion(Film &film, const u_int index,
+		const u_int xStart, const u_int xEnd,
+		const u_int yStart, const u_int yEnd) {
+	const u_int width = xEnd - xStart;
+
+	if (!redLUT.accurate || (color && (!greenLUT.accurate || !blueLUT.accurate))) {
+		// Some curve is too steep for a LUT
+		for (u_int y = yStart; y < yEnd; ++y) {
+			RGBColor *pixel = (RGBColor *)film.channel_IMAGEPIPELINEs[index]->GetPixel(xStart, y);
+			const u_int *mask = film.channel_FRAMEBUFFER_MASK->GetPixel(xStart, y);
+
+			for (u_int x = 0; x < width; ++x) {
+				if (mask[x])
+					Map(pixel[x]);
+			}
+		}
+		return;
+	}
 
-	for (u_int i = 0; i < pixelCount; ++i) {
-		if (*(film.channel_FRAMEBUFFER_MASK->GetPixel(i)))
-			Map(pixels[i]);
+	const float *redValues = &redLUT.values[0];
+	const float redStart = redLUT.start;
+	const float redInvStep = redLUT.invStep;
+	const u_int redIntervals = redLUT.intervals;
+
+	if (color) {
+		const float *greenValues = &greenLUT.values[0];
+		const float greenStart = greenLUT.start;
+		const float greenInvStep = greenLUT.invStep;
+		const u_int greenIntervals = greenLUT.intervals;
+		const float *blueValues = &blueLUT.values[0];
+		const float blueStart = blueLUT.start;
+		const float blueInvStep = blueLUT.invStep;
+		const u_int blueIntervals = blueLUT.intervals;
+
+		for (u_int y = yStart; y < yEnd; ++y) {
+			float *pixel = film.channel_IMAGEPIPELINEs[index]->GetPixel(xStart, y);
+			const u_int *mask = film.channel_FRAMEBUFFER_MASK->GetPixel(xStart, y);
+
+			for (u_int x = 0; x < width; ++x, pixel += 3) {
+				const float r = LookUpLUT(redValues, redStart, redInvStep, redIntervals, pixel[0]);
+				const float g = LookUpLUT(greenValues, greenStart, greenInvStep, greenIntervals, pixel[1]);
+				const float b = LookUpLUT(blueValues, blueStart, blueInvStep, blueIntervals, pixel[2]);
+
+				pixel[0] = mask[x] ? r : pixel[0];
+				pixel[1] = mask[x] ? g : pixel[1];
+				pixel[2] = mask[x] ? b : pixel[2];
+			}
+		}
+	} else {
+		for (u_int y = yStart; y < yEnd; ++y) {
+			float *pixel = film.channel_IMAGEPIPELINEs[index]->GetPixel(xStart, y);
+			const u_int *mask = film.channel_FRAMEBUFFER_MASK->GetPixel(xStart, y);
+
+			for (u_int x = 0; x < width; ++x, pixel += 3) {
+				// Same weights of RGBColor::Y()
+				const float lum = 0.212671f * pixel[0] + 0.715160f * pixel[1] + 0.072169f * pixel[2];
+				const float v = LookUpLUT(redValues, redStart, redInvStep, redIntervals, lum);
+
+				pixel[0] = mask[x] ? v : pixel[0];
+				pixel[1] = mask[x] ? v : pixel[1];
+				pixel[2] = mask[x] ? v : pixel[2];
+			}
+		}
 	}
 }
 
@@ -229,6 +305,69 @@ float CameraResponsePlugin::ApplyCrf(float point, const vector<float> &from, con
 	return Lerp((point - x1) / (x2 - x1), y1, y2);
 }
 
+void CameraResponsePlugin::InitLUT(const vector<float> &from, const vector<float> &to,
+		CrfLUT &lut) const {
+	if (from.empty() || (from.size() != to.size()))
+		throw runtime_error("Wrong number of points in a Camera Response Function curve");
+
+	lut.start = from.front();
+
+	const float range = (from.size() < 2) ? 0.f : (from.back() - from.front());
+	if (!(range > 0.f)) {
+		// A constant function
+		lut.invStep = 0.f;
+		lut.intervals = 1;
+		lut.values.assign(2, to.back());
+		lut.accurate = true;
+		return;
+	}
+
+	// Use a multiple of the number of curve segments, so the LUT includes
+	// all the points of curves sampled at uniform steps and the LUT
+	// interpolation matches the curve one
+	const u_int segments = from.size() - 1;
+	u_int intervals = segments * Max(1u, (LUT_MIN_INTERVALS + segments - 1) / segments);
+
+	for (;;) {
+		lut.intervals = intervals;
+		lut.invStep = intervals / range;
+
+		lut.values.resize(intervals + 1);
+		for (u_int i = 0; i <= intervals; ++i)
+			lut.values[i] = ApplyCrf(lut.start + i * (range / intervals), from, to);
+		// Avoid any rounding error at the end of the range
+		lut.values[intervals] = to.back();
+
+		// The LUT and the curve are both piecewise linear, so the largest
+		// error is at the points of the curve
+		float maxError = 0.f;
+		for (u_int i = 0; i < from.size(); ++i)
+			maxError = Max(maxError, fabsf(LookUpLUT(&lut.values[0], lut.start, lut.invStep, intervals, from[i]) - to[i]));
+
+		// Curves with very steep segments can require a finer LUT
+		lut.accurate = (maxError <= LUT_MAX_ERROR);
+		if (lut.accurate)
+			break;
+		if (intervals * 2 > LUT_MAX_INTERVALS) {
+			SLG_LOG("[CameraResponsePlugin] The LUT error is " << maxError << " with " << intervals <<
+					" intervals, the curve is evaluated without LUT");
+			break;
+		}
+		intervals *= 2;
+	}
+}
+
+void CameraResponsePlugin::InitLUTs() {
+	InitLUT(redI, redB, redLUT);
+	if (color) {
+		InitLUT(greenI, greenB, greenLUT);
+		InitLUT(blueI, blueB, blueLUT);
+	} else {
+		greenLUT = CrfLUT();
+		blueLUT = CrfLUT();
+	}
+}
+
 //------------------------------------------------------------------------------
 // OpenCL version
 //------------------------------------------------------------------------------
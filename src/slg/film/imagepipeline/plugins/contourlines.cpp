@@ -47,6 +47,10 @@ ImagePipelinePlugin *ContourLinesPlugin::Copy() const {
 	return new ContourLinesPlugin(scale, range, steps, zeroGridSize);
 }
 
+u_int ContourLinesPlugin::GetRequiredChannels() const {
+	return Film::IRRADIANCE;
+}
+
 float ContourLinesPlugin::GetLuminance(const Film &film,
 		const u_int x, const u_int y) const {
 	Spectrum v;
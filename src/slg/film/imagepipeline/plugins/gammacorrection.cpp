@@ -78,20 +78,22 @@ float GammaCorrectionPlugin::Radiance2PixelFloat(const float x) const {
 //------------------------------------------------------------------------------
 
 void GammaCorrectionPlugin::Apply(Film &film, const u_int index) {
-	Spectrum *pixels = (Spectrum *)film.channel_IMAGEPIPELINEs[index]->GetPixels();
-	const u_int pixelCount = film.GetWidth() * film.GetHeight();
-
-	#pragma omp parallel for
-	for (
-			// Visual C++ 2013 supports only OpenMP 2.5
-#if _OPENMP >= 200805
-			unsigned
-#endif
-			int i = 0; i < pixelCount; ++i) {
-		if (*(film.channel_FRAMEBUFFER_MASK->GetPixel(i))) {
-			pixels[i].c[0] = Radiance2PixelFloat(pixels[i].c[0]);
-			pixels[i].c[1] = Radiance2PixelFloat(pixels[i].c[1]);
-			pixels[i].c[2] = Radiance2PixelFloat(pixels[i].c[2]);
+	ApplyPerPixel(film, index);
+}
+
+void GammaCorrectionPlugin::ApplyRegion(Film &film, const u_int index,
+		const u_int xStart, const u_int xEnd,
+		const u_int yStart, const u_int yEnd) {
+	for (u_int y = yStart; y < yEnd; ++y) {
+		float *pixel = film.channel_IMAGEPIPELINEs[index]->GetPixel(xStart, y);
+		const u_int *mask = film.channel_FRAMEBUFFER_MASK->GetPixel(xStart, y);
+
+		for (u_int x = 0; x < xEnd - xStart; ++x, pixel += 3) {
+			if (mask[x]) {
+				pixel[0] = Radiance2PixelFloat(pixel[0]);
+				pixel[1] = Radiance2PixelFloat(pixel[1]);
+				pixel[2] = Radiance2PixelFloat(pixel[2]);
+			}
 		}
 	}
 }
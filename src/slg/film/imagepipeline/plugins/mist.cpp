@@ -47,6 +47,10 @@ ImagePipelinePlugin *MistPlugin::Copy() const {
 	return new MistPlugin(color, amount, start, end, excludeBackground);
 }
 
+u_int MistPlugin::GetRequiredChannels() const {
+	return Film::DEPTH;
+}
+
 //------------------------------------------------------------------------------
 // CPU version
 //------------------------------------------------------------------------------
@@ -40,6 +40,11 @@ ImagePipelinePlugin *NopPlugin::Copy() const {
 void NopPlugin::Apply(Film &film, const u_int index) {
 }
 
+void NopPlugin::ApplyRegion(Film &film, const u_int index,
+		const u_int xStart, const u_int xEnd,
+		const u_int yStart, const u_int yEnd) {
+}
+
 #if !defined(LUXRAYS_DISABLE_OPENCL)
 void NopPlugin::ApplyOCL(Film &film, const u_int index) {
 }
@@ -58,6 +58,10 @@ ImagePipelinePlugin *ObjectIDMaskFilterPlugin::Copy() const {
 	return new ObjectIDMaskFilterPlugin(objectID);
 }
 
+u_int ObjectIDMaskFilterPlugin::GetRequiredChannels() const {
+	return Film::OBJECT_ID;
+}
+
 //------------------------------------------------------------------------------
 // CPU version
 //------------------------------------------------------------------------------
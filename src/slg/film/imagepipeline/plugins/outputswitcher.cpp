@@ -37,6 +37,10 @@ ImagePipelinePlugin *OutputSwitcherPlugin::Copy() const {
 	return new OutputSwitcherPlugin(type, index);
 }
 
+u_int OutputSwitcherPlugin::GetRequiredChannels() const {
+	return type;
+}
+
 void OutputSwitcherPlugin::Apply(Film &film, const u_int index) {
 	// Copy the data from another Film output channel
 
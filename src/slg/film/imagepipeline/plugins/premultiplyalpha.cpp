@@ -51,36 +51,38 @@ ImagePipelinePlugin *PremultiplyAlphaPlugin::Copy() const {
 	return new PremultiplyAlphaPlugin();
 }
 
+u_int PremultiplyAlphaPlugin::GetRequiredChannels() const {
+	return Film::ALPHA;
+}
+
 //------------------------------------------------------------------------------
 // CPU version
 //------------------------------------------------------------------------------
 
 void PremultiplyAlphaPlugin::Apply(Film &film, const u_int index) {
+	ApplyPerPixel(film, index);
+}
+
+void PremultiplyAlphaPlugin::ApplyRegion(Film &film, const u_int index,
+		const u_int xStart, const u_int xEnd,
+		const u_int yStart, const u_int yEnd) {
 	if (!film.HasChannel(Film::ALPHA)) {
 		// I can not work without alpha channel
 		return;
 	}
 
-	Spectrum *pixels = (Spectrum *)film.channel_IMAGEPIPELINEs[index]->GetPixels();
-	const u_int width = film.GetWidth();
-	const u_int height = film.GetHeight();
-
-	#pragma omp parallel for
-	for (
-		// Visual C++ 2013 supports only OpenMP 2.5
-#if _OPENMP >= 200805
-		unsigned
-#endif
-		int y = 0; y < height; ++y) {
-		for (u_int x = 0; x < width; ++x) {
-			const u_int filmPixelIndex = x + y * width;
+	for (u_int y = yStart; y < yEnd; ++y) {
+		float *pixel = film.channel_IMAGEPIPELINEs[index]->GetPixel(xStart, y);
+		const u_int *mask = film.channel_FRAMEBUFFER_MASK->GetPixel(xStart, y);
+		const float *alphaPixel = film.channel_ALPHA->GetPixel(xStart, y);
 
-			if (*(film.channel_FRAMEBUFFER_MASK->GetPixel(filmPixelIndex))) {
-				float alpha;
-				film.channel_ALPHA->GetWeightedPixel(x, y, &alpha);
+		for (u_int x = 0; x < xEnd - xStart; ++x, pixel += 3, alphaPixel += 2) {
+			const float alpha = (alphaPixel[1] == 0.f) ? 0.f : (alphaPixel[0] / alphaPixel[1]);
+			const float scale = mask[x] ? alpha : 1.f;
 
-				pixels[filmPixelIndex] *= alpha;
-			}
+			pixel[0] *= scale;
+			pixel[1] *= scale;
+			pixel[2] *= scale;
 		}
 	}
 }
@@ -69,23 +69,28 @@ float LuxLinearToneMap::GetScale(const float gamma) const {
 //------------------------------------------------------------------------------
 
 void LuxLinearToneMap::Apply(Film &film, const u_int index) {
-	Spectrum *pixels = (Spectrum *)film.channel_IMAGEPIPELINEs[index]->GetPixels();
-	const u_int pixelCount = film.GetWidth() * film.GetHeight();
+	ApplyPerPixel(film, index);
+}
 
+void LuxLinearToneMap::ApplyRegion(Film &film, const u_int index,
+		const u_int xStart, const u_int xEnd,
+		const u_int yStart, const u_int yEnd) {
 	const float gamma = GetGammaCorrectionValue(film, index);
 	const float scale = GetScale(gamma);
 
-	#pragma omp parallel for
-	for (
-			// Visual C++ 2013 supports only OpenMP 2.5
-#if _OPENMP >= 200805
-			unsigned
-#endif
-			int i = 0; i < pixelCount; ++i) {
-		if (*(film.channel_FRAMEBUFFER_MASK->GetPixel(i)))
+	for (u_int y = yStart; y < yEnd; ++y) {
+		float *pixel = film.channel_IMAGEPIPELINEs[index]->GetPixel(xStart, y);
+		const u_int *mask = film.channel_FRAMEBUFFER_MASK->GetPixel(xStart, y);
+
+		for (u_int x = 0; x < xEnd - xStart; ++x, pixel += 3) {
 			// Note: I don't need to convert to XYZ and back because I'm only
-			// scaling the value.
-			pixels[i] = scale * pixels[i];
+			// scaling the value
+			const float s = mask[x] ? scale : 1.f;
+
+			pixel[0] *= s;
+			pixel[1] *= s;
+			pixel[2] *= s;
+		}
 	}
 }
 
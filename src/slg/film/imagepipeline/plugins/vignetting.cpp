@@ -56,38 +56,36 @@ ImagePipelinePlugin *VignettingPlugin::Copy() const {
 //------------------------------------------------------------------------------
 
 void VignettingPlugin::Apply(Film &film, const u_int index) {
-	Spectrum *pixels = (Spectrum *)film.channel_IMAGEPIPELINEs[index]->GetPixels();
+	ApplyPerPixel(film, index);
+}
 
+void VignettingPlugin::ApplyRegion(Film &film, const u_int index,
+		const u_int xStart, const u_int xEnd,
+		const u_int yStart, const u_int yEnd) {
 	const u_int width = film.GetWidth();
 	const u_int height = film.GetHeight();
 	const float invWidth = 1.f / width;
 	const float invHeight = 1.f / height;
 
-	#pragma omp parallel for
-	for (
-			// Visual C++ 2013 supports only OpenMP 2.5
-#if _OPENMP >= 200805
-			unsigned
-#endif
-			int y = 0; y < height; ++y) {
-		for (u_int x = 0; x < width; ++x) {
-			const u_int index = x + y * width;
-
-			if (*(film.channel_FRAMEBUFFER_MASK->GetPixel(index))) {
-				const float nx = x * invWidth;
-				const float ny = y * invHeight;
-				const float xOffset = (nx - .5f) * 2.f;
-				const float yOffset = (ny - .5f) * 2.f;
-				const float tOffset = sqrtf(xOffset * xOffset + yOffset * yOffset);
-
-				// Normalize to range [0.f - 1.f]
-				const float invOffset = 1.f - (fabsf(tOffset) * 1.42f);
-				float vWeight = Lerp(invOffset, 1.f - scale, 1.f);
-
-				pixels[index].c[0] *= vWeight;
-				pixels[index].c[1] *= vWeight;
-				pixels[index].c[2] *= vWeight;
-			}
+	for (u_int y = yStart; y < yEnd; ++y) {
+		float *pixel = film.channel_IMAGEPIPELINEs[index]->GetPixel(xStart, y);
+		const u_int *mask = film.channel_FRAMEBUFFER_MASK->GetPixel(xStart, y);
+
+		const float ny = y * invHeight;
+		const float yOffset = (ny - .5f) * 2.f;
+
+		for (u_int x = xStart; x < xEnd; ++x, pixel += 3) {
+			const float nx = x * invWidth;
+			const float xOffset = (nx - .5f) * 2.f;
+			const float tOffset = sqrtf(xOffset * xOffset + yOffset * yOffset);
+
+			// Normalize to range [0.f - 1.f]
+			const float invOffset = 1.f - (fabsf(tOffset) * 1.42f);
+			const float vWeight = mask[x - xStart] ? Lerp(invOffset, 1.f - scale, 1.f) : 1.f;
+
+			pixel[0] *= vWeight;
+			pixel[1] *= vWeight;
+			pixel[2] *= vWeight;
 		}
 	}
 }
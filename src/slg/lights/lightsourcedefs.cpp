@@ -17,6 +17,9 @@
  ***************************************************************************/
 
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/bind.hpp>
+
+#include "luxrays/utils/taskscheduler.h"
 
 #include "slg/scene/scene.h"
 #include "slg/lights/trianglelight.h"
@@ -198,8 +201,10 @@ void LightSourceDefinitions::Preprocess(const Scene *scene) {
 		++i;
 	}
 
-	// Build the light strategy
-	emitLightStrategy->Preprocess(scene, TASK_EMIT);
-	illuminateLightStrategy->Preprocess(scene, TASK_ILLUMINATE);
-	infiniteLightStrategy->Preprocess(scene, TASK_INFINITE_ONLY);
+	// Build the light strategies, they are independent so they are built in parallel
+	TaskGroup strategyTasks;
+	strategyTasks.Run(boost::bind(&LightStrategy::Preprocess, emitLightStrategy, scene, TASK_EMIT));
+	strategyTasks.Run(boost::bind(&LightStrategy::Preprocess, illuminateLightStrategy, scene, TASK_ILLUMINATE));
+	strategyTasks.Run(boost::bind(&LightStrategy::Preprocess, infiniteLightStrategy, scene, TASK_INFINITE_ONLY));
+	strategyTasks.Wait();
 }
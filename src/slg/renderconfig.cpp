@@ -330,6 +330,7 @@ Film *RenderConfig::AllocFilm() const {
 	film->oclEnable = cfg.Get(Property("film.opencl.enable")(true)).Get<bool>();
 	film->oclPlatformIndex = cfg.Get(Property("film.opencl.platform")(-1)).Get<int>();
 	film->oclDeviceIndex = cfg.Get(Property("film.opencl.device")(-1)).Get<int>();
+	film->SetAsyncImagePipelineFlag(cfg.Get(Property("film.asyncimagepipeline.enable")(false)).Get<bool>());
 
 	//--------------------------------------------------------------------------
 	// Add the default image pipeline
@@ -396,6 +397,16 @@ Properties RenderConfig::ToProperties(const Properties &cfg) {
 	props << cfg.Get(Property("accelerator.bvh.isectcost")(80));
 	props << cfg.Get(Property("accelerator.bvh.travcost")(10));
 	props << cfg.Get(Property("accelerator.bvh.emptybonus")(.5));
+	props << cfg.Get(Property("accelerator.bvh.sbvh.memorybudget")(.3f));
+	props << cfg.Get(Property("accelerator.bvh.sbvh.alpha")(1e-5f));
+	props << cfg.Get(Property("accelerator.bvh.nodeformat")("FLOAT"));
+	props << cfg.Get(Property("accelerator.mbvh.refit.maxcostratio")(1.5f));
+	props << cfg.Get(Property("accelerator.mbvh.rootrefit.enable")(true));
+	props << cfg.Get(Property("accelerator.mbvh.rootrefit.maxcostratio")(1.2f));
+	props << cfg.Get(Property("accelerator.mbvh.motionblur.timesegments")(8u));
+	props << cfg.Get(Property("accelerator.bvh.cache.enable")(false));
+	props << cfg.Get(Property("accelerator.bvh.cache.dir")(""));
+	props << cfg.Get(Property("accelerator.bvh.cache.mintrianglecount")(10000u));
 
 	// Scene epsilon
 	props << cfg.Get(Property("scene.epsilon.min")(DEFAULT_EPSILON_MIN));
@@ -32,16 +32,55 @@ using namespace slg;
 
 SamplerSharedData *RandomSamplerSharedData::FromProperties(const Properties &cfg,
 		RandomGenerator *rndGen, Film *film) {
-	return new RandomSamplerSharedData();
+	return new RandomSamplerSharedData(film);
 }
 
 //------------------------------------------------------------------------------
 // Random sampler
 //------------------------------------------------------------------------------
 
+RandomSampler::RandomSampler(RandomGenerator *rnd, Film *flm,
+		const FilmSampleSplatter *flmSplatter,
+		RandomSamplerSharedData *samplerSharedData,
+		const float adaptiveStr) : Sampler(rnd, flm, flmSplatter),
+		sharedData(samplerSharedData), adaptiveStrength(adaptiveStr) {
+	adaptiveFilm = ((adaptiveStrength > 0.f) && sharedData && IsAdaptiveSamplingSupported(sharedData->engineFilm)) ?
+		sharedData->engineFilm : NULL;
+}
+
+void RandomSampler::RequestSamples(const u_int size) {
+	InitNewSample();
+}
+
+void RandomSampler::InitNewSample() {
+	// Look for an image plane sample falling on a not yet converged pixel
+	do {
+		sample0 = rndGen->floatValue();
+		sample1 = rndGen->floatValue();
+	} while (adaptiveFilm && !IsAdaptiveSampleAccepted(adaptiveFilm, adaptiveStrength, sample0, sample1));
+}
+
+float RandomSampler::GetSample(const u_int index) {
+	switch (index) {
+		case 0:
+			return sample0;
+		case 1:
+			return sample1;
+		default:
+			return rndGen->floatValue();
+	}
+}
+
 void RandomSampler::NextSample(const vector<SampleResult> &sampleResults) {
 	film->AddSampleCount(1.0);
 	AddSamplesToFilm(sampleResults);
+
+	InitNewSample();
+}
+
+Properties RandomSampler::ToProperties() const {
+	return Sampler::ToProperties() <<
+			Property("sampler.random.adaptive.strength")(adaptiveStrength);
 }
 
 //------------------------------------------------------------------------------
@@ -50,12 +89,17 @@ void RandomSampler::NextSample(const vector<SampleResult> &sampleResults) {
 
 Properties RandomSampler::ToProperties(const Properties &cfg) {
 	return Properties() <<
-			cfg.Get(GetDefaultProps().Get("sampler.type"));
+			cfg.Get(GetDefaultProps().Get("sampler.type")) <<
+			cfg.Get(GetDefaultProps().Get("sampler.random.adaptive.strength"));
 }
 
 Sampler *RandomSampler::FromProperties(const Properties &cfg, RandomGenerator *rndGen,
 		Film *film, const FilmSampleSplatter *flmSplatter, SamplerSharedData *sharedData) {
-	return new RandomSampler(rndGen, film, flmSplatter);
+	// At least 5% of the samples are still used for converged pixels
+	const float adaptiveStrength = Clamp(cfg.Get(GetDefaultProps().Get("sampler.random.adaptive.strength")).Get<float>(), 0.f, .95f);
+
+	return new RandomSampler(rndGen, film, flmSplatter, (RandomSamplerSharedData *)sharedData,
+			adaptiveStrength);
 }
 
 slg::ocl::Sampler *RandomSampler::FromPropertiesOCL(const Properties &cfg) {
@@ -69,7 +113,8 @@ slg::ocl::Sampler *RandomSampler::FromPropertiesOCL(const Properties &cfg) {
 const Properties &RandomSampler::GetDefaultProps() {
 	static Properties props = Properties() <<
 			Sampler::GetDefaultProps() <<
-			Property("sampler.type")(GetObjectTag());
+			Property("sampler.type")(GetObjectTag()) <<
+			Property("sampler.random.adaptive.strength")(0.f);
 
 	return props;
 }
@@ -53,6 +53,28 @@ void Sampler::AddSamplesToFilm(const vector<SampleResult> &sampleResults, const
 	}
 }
 
+bool Sampler::IsAdaptiveSamplingSupported(const Film *adaptiveFilm) {
+	// Samples splatted on the whole screen (i.e. light tracing) are normalized
+	// by the total number of samples so they can not be concentrated on
+	// some pixel
+	return adaptiveFilm && adaptiveFilm->HasChannel(Film::CONVERGENCE) &&
+			!adaptiveFilm->HasChannel(Film::RADIANCE_PER_SCREEN_NORMALIZED);
+}
+
+bool Sampler::IsAdaptiveSampleAccepted(const Film *adaptiveFilm, const float adaptiveStrength,
+		const float u0, const float u1) const {
+	float filmX, filmY;
+	adaptiveFilm->GetSampleXY(u0, u1, &filmX, &filmY);
+
+	// The CONVERGENCE channel holds the pixel error normalized in the
+	// [0.0, 1.0] range (or INFINITY if it has not been tested yet). A pixel is
+	// sampled with a probability proportional to its error but never lower
+	// than (1 - adaptiveStrength), so converged pixels keep being refined.
+	const float convergence = *(adaptiveFilm->channel_CONVERGENCE->GetPixel((u_int)filmX, (u_int)filmY));
+
+	return (rndGen->floatValue() < Max(convergence, 1.f - adaptiveStrength));
+}
+
 Properties Sampler::ToProperties() const {
 	return Properties() <<
 			Property("sampler.type")(SamplerType2String(GetType()));
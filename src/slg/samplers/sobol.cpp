@@ -30,7 +30,8 @@ using namespace slg;
 // SobolSamplerSharedData
 //------------------------------------------------------------------------------
 
-SobolSamplerSharedData::SobolSamplerSharedData(RandomGenerator *rndGen) : SamplerSharedData() {
+SobolSamplerSharedData::SobolSamplerSharedData(RandomGenerator *rndGen, Film *engineFlm) : SamplerSharedData(),
+		engineFilm(engineFlm) {
 	rng0 = rndGen->floatValue();
 	rng1 = rndGen->floatValue();
 	pass = SOBOL_STARTOFFSET;
@@ -38,7 +39,7 @@ SobolSamplerSharedData::SobolSamplerSharedData(RandomGenerator *rndGen) : Sample
 
 SamplerSharedData *SobolSamplerSharedData::FromProperties(const Properties &cfg,
 		RandomGenerator *rndGen, Film *film) {
-	return new SobolSamplerSharedData(rndGen);
+	return new SobolSamplerSharedData(rndGen, film);
 }
 
 //------------------------------------------------------------------------------
@@ -49,8 +50,11 @@ SamplerSharedData *SobolSamplerSharedData::FromProperties(const Properties &cfg,
 
 SobolSampler::SobolSampler(RandomGenerator *rnd, Film *flm,
 		const FilmSampleSplatter *flmSplatter,
-		SobolSamplerSharedData *samplerSharedData) : Sampler(rnd, flm, flmSplatter),
-		sharedData(samplerSharedData), directions(NULL) {
+		SobolSamplerSharedData *samplerSharedData,
+		const float adaptiveStr) : Sampler(rnd, flm, flmSplatter),
+		sharedData(samplerSharedData), adaptiveStrength(adaptiveStr), directions(NULL) {
+	adaptiveFilm = ((adaptiveStrength > 0.f) && IsAdaptiveSamplingSupported(sharedData->engineFilm)) ?
+		sharedData->engineFilm : NULL;
 }
 
 SobolSampler::~SobolSampler() {
@@ -63,6 +67,8 @@ void SobolSampler::RequestSamples(const u_int size) {
 
 	passBase = sharedData->pass.fetch_add(SOBOL_THREAD_WORK_SIZE);
 	passOffset = 0;
+
+	InitNewSample();
 }
 
 u_int SobolSampler::SobolDimension(const u_int index, const u_int dimension) const {
@@ -89,10 +95,7 @@ float SobolSampler::GetSample(const u_int index) {
 	return val - floorf(val);
 }
 
-void SobolSampler::NextSample(const vector<SampleResult> &sampleResults) {
-	film->AddSampleCount(1.0);
-	AddSamplesToFilm(sampleResults);
-
+void SobolSampler::NextPass() {
 	++passOffset;
 	if (passOffset >= SOBOL_THREAD_WORK_SIZE) {
 		passBase = sharedData->pass.fetch_add(SOBOL_THREAD_WORK_SIZE);
@@ -100,18 +103,42 @@ void SobolSampler::NextSample(const vector<SampleResult> &sampleResults) {
 	}
 }
 
+void SobolSampler::InitNewSample() {
+	// Skip the passes with an image plane sample falling on a converged pixel
+	while (adaptiveFilm && !IsAdaptiveSampleAccepted(adaptiveFilm, adaptiveStrength, GetSample(0), GetSample(1)))
+		NextPass();
+}
+
+void SobolSampler::NextSample(const vector<SampleResult> &sampleResults) {
+	film->AddSampleCount(1.0);
+	AddSamplesToFilm(sampleResults);
+
+	NextPass();
+	InitNewSample();
+}
+
+Properties SobolSampler::ToProperties() const {
+	return Sampler::ToProperties() <<
+			Property("sampler.sobol.adaptive.strength")(adaptiveStrength);
+}
+
 //------------------------------------------------------------------------------
 // Static methods used by SamplerRegistry
 //------------------------------------------------------------------------------
 
 Properties SobolSampler::ToProperties(const Properties &cfg) {
 	return Properties() <<
-			cfg.Get(GetDefaultProps().Get("sampler.type"));
+			cfg.Get(GetDefaultProps().Get("sampler.type")) <<
+			cfg.Get(GetDefaultProps().Get("sampler.sobol.adaptive.strength"));
 }
 
 Sampler *SobolSampler::FromProperties(const Properties &cfg, RandomGenerator *rndGen,
 		Film *film, const FilmSampleSplatter *flmSplatter, SamplerSharedData *sharedData) {
-	return new SobolSampler(rndGen, film, flmSplatter, (SobolSamplerSharedData *)sharedData);
+	// At least 5% of the samples are still used for converged pixels
+	const float adaptiveStrength = Clamp(cfg.Get(GetDefaultProps().Get("sampler.sobol.adaptive.strength")).Get<float>(), 0.f, .95f);
+
+	return new SobolSampler(rndGen, film, flmSplatter, (SobolSamplerSharedData *)sharedData,
+			adaptiveStrength);
 }
 
 slg::ocl::Sampler *SobolSampler::FromPropertiesOCL(const Properties &cfg) {
@@ -125,7 +152,8 @@ slg::ocl::Sampler *SobolSampler::FromPropertiesOCL(const Properties &cfg) {
 const Properties &SobolSampler::GetDefaultProps() {
 	static Properties props = Properties() <<
 			Sampler::GetDefaultProps() <<
-			Property("sampler.type")(GetObjectTag());
+			Property("sampler.type")(GetObjectTag()) <<
+			Property("sampler.sobol.adaptive.strength")(0.f);
 
 	return props;
 }
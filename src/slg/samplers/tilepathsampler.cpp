@@ -40,7 +40,11 @@ SamplerSharedData *TilePathSamplerSharedData::FromProperties(const Properties &c
 //------------------------------------------------------------------------------
 
 TilePathSampler::TilePathSampler(luxrays::RandomGenerator *rnd, Film *flm,
-		const FilmSampleSplatter *flmSplatter) : Sampler(rnd, flm, flmSplatter) {
+		const FilmSampleSplatter *flmSplatter,
+		const float adaptiveStr) : Sampler(rnd, flm, flmSplatter),
+		adaptiveStrength(adaptiveStr) {
+	adaptiveFilm = ((adaptiveStrength > 0.f) && IsAdaptiveSamplingSupported(film)) ?
+		film : NULL;
 	aaSamples = 1;
 }
 
@@ -63,12 +67,40 @@ void TilePathSampler::SampleGrid(const u_int ix, const u_int iy, float *u0, floa
 }
 
 void TilePathSampler::InitNewSample() {
-	float u0, u1;
-	SampleGrid(tileSampleX, tileSampleY, &u0, &u1);
+	for (;;) {
+		float u0, u1;
+		SampleGrid(tileSampleX, tileSampleY, &u0, &u1);
+
+		const u_int *subRegion = film->GetSubRegion();
+		sample0 = (tile->coord.x - subRegion[0] + tileX + u0) / (subRegion[1] - subRegion[0] + 1);
+		sample1 = (tile->coord.y - subRegion[2] + tileY + u1) / (subRegion[3] - subRegion[2] + 1);	
+
+		// With adaptive sampling, the samples of converged pixels are moved
+		// to the next pixels of the tile. The check is done only once for
+		// each pixel.
+		if (!adaptiveFilm || (tileSampleX > 0) || (tileSampleY > 0) ||
+				IsAdaptiveSampleAccepted(adaptiveFilm, adaptiveStrength, sample0, sample1))
+			break;
+
+		NextPixel();
+	}
+}
+
+void TilePathSampler::NextPixel() {
+	tileSampleX = 0;
+	tileSampleY = 0;
+	++tileX;
+
+	if (tileX >= tile->coord.width) {
+		tileX = 0;
+		++tileY;
 
-	const u_int *subRegion = film->GetSubRegion();
-	sample0 = (tile->coord.x - subRegion[0] + tileX + u0) / (subRegion[1] - subRegion[0] + 1);
-	sample1 = (tile->coord.y - subRegion[2] + tileY + u1) / (subRegion[3] - subRegion[2] + 1);	
+		if (tileY >= tile->coord.height) {
+			// Restart
+
+			tileY = 0;
+		}
+	}
 }
 
 float TilePathSampler::GetSample(const u_int index) {
@@ -91,27 +123,18 @@ void TilePathSampler::NextSample(const vector<SampleResult> &sampleResults) {
 		tileSampleX = 0;
 		++tileSampleY;
 
-		if (tileSampleY >= aaSamples) {
-			tileSampleY = 0;
-			++tileX;
-
-			if (tileX >= tile->coord.width) {
-				tileX = 0;
-				++tileY;
-
-				if (tileY >= tile->coord.height) {
-					// Restart
-
-					tileY = 0;
-				}
-			}
-			
-		}
+		if (tileSampleY >= aaSamples)
+			NextPixel();
 	}
 
 	InitNewSample();
 }
 
+Properties TilePathSampler::ToProperties() const {
+	return Sampler::ToProperties() <<
+			Property("sampler.tilepath.adaptive.strength")(adaptiveStrength);
+}
+
 void TilePathSampler::Init(TileRepository::Tile *t, Film *tFilm) {
 	tile = t;
 	tileFilm = tFilm;
@@ -130,12 +153,16 @@ void TilePathSampler::Init(TileRepository::Tile *t, Film *tFilm) {
 
 Properties TilePathSampler::ToProperties(const Properties &cfg) {
 	return Properties() <<
-			cfg.Get(GetDefaultProps().Get("sampler.type"));
+			cfg.Get(GetDefaultProps().Get("sampler.type")) <<
+			cfg.Get(GetDefaultProps().Get("sampler.tilepath.adaptive.strength"));
 }
 
 Sampler *TilePathSampler::FromProperties(const Properties &cfg, RandomGenerator *rndGen,
 		Film *film, const FilmSampleSplatter *flmSplatter, SamplerSharedData *sharedData) {
-	return new TilePathSampler(rndGen, film, flmSplatter);
+	// At least 5% of the samples are still used for converged pixels
+	const float adaptiveStrength = Clamp(cfg.Get(GetDefaultProps().Get("sampler.tilepath.adaptive.strength")).Get<float>(), 0.f, .95f);
+
+	return new TilePathSampler(rndGen, film, flmSplatter, adaptiveStrength);
 }
 
 slg::ocl::Sampler *TilePathSampler::FromPropertiesOCL(const Properties &cfg) {
@@ -149,7 +176,8 @@ slg::ocl::Sampler *TilePathSampler::FromPropertiesOCL(const Properties &cfg) {
 const Properties &TilePathSampler::GetDefaultProps() {
 	static Properties props = Properties() <<
 			Sampler::GetDefaultProps() <<
-			Property("sampler.type")(GetObjectTag());
+			Property("sampler.type")(GetObjectTag()) <<
+			Property("sampler.tilepath.adaptive.strength")(0.f);
 
 	return props;
 }
@@ -174,5 +174,7 @@ string ExtMeshCache::GetSequenceFileName(const ExtMesh *m) const {
 	} else
 		meshIndex = GetExtMeshIndex(m);
 
-	return "mesh-" + (boost::format("%05d") % meshIndex).str() + ".ply";
+	// Strands meshes can be saved only in the serialized format
+	return "mesh-" + (boost::format("%05d") % meshIndex).str() +
+			((m->GetType() == TYPE_EXT_STRANDS) ? ".bpy" : ".ply");
 }
@@ -16,6 +16,7 @@
  * limitations under the License.                                          *
  ***************************************************************************/
 
+#include "luxrays/core/extstrandsmesh.h"
 #include "slg/scene/scene.h"
 
 using namespace std;
@@ -103,6 +104,15 @@ SceneObject *Scene::CreateObject(const u_int defaultObjID, const string &objName
 			ExtTriangleMesh *mesh = ExtTriangleMesh::Load(meshName);
 			extMeshCache.DefineExtMesh(meshName, mesh);
 		}
+	} else if (props.IsDefined(propName + ".strands")) {
+		// Native strands meshes, as saved by the FILESAVER render engine
+		meshName = props.Get(Property(propName + ".strands")("")).Get<string>();
+
+		if (!extMeshCache.IsExtMeshDefined(meshName)) {
+			// It is a mesh to define
+			ExtStrandsMesh *mesh = ExtStrandsMesh::Load(meshName);
+			extMeshCache.DefineExtMesh(meshName, mesh);
+		}
 	} else if (props.IsDefined(propName + ".vertices")) {
 		// For compatibility with the past SDL syntax
 		meshName = "InlinedMesh-" + objName;
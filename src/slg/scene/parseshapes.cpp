@@ -194,7 +194,11 @@ ExtMesh *Scene::CreateShape(const string &shapeName, const Properties &props) {
 		if (!extMeshCache.IsExtMeshDefined(sourceMeshName))
 			throw runtime_error("Unknown shape name in a pointiness shape: " + shapeName);
 		
-		shape = new PointinessShape((ExtTriangleMesh *)extMeshCache.GetExtMesh(sourceMeshName));
+		ExtMesh *sourceMesh = extMeshCache.GetExtMesh(sourceMeshName);
+		if (sourceMesh->GetType() != TYPE_EXT_TRIANGLE)
+			throw runtime_error("Pointiness shape can be applied only to triangle meshes: " + shapeName);
+
+		shape = new PointinessShape((ExtTriangleMesh *)sourceMesh);
 	} else if (shapeType == "strands") {
 		const string fileName = props.Get(Property(propName + ".file")("strands.hair")).Get<string>();
 
@@ -211,6 +215,10 @@ ExtMesh *Scene::CreateShape(const string &shapeName, const Properties &props) {
 			tessellationType = StrendsShape::TESSEL_SOLID;
 		else if (tessellationTypeStr == "solidadaptive")
 			tessellationType = StrendsShape::TESSEL_SOLID_ADAPTIVE;
+		else if (tessellationTypeStr == "segments")
+			tessellationType = StrendsShape::TESSEL_SEGMENTS;
+		else if (tessellationTypeStr == "segmentsadaptive")
+			tessellationType = StrendsShape::TESSEL_SEGMENTS_ADAPTIVE;
 		else
 			throw runtime_error("Tessellation type unknown: " + tessellationTypeStr);
 
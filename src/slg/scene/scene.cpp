@@ -73,6 +73,7 @@ void Scene::Init(const float imageScale) {
 	imgMapCache.SetImageResize(imageScale);
 
 	enableParsePrint = false;
+	useAnyHitShadowRays = false;
 }
 
 Scene::~Scene() {
@@ -113,8 +114,9 @@ void Scene::Preprocess(Context *ctx, const u_int filmWidth, const u_int filmHeig
 		PreprocessCamera(filmWidth, filmHeight, filmSubRegion);
 
 	// Check if I have to rebuild the dataset
-	if (editActions.Has(GEOMETRY_EDIT) || (editActions.Has(GEOMETRY_TRANS_EDIT) &&
-			!dataSet->DoesAllAcceleratorsSupportUpdate())) {
+	if (editActions.Has(GEOMETRY_EDIT) ||
+			(editActions.Has(GEOMETRY_TRANS_EDIT) && !dataSet->DoesAllAcceleratorsSupportUpdate()) ||
+			(editActions.Has(GEOMETRY_REFIT_EDIT) && !dataSet->DoesAllAcceleratorsSupportRefit())) {
 		// Rebuild the data set
 		delete dataSet;
 		dataSet = new DataSet(ctx);
@@ -124,7 +126,7 @@ void Scene::Preprocess(Context *ctx, const u_int filmWidth, const u_int filmHeig
 			dataSet->Add(objDefs.GetSceneObject(i)->GetExtMesh());
 
 		dataSet->Preprocess();
-	} else if(editActions.Has(GEOMETRY_TRANS_EDIT)) {
+	} else if(editActions.Has(GEOMETRY_TRANS_EDIT) || editActions.Has(GEOMETRY_REFIT_EDIT)) {
 		// I have only to update the DataSet bounding boxes
 		dataSet->UpdateBBoxes();
 	}
@@ -132,6 +134,7 @@ void Scene::Preprocess(Context *ctx, const u_int filmWidth, const u_int filmHeig
 	// Check if something has changed in light sources
 	if (editActions.Has(GEOMETRY_EDIT) ||
 			editActions.Has(GEOMETRY_TRANS_EDIT) ||
+			editActions.Has(GEOMETRY_REFIT_EDIT) ||
 			editActions.Has(MATERIALS_EDIT) ||
 			editActions.Has(MATERIAL_TYPES_EDIT) ||
 			editActions.Has(LIGHTS_EDIT) ||
@@ -140,6 +143,9 @@ void Scene::Preprocess(Context *ctx, const u_int filmWidth, const u_int filmHeig
 		lightDefs.Preprocess(this);
 	}
 
+	// Check if shadow rays can use the any-hit query
+	useAnyHitShadowRays = IsOnlyOpaqueSurfacesScene();
+
 	editActions.Reset();
 }
 
@@ -469,87 +475,145 @@ bool Scene::Intersect(IntersectionDevice *device,
 	float passThrough = initialPassThrough;
 	const float originalMaxT = ray->maxt;
 
-	for (;;) {
-		const bool hit = device->TraceRay(ray, rayHit);
-
-		const Volume *rayVolume = volInfo->GetCurrentVolume();
-		if (hit) {
-			bsdf->Init(fromLight, *this, *ray, *rayHit, passThrough, volInfo);
-			rayVolume = bsdf->hitPoint.intoObject ? bsdf->hitPoint.exteriorVolume : bsdf->hitPoint.interiorVolume;
-			ray->maxt = rayHit->t;
-		} else if (!rayVolume) {
-			// No volume information, I use the default volume
-			rayVolume = defaultWorldVolume;
-		}
+	bool hit;
+	do {
+		device->TraceRay(ray, rayHit);
+	} while (EvaluateTracedRay(fromLight, volInfo, &passThrough, originalMaxT,
+			ray, rayHit, bsdf, connectionThroughput, pathThroughput,
+			sampleResult, &hit));
 
-		// Check if there is volume scatter event
-		if (rayVolume) {
-			// This applies volume transmittance too
-			//
-			// Note: by using passThrough here, I introduce subtle correlation
-			// between scattering events and pass-through events
-			Spectrum emis;
-			const float t = rayVolume->Scatter(*ray, passThrough, volInfo->IsScatteredStart(),
-					connectionThroughput, &emis);
-
-			// Add the volume emitted light to the appropriate light group
-			if (!emis.Black()) {
-				if (sampleResult)
-					sampleResult->AddEmission(rayVolume->GetVolumeLightID(), *pathThroughput, emis);
-			}
+	return hit;
+}
+
+bool Scene::EvaluateTracedRay(const bool fromLight, PathVolumeInfo *volInfo,
+		float *passThrough, const float originalMaxT,
+		Ray *ray, RayHit *rayHit, BSDF *bsdf,
+		Spectrum *connectionThroughput, const Spectrum *pathThroughput,
+		SampleResult *sampleResult, bool *result) const {
+	const bool hit = !rayHit->Miss();
+
+	const Volume *rayVolume = volInfo->GetCurrentVolume();
+	if (hit) {
+		bsdf->Init(fromLight, *this, *ray, *rayHit, *passThrough, volInfo);
+		rayVolume = bsdf->hitPoint.intoObject ? bsdf->hitPoint.exteriorVolume : bsdf->hitPoint.interiorVolume;
+		ray->maxt = rayHit->t;
+	} else if (!rayVolume) {
+		// No volume information, I use the default volume
+		rayVolume = defaultWorldVolume;
+	}
+
+	// Check if there is volume scatter event
+	if (rayVolume) {
+		// This applies volume transmittance too
+		//
+		// Note: by using passThrough here, I introduce subtle correlation
+		// between scattering events and pass-through events
+		Spectrum emis;
+		const float t = rayVolume->Scatter(*ray, *passThrough, volInfo->IsScatteredStart(),
+				connectionThroughput, &emis);
+
+		// Add the volume emitted light to the appropriate light group
+		if (!emis.Black()) {
+			if (sampleResult)
+				sampleResult->AddEmission(rayVolume->GetVolumeLightID(), *pathThroughput, emis);
+		}
 
-			if (t > 0.f) {
-				// There was a volume scatter event
+		if (t > 0.f) {
+			// There was a volume scatter event
 
-				// I have to set RayHit fields even if there wasn't a real
-				// ray hit
-				rayHit->t = t;
-				// This is a trick in order to have RayHit::Miss() return
-				// false. I assume 0xfffffffeu will trigger a memory fault if
-				// used (and the bug will be noticed)
-				rayHit->meshIndex = 0xfffffffeu;
+			// I have to set RayHit fields even if there wasn't a real
+			// ray hit
+			rayHit->t = t;
+			// This is a trick in order to have RayHit::Miss() return
+			// false. I assume 0xfffffffeu will trigger a memory fault if
+			// used (and the bug will be noticed)
+			rayHit->meshIndex = 0xfffffffeu;
 
-				bsdf->Init(fromLight, *this, *ray, *rayVolume, t, passThrough);
-				volInfo->SetScatteredStart(true);
+			bsdf->Init(fromLight, *this, *ray, *rayVolume, t, *passThrough);
+			volInfo->SetScatteredStart(true);
 
-				return true;
-			}
+			*result = true;
+			return false;
 		}
+	}
+
+	if (hit) {
+		// Check if the volume priority system tells me to continue to trace the ray
+		bool continueToTrace = volInfo->ContinueToTrace(*bsdf);
 
-		if (hit) {
-			// Check if the volume priority system tells me to continue to trace the ray
-			bool continueToTrace = volInfo->ContinueToTrace(*bsdf);
-
-			// Check if it is a pass through point
-			if (!continueToTrace) {
-				const Spectrum transp = bsdf->GetPassThroughTransparency();
-				if (!transp.Black()) {
-					*connectionThroughput *= transp;
-					continueToTrace = true;
-				}
+		// Check if it is a pass through point
+		if (!continueToTrace) {
+			const Spectrum transp = bsdf->GetPassThroughTransparency();
+			if (!transp.Black()) {
+				*connectionThroughput *= transp;
+				continueToTrace = true;
 			}
+		}
 
-			if (continueToTrace) {
-				// Update volume information
-				volInfo->Update(bsdf->GetEventTypes(), *bsdf);
+		if (continueToTrace) {
+			// Update volume information
+			volInfo->Update(bsdf->GetEventTypes(), *bsdf);
 
-				// It is a transparent material, continue to trace the ray
-				ray->mint = rayHit->t + MachineEpsilon::E(rayHit->t);
-				ray->maxt = originalMaxT;
+			// It is a transparent material, continue to trace the ray
+			ray->mint = rayHit->t + MachineEpsilon::E(rayHit->t);
+			ray->maxt = originalMaxT;
 
-				// A safety check
-				if (ray->mint >= ray->maxt)
-					return false;
-			} else
-				return true;
+			// A safety check
+			if (ray->mint >= ray->maxt) {
+				*result = false;
+				return false;
+			}
 		} else {
-			// Nothing was hit
+			*result = true;
 			return false;
 		}
+	} else {
+		// Nothing was hit
+		*result = false;
+		return false;
+	}
+
+	// I generate a new random variable starting from the previous one. I'm
+	// not really sure about the kind of correlation introduced by this
+	// trick.
+	*passThrough = fabsf(*passThrough - .5f) * 2.f;
 
-		// I generate a new random variable starting from the previous one. I'm
-		// not really sure about the kind of correlation introduced by this
-		// trick.
-		passThrough = fabsf(passThrough - .5f) * 2.f;
+	return true;
+}
+
+bool Scene::IsOnlyOpaqueSurfacesScene() const {
+	if (defaultWorldVolume)
+		return false;
+
+	// Mix and glossy coating materials delegate the pass-through to their
+	// sub-materials and they are all defined in matDefs too
+	for (u_int i = 0; i < matDefs.GetSize(); ++i) {
+		const Material *mat = matDefs.GetMaterial(i);
+
+		if (dynamic_cast<const Volume *>(mat) ||
+				mat->GetInteriorVolume() || mat->GetExteriorVolume() ||
+				mat->GetTransparencyTexture() ||
+				mat->IsPassThrough() ||
+				(mat->GetType() == ARCHGLASS))
+			return false;
+	}
+
+	return true;
+}
+
+bool Scene::Occluded(IntersectionDevice *device,
+		const bool fromLight, PathVolumeInfo *volInfo,
+		const float passThrough, Ray *ray, Spectrum *connectionThroughput) const {
+	if (useAnyHitShadowRays && !volInfo->GetCurrentVolume()) {
+		// Any hit is an opaque one so the first one found is enough
+		*connectionThroughput = Spectrum(1.f);
+
+		return device->TraceShadowRay(ray);
+	} else {
+		RayHit rayHit;
+		BSDF bsdf;
+
+		return Intersect(device, fromLight, volInfo, passThrough, ray, &rayHit,
+				&bsdf, connectionThroughput);
 	}
 }
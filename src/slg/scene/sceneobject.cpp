@@ -60,7 +60,10 @@ Properties SceneObject::ToProperties(const ExtMeshCache &extMeshCache,
     props.Set(Property("scene.objects." + name + ".material")(mat->GetName()));
 	const string fileName = useRealFileName ?
 		extMeshCache.GetRealFileName(mesh) : extMeshCache.GetSequenceFileName(mesh);
-	props.Set(Property("scene.objects." + name + ".ply")(fileName));
+	if (mesh->GetType() == TYPE_EXT_STRANDS)
+		props.Set(Property("scene.objects." + name + ".strands")(fileName));
+	else
+		props.Set(Property("scene.objects." + name + ".ply")(fileName));
 
 	if (mesh->GetType() == TYPE_EXT_TRIANGLE_INSTANCE) {
 		// I have to output also the transformation
@@ -51,6 +51,8 @@ void SceneObjectDefinitions::DefineIntersectableLights(LightSourceDefinitions &l
 void SceneObjectDefinitions::DefineIntersectableLights(LightSourceDefinitions &lightDefs,
 		const SceneObject *obj) const {
 	const ExtMesh *mesh = obj->GetExtMesh();
+	if (mesh->GetType() == TYPE_EXT_STRANDS)
+		throw runtime_error("Native strands can not be light sources: " + obj->GetName());
 
 	// Add all new triangle lights
 	for (u_int i = 0; i < mesh->GetTotalTriangleCount(); ++i) {
@@ -37,7 +37,14 @@ void Scene::UpdateObjectTransformation(const string &objName, const Transform &t
 		editActions.AddAction(GEOMETRY_TRANS_EDIT);
 	} else {
 		mesh->ApplyTransform(trans);
-		editActions.AddAction(GEOMETRY_EDIT);
+
+		if (dataSet) {
+			// Only the vertices have changed so the accelerators can be
+			// refitted instead of rebuilt
+			dataSet->AddRefitMesh(mesh);
+			editActions.AddAction(GEOMETRY_REFIT_EDIT);
+		} else
+			editActions.AddAction(GEOMETRY_EDIT);
 	}
 
 	// Check if it is a light source
@@ -16,6 +16,7 @@
  * limitations under the License.                                          *
  ***************************************************************************/
 
+#include "luxrays/core/extstrandsmesh.h"
 #include "slg/shapes/strands.h"
 #include "slg/scene/scene.h"
 #include "slg/cameras/perspective.h"
@@ -322,6 +323,9 @@ StrendsShape::StrendsShape(const Scene *scene,
 		vector<Point> meshVerts;
 		vector<Normal> meshNorms;
 		vector<Triangle> meshTris;
+		// Used only by native strands
+		vector<float> meshRadii;
+		vector<u_int> meshSegs;
 		vector<UV> meshUVs;
 		vector<Spectrum> meshCols;
 		vector<float> meshTransps;
@@ -377,27 +381,34 @@ StrendsShape::StrendsShape(const Scene *scene,
 							hairTransps, meshVerts, meshNorms, meshTris, meshUVs,
 							meshCols, meshTransps);
 					break;
+				case TESSEL_SEGMENTS:
+					AddSegments(hairPoints, hairSizes, hairCols, hairUVs,
+							hairTransps, meshVerts, meshRadii, meshSegs, meshUVs,
+							meshCols, meshTransps);
+					break;
+				case TESSEL_SEGMENTS_ADAPTIVE: {
+					vector<Point> tesselPoints;
+					vector<float> tesselSizes;
+					vector<Spectrum> tesselCols;
+					vector<float> tesselTransps;
+					vector<UV> tesselUVs;
+					RefineAdaptive(hairPoints, hairSizes, hairCols, hairUVs, hairTransps,
+							tesselPoints, tesselSizes, tesselCols, tesselUVs, tesselTransps);
+
+					AddSegments(tesselPoints, tesselSizes, tesselCols, tesselUVs,
+							tesselTransps, meshVerts, meshRadii, meshSegs, meshUVs,
+							meshCols, meshTransps);
+					break;
+				}
 				default:
 					SLG_LOG("Unknown tessellation  type in an Strands Shape: " + ToString(tesselType));
 			}
 		}
 
-		// Normalize normals
-		for (u_int i = 0; i < meshNorms.size(); ++i)
-			meshNorms[i] = Normalize(meshNorms[i]);
-
-		SLG_LOG("Strands mesh: " << meshTris.size() / 3 << " triangles");
-
-		// Create the mesh
-		Point *newMeshVerts = TriangleMesh::AllocVerticesBuffer(meshVerts.size());
-		copy(meshVerts.begin(), meshVerts.end(), newMeshVerts);
-
-		Triangle *newMeshTris = TriangleMesh::AllocTrianglesBuffer(meshTris.size());
-		copy(meshTris.begin(), meshTris.end(), newMeshTris);
+		if ((meshVerts.size() == 0) ||
+				(((tesselType == TESSEL_SEGMENTS) || (tesselType == TESSEL_SEGMENTS_ADAPTIVE)) && (meshSegs.size() == 0)))
+			throw runtime_error("Strands shape without segments are not supported");
 
-		Normal *newMeshNorms = new Normal[meshNorms.size()];
-		copy(meshNorms.begin(), meshNorms.end(), newMeshNorms);
-		
 		UV *newMeshUVs = new UV[meshUVs.size()];
 		copy(meshUVs.begin(), meshUVs.end(), newMeshUVs);
 		
@@ -427,9 +438,40 @@ StrendsShape::StrendsShape(const Scene *scene,
 			}
 		}
 
-		mesh = new ExtTriangleMesh(meshVerts.size(), meshTris.size(),
-				newMeshVerts, newMeshTris, newMeshNorms, newMeshUVs,
-				newMeshCols, newMeshTransps);
+		if ((tesselType == TESSEL_SEGMENTS) || (tesselType == TESSEL_SEGMENTS_ADAPTIVE)) {
+			SLG_LOG("Strands mesh: " << meshSegs.size() << " segments");
+
+			// Create the native strands mesh
+			Point *newMeshVerts = new Point[meshVerts.size()];
+			copy(meshVerts.begin(), meshVerts.end(), newMeshVerts);
+
+			float *newMeshRadii = new float[meshRadii.size()];
+			copy(meshRadii.begin(), meshRadii.end(), newMeshRadii);
+
+			mesh = new ExtStrandsMesh(meshVerts.size(), meshSegs.size(),
+					newMeshVerts, newMeshRadii, &meshSegs[0], newMeshUVs,
+					newMeshCols, newMeshTransps);
+		} else {
+			// Normalize normals
+			for (u_int i = 0; i < meshNorms.size(); ++i)
+				meshNorms[i] = Normalize(meshNorms[i]);
+
+			SLG_LOG("Strands mesh: " << meshTris.size() / 3 << " triangles");
+
+			// Create the mesh
+			Point *newMeshVerts = TriangleMesh::AllocVerticesBuffer(meshVerts.size());
+			copy(meshVerts.begin(), meshVerts.end(), newMeshVerts);
+
+			Triangle *newMeshTris = TriangleMesh::AllocTrianglesBuffer(meshTris.size());
+			copy(meshTris.begin(), meshTris.end(), newMeshTris);
+
+			Normal *newMeshNorms = new Normal[meshNorms.size()];
+			copy(meshNorms.begin(), meshNorms.end(), newMeshNorms);
+
+			mesh = new ExtTriangleMesh(meshVerts.size(), meshTris.size(),
+					newMeshVerts, newMeshTris, newMeshNorms, newMeshUVs,
+					newMeshCols, newMeshTransps);
+		}
 	} else
 		throw runtime_error("Strands shape without segments are not supported");
 
@@ -540,13 +582,12 @@ void StrendsShape::TessellateRibbon(const Scene *scene,
 	}
 }
 
-void StrendsShape::TessellateAdaptive(const Scene *scene,
-		const bool solid, const vector<Point> &hairPoints,
+void StrendsShape::RefineAdaptive(const vector<Point> &hairPoints,
 		const vector<float> &hairSizes, const vector<Spectrum> &hairCols,
 		const vector<UV> &hairUVs, const vector<float> &hairTransps,
-		vector<Point> &meshVerts, vector<Normal> &meshNorms,
-		vector<Triangle> &meshTris, vector<UV> &meshUVs, vector<Spectrum> &meshCols,
-		vector<float> &meshTransps) const {
+		vector<Point> &tesselPoints, vector<float> &tesselSizes,
+		vector<Spectrum> &tesselCols, vector<UV> &tesselUVs,
+		vector<float> &tesselTransps) const {
 	// Interpolate the hair segments
 	CatmullRomCurve curve;
 	for (int i = 0; i < (int)hairPoints.size(); ++i)
@@ -557,12 +598,6 @@ void StrendsShape::TessellateAdaptive(const Scene *scene,
 	vector<float> values;
 	curve.AdaptiveTessellate(adaptiveMaxDepth, adaptiveError, values);
 
-	// Create the ribbon
-	vector<Point> tesselPoints;
-	vector<float> tesselSizes;
-	vector<Spectrum> tesselCols;
-	vector<float> tesselTransps;
-	vector<UV> tesselUVs;
 	for (u_int i = 0; i < values.size(); ++i) {
 		tesselPoints.push_back(curve.EvaluatePoint(values[i]));
 		tesselSizes.push_back(curve.EvaluateSize(values[i]));
@@ -570,6 +605,22 @@ void StrendsShape::TessellateAdaptive(const Scene *scene,
 		tesselTransps.push_back(curve.EvaluateTransparency(values[i]));
 		tesselUVs.push_back(curve.EvaluateUV(values[i]));
 	}
+}
+
+void StrendsShape::TessellateAdaptive(const Scene *scene,
+		const bool solid, const vector<Point> &hairPoints,
+		const vector<float> &hairSizes, const vector<Spectrum> &hairCols,
+		const vector<UV> &hairUVs, const vector<float> &hairTransps,
+		vector<Point> &meshVerts, vector<Normal> &meshNorms,
+		vector<Triangle> &meshTris, vector<UV> &meshUVs, vector<Spectrum> &meshCols,
+		vector<float> &meshTransps) const {
+	vector<Point> tesselPoints;
+	vector<float> tesselSizes;
+	vector<Spectrum> tesselCols;
+	vector<float> tesselTransps;
+	vector<UV> tesselUVs;
+	RefineAdaptive(hairPoints, hairSizes, hairCols, hairUVs, hairTransps,
+			tesselPoints, tesselSizes, tesselCols, tesselUVs, tesselTransps);
 
 	if (solid)
 		TessellateSolid(scene, tesselPoints, tesselSizes, tesselCols, tesselUVs, tesselTransps,
@@ -733,6 +784,30 @@ void StrendsShape::TessellateSolid(const Scene *scene,
 	}
 }
 
+void StrendsShape::AddSegments(const vector<Point> &hairPoints,
+		const vector<float> &hairSizes, const vector<Spectrum> &hairCols,
+		const vector<UV> &hairUVs, const vector<float> &hairTransps,
+		vector<Point> &meshVerts, vector<float> &meshRadii,
+		vector<u_int> &meshSegs, vector<UV> &meshUVs,
+		vector<Spectrum> &meshCols, vector<float> &meshTransps) const {
+	// A single point has no segment
+	if (hairPoints.size() < 2)
+		return;
+
+	const u_int baseOffset = meshVerts.size();
+
+	for (u_int i = 0; i < hairPoints.size(); ++i) {
+		meshVerts.push_back(hairPoints[i]);
+		meshRadii.push_back(hairSizes[i]);
+		meshUVs.push_back(hairUVs[i]);
+		meshCols.push_back(hairCols[i]);
+		meshTransps.push_back(hairTransps[i]);
+
+		if (i > 0)
+			meshSegs.push_back(baseOffset + i - 1);
+	}
+}
+
 StrendsShape::~StrendsShape() {
 	if (!refined)
 		delete mesh;
@@ -0,0 +1,218 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+// Camera response accuracy test and benchmark: for each camera response
+// preset, it compares the LUT based CameraResponsePlugin::Apply() with the
+// reference CameraResponsePlugin::Map() (the search over the curve data)
+// and measures the time of both. The results are written as JSON. The exit
+// code is EXIT_FAILURE if the error of any preset is over the tolerance.
+
+#include <cstdlib>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include <string>
+
+#include <boost/bind.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "luxrays/luxrays.h"
+#include "luxrays/core/randomgen.h"
+#include "luxrays/utils/taskscheduler.h"
+#include "slg/film/film.h"
+#include "slg/film/imagepipeline/imagepipeline.h"
+#include "slg/film/imagepipeline/plugins/cameraresponse.h"
+
+#include "benchutils.h"
+
+using namespace std;
+using namespace luxrays;
+using namespace slg;
+
+static const char *Presets[] = {
+	"Advantix_100CD", "Advantix_200CD", "Advantix_400CD",
+	"Agfachrome_ctpecisa_200CD", "Agfachrome_ctprecisa_100CD",
+	"Agfachrome_rsx2_050CD", "Agfachrome_rsx2_100CD", "Agfachrome_rsx2_200CD",
+	"Agfacolor_futura_100CD", "Agfacolor_futura_200CD", "Agfacolor_futura_400CD",
+	"Agfacolor_futuraII_100CD", "Agfacolor_futuraII_200CD", "Agfacolor_futuraII_400CD",
+	"Agfacolor_hdc_100_plusCD", "Agfacolor_hdc_200_plusCD", "Agfacolor_hdc_400_plusCD",
+	"Agfacolor_optimaII_100CD", "Agfacolor_optimaII_200CD", "Agfacolor_ultra_050_CD",
+	"Agfacolor_vista_100CD", "Agfacolor_vista_200CD", "Agfacolor_vista_400CD",
+	"Agfacolor_vista_800CD", "Agfapan_apx_025CD", "Agfapan_apx_100CD",
+	"Agfapan_apx_400CD", "Ektachrome_100_plusCD", "Ektachrome_100CD",
+	"Ektachrome_320TCD", "Ektachrome_400XCD", "Ektachrome_64CD",
+	"Ektachrome_64TCD", "Ektachrome_E100SCD", "F125CD", "F250CD", "F400CD",
+	"FCICD", "Gold_100CD", "Gold_200CD", "Kodachrome_200CD", "Kodachrome_25CD",
+	"Kodachrome_64CD", "Max_Zoom_800CD", "Portra_100TCD", "Portra_160NCCD",
+	"Portra_160VCCD", "Portra_400NCCD", "Portra_400VCCD", "Portra_800CD"
+};
+
+static Film *AllocFilm(const u_int width, const u_int height) {
+	Film *film = new Film(width, height, NULL);
+	film->oclEnable = false;
+	film->SetImagePipelines(new ImagePipeline());
+	film->Init();
+
+	return film;
+}
+
+// Values in the [-0.1, 1.2] range to cover the clamping at both ends of the
+// curves, with a pixel out of 8 not in the mask
+static void FillFilm(Film &film) {
+	RandomGenerator rndGen(131);
+	const size_t pixelCount = film.GetWidth() * (size_t)film.GetHeight();
+	float *pixels = film.channel_IMAGEPIPELINEs[0]->GetPixels();
+	u_int *mask = film.channel_FRAMEBUFFER_MASK->GetPixels();
+	for (size_t i = 0; i < pixelCount; ++i) {
+		for (u_int j = 0; j < 3; ++j)
+			pixels[i * 3 + j] = rndGen.floatValue() * 1.3f - .1f;
+		mask[i] = (rndGen.uintValue() % 8) ? 1 : 0;
+	}
+}
+
+static void CopyPixels(const Film &src, Film &dst) {
+	const size_t size = src.GetWidth() * (size_t)src.GetHeight() * 3;
+	copy(src.channel_IMAGEPIPELINEs[0]->GetPixels(), src.channel_IMAGEPIPELINEs[0]->GetPixels() + size,
+			dst.channel_IMAGEPIPELINEs[0]->GetPixels());
+}
+
+static void ApplyReference(const CameraResponsePlugin *plugin, Film *film) {
+	const size_t pixelCount = film->GetWidth() * (size_t)film->GetHeight();
+	RGBColor *pixels = (RGBColor *)film->channel_IMAGEPIPELINEs[0]->GetPixels();
+	const u_int *mask = film->channel_FRAMEBUFFER_MASK->GetPixels();
+	for (size_t i = 0; i < pixelCount; ++i) {
+		if (mask[i])
+			plugin->Map(pixels[i]);
+	}
+}
+
+static void ApplyLUT(CameraResponsePlugin *plugin, Film *film) {
+	plugin->Apply(*film, 0);
+}
+
+// Returns the maximum absolute error
+static float BenchPreset(const string &name, Film &srcFilm, Film &refFilm, Film &lutFilm,
+		const vector<u_int> &threadCounts, const double minTime, ostream &json) {
+	auto_ptr<CameraResponsePlugin> plugin(new CameraResponsePlugin(name));
+
+	// Accuracy
+	CopyPixels(srcFilm, refFilm);
+	ApplyReference(plugin.get(), &refFilm);
+	CopyPixels(srcFilm, lutFilm);
+	plugin->Apply(lutFilm, 0);
+
+	const size_t size = srcFilm.GetWidth() * (size_t)srcFilm.GetHeight() * 3;
+	const float *refPixels = refFilm.channel_IMAGEPIPELINEs[0]->GetPixels();
+	const float *lutPixels = lutFilm.channel_IMAGEPIPELINEs[0]->GetPixels();
+	double errorSum = 0.0;
+	float maxError = 0.f;
+	for (size_t i = 0; i < size; ++i) {
+		const float error = fabsf(refPixels[i] - lutPixels[i]);
+		errorSum += error;
+		// Written to catch NaNs too
+		if (!(error <= maxError))
+			maxError = error;
+	}
+	const double meanError = errorSum / size;
+
+	// Performances (the pixels are the output of the previous run, it
+	// doesn't matter for the measure)
+	const double pixelCount = srcFilm.GetWidth() * (double)srcFilm.GetHeight();
+	const double refTime = Measure(boost::bind(&ApplyReference, plugin.get(), &refFilm), minTime);
+
+	cerr << "  " << name << ": max. error " << maxError << ", mean error " << meanError <<
+			", reference " << (refTime * 1000.0) << "ms (" << (pixelCount / refTime / 1000000.0) << " Mpixels/sec)";
+	json << "{ \"name\": \"" << name << "\", \"maxError\": " << maxError <<
+			", \"meanError\": " << meanError <<
+			", \"referenceTime\": " << refTime <<
+			", \"referencePixelsSec\": " << (pixelCount / refTime) << ", \"results\": [";
+	for (u_int i = 0; i < threadCounts.size(); ++i) {
+		TaskScheduler::GetInstance().SetThreadCount(threadCounts[i]);
+
+		const double lutTime = Measure(boost::bind(&ApplyLUT, plugin.get(), &lutFilm), minTime);
+
+		cerr << ", LUT " << threadCounts[i] << " threads " << (lutTime * 1000.0) << "ms (" <<
+				(pixelCount / lutTime / 1000000.0) << " Mpixels/sec)";
+		json << ((i > 0) ? ", " : " ") << "{ \"threads\": " << threadCounts[i] <<
+				", \"lutTime\": " << lutTime <<
+				", \"lutPixelsSec\": " << (pixelCount / lutTime) << " }";
+	}
+	cerr << endl;
+	json << " ] }";
+
+	return maxError;
+}
+
+static int Bench(const BenchConfig &config, ostream &json) {
+	const string &resolution = config.GetValue("-r");
+	vector<string> presets(Presets, Presets + sizeof(Presets) / sizeof(Presets[0]));
+	if (config.GetValue("-p").length() > 0)
+		boost::split(presets, config.GetValue("-p"), boost::is_any_of(","));
+	const float maxAllowedError = boost::lexical_cast<float>(config.GetValue("-e"));
+
+	vector<string> size;
+	boost::split(size, resolution, boost::is_any_of("x"));
+	if (size.size() != 2)
+		throw runtime_error("Wrong resolution: " + resolution);
+	const u_int width = boost::lexical_cast<u_int>(size[0]);
+	const u_int height = boost::lexical_cast<u_int>(size[1]);
+
+	auto_ptr<Film> srcFilm(AllocFilm(width, height));
+	auto_ptr<Film> refFilm(AllocFilm(width, height));
+	auto_ptr<Film> lutFilm(AllocFilm(width, height));
+	FillFilm(*srcFilm);
+	// The mask is the same for all films
+	const size_t maskSize = width * (size_t)height;
+	copy(srcFilm->channel_FRAMEBUFFER_MASK->GetPixels(), srcFilm->channel_FRAMEBUFFER_MASK->GetPixels() + maskSize,
+			refFilm->channel_FRAMEBUFFER_MASK->GetPixels());
+	copy(srcFilm->channel_FRAMEBUFFER_MASK->GetPixels(), srcFilm->channel_FRAMEBUFFER_MASK->GetPixels() + maskSize,
+			lutFilm->channel_FRAMEBUFFER_MASK->GetPixels());
+
+	cerr << "Resolution " << width << "x" << height << endl;
+
+	json << "\t\"width\": " << width << "," << endl;
+	json << "\t\"height\": " << height << "," << endl;
+	json << "\t\"maxAllowedError\": " << maxAllowedError << "," << endl;
+	json << "\t\"presets\": [";
+	vector<string> failedPresets;
+	for (u_int i = 0; i < presets.size(); ++i) {
+		json << ((i > 0) ? "," : "") << endl << "\t\t";
+		const float maxError = BenchPreset(presets[i], *srcFilm, *refFilm, *lutFilm,
+				config.threadCounts, config.minTime, json);
+		if (!(maxError <= maxAllowedError))
+			failedPresets.push_back(presets[i]);
+	}
+	json << endl << "\t]" << endl;
+
+	if (failedPresets.size() > 0) {
+		cerr << "Error over " << maxAllowedError << " with: " << boost::algorithm::join(failedPresets, ", ") << endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv) {
+	vector<BenchOption> options;
+	options.push_back(BenchOption("-r", "<WxH>", "film resolution", "1920x1080"));
+	options.push_back(BenchOption("-p", "<name,...>", "presets or camera response files", "", "all presets"));
+	options.push_back(BenchOption("-e", "<error>", "maximum absolute error", "0.001"));
+
+	return RunBenchmark("SLG Camera Response Benchmark", argc, argv, options, 1.0, &Bench);
+}
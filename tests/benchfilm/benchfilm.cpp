@@ -0,0 +1,226 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+// Film merge micro-benchmark: it measures the throughput of Film::AddFilm()
+// (used to merge thread and tile films) and of the sample buffer merge done
+// by Film::ExecuteImagePipeline() at 4K and 8K, with all AOVs enabled and a
+// different number of threads. The results are written as JSON.
+//
+// Note: a 8K film with all AOVs requires about 8GB of memory and the
+// benchmark uses two of them.
+
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <string>
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "luxrays/luxrays.h"
+#include "luxrays/core/randomgen.h"
+#include "luxrays/utils/taskscheduler.h"
+#include "slg/film/film.h"
+#include "slg/film/sampleresult.h"
+#include "slg/film/imagepipeline/imagepipeline.h"
+
+#include "benchutils.h"
+
+using namespace std;
+using namespace luxrays;
+using namespace slg;
+
+// All channels with the exception of IMAGEPIPELINE and FRAMEBUFFER_MASK,
+// added by Film::Init()
+static const Film::FilmChannelType AllChannels[] = {
+	Film::RADIANCE_PER_PIXEL_NORMALIZED, Film::RADIANCE_PER_SCREEN_NORMALIZED,
+	Film::ALPHA, Film::DEPTH, Film::POSITION, Film::GEOMETRY_NORMAL,
+	Film::SHADING_NORMAL, Film::MATERIAL_ID, Film::DIRECT_DIFFUSE,
+	Film::DIRECT_GLOSSY, Film::EMISSION, Film::INDIRECT_DIFFUSE,
+	Film::INDIRECT_GLOSSY, Film::INDIRECT_SPECULAR, Film::MATERIAL_ID_MASK,
+	Film::DIRECT_SHADOW_MASK, Film::INDIRECT_SHADOW_MASK, Film::UV,
+	Film::RAYCOUNT, Film::BY_MATERIAL_ID, Film::IRRADIANCE, Film::OBJECT_ID,
+	Film::OBJECT_ID_MASK, Film::BY_OBJECT_ID
+};
+
+template<u_int CHANNELS, u_int WEIGHT_CHANNELS, class T> static size_t PixelSize(
+		const GenericFrameBuffer<CHANNELS, WEIGHT_CHANNELS, T> *fb) {
+	return fb ? (CHANNELS * sizeof(T)) : 0;
+}
+
+template<u_int CHANNELS, u_int WEIGHT_CHANNELS, class T> static size_t PixelSize(
+		const vector<GenericFrameBuffer<CHANNELS, WEIGHT_CHANNELS, T> *> &fbs) {
+	return fbs.size() * CHANNELS * sizeof(T);
+}
+
+// The size of the data of a pixel merged by Film::AddFilm()
+static size_t GetMergedPixelSize(const Film &film) {
+	return PixelSize(film.channel_RADIANCE_PER_PIXEL_NORMALIZEDs) +
+			PixelSize(film.channel_RADIANCE_PER_SCREEN_NORMALIZEDs) +
+			PixelSize(film.channel_ALPHA) +
+			PixelSize(film.channel_DEPTH) +
+			PixelSize(film.channel_POSITION) +
+			PixelSize(film.channel_GEOMETRY_NORMAL) +
+			PixelSize(film.channel_SHADING_NORMAL) +
+			PixelSize(film.channel_MATERIAL_ID) +
+			PixelSize(film.channel_DIRECT_DIFFUSE) +
+			PixelSize(film.channel_DIRECT_GLOSSY) +
+			PixelSize(film.channel_EMISSION) +
+			PixelSize(film.channel_INDIRECT_DIFFUSE) +
+			PixelSize(film.channel_INDIRECT_GLOSSY) +
+			PixelSize(film.channel_INDIRECT_SPECULAR) +
+			PixelSize(film.channel_MATERIAL_ID_MASKs) +
+			PixelSize(film.channel_DIRECT_SHADOW_MASK) +
+			PixelSize(film.channel_INDIRECT_SHADOW_MASK) +
+			PixelSize(film.channel_UV) +
+			PixelSize(film.channel_RAYCOUNT) +
+			PixelSize(film.channel_BY_MATERIAL_IDs) +
+			PixelSize(film.channel_IRRADIANCE) +
+			PixelSize(film.channel_OBJECT_ID) +
+			PixelSize(film.channel_OBJECT_ID_MASKs) +
+			PixelSize(film.channel_BY_OBJECT_IDs);
+}
+
+static Film *AllocFilm(const u_int width, const u_int height, const u_int radianceGroupCount) {
+	Film *film = new Film(width, height, NULL);
+	film->oclEnable = false;
+	film->SetRadianceGroupCount(radianceGroupCount);
+
+	Properties idProps;
+	idProps << Property("id")(1u);
+	BOOST_FOREACH(const Film::FilmChannelType channel, AllChannels)
+		film->AddChannel(channel, &idProps);
+
+	// An empty image pipeline, only the sample buffers merge is measured
+	film->SetImagePipelines(new ImagePipeline());
+	film->Init();
+
+	return film;
+}
+
+static void FillFilm(Film &film, const u_int radianceGroupCount) {
+	u_int channels = 0;
+	BOOST_FOREACH(const Film::FilmChannelType channel, AllChannels)
+		channels |= channel;
+
+	RandomGenerator rndGen(131);
+	SampleResult sampleResult(channels, radianceGroupCount);
+	for (u_int y = 0; y < film.GetHeight(); ++y) {
+		for (u_int x = 0; x < film.GetWidth(); ++x) {
+			for (u_int i = 0; i < radianceGroupCount; ++i)
+				sampleResult.radiance[i] = Spectrum(rndGen.floatValue(), rndGen.floatValue(), rndGen.floatValue());
+			sampleResult.alpha = 1.f;
+			sampleResult.depth = rndGen.floatValue() * 100.f;
+			sampleResult.position = Point(x, y, sampleResult.depth);
+			sampleResult.geometryNormal = Normal(0.f, 0.f, 1.f);
+			sampleResult.shadingNormal = Normal(0.f, 0.f, 1.f);
+			sampleResult.materialID = rndGen.uintValue() % 4;
+			sampleResult.objectID = rndGen.uintValue() % 4;
+			sampleResult.directDiffuse = sampleResult.radiance[0];
+			sampleResult.directGlossy = sampleResult.radiance[0];
+			sampleResult.emission = sampleResult.radiance[0];
+			sampleResult.indirectDiffuse = sampleResult.radiance[0];
+			sampleResult.indirectGlossy = sampleResult.radiance[0];
+			sampleResult.indirectSpecular = sampleResult.radiance[0];
+			sampleResult.directShadowMask = rndGen.floatValue();
+			sampleResult.indirectShadowMask = rndGen.floatValue();
+			sampleResult.uv = UV(x / (float)film.GetWidth(), y / (float)film.GetHeight());
+			sampleResult.rayCount = 4.f;
+			sampleResult.irradiance = sampleResult.radiance[0];
+
+			film.AddSample(x, y, sampleResult);
+		}
+	}
+
+	film.SetSampleCount(film.GetWidth() * (double)film.GetHeight());
+}
+
+static void AddFilm(Film *dst, const Film *src) {
+	dst->AddFilm(*src);
+}
+
+static void BenchResolution(const u_int width, const u_int height,
+		const u_int radianceGroupCount, const vector<u_int> &threadCounts,
+		const double minTime, ostream &json) {
+	cerr << "Resolution " << width << "x" << height << endl;
+
+	auto_ptr<Film> srcFilm(AllocFilm(width, height, radianceGroupCount));
+	auto_ptr<Film> dstFilm(AllocFilm(width, height, radianceGroupCount));
+	FillFilm(*srcFilm, radianceGroupCount);
+
+	const double pixelCount = width * (double)height;
+	const size_t pixelSize = GetMergedPixelSize(*srcFilm);
+	cerr << "  Merged data: " << pixelSize << " bytes/pixel" << endl;
+
+	json << "{ \"width\": " << width << ", \"height\": " << height <<
+			", \"radianceGroups\": " << radianceGroupCount <<
+			", \"mergedBytesPerPixel\": " << pixelSize << ", \"results\": [";
+	for (u_int i = 0; i < threadCounts.size(); ++i) {
+		TaskScheduler::GetInstance().SetThreadCount(threadCounts[i]);
+
+		const double addFilmTime = Measure(boost::bind(&AddFilm, dstFilm.get(), srcFilm.get()), minTime);
+		const double mergeTime = Measure(boost::bind(&Film::ExecuteImagePipeline, srcFilm.get(), 0u), minTime);
+
+		// AddFilm() reads the source and destination films and writes the destination
+		const double addFilmGBSec = (3.0 * pixelCount * pixelSize) / (addFilmTime * 1024.0 * 1024.0 * 1024.0);
+		cerr << "  Threads " << threadCounts[i] <<
+				": AddFilm " << (addFilmTime * 1000.0) << "ms (" <<
+				(pixelCount / addFilmTime / 1000000.0) << " Mpixels/sec, " << addFilmGBSec << " GB/sec)" <<
+				", MergeSampleBuffers " << (mergeTime * 1000.0) << "ms (" <<
+				(pixelCount / mergeTime / 1000000.0) << " Mpixels/sec)" << endl;
+
+		json << ((i > 0) ? "," : "") << endl << "\t\t\t{ \"threads\": " << threadCounts[i] <<
+				", \"addFilmTime\": " << addFilmTime <<
+				", \"addFilmPixelsSec\": " << (pixelCount / addFilmTime) <<
+				", \"addFilmGBSec\": " << addFilmGBSec <<
+				", \"mergeSampleBuffersTime\": " << mergeTime <<
+				", \"mergeSampleBuffersPixelsSec\": " << (pixelCount / mergeTime) << " }";
+	}
+	json << endl << "\t\t] }";
+}
+
+static int Bench(const BenchConfig &config, ostream &json) {
+	vector<string> resolutions;
+	boost::split(resolutions, config.GetValue("-r"), boost::is_any_of(","));
+	const u_int radianceGroupCount = Max(1u, boost::lexical_cast<u_int>(config.GetValue("-g")));
+
+	json << "\t\"resolutions\": [";
+	for (u_int i = 0; i < resolutions.size(); ++i) {
+		vector<string> size;
+		boost::split(size, resolutions[i], boost::is_any_of("x"));
+		if (size.size() != 2)
+			throw runtime_error("Wrong resolution: " + resolutions[i]);
+
+		json << ((i > 0) ? "," : "") << endl << "\t\t";
+		BenchResolution(boost::lexical_cast<u_int>(size[0]), boost::lexical_cast<u_int>(size[1]),
+				radianceGroupCount, config.threadCounts, config.minTime, json);
+	}
+	json << endl << "\t]" << endl;
+
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv) {
+	vector<BenchOption> options;
+	options.push_back(BenchOption("-r", "<WxH,...>", "film resolutions", "3840x2160,7680x4320"));
+	options.push_back(BenchOption("-g", "<count>", "radiance groups", "2"));
+
+	return RunBenchmark("SLG Film Merge Benchmark", argc, argv, options, 2.0, &Bench);
+}
@@ -0,0 +1,496 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+// Accelerator benchmark on real scenes: it loads the meshes of a list of
+// scenes, builds each accelerator type (and each BVH builder type) and
+// measures the build time, the memory usage and the number of primary,
+// shadow and diffuse bounce rays traced per second with a different number
+// of threads. The results are written as JSON.
+//
+// It has to be run from the root directory of the sources, the default
+// list of scenes is:
+//
+//  scenes/classroom/classroom.scn
+//  scenes/kitchen/kitchen.scn
+//  scenes/bigmonkey/bigmonkey.scn
+//  scenes/bigmonkey/bigmonkey-instances.scn
+//  scenes/strands/hair.scn
+
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <deque>
+#include <string>
+#include <algorithm>
+
+#include <boost/thread.hpp>
+#include <boost/foreach.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "luxrays/luxrays.h"
+#include "luxrays/core/context.h"
+#include "luxrays/core/dataset.h"
+#include "luxrays/core/accelerator.h"
+#include "luxrays/core/randomgen.h"
+#include "luxrays/core/geometry/frame.h"
+#include "luxrays/utils/mc.h"
+#include "slg/scene/scene.h"
+#include "luxcore/luxcore.h"
+
+using namespace std;
+using namespace luxrays;
+using namespace slg;
+
+// The number of rays traced with a single IntersectStream() call
+#define STREAM_SIZE 1024
+
+typedef enum {
+	RAYS_PRIMARY, RAYS_SHADOW, RAYS_DIFFUSE, RAYS_TYPE_COUNT
+} RaysType;
+
+static const char *RaysTypeNames[RAYS_TYPE_COUNT] = { "primary", "shadow", "diffuse" };
+
+typedef struct {
+	AcceleratorType type;
+	// NULL if the accelerator doesn't use the BVH builders
+	const char *builderType;
+} AcceleratorConfig;
+
+static const AcceleratorConfig AcceleratorConfigs[] = {
+	{ ACCEL_BVH, "CLASSIC" },
+	{ ACCEL_BVH, "EMBREE_BINNED_SAH" },
+	{ ACCEL_BVH, "EMBREE_MORTON" },
+	{ ACCEL_BVH, "PARALLEL_BINNED_SAH" },
+	{ ACCEL_BVH, "SBVH" },
+	{ ACCEL_MBVH, "CLASSIC" },
+	{ ACCEL_MBVH, "EMBREE_BINNED_SAH" },
+	{ ACCEL_MBVH, "EMBREE_MORTON" },
+	{ ACCEL_MBVH, "PARALLEL_BINNED_SAH" },
+	{ ACCEL_MBVH, "SBVH" },
+	{ ACCEL_BVH4, "EMBREE_BINNED_SAH" },
+	{ ACCEL_BVH8, "EMBREE_BINNED_SAH" },
+	{ ACCEL_EMBREE, NULL }
+};
+
+static bool verbose = false;
+
+static void LogHandler(const char *msg) {
+	if (verbose)
+		cerr << msg << endl;
+}
+
+static string ToJSONString(const string &s) {
+	string result = "\"";
+	BOOST_FOREACH(const char c, s) {
+		if ((c == '"') || (c == '\\')) {
+			result += '\\';
+			result += c;
+		} else if ((unsigned char)c < 0x20) {
+			// Control characters must be escaped
+			stringstream ss;
+			ss << "\\u" << hex << setw(4) << setfill('0') << (u_int)(unsigned char)c;
+			result += ss.str();
+		} else
+			result += c;
+	}
+
+	return result + "\"";
+}
+
+//------------------------------------------------------------------------------
+// Rays generation
+//------------------------------------------------------------------------------
+
+static Normal GetGeometryNormal(const deque<const Mesh *> &meshes, const Ray &ray, const RayHit &hit) {
+	const Mesh *mesh = meshes[hit.meshIndex];
+	const Triangle &tri = mesh->GetTriangles()[hit.triangleIndex];
+	const Point p0 = mesh->GetVertex(ray.time, tri.v[0]);
+	const Point p1 = mesh->GetVertex(ray.time, tri.v[1]);
+
+	if (tri.v[2] == SEGMENT_PRIMITIVE_MARKER) {
+		// A strands segment: the ribbon faces the ray, so the normal is the
+		// incoming direction orthogonal to the segment (like
+		// ExtStrandsMesh::GetHitPointNormals() but working with instances too)
+		const Vector e = p1 - p0;
+		Vector facing = -ray.d;
+		if (e.LengthSquared() > 0.f) {
+			const Vector tangent = Normalize(e);
+			facing -= Dot(facing, tangent) * tangent;
+		}
+
+		return Normal(Normalize((facing.LengthSquared() > 0.f) ? facing : -ray.d));
+	}
+
+	const Point p2 = mesh->GetVertex(ray.time, tri.v[2]);
+
+	const Normal n = Normal(Normalize(Cross(p1 - p0, p2 - p0)));
+
+	// Facing the incoming ray
+	return (Dot(n, ray.d) > 0.f) ? -n : n;
+}
+
+// Primary rays are generated with the scene camera, shadow rays go from the
+// primary ray hit points to a random point inside the scene bounding box and
+// diffuse bounce rays leave the hit points with a cosine distribution. All
+// accelerators trace exactly the same rays.
+static void GenerateRays(const Scene &scene, const u_int filmWidth, const u_int filmHeight,
+		const deque<const Mesh *> &meshes, const BBox &sceneBBox, const Accelerator *accel,
+		const u_int rayCount, vector<Ray> rays[RAYS_TYPE_COUNT]) {
+	RandomGenerator rnd(1u);
+
+	vector<Ray> &primaryRays = rays[RAYS_PRIMARY];
+	vector<Ray> &shadowRays = rays[RAYS_SHADOW];
+	vector<Ray> &diffuseRays = rays[RAYS_DIFFUSE];
+
+	primaryRays.resize(rayCount);
+	for (u_int i = 0; i < rayCount; ++i) {
+		const float filmX = rnd.floatValue() * filmWidth;
+		const float filmY = rnd.floatValue() * filmHeight;
+		const float u1 = rnd.floatValue();
+		const float u2 = rnd.floatValue();
+		const float u3 = rnd.floatValue();
+
+		scene.camera->GenerateRay(filmX, filmY, &primaryRays[i], u1, u2, u3);
+	}
+
+	shadowRays.clear();
+	diffuseRays.clear();
+	for (u_int i = 0; (i < rayCount) && (shadowRays.size() < rayCount); ++i) {
+		const Ray &ray = primaryRays[i];
+
+		RayHit hit;
+		if (!accel->Intersect(&ray, &hit))
+			continue;
+
+		const Point p = ray(hit.t);
+		const Normal n = GetGeometryNormal(meshes, ray, hit);
+
+		const Point target(
+				Lerp(rnd.floatValue(), sceneBBox.pMin.x, sceneBBox.pMax.x),
+				Lerp(rnd.floatValue(), sceneBBox.pMin.y, sceneBBox.pMax.y),
+				Lerp(rnd.floatValue(), sceneBBox.pMin.z, sceneBBox.pMax.z));
+		const Vector toTarget = target - p;
+		const float distance = toTarget.Length();
+		if (distance > 0.f) {
+			Ray shadowRay(p, toTarget / distance);
+			shadowRay.maxt = distance;
+			shadowRay.time = ray.time;
+			shadowRay.UpdateMinMaxWithEpsilon();
+			shadowRays.push_back(shadowRay);
+		}
+
+		const Frame frame(n);
+		Ray diffuseRay(p, frame.ToWorld(CosineSampleHemisphere(rnd.floatValue(), rnd.floatValue())));
+		diffuseRay.time = ray.time;
+		diffuseRays.push_back(diffuseRay);
+	}
+}
+
+//------------------------------------------------------------------------------
+// Rays tracing
+//------------------------------------------------------------------------------
+
+static void TraceRaysThread(const Accelerator *accel, const RaysType raysType,
+		const Ray *rays, const u_int rayCount, u_int *hitCount) {
+	u_int hits = 0;
+
+	if (raysType == RAYS_SHADOW) {
+		for (u_int i = 0; i < rayCount; ++i) {
+			if (accel->Occluded(&rays[i]))
+				++hits;
+		}
+	} else {
+		RayHit rayHits[STREAM_SIZE];
+		for (u_int i = 0; i < rayCount; i += STREAM_SIZE) {
+			const u_int count = Min<u_int>(STREAM_SIZE, rayCount - i);
+			accel->IntersectStream(&rays[i], rayHits, count);
+
+			for (u_int j = 0; j < count; ++j) {
+				if (!rayHits[j].Miss())
+					++hits;
+			}
+		}
+	}
+
+	*hitCount = hits;
+}
+
+// Returns the number of rays traced per second
+static double TraceRays(const Accelerator *accel, const RaysType raysType,
+		const vector<Ray> &rays, const u_int threadCount, const double minTime,
+		u_int *hitCount) {
+	const u_int rayCount = rays.size();
+	if (rayCount == 0) {
+		*hitCount = 0;
+		return 0.0;
+	}
+
+	vector<u_int> threadHitCounts(threadCount, 0);
+
+	const double tStart = WallClockTime();
+	double tNow;
+	u_int passes = 0;
+	do {
+		boost::thread_group threads;
+		for (u_int i = 0; i < threadCount; ++i) {
+			const u_int first = (u_longlong)rayCount * i / threadCount;
+			const u_int last = (u_longlong)rayCount * (i + 1) / threadCount;
+
+			threads.create_thread(boost::bind(TraceRaysThread, accel, raysType,
+					&rays[first], last - first, &threadHitCounts[i]));
+		}
+		threads.join_all();
+
+		++passes;
+		tNow = WallClockTime();
+	} while (tNow - tStart < minTime);
+
+	*hitCount = 0;
+	BOOST_FOREACH(const u_int count, threadHitCounts)
+		*hitCount += count;
+
+	return (double(passes) * rayCount) / (tNow - tStart);
+}
+
+//------------------------------------------------------------------------------
+// Scene benchmark
+//------------------------------------------------------------------------------
+
+static void BenchScene(const string &sceneFileName, const vector<string> &accelTypes,
+		const vector<u_int> &threadCounts, const u_int rayCount, const double minTime,
+		ostream &json) {
+	cerr << "Loading scene: " << sceneFileName << endl;
+
+	const u_int filmWidth = 640;
+	const u_int filmHeight = 480;
+	const Properties sceneProps(sceneFileName);
+	Scene scene(sceneProps);
+	scene.PreprocessCamera(filmWidth, filmHeight, NULL);
+
+	deque<const Mesh *> meshes;
+	BBox sceneBBox;
+	u_longlong totalTriangleCount = 0;
+	for (u_int i = 0; i < scene.objDefs.GetSize(); ++i) {
+		const Mesh *mesh = scene.objDefs.GetSceneObject(i)->GetExtMesh();
+
+		meshes.push_back(mesh);
+		sceneBBox = Union(sceneBBox, mesh->GetBBox());
+		totalTriangleCount += mesh->GetTotalTriangleCount();
+	}
+
+	json << "{" << endl;
+	json << "\t\t\t\"file\": " << ToJSONString(sceneFileName) << "," << endl;
+	json << "\t\t\t\"meshes\": " << meshes.size() << "," << endl;
+	json << "\t\t\t\"triangles\": " << totalTriangleCount << "," << endl;
+	json << "\t\t\t\"accelerators\": [";
+
+	vector<Ray> rays[RAYS_TYPE_COUNT];
+	bool firstAccel = true;
+	for (u_int configIndex = 0; configIndex < sizeof(AcceleratorConfigs) / sizeof(AcceleratorConfig); ++configIndex) {
+		const AcceleratorConfig &config = AcceleratorConfigs[configIndex];
+		const string accelTypeName = Accelerator::AcceleratorType2String(config.type);
+
+		if (find(accelTypes.begin(), accelTypes.end(), accelTypeName) == accelTypes.end())
+			continue;
+
+		const string builderType = config.builderType ? config.builderType : "";
+		cerr << "  Accelerator: " << accelTypeName <<
+				(config.builderType ? (" " + builderType) : "") << endl;
+
+		json << (firstAccel ? "" : ",") << endl << "\t\t\t\t{" << endl;
+		json << "\t\t\t\t\t\"type\": " << ToJSONString(accelTypeName) << "," << endl;
+		json << "\t\t\t\t\t\"builder\": " << ToJSONString(builderType) << "," << endl;
+		firstAccel = false;
+
+		Properties cfg;
+		if (config.builderType)
+			cfg << Property("accelerator.bvh.builder.type")(builderType);
+		Context ctx(LogHandler, cfg);
+
+		DataSet dataSet(&ctx);
+		BOOST_FOREACH(const Mesh *mesh, meshes)
+			dataSet.Add(mesh);
+		dataSet.Preprocess();
+
+		const Accelerator *accel;
+		try {
+			accel = dataSet.GetAccelerator(config.type);
+		} catch (runtime_error &err) {
+			cerr << "    Build error: " << err.what() << endl;
+			json << "\t\t\t\t\t\"error\": " << ToJSONString(err.what()) << endl;
+			json << "\t\t\t\t}";
+			continue;
+		}
+
+		const double buildTime = dataSet.GetAcceleratorsBuildTime();
+		cerr << "    Build time: " << buildTime << "secs" << endl;
+		cerr << "    Memory usage: " << accel->GetMemoryUsage() / 1024 << "Kbytes" << endl;
+		json << "\t\t\t\t\t\"buildTime\": " << buildTime << "," << endl;
+		json << "\t\t\t\t\t\"memory\": " << accel->GetMemoryUsage() << "," << endl;
+
+		// The rays are generated with the first accelerator available
+		if (rays[RAYS_PRIMARY].empty())
+			GenerateRays(scene, filmWidth, filmHeight, meshes, sceneBBox, accel, rayCount, rays);
+
+		json << "\t\t\t\t\t\"results\": [";
+		for (u_int i = 0; i < threadCounts.size(); ++i) {
+			json << ((i > 0) ? "," : "") << endl << "\t\t\t\t\t\t{ \"threads\": " << threadCounts[i];
+
+			for (u_int raysType = 0; raysType < RAYS_TYPE_COUNT; ++raysType) {
+				u_int hitCount;
+				const double raysSec = TraceRays(accel, (RaysType)raysType, rays[raysType],
+						threadCounts[i], minTime, &hitCount);
+
+				cerr << "    Threads: " << threadCounts[i] << " " << RaysTypeNames[raysType] <<
+						" rays: " << (raysSec / 1000000.0) << "M rays/sec (hits: " <<
+						hitCount << "/" << rays[raysType].size() << ")" << endl;
+				json << ", \"" << RaysTypeNames[raysType] << "\": { \"raysSec\": " << raysSec <<
+						", \"rays\": " << rays[raysType].size() << ", \"hits\": " << hitCount << " }";
+			}
+
+			json << " }";
+		}
+		json << endl << "\t\t\t\t\t]" << endl;
+		json << "\t\t\t\t}";
+	}
+
+	json << endl << "\t\t\t]" << endl;
+	json << "\t\t}";
+}
+
+//------------------------------------------------------------------------------
+
+static void PrintUsage(const char *name) {
+	cerr << "Usage: " << name << " [options] [scene files]" << endl;
+	cerr << " -o <file>        write the JSON results to a file (default: stdout)" << endl;
+	cerr << " -a <types>       comma separated list of accelerators (default: BVH,MBVH,BVH4,BVH8,EMBREE)" << endl;
+	cerr << " -t <counts>      comma separated list of thread counts (default: 1, 2, 4, ... up to all cores)" << endl;
+	cerr << " -r <count>       number of rays of each type (default: 262144)" << endl;
+	cerr << " -s <seconds>     minimum time of each measure (default: 2)" << endl;
+	cerr << " -v               print the LuxRays log" << endl;
+	cerr << " -h               display this help and exit" << endl;
+}
+
+int main(int argc, char** argv) {
+	try {
+		cerr << "LuxRays Scenes Accelerator Benchmark v" << LUXRAYS_VERSION_MAJOR << "." << LUXRAYS_VERSION_MINOR << endl;
+
+		luxcore::Init();
+
+		string outputFileName;
+		vector<string> accelTypes;
+		boost::split(accelTypes, "BVH,MBVH,BVH4,BVH8,EMBREE", boost::is_any_of(","));
+		vector<u_int> threadCounts;
+		u_int rayCount = 262144;
+		double minTime = 2.0;
+		vector<string> sceneFileNames;
+
+		for (int i = 1; i < argc; ++i) {
+			const string arg = argv[i];
+
+			if ((arg == "-h") || (arg == "--help")) {
+				PrintUsage(argv[0]);
+				return EXIT_SUCCESS;
+			} else if (arg == "-v")
+				verbose = true;
+			else if ((arg == "-o") || (arg == "-a") || (arg == "-t") || (arg == "-r") || (arg == "-s")) {
+				if (i + 1 >= argc)
+					throw runtime_error("Missing value of option: " + arg);
+				const string value = argv[++i];
+
+				if (arg == "-o")
+					outputFileName = value;
+				else if (arg == "-a")
+					boost::split(accelTypes, value, boost::is_any_of(","));
+				else if (arg == "-t") {
+					vector<string> counts;
+					boost::split(counts, value, boost::is_any_of(","));
+					BOOST_FOREACH(const string &count, counts)
+						threadCounts.push_back(Max(1u, boost::lexical_cast<u_int>(count)));
+				} else if (arg == "-r")
+					rayCount = Max(1u, boost::lexical_cast<u_int>(value));
+				else
+					minTime = boost::lexical_cast<double>(value);
+			} else if (arg[0] == '-') {
+				PrintUsage(argv[0]);
+				throw runtime_error("Unknown option: " + arg);
+			} else
+				sceneFileNames.push_back(arg);
+		}
+
+		if (sceneFileNames.empty()) {
+			sceneFileNames.push_back("scenes/classroom/classroom.scn");
+			sceneFileNames.push_back("scenes/kitchen/kitchen.scn");
+			sceneFileNames.push_back("scenes/bigmonkey/bigmonkey.scn");
+			sceneFileNames.push_back("scenes/bigmonkey/bigmonkey-instances.scn");
+			sceneFileNames.push_back("scenes/strands/hair.scn");
+		}
+
+		if (threadCounts.empty()) {
+			const u_int hardwareThreadCount = Max(1u, boost::thread::hardware_concurrency());
+			for (u_int count = 1; count < hardwareThreadCount; count *= 2)
+				threadCounts.push_back(count);
+			threadCounts.push_back(hardwareThreadCount);
+		}
+
+		stringstream json;
+		json << "{" << endl;
+		json << "\t\"version\": \"" << LUXRAYS_VERSION_MAJOR << "." << LUXRAYS_VERSION_MINOR << "\"," << endl;
+		json << "\t\"hardwareThreads\": " << boost::thread::hardware_concurrency() << "," << endl;
+		json << "\t\"raysPerType\": " << rayCount << "," << endl;
+		json << "\t\"scenes\": [";
+		for (u_int i = 0; i < sceneFileNames.size(); ++i) {
+			json << ((i > 0) ? "," : "") << endl << "\t\t";
+
+			// A scene that can not be loaded doesn't stop the benchmark
+			stringstream sceneJSON;
+			try {
+				BenchScene(sceneFileNames[i], accelTypes, threadCounts, rayCount, minTime, sceneJSON);
+				json << sceneJSON.str();
+			} catch (runtime_error &err) {
+				cerr << "  Scene error: " << err.what() << endl;
+				json << "{ \"file\": " << ToJSONString(sceneFileNames[i]) <<
+						", \"error\": " << ToJSONString(err.what()) << " }";
+			}
+		}
+		json << endl << "\t]" << endl;
+		json << "}" << endl;
+
+		if (outputFileName.length() > 0) {
+			ofstream outputFile(outputFileName.c_str());
+			outputFile << json.str();
+			if (!outputFile.good())
+				throw runtime_error("Unable to write the results file: " + outputFileName);
+		} else
+			cout << json.str();
+
+		cerr << "Done." << endl;
+	} catch (runtime_error &err) {
+		cerr << "RUNTIME ERROR: " << err.what() << endl;
+		return EXIT_FAILURE;
+	} catch (exception &err) {
+		cerr << "ERROR: " << err.what() << endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,178 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <boost/thread.hpp>
+#include <boost/foreach.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "luxrays/utils/utils.h"
+#include "luxcore/luxcore.h"
+
+#include "benchutils.h"
+
+using namespace std;
+using namespace luxrays;
+
+//------------------------------------------------------------------------------
+// BenchConfig
+//------------------------------------------------------------------------------
+
+const string &BenchConfig::GetValue(const string &optionName) const {
+	map<string, string>::const_iterator it = values.find(optionName);
+	if (it == values.end())
+		throw runtime_error("Unknown benchmark option: " + optionName);
+
+	return it->second;
+}
+
+//------------------------------------------------------------------------------
+// RunBenchmark
+//------------------------------------------------------------------------------
+
+static void PrintUsageLine(const string &option, const string &description) {
+	cerr << "  " << left << setw(16) << option << description << endl;
+}
+
+static void PrintUsage(const char *cmd, const vector<BenchOption> &options,
+		const double defaultMinTime) {
+	cerr << "Usage: " << cmd << " [options]" << endl;
+	PrintUsageLine("-o <file>", "JSON output file (default: stdout)");
+	BOOST_FOREACH(const BenchOption &option, options)
+		PrintUsageLine(option.name + " " + option.argument, option.description + " (default: " +
+				((option.defaultValueDescription.length() > 0) ? option.defaultValueDescription : option.defaultValue) + ")");
+	PrintUsageLine("-t <n,...>", "thread counts (default: 1, 2, 4, ... hardware threads)");
+	PrintUsageLine("-s <seconds>", "minimum time of each measure (default: " +
+			boost::lexical_cast<string>(defaultMinTime) + ")");
+	PrintUsageLine("-h", "this help");
+}
+
+static bool IsOption(const vector<BenchOption> &options, const string &arg) {
+	BOOST_FOREACH(const BenchOption &option, options) {
+		if (option.name == arg)
+			return true;
+	}
+
+	return false;
+}
+
+int RunBenchmark(const string &title, int argc, char **argv,
+		const vector<BenchOption> &options, const double defaultMinTime,
+		const BenchFunc &benchFunc) {
+	try {
+		cerr << title << " v" << LUXRAYS_VERSION_MAJOR << "." << LUXRAYS_VERSION_MINOR << endl;
+
+		luxcore::Init();
+
+		BenchConfig config;
+		config.minTime = defaultMinTime;
+		BOOST_FOREACH(const BenchOption &option, options)
+			config.values[option.name] = option.defaultValue;
+
+		for (int i = 1; i < argc; ++i) {
+			const string arg = argv[i];
+
+			if ((arg == "-h") || (arg == "--help")) {
+				PrintUsage(argv[0], options, defaultMinTime);
+				return EXIT_SUCCESS;
+			} else if ((arg == "-o") || (arg == "-t") || (arg == "-s") || IsOption(options, arg)) {
+				if (i + 1 >= argc)
+					throw runtime_error("Missing value of option: " + arg);
+				const string value = argv[++i];
+
+				if (arg == "-o")
+					config.outputFileName = value;
+				else if (arg == "-t") {
+					vector<string> counts;
+					boost::split(counts, value, boost::is_any_of(","));
+					BOOST_FOREACH(const string &count, counts)
+						config.threadCounts.push_back(Max(1u, boost::lexical_cast<u_int>(count)));
+				} else if (arg == "-s")
+					config.minTime = boost::lexical_cast<double>(value);
+				else
+					config.values[arg] = value;
+			} else {
+				PrintUsage(argv[0], options, defaultMinTime);
+				throw runtime_error("Unknown option: " + arg);
+			}
+		}
+
+		if (config.threadCounts.empty()) {
+			const u_int hardwareThreadCount = Max(1u, boost::thread::hardware_concurrency());
+			for (u_int count = 1; count < hardwareThreadCount; count *= 2)
+				config.threadCounts.push_back(count);
+			config.threadCounts.push_back(hardwareThreadCount);
+		}
+
+		stringstream json;
+		json << "{" << endl;
+		json << "\t\"version\": \"" << LUXRAYS_VERSION_MAJOR << "." << LUXRAYS_VERSION_MINOR << "\"," << endl;
+		json << "\t\"hardwareThreads\": " << boost::thread::hardware_concurrency() << "," << endl;
+		const int exitCode = benchFunc(config, json);
+		json << "}" << endl;
+
+		// The results are written also when the benchmark has failed
+		if (config.outputFileName.length() > 0) {
+			ofstream outputFile(config.outputFileName.c_str());
+			outputFile << json.str();
+			if (!outputFile.good())
+				throw runtime_error("Unable to write the results file: " + config.outputFileName);
+		} else
+			cout << json.str();
+
+		if (exitCode != EXIT_SUCCESS)
+			return exitCode;
+
+		cerr << "Done." << endl;
+	} catch (runtime_error &err) {
+		cerr << "RUNTIME ERROR: " << err.what() << endl;
+		return EXIT_FAILURE;
+	} catch (exception &err) {
+		cerr << "ERROR: " << err.what() << endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+// Measure
+//------------------------------------------------------------------------------
+
+double Measure(const boost::function<void ()> &func, const double minTime) {
+	// Warm up
+	func();
+
+	u_int runs = 0;
+	const double startTime = WallClockTime();
+	double elapsedTime;
+	do {
+		func();
+		++runs;
+		elapsedTime = WallClockTime() - startTime;
+	} while (elapsedTime < minTime);
+
+	return elapsedTime / runs;
+}
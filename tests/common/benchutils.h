@@ -0,0 +1,72 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+#ifndef _TESTS_BENCHUTILS_H
+#define	_TESTS_BENCHUTILS_H
+
+// Harness shared by the micro-benchmarks: command line parsing of the common
+// options (-o, -t, -s and -h), time measures and the JSON results file.
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+
+#include "luxrays/luxrays.h"
+
+// A benchmark specific option with a value. defValueDesc, if not empty, is
+// shown in the usage instead of defValue.
+class BenchOption {
+public:
+	BenchOption(const std::string &n, const std::string &arg, const std::string &desc,
+			const std::string &defValue, const std::string &defValueDesc = "") :
+			name(n), argument(arg), description(desc), defaultValue(defValue),
+			defaultValueDescription(defValueDesc) { }
+
+	std::string name, argument, description, defaultValue, defaultValueDescription;
+};
+
+class BenchConfig {
+public:
+	const std::string &GetValue(const std::string &optionName) const;
+
+	std::string outputFileName;
+	std::vector<u_int> threadCounts;
+	double minTime;
+
+	// The values of the benchmark specific options
+	std::map<std::string, std::string> values;
+};
+
+// Writes the benchmark results to json, the fields after the ones shared by
+// all benchmarks, and returns the exit code
+typedef boost::function<int (const BenchConfig &config, std::ostream &json)> BenchFunc;
+
+// Parses the command line, runs the benchmark and writes its JSON results to
+// the output file or to stdout. It returns the exit code of main().
+extern int RunBenchmark(const std::string &title, int argc, char **argv,
+		const std::vector<BenchOption> &options, const double defaultMinTime,
+		const BenchFunc &benchFunc);
+
+// Runs func until at least minTime seconds are elapsed and returns the
+// average time of a run
+extern double Measure(const boost::function<void ()> &func, const double minTime);
+
+#endif	/* _TESTS_BENCHUTILS_H */
@@ -0,0 +1,66 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+#ifndef _TESTS_TESTUTILS_H
+#define	_TESTS_TESTUTILS_H
+
+// Helpers shared by the C++ tests registered with CTest: each test is a
+// standalone executable running a list of test cases and returning
+// EXIT_FAILURE if any of them fails.
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include <boost/preprocessor/stringize.hpp>
+
+#define TEST_CHECK(cond) \
+	if (!(cond)) \
+		throw std::runtime_error(std::string(__FILE__ ":" BOOST_PP_STRINGIZE(__LINE__) ": check failed: ") + #cond)
+
+#define TEST_CHECK_MSG(cond, msg) \
+	if (!(cond)) { \
+		std::stringstream testCheckSS; \
+		testCheckSS << __FILE__ ":" BOOST_PP_STRINGIZE(__LINE__) ": check failed: " #cond ": " << msg; \
+		throw std::runtime_error(testCheckSS.str()); \
+	}
+
+typedef void (*TestCase)();
+
+// Runs a test case and returns true if it has passed
+inline bool RunTestCase(const char *name, TestCase testCase) {
+	std::cerr << "[ RUN  ] " << name << std::endl;
+	try {
+		testCase();
+	} catch (std::exception &err) {
+		std::cerr << err.what() << std::endl;
+		std::cerr << "[ FAIL ] " << name << std::endl;
+		return false;
+	}
+
+	std::cerr << "[ OK   ] " << name << std::endl;
+	return true;
+}
+
+#define RUN_TEST_CASE(failed, testCase) \
+	if (!RunTestCase(#testCase, testCase)) \
+		++failed
+
+#endif	/* _TESTS_TESTUTILS_H */
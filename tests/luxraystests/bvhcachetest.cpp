@@ -0,0 +1,256 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+// BVH persistent cache test: a BVHAccel loaded from the cache must return
+// the same Intersect() and Occluded() results of one built from scratch, an
+// edited mesh or different build parameters must not hit the cache and a
+// corrupted cache file must be detected and replaced.
+
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/foreach.hpp>
+#include <boost/filesystem.hpp>
+
+#include "luxrays/luxrays.h"
+#include "luxrays/core/context.h"
+#include "luxrays/core/randomgen.h"
+#include "luxrays/core/trianglemesh.h"
+#include "luxrays/accelerators/bvhaccel.h"
+
+#include "testutils.h"
+
+using namespace std;
+using namespace luxrays;
+
+static const u_int TRIANGLE_COUNT = 20000;
+static const u_int RAY_COUNT = 50000;
+static const float SPACE_SIZE = 100.f;
+
+// Counts the trees loaded from the cache and the cache files discarded
+static u_int loadCount = 0;
+static u_int errorCount = 0;
+
+static void DebugHandler(const char *msg) {
+	if (strstr(msg, "BVH loaded from cache"))
+		++loadCount;
+	else if (strstr(msg, "Error while loading BVH cache file"))
+		++errorCount;
+}
+
+class CacheScene {
+public:
+	CacheScene() : rndGen(41) {
+		vertices = TriangleMesh::AllocVerticesBuffer(3 * TRIANGLE_COUNT);
+		Triangle *triangles = TriangleMesh::AllocTrianglesBuffer(TRIANGLE_COUNT);
+		for (u_int i = 0; i < TRIANGLE_COUNT; ++i) {
+			const Point center(rndGen.floatValue() * SPACE_SIZE, rndGen.floatValue() * SPACE_SIZE,
+					rndGen.floatValue() * SPACE_SIZE);
+			for (u_int j = 0; j < 3; ++j) {
+				vertices[3 * i + j] = center + 2.f * Vector(rndGen.floatValue(), rndGen.floatValue(), rndGen.floatValue());
+				triangles[i].v[j] = 3 * i + j;
+			}
+		}
+		mesh.reset(new TriangleMesh(3 * TRIANGLE_COUNT, TRIANGLE_COUNT, vertices, triangles));
+		meshes.push_back(mesh.get());
+
+		for (u_int i = 0; i < RAY_COUNT; ++i) {
+			const Point orig(rndGen.floatValue() * SPACE_SIZE, rndGen.floatValue() * SPACE_SIZE,
+					rndGen.floatValue() * SPACE_SIZE);
+			const Vector dir(rndGen.floatValue() - .5f, rndGen.floatValue() - .5f, rndGen.floatValue() - .5f);
+			rays.push_back(Ray(orig, Normalize(dir)));
+		}
+
+		cacheDir = boost::filesystem::temp_directory_path() /
+				boost::filesystem::unique_path("bvhcachetest-%%%%-%%%%-%%%%");
+	}
+
+	~CacheScene() {
+		mesh->Delete();
+
+		boost::system::error_code ec;
+		boost::filesystem::remove_all(cacheDir, ec);
+	}
+
+	Properties GetConfig(const bool cacheEnabled, const string &builderType = "CLASSIC",
+			const float sbvhMemoryBudget = .3f) const {
+		Properties cfg;
+		cfg <<
+				Property("accelerator.bvh.builder.type")(builderType) <<
+				Property("accelerator.bvh.sbvh.memorybudget")(sbvhMemoryBudget) <<
+				Property("accelerator.bvh.cache.enable")(cacheEnabled) <<
+				Property("accelerator.bvh.cache.dir")(cacheDir.generic_string()) <<
+				Property("accelerator.bvh.cache.mintrianglecount")(0u);
+
+		return cfg;
+	}
+
+	BVHAccel *NewAccel(const Context &ctx) const {
+		BVHAccel *accel = new BVHAccel(&ctx);
+		accel->Init(meshes, 3 * TRIANGLE_COUNT, TRIANGLE_COUNT);
+
+		return accel;
+	}
+
+	vector<boost::filesystem::path> GetCacheFiles() const {
+		vector<boost::filesystem::path> files;
+		if (boost::filesystem::exists(cacheDir)) {
+			for (boost::filesystem::directory_iterator it(cacheDir); it != boost::filesystem::directory_iterator(); ++it)
+				files.push_back(it->path());
+		}
+
+		return files;
+	}
+
+	RandomGenerator rndGen;
+	Point *vertices;
+	auto_ptr<TriangleMesh> mesh;
+	deque<const Mesh *> meshes;
+	vector<Ray> rays;
+	boost::filesystem::path cacheDir;
+};
+
+// Checks that the 2 accelerators return the same results for all rays
+static void CheckSameHits(const CacheScene &scene, const BVHAccel &accel, const BVHAccel &refAccel) {
+	u_int hits = 0;
+	u_int mismatches = 0;
+	u_int occludedMismatches = 0;
+	BOOST_FOREACH(const Ray &ray, scene.rays) {
+		RayHit hit, refHit;
+		accel.Intersect(&ray, &hit);
+		refAccel.Intersect(&ray, &refHit);
+
+		if (!refHit.Miss())
+			++hits;
+		if ((hit.Miss() != refHit.Miss()) || (!hit.Miss() && ((hit.t != refHit.t) ||
+				(hit.meshIndex != refHit.meshIndex) || (hit.triangleIndex != refHit.triangleIndex))))
+			++mismatches;
+		if (accel.Occluded(&ray) != refAccel.Occluded(&ray))
+			++occludedMismatches;
+	}
+
+	// Make sure the test is meaningful
+	TEST_CHECK_MSG(hits > RAY_COUNT / 10, "hits: " << hits);
+	TEST_CHECK_MSG((mismatches == 0) && (occludedMismatches == 0), "Intersect() mismatches: " <<
+			mismatches << ", Occluded() mismatches: " << occludedMismatches);
+}
+
+static void TestCacheHit() {
+	CacheScene scene;
+	Context refCtx(DebugHandler, scene.GetConfig(false));
+	Context ctx(DebugHandler, scene.GetConfig(true));
+
+	loadCount = errorCount = 0;
+	auto_ptr<BVHAccel> refAccel(scene.NewAccel(refCtx));
+	TEST_CHECK(scene.GetCacheFiles().size() == 0);
+
+	// The first build writes the cache file
+	auto_ptr<BVHAccel> builtAccel(scene.NewAccel(ctx));
+	TEST_CHECK(loadCount == 0);
+	TEST_CHECK(scene.GetCacheFiles().size() == 1);
+	CheckSameHits(scene, *builtAccel, *refAccel);
+
+	// And the second one reads it
+	auto_ptr<BVHAccel> loadedAccel(scene.NewAccel(ctx));
+	TEST_CHECK((loadCount == 1) && (errorCount == 0));
+	CheckSameHits(scene, *loadedAccel, *refAccel);
+}
+
+static void TestMeshEdit() {
+	CacheScene scene;
+	Context ctx(DebugHandler, scene.GetConfig(true));
+
+	auto_ptr<BVHAccel> accel(scene.NewAccel(ctx));
+
+	// A different mesh has a different key
+	scene.vertices[0] = scene.vertices[0] + Vector(1.f, 0.f, 0.f);
+	loadCount = 0;
+	auto_ptr<BVHAccel> editedAccel(scene.NewAccel(ctx));
+	TEST_CHECK(loadCount == 0);
+	TEST_CHECK(scene.GetCacheFiles().size() == 2);
+
+	Context refCtx(DebugHandler, scene.GetConfig(false));
+	auto_ptr<BVHAccel> refAccel(scene.NewAccel(refCtx));
+	CheckSameHits(scene, *editedAccel, *refAccel);
+}
+
+static void TestBuildParams() {
+	CacheScene scene;
+
+	// The SBVH parameters are ignored by the other builders
+	Context ctx(DebugHandler, scene.GetConfig(true, "CLASSIC", .3f));
+	auto_ptr<BVHAccel> accel(scene.NewAccel(ctx));
+	Context otherBudgetCtx(DebugHandler, scene.GetConfig(true, "CLASSIC", .1f));
+	loadCount = 0;
+	auto_ptr<BVHAccel> otherBudgetAccel(scene.NewAccel(otherBudgetCtx));
+	TEST_CHECK(loadCount == 1);
+	TEST_CHECK(scene.GetCacheFiles().size() == 1);
+
+	// But not by the SBVH one
+	Context sbvhCtx(DebugHandler, scene.GetConfig(true, "SBVH", .3f));
+	loadCount = 0;
+	auto_ptr<BVHAccel> sbvhAccel(scene.NewAccel(sbvhCtx));
+	TEST_CHECK(loadCount == 0);
+	Context sbvhOtherBudgetCtx(DebugHandler, scene.GetConfig(true, "SBVH", .1f));
+	auto_ptr<BVHAccel> sbvhOtherBudgetAccel(scene.NewAccel(sbvhOtherBudgetCtx));
+	TEST_CHECK(loadCount == 0);
+	TEST_CHECK(scene.GetCacheFiles().size() == 3);
+}
+
+static void TestCorruptedFile() {
+	CacheScene scene;
+	Context ctx(DebugHandler, scene.GetConfig(true));
+
+	auto_ptr<BVHAccel> refAccel(scene.NewAccel(ctx));
+
+	// Overwrite some byte of the nodes
+	vector<boost::filesystem::path> files = scene.GetCacheFiles();
+	TEST_CHECK(files.size() == 1);
+	{
+		fstream file(files[0].string().c_str(), ios_base::in | ios_base::out | ios_base::binary);
+		file.seekp(boost::filesystem::file_size(files[0]) / 2);
+		file.write("XXXXXXXX", 8);
+		TEST_CHECK(file.good());
+	}
+
+	// The file is discarded and the tree built again
+	loadCount = errorCount = 0;
+	auto_ptr<BVHAccel> rebuiltAccel(scene.NewAccel(ctx));
+	TEST_CHECK((loadCount == 0) && (errorCount == 1));
+	CheckSameHits(scene, *rebuiltAccel, *refAccel);
+
+	// And a valid file has been written again
+	loadCount = errorCount = 0;
+	auto_ptr<BVHAccel> loadedAccel(scene.NewAccel(ctx));
+	TEST_CHECK((loadCount == 1) && (errorCount == 0));
+	CheckSameHits(scene, *loadedAccel, *refAccel);
+}
+
+int main(int argc, char** argv) {
+	u_int failed = 0;
+	RUN_TEST_CASE(failed, TestCacheHit);
+	RUN_TEST_CASE(failed, TestMeshEdit);
+	RUN_TEST_CASE(failed, TestBuildParams);
+	RUN_TEST_CASE(failed, TestCorruptedFile);
+
+	return (failed > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,168 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+// BVHAccel quantized nodes test: the quantized bounding boxes are
+// conservative so the QUANTIZED16 and QUANTIZED8 node formats must return
+// the same Intersect() and Occluded() results of the FLOAT one, also with
+// triangles of very different sizes and far from the origin.
+
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/foreach.hpp>
+
+#include "luxrays/luxrays.h"
+#include "luxrays/core/context.h"
+#include "luxrays/core/randomgen.h"
+#include "luxrays/core/trianglemesh.h"
+#include "luxrays/accelerators/bvhaccel.h"
+
+#include "testutils.h"
+
+using namespace std;
+using namespace luxrays;
+
+static const u_int TRIANGLE_COUNT = 50000;
+static const u_int RAY_COUNT = 100000;
+
+// Counts the quantized trees built
+static u_int quantizedCount = 0;
+
+static void DebugHandler(const char *msg) {
+	if (strstr(msg, "Total BVH quantized memory usage"))
+		++quantizedCount;
+}
+
+class QuantizedScene {
+public:
+	QuantizedScene(const Point &o, const float size) : rndGen(53), origin(o), spaceSize(size) {
+		Point *vertices = TriangleMesh::AllocVerticesBuffer(3 * TRIANGLE_COUNT);
+		Triangle *triangles = TriangleMesh::AllocTrianglesBuffer(TRIANGLE_COUNT);
+		for (u_int i = 0; i < TRIANGLE_COUNT; ++i) {
+			// Triangle sizes from 1e-4 to 1e-1 of the scene size
+			const float triangleSize = spaceSize * powf(10.f, -1.f - 3.f * rndGen.floatValue());
+
+			const Point center = RandomPoint();
+			for (u_int j = 0; j < 3; ++j) {
+				vertices[3 * i + j] = center + triangleSize * Vector(rndGen.floatValue(), rndGen.floatValue(), rndGen.floatValue());
+				triangles[i].v[j] = 3 * i + j;
+			}
+		}
+		mesh.reset(new TriangleMesh(3 * TRIANGLE_COUNT, TRIANGLE_COUNT, vertices, triangles));
+		meshes.push_back(mesh.get());
+
+		for (u_int i = 0; i < RAY_COUNT; ++i) {
+			const Vector dir(rndGen.floatValue() - .5f, rndGen.floatValue() - .5f, rndGen.floatValue() - .5f);
+			Ray ray(RandomPoint(), Normalize(dir));
+			// Some short rays to test the early exit on maxt
+			if (i % 3 == 0)
+				ray.maxt = spaceSize * .05f;
+			rays.push_back(ray);
+		}
+	}
+
+	~QuantizedScene() {
+		mesh->Delete();
+	}
+
+	Point RandomPoint() {
+		return origin + spaceSize * Vector(rndGen.floatValue(), rndGen.floatValue(), rndGen.floatValue());
+	}
+
+	BVHAccel *NewAccel(const Context &ctx) const {
+		BVHAccel *accel = new BVHAccel(&ctx);
+		accel->Init(meshes, 3 * TRIANGLE_COUNT, TRIANGLE_COUNT);
+
+		return accel;
+	}
+
+	RandomGenerator rndGen;
+	const Point origin;
+	const float spaceSize;
+	auto_ptr<TriangleMesh> mesh;
+	deque<const Mesh *> meshes;
+	vector<Ray> rays;
+};
+
+static Properties GetConfig(const string &nodeFormat) {
+	Properties cfg;
+	cfg <<
+			Property("accelerator.bvh.builder.type")("PARALLEL_BINNED_SAH") <<
+			Property("accelerator.bvh.nodeformat")(nodeFormat);
+
+	return cfg;
+}
+
+static void CheckSameHits(const QuantizedScene &scene) {
+	Context refCtx(DebugHandler, GetConfig("FLOAT"));
+	auto_ptr<BVHAccel> refAccel(scene.NewAccel(refCtx));
+
+	const string nodeFormats[] = { "QUANTIZED16", "QUANTIZED8" };
+	BOOST_FOREACH(const string &nodeFormat, nodeFormats) {
+		Context ctx(DebugHandler, GetConfig(nodeFormat));
+		quantizedCount = 0;
+		auto_ptr<BVHAccel> accel(scene.NewAccel(ctx));
+		// Check the quantized nodes are really used
+		TEST_CHECK_MSG(quantizedCount == 1, nodeFormat);
+		TEST_CHECK(accel->GetMemoryUsage() < refAccel->GetMemoryUsage());
+
+		u_int hits = 0;
+		u_int mismatches = 0;
+		u_int occludedMismatches = 0;
+		BOOST_FOREACH(const Ray &ray, scene.rays) {
+			RayHit hit, refHit;
+			accel->Intersect(&ray, &hit);
+			refAccel->Intersect(&ray, &refHit);
+
+			if (!refHit.Miss())
+				++hits;
+			if ((hit.Miss() != refHit.Miss()) || (!hit.Miss() && ((hit.t != refHit.t) ||
+					(hit.meshIndex != refHit.meshIndex) || (hit.triangleIndex != refHit.triangleIndex))))
+				++mismatches;
+			if (accel->Occluded(&ray) != refAccel->Occluded(&ray))
+				++occludedMismatches;
+		}
+
+		// Make sure the test is meaningful
+		TEST_CHECK_MSG(hits > RAY_COUNT / 20, "hits: " << hits);
+		TEST_CHECK_MSG((mismatches == 0) && (occludedMismatches == 0), nodeFormat <<
+				": Intersect() mismatches: " << mismatches << ", Occluded() mismatches: " << occludedMismatches);
+	}
+}
+
+static void TestSameHits() {
+	QuantizedScene scene(Point(0.f, 0.f, 0.f), 100.f);
+	CheckSameHits(scene);
+}
+
+static void TestSameHitsFarFromOrigin() {
+	// The float precision is lower far from the origin
+	QuantizedScene scene(Point(1e5f, -2e5f, 5e4f), 1000.f);
+	CheckSameHits(scene);
+}
+
+int main(int argc, char** argv) {
+	u_int failed = 0;
+	RUN_TEST_CASE(failed, TestSameHits);
+	RUN_TEST_CASE(failed, TestSameHitsFarFromOrigin);
+
+	return (failed > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
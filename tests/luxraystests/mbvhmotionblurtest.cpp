@@ -0,0 +1,219 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+// MBVHAccel motion blur time segments test: the per time segment bounding
+// boxes must only skip the moving instances a ray can't hit at its time, so
+// Intersect() and Occluded() have to return the same results with any
+// number of segments.
+
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include <boost/foreach.hpp>
+
+#include "luxrays/luxrays.h"
+#include "luxrays/core/context.h"
+#include "luxrays/core/randomgen.h"
+#include "luxrays/core/trianglemesh.h"
+#include "luxrays/core/geometry/motionsystem.h"
+#include "luxrays/accelerators/mbvhaccel.h"
+
+#include "testutils.h"
+
+using namespace std;
+using namespace luxrays;
+
+static const u_int TRIANGLE_COUNT = 100;
+static const u_int STATIC_INSTANCE_COUNT = 500;
+static const u_int MOTION_INSTANCE_COUNT = 1000;
+static const u_int RAY_COUNT = 50000;
+static const float SPACE_SIZE = 100.f;
+
+// Counts the MBVH built with time segments
+static u_int motionBBoxesCount = 0;
+
+static void DebugHandler(const char *msg) {
+	if (strstr(msg, "MBVH motion blur time segments"))
+		++motionBBoxesCount;
+}
+
+class MotionScene {
+public:
+	MotionScene() : rndGen(29) {
+		Point *vertices = TriangleMesh::AllocVerticesBuffer(3 * TRIANGLE_COUNT);
+		Triangle *triangles = TriangleMesh::AllocTrianglesBuffer(TRIANGLE_COUNT);
+		for (u_int i = 0; i < TRIANGLE_COUNT; ++i) {
+			const Point center(rndGen.floatValue() * 4.f, rndGen.floatValue() * 2.f, rndGen.floatValue() * 2.f);
+			for (u_int j = 0; j < 3; ++j) {
+				vertices[3 * i + j] = center + .5f * Vector(rndGen.floatValue(), rndGen.floatValue(), rndGen.floatValue());
+				triangles[i].v[j] = 3 * i + j;
+			}
+		}
+		mesh.reset(new TriangleMesh(3 * TRIANGLE_COUNT, TRIANGLE_COUNT, vertices, triangles));
+
+		for (u_int i = 0; i < STATIC_INSTANCE_COUNT; ++i) {
+			const Vector pos(rndGen.floatValue() * SPACE_SIZE, rndGen.floatValue() * SPACE_SIZE, 0.f);
+			meshes.push_back(new InstanceTriangleMesh(mesh.get(), Translate(pos)));
+		}
+
+		// Fast moving and rotating instances, the motion systems store the
+		// global to local transformations
+		for (u_int i = 0; i < MOTION_INSTANCE_COUNT; ++i) {
+			const Vector pos(rndGen.floatValue() * SPACE_SIZE, rndGen.floatValue() * SPACE_SIZE, 5.f);
+			const Vector move(rndGen.floatValue() * 40.f - 20.f, rndGen.floatValue() * 40.f - 20.f, 0.f);
+
+			vector<float> times;
+			vector<Transform> transforms;
+			for (u_int k = 0; k < 3; ++k) {
+				const float time = k * .5f;
+				times.push_back(time);
+				transforms.push_back(Inverse(Translate(pos + move * time) * RotateZ(k * 20.f)));
+			}
+
+			motionSystems.push_back(MotionSystem(times, transforms));
+			meshes.push_back(new MotionTriangleMesh(mesh.get(), motionSystems.back()));
+		}
+
+		for (u_int i = 0; i < RAY_COUNT; ++i) {
+			const Point orig(rndGen.floatValue() * SPACE_SIZE, rndGen.floatValue() * SPACE_SIZE, 30.f);
+			const Vector dir(rndGen.floatValue() - .5f, rndGen.floatValue() - .5f, -2.f);
+			Ray ray(orig, Normalize(dir));
+			// Include times out of the shutter interval
+			ray.time = rndGen.floatValue() * 1.2f - .1f;
+			rays.push_back(ray);
+		}
+	}
+
+	~MotionScene() {
+		BOOST_FOREACH(const Mesh *m, meshes)
+			delete m;
+		mesh->Delete();
+	}
+
+	MBVHAccel *NewAccel(const Context &ctx) const {
+		MBVHAccel *accel = new MBVHAccel(&ctx);
+		accel->Init(meshes, 0, TRIANGLE_COUNT * meshes.size());
+
+		return accel;
+	}
+
+	RandomGenerator rndGen;
+	auto_ptr<TriangleMesh> mesh;
+	vector<MotionSystem> motionSystems;
+	deque<const Mesh *> meshes;
+	vector<Ray> rays;
+};
+
+static Properties GetConfig(const u_int timeSegments) {
+	Properties cfg;
+	cfg << Property("accelerator.mbvh.motionblur.timesegments")(timeSegments);
+
+	return cfg;
+}
+
+static void TestSegmentBound() {
+	MotionScene scene;
+	const u_int segments = 8;
+
+	BOOST_FOREACH(const MotionSystem &ms, scene.motionSystems) {
+		const BBox localBBox = scene.mesh->GetBBox();
+		const BBox fullBBox = ms.Bound(localBBox, true);
+
+		const float segmentLength = (ms.EndTime() - ms.StartTime()) / segments;
+		for (u_int segment = 0; segment < segments; ++segment) {
+			const float startTime = ms.StartTime() + segment * segmentLength;
+			const BBox segmentBBox = ms.Bound(localBBox, true, startTime, startTime + segmentLength);
+
+			// The segment bounding box is a subset of the whole shutter one
+			BBox expandedFullBBox = fullBBox;
+			expandedFullBBox.Expand(1e-3f);
+			TEST_CHECK(expandedFullBBox.Inside(segmentBBox));
+
+			// And it includes the object at any time of the segment
+			BBox expandedSegmentBBox = segmentBBox;
+			expandedSegmentBBox.Expand(1e-3f);
+			for (u_int i = 0; i <= 16; ++i) {
+				const Transform local2Global = Inverse(Transform(ms.Sample(startTime + segmentLength * i / 16.f)));
+				for (u_int corner = 0; corner < 8; ++corner) {
+					const Point p((corner & 1) ? localBBox.pMax.x : localBBox.pMin.x,
+							(corner & 2) ? localBBox.pMax.y : localBBox.pMin.y,
+							(corner & 4) ? localBBox.pMax.z : localBBox.pMin.z);
+					TEST_CHECK(expandedSegmentBBox.Inside(local2Global * p));
+				}
+			}
+		}
+	}
+}
+
+static void TestSameHits() {
+	MotionScene scene;
+
+	// The reference: one segment, the whole shutter bounding boxes
+	Context refCtx(DebugHandler, GetConfig(1));
+	motionBBoxesCount = 0;
+	auto_ptr<MBVHAccel> refAccel(scene.NewAccel(refCtx));
+	TEST_CHECK(motionBBoxesCount == 0);
+
+	vector<RayHit> refHits(RAY_COUNT);
+	vector<bool> refOccluded(RAY_COUNT);
+	u_int hits = 0;
+	for (u_int i = 0; i < RAY_COUNT; ++i) {
+		refAccel->Intersect(&scene.rays[i], &refHits[i]);
+		refOccluded[i] = refAccel->Occluded(&scene.rays[i]);
+		TEST_CHECK(refOccluded[i] == !refHits[i].Miss());
+
+		if (!refHits[i].Miss())
+			++hits;
+	}
+	// Make sure the test is meaningful
+	TEST_CHECK_MSG(hits > RAY_COUNT / 10, "hits: " << hits);
+
+	const u_int segmentCounts[] = { 2, 8, 16 };
+	BOOST_FOREACH(const u_int segments, segmentCounts) {
+		Context ctx(DebugHandler, GetConfig(segments));
+		motionBBoxesCount = 0;
+		auto_ptr<MBVHAccel> accel(scene.NewAccel(ctx));
+		TEST_CHECK(motionBBoxesCount == 1);
+
+		u_int mismatches = 0;
+		u_int occludedMismatches = 0;
+		for (u_int i = 0; i < RAY_COUNT; ++i) {
+			RayHit hit;
+			accel->Intersect(&scene.rays[i], &hit);
+
+			if ((hit.Miss() != refHits[i].Miss()) || (!hit.Miss() && ((hit.t != refHits[i].t) ||
+					(hit.meshIndex != refHits[i].meshIndex) || (hit.triangleIndex != refHits[i].triangleIndex))))
+				++mismatches;
+			if (accel->Occluded(&scene.rays[i]) != refOccluded[i])
+				++occludedMismatches;
+		}
+
+		TEST_CHECK_MSG((mismatches == 0) && (occludedMismatches == 0), "segments: " << segments <<
+				", Intersect() mismatches: " << mismatches << ", Occluded() mismatches: " << occludedMismatches);
+	}
+}
+
+int main(int argc, char** argv) {
+	u_int failed = 0;
+	RUN_TEST_CASE(failed, TestSegmentBound);
+	RUN_TEST_CASE(failed, TestSameHits);
+
+	return (failed > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,259 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+// MBVHAccel root tree refit test: after editing the transformation of some
+// instances, the refitted (or rebuilt, when its cost is over
+// accelerator.mbvh.rootrefit.maxcostratio) MBVH must return the same hits
+// of a MBVH built from scratch on the same meshes.
+
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include <boost/foreach.hpp>
+
+#include "luxrays/luxrays.h"
+#include "luxrays/core/context.h"
+#include "luxrays/core/randomgen.h"
+#include "luxrays/core/trianglemesh.h"
+#include "luxrays/accelerators/mbvhaccel.h"
+
+#include "testutils.h"
+
+using namespace std;
+using namespace luxrays;
+
+static const u_int TRIANGLE_COUNT = 50;
+static const u_int INSTANCE_COUNT = 5000;
+static const u_int RAY_COUNT = 50000;
+static const float SPACE_SIZE = 100.f;
+
+// Counts the root tree refits and rebuilds logged by MBVHAccel::Update()
+static u_int refitCount = 0;
+static u_int rebuildCount = 0;
+
+static void DebugHandler(const char *msg) {
+	if (strstr(msg, "MBVH root tree refitted"))
+		++refitCount;
+	else if (strstr(msg, "rebuilding"))
+		++rebuildCount;
+}
+
+class InstanceScene {
+public:
+	InstanceScene() : rndGen(17) {
+		Point *vertices = TriangleMesh::AllocVerticesBuffer(3 * TRIANGLE_COUNT);
+		Triangle *triangles = TriangleMesh::AllocTrianglesBuffer(TRIANGLE_COUNT);
+		for (u_int i = 0; i < TRIANGLE_COUNT; ++i) {
+			const Point center(rndGen.floatValue(), rndGen.floatValue(), rndGen.floatValue());
+			for (u_int j = 0; j < 3; ++j) {
+				vertices[3 * i + j] = center + .3f * Vector(rndGen.floatValue(), rndGen.floatValue(), rndGen.floatValue());
+				triangles[i].v[j] = 3 * i + j;
+			}
+		}
+		mesh.reset(new TriangleMesh(3 * TRIANGLE_COUNT, TRIANGLE_COUNT, vertices, triangles));
+
+		for (u_int i = 0; i < INSTANCE_COUNT; ++i) {
+			instances.push_back(new InstanceTriangleMesh(mesh.get(), RandomTranslation()));
+			meshes.push_back(instances.back());
+		}
+
+		for (u_int i = 0; i < RAY_COUNT; ++i) {
+			const Point orig(rndGen.floatValue() * SPACE_SIZE, rndGen.floatValue() * SPACE_SIZE, 20.f);
+			const Vector dir(rndGen.floatValue() - .5f, rndGen.floatValue() - .5f, -1.f);
+			rays.push_back(Ray(orig, Normalize(dir)));
+		}
+	}
+
+	~InstanceScene() {
+		BOOST_FOREACH(InstanceTriangleMesh *instance, instances)
+			delete instance;
+		mesh->Delete();
+	}
+
+	Transform RandomTranslation() {
+		return Translate(Vector(rndGen.floatValue() * SPACE_SIZE, rndGen.floatValue() * SPACE_SIZE,
+				rndGen.floatValue() * 10.f));
+	}
+
+	void MoveInstances(const u_int count) {
+		for (u_int i = 0; i < count; ++i) {
+			InstanceTriangleMesh *instance = instances[rndGen.uintValue() % instances.size()];
+			instance->SetTransformation(instance->GetTransformation() *
+					Translate(Vector(rndGen.floatValue() * 5.f, rndGen.floatValue() * 5.f, 0.f)));
+		}
+	}
+
+	MBVHAccel *NewAccel(const Context &ctx) const {
+		MBVHAccel *accel = new MBVHAccel(&ctx);
+		accel->Init(meshes, 3 * TRIANGLE_COUNT * INSTANCE_COUNT, TRIANGLE_COUNT * INSTANCE_COUNT);
+
+		return accel;
+	}
+
+	RandomGenerator rndGen;
+	auto_ptr<TriangleMesh> mesh;
+	vector<InstanceTriangleMesh *> instances;
+	deque<const Mesh *> meshes;
+	vector<Ray> rays;
+};
+
+// Checks that the 2 accelerators return the same hit for all rays
+static void CheckSameHits(const InstanceScene &scene, const MBVHAccel &accel, const MBVHAccel &refAccel) {
+	u_int mismatches = 0;
+	u_int hits = 0;
+	BOOST_FOREACH(const Ray &ray, scene.rays) {
+		RayHit hit, refHit;
+		accel.Intersect(&ray, &hit);
+		refAccel.Intersect(&ray, &refHit);
+
+		if (!refHit.Miss())
+			++hits;
+		if ((hit.Miss() != refHit.Miss()) || (!hit.Miss() && ((hit.t != refHit.t) ||
+				(hit.meshIndex != refHit.meshIndex) || (hit.triangleIndex != refHit.triangleIndex))))
+			++mismatches;
+	}
+
+	// Make sure the test is meaningful
+	TEST_CHECK_MSG(hits > RAY_COUNT / 10, "hits: " << hits);
+	TEST_CHECK_MSG(mismatches == 0, "mismatches: " << mismatches << "/" << RAY_COUNT);
+}
+
+static Properties GetConfig(const bool rootRefit, const float rootMaxCostRatio,
+		const float leafMaxCostRatio = 1.5f) {
+	Properties cfg;
+	cfg <<
+			Property("accelerator.mbvh.rootrefit.enable")(rootRefit) <<
+			Property("accelerator.mbvh.rootrefit.maxcostratio")(rootMaxCostRatio) <<
+			Property("accelerator.mbvh.refit.maxcostratio")(leafMaxCostRatio);
+
+	return cfg;
+}
+
+static void TestRefitMatchesRebuild() {
+	InstanceScene scene;
+	Context ctx(DebugHandler, GetConfig(true, 1000.f));
+	auto_ptr<MBVHAccel> accel(scene.NewAccel(ctx));
+
+	const u_int editCounts[] = { 1, 10, 100, INSTANCE_COUNT / 2 };
+	BOOST_FOREACH(const u_int editCount, editCounts) {
+		scene.MoveInstances(editCount);
+
+		refitCount = rebuildCount = 0;
+		accel->Update();
+		TEST_CHECK_MSG((refitCount == 1) && (rebuildCount == 0), "edits: " << editCount);
+
+		auto_ptr<MBVHAccel> refAccel(scene.NewAccel(ctx));
+		CheckSameHits(scene, *accel, *refAccel);
+	}
+}
+
+static void TestRebuildOnCostIncrease() {
+	InstanceScene scene;
+	// Any cost increase triggers a rebuild
+	Context ctx(DebugHandler, GetConfig(true, 1.f));
+	auto_ptr<MBVHAccel> accel(scene.NewAccel(ctx));
+
+	// Scatter half of the instances to degrade the tree
+	for (u_int i = 0; i < INSTANCE_COUNT / 2; ++i)
+		scene.instances[i]->SetTransformation(scene.RandomTranslation());
+
+	refitCount = rebuildCount = 0;
+	accel->Update();
+	TEST_CHECK(rebuildCount == 1);
+
+	auto_ptr<MBVHAccel> refAccel(scene.NewAccel(ctx));
+	CheckSameHits(scene, *accel, *refAccel);
+}
+
+static void TestRootRatioOnly() {
+	// The root tree rebuild depends only on the root tree ratio: a leaf ratio
+	// that would rebuild the leafs doesn't rebuild the root tree
+	{
+		InstanceScene scene;
+		Context ctx(DebugHandler, GetConfig(true, 1000.f, 1.f));
+		auto_ptr<MBVHAccel> accel(scene.NewAccel(ctx));
+
+		scene.MoveInstances(100);
+
+		refitCount = rebuildCount = 0;
+		accel->Update();
+		TEST_CHECK((refitCount == 1) && (rebuildCount == 0));
+
+		auto_ptr<MBVHAccel> refAccel(scene.NewAccel(ctx));
+		CheckSameHits(scene, *accel, *refAccel);
+	}
+
+	// And a leaf ratio that would never rebuild the leafs doesn't prevent
+	// the root tree rebuild
+	{
+		InstanceScene scene;
+		Context ctx(DebugHandler, GetConfig(true, 1.f, 1000.f));
+		auto_ptr<MBVHAccel> accel(scene.NewAccel(ctx));
+
+		for (u_int i = 0; i < INSTANCE_COUNT / 2; ++i)
+			scene.instances[i]->SetTransformation(scene.RandomTranslation());
+
+		refitCount = rebuildCount = 0;
+		accel->Update();
+		TEST_CHECK((refitCount == 0) && (rebuildCount == 1));
+
+		auto_ptr<MBVHAccel> refAccel(scene.NewAccel(ctx));
+		CheckSameHits(scene, *accel, *refAccel);
+	}
+}
+
+static void TestNoEdit() {
+	InstanceScene scene;
+	Context ctx(DebugHandler, GetConfig(true, 1.5f));
+	auto_ptr<MBVHAccel> accel(scene.NewAccel(ctx));
+
+	refitCount = rebuildCount = 0;
+	accel->Update();
+	TEST_CHECK((refitCount == 0) && (rebuildCount == 0));
+
+	auto_ptr<MBVHAccel> refAccel(scene.NewAccel(ctx));
+	CheckSameHits(scene, *accel, *refAccel);
+}
+
+static void TestRefitDisabled() {
+	InstanceScene scene;
+	Context ctx(DebugHandler, GetConfig(false, 1000.f));
+	auto_ptr<MBVHAccel> accel(scene.NewAccel(ctx));
+
+	scene.MoveInstances(10);
+
+	refitCount = rebuildCount = 0;
+	accel->Update();
+	TEST_CHECK(refitCount == 0);
+
+	auto_ptr<MBVHAccel> refAccel(scene.NewAccel(ctx));
+	CheckSameHits(scene, *accel, *refAccel);
+}
+
+int main(int argc, char** argv) {
+	u_int failed = 0;
+	RUN_TEST_CASE(failed, TestRefitMatchesRebuild);
+	RUN_TEST_CASE(failed, TestRebuildOnCostIncrease);
+	RUN_TEST_CASE(failed, TestRootRatioOnly);
+	RUN_TEST_CASE(failed, TestNoEdit);
+	RUN_TEST_CASE(failed, TestRefitDisabled);
+
+	return (failed > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
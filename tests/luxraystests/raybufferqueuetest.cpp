@@ -0,0 +1,138 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+// RayBufferQueue multi-producer, multi-consumer stress test: each producer
+// (a queue index) pushes a set of ray buffers, many workers pop them from
+// the shared to-do queue and push them back to the done queue. Every buffer
+// must be delivered to a worker exactly once per push and come back to its
+// producer in the order it was pushed.
+
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include "luxrays/luxrays.h"
+#include "luxrays/core/geometry/raybuffer.h"
+
+#include "testutils.h"
+
+using namespace std;
+using namespace luxrays;
+
+static const u_int PASS_COUNT = 5000;
+
+// Producer errors are counted here because the checks run outside the
+// main thread
+static boost::atomic<u_int> orderErrors(0);
+static boost::atomic<u_int> deliveryErrors(0);
+
+static void Worker(RayBufferQueue *queue) {
+	try {
+		for (;;) {
+			RayBuffer *rayBuffer = queue->PopToDo();
+			// Count the deliveries in the ray hit buffer: only the worker
+			// owning the buffer can touch it
+			rayBuffer->GetHitBuffer()[0].meshIndex++;
+			queue->PushDone(rayBuffer);
+		}
+	} catch (boost::thread_interrupted) {
+	}
+}
+
+static void Producer(RayBufferQueue *queue, const u_int queueIndex, const u_int bufferCount) {
+	vector<RayBuffer *> rayBuffers(bufferCount);
+	for (u_int i = 0; i < bufferCount; ++i) {
+		rayBuffers[i] = new RayBuffer(1);
+		rayBuffers[i]->GetHitBuffer()[0].meshIndex = 0;
+	}
+
+	for (u_int pass = 0; pass < PASS_COUNT; ++pass) {
+		for (u_int i = 0; i < bufferCount; ++i)
+			queue->PushToDo(rayBuffers[i], queueIndex);
+
+		for (u_int i = 0; i < bufferCount; ++i) {
+			RayBuffer *rayBuffer = queue->PopDone(queueIndex);
+
+			if (rayBuffer != rayBuffers[i])
+				++orderErrors;
+			if (rayBuffer->GetHitBuffer()[0].meshIndex != pass + 1)
+				++deliveryErrors;
+			// The queue has to remove any book keeping data it has added
+			if (rayBuffer->GetUserDataCount() != 0)
+				++orderErrors;
+		}
+	}
+
+	for (u_int i = 0; i < bufferCount; ++i)
+		delete rayBuffers[i];
+}
+
+static void RunStress(RayBufferQueue &queue, const u_int producerCount,
+		const u_int bufferCount, const u_int workerCount) {
+	orderErrors = 0;
+	deliveryErrors = 0;
+
+	boost::thread_group workers, producers;
+	for (u_int i = 0; i < workerCount; ++i)
+		workers.create_thread(boost::bind(Worker, &queue));
+	for (u_int i = 0; i < producerCount; ++i)
+		producers.create_thread(boost::bind(Producer, &queue, i, bufferCount));
+
+	producers.join_all();
+	workers.interrupt_all();
+	workers.join_all();
+
+	TEST_CHECK_MSG((orderErrors == 0) && (deliveryErrors == 0),
+			"producers: " << producerCount << ", buffers: " << bufferCount << ", workers: " << workerCount <<
+			", order errors: " << orderErrors << ", delivery errors: " << deliveryErrors);
+	TEST_CHECK((queue.GetSizeToDo() == 0) && (queue.GetSizeDone() == 0));
+}
+
+// Producers, buffers per producer, workers
+static const u_int configs[][3] = {
+	{ 1, 1, 1 },
+	{ 1, 3, 2 },
+	{ 4, 3, 2 },
+	{ 8, 5, 3 },
+	{ 3, 8, 4 }
+};
+static const u_int configCount = sizeof(configs) / sizeof(configs[0]);
+
+static void TestLockFreeQueue() {
+	for (u_int i = 0; i < configCount; ++i) {
+		RayBufferQueueM2MLockFree queue(configs[i][0], configs[i][1]);
+		RunStress(queue, configs[i][0], configs[i][1], configs[i][2]);
+	}
+}
+
+static void TestLockQueue() {
+	for (u_int i = 0; i < configCount; ++i) {
+		RayBufferQueueM2M queue(configs[i][0]);
+		RunStress(queue, configs[i][0], configs[i][1], configs[i][2]);
+	}
+}
+
+int main(int argc, char** argv) {
+	u_int failed = 0;
+	RUN_TEST_CASE(failed, TestLockFreeQueue);
+	RUN_TEST_CASE(failed, TestLockQueue);
+
+	return (failed > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,193 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+// SBVH builder test: the spatial splits duplicate the references of the long
+// diagonal triangles. The tree must return the same Intersect() and
+// Occluded() results of a plain BVH and the number of additional references
+// must stay within accelerator.bvh.sbvh.memorybudget.
+
+#include <cstring>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/foreach.hpp>
+
+#include "luxrays/luxrays.h"
+#include "luxrays/core/context.h"
+#include "luxrays/core/randomgen.h"
+#include "luxrays/core/trianglemesh.h"
+#include "luxrays/accelerators/bvhaccel.h"
+
+#include "testutils.h"
+
+using namespace std;
+using namespace luxrays;
+
+static const u_int TRIANGLE_COUNT = 10000;
+static const u_int RAY_COUNT = 50000;
+static const float SPACE_SIZE = 100.f;
+
+// The number of triangle references of the last BVH built
+static u_int referenceCount = 0;
+
+static void DebugHandler(const char *msg) {
+	const char *prefix = "BVH triangle references: ";
+	const char *s = strstr(msg, prefix);
+	if (s)
+		referenceCount = strtoul(s + strlen(prefix), NULL, 10);
+}
+
+class DiagonalScene {
+public:
+	DiagonalScene() : rndGen(61) {
+		Point *vertices = TriangleMesh::AllocVerticesBuffer(3 * TRIANGLE_COUNT);
+		Triangle *triangles = TriangleMesh::AllocTrianglesBuffer(TRIANGLE_COUNT);
+		for (u_int i = 0; i < TRIANGLE_COUNT; ++i) {
+			if (i % 8 == 0) {
+				// A long and thin triangle crossing the scene along a
+				// diagonal, its bounding box overlaps most of the others
+				const Point start = Point(0.f, 0.f, 0.f) + .2f * RandomVector();
+				const Point end = Point(SPACE_SIZE, SPACE_SIZE, SPACE_SIZE) - .2f * RandomVector();
+				vertices[3 * i] = start;
+				vertices[3 * i + 1] = end;
+				vertices[3 * i + 2] = end + Vector(rndGen.floatValue(), -rndGen.floatValue(), rndGen.floatValue());
+			} else {
+				const Point center = RandomPoint();
+				for (u_int j = 0; j < 3; ++j)
+					vertices[3 * i + j] = center + Vector(rndGen.floatValue(), rndGen.floatValue(), rndGen.floatValue());
+			}
+
+			for (u_int j = 0; j < 3; ++j)
+				triangles[i].v[j] = 3 * i + j;
+		}
+		mesh.reset(new TriangleMesh(3 * TRIANGLE_COUNT, TRIANGLE_COUNT, vertices, triangles));
+		meshes.push_back(mesh.get());
+
+		for (u_int i = 0; i < RAY_COUNT; ++i) {
+			const Vector dir(rndGen.floatValue() - .5f, rndGen.floatValue() - .5f, rndGen.floatValue() - .5f);
+			Ray ray(RandomPoint(), Normalize(dir));
+			// Some short rays to test the early exit on maxt
+			if (i % 3 == 0)
+				ray.maxt = 5.f;
+			rays.push_back(ray);
+		}
+	}
+
+	~DiagonalScene() {
+		mesh->Delete();
+	}
+
+	Vector RandomVector() {
+		return Vector(rndGen.floatValue() * SPACE_SIZE, rndGen.floatValue() * SPACE_SIZE,
+				rndGen.floatValue() * SPACE_SIZE);
+	}
+
+	Point RandomPoint() {
+		return Point(0.f, 0.f, 0.f) + RandomVector();
+	}
+
+	BVHAccel *NewAccel(const Context &ctx) const {
+		BVHAccel *accel = new BVHAccel(&ctx);
+		accel->Init(meshes, 3 * TRIANGLE_COUNT, TRIANGLE_COUNT);
+
+		return accel;
+	}
+
+	RandomGenerator rndGen;
+	auto_ptr<TriangleMesh> mesh;
+	deque<const Mesh *> meshes;
+	vector<Ray> rays;
+};
+
+static Properties GetConfig(const string &builderType, const float memoryBudget) {
+	Properties cfg;
+	cfg <<
+			Property("accelerator.bvh.builder.type")(builderType) <<
+			Property("accelerator.bvh.sbvh.memorybudget")(memoryBudget);
+
+	return cfg;
+}
+
+// Checks that the 2 accelerators return the same results for all rays
+static void CheckSameHits(const DiagonalScene &scene, const BVHAccel &accel, const BVHAccel &refAccel) {
+	u_int hits = 0;
+	u_int mismatches = 0;
+	u_int occludedMismatches = 0;
+	BOOST_FOREACH(const Ray &ray, scene.rays) {
+		RayHit hit, refHit;
+		accel.Intersect(&ray, &hit);
+		refAccel.Intersect(&ray, &refHit);
+
+		if (!refHit.Miss())
+			++hits;
+		if ((hit.Miss() != refHit.Miss()) || (!hit.Miss() && ((hit.t != refHit.t) ||
+				(hit.meshIndex != refHit.meshIndex) || (hit.triangleIndex != refHit.triangleIndex))))
+			++mismatches;
+		if (accel.Occluded(&ray) != refAccel.Occluded(&ray))
+			++occludedMismatches;
+	}
+
+	// Make sure the test is meaningful
+	TEST_CHECK_MSG(hits > RAY_COUNT / 10, "hits: " << hits);
+	TEST_CHECK_MSG((mismatches == 0) && (occludedMismatches == 0), "Intersect() mismatches: " <<
+			mismatches << ", Occluded() mismatches: " << occludedMismatches);
+}
+
+static void TestSameHits() {
+	DiagonalScene scene;
+
+	Context refCtx(DebugHandler, GetConfig("CLASSIC", 0.f));
+	auto_ptr<BVHAccel> refAccel(scene.NewAccel(refCtx));
+
+	Context ctx(DebugHandler, GetConfig("SBVH", .3f));
+	referenceCount = 0;
+	auto_ptr<BVHAccel> accel(scene.NewAccel(ctx));
+	// Make sure some spatial split has been done
+	TEST_CHECK_MSG(referenceCount > TRIANGLE_COUNT, "references: " << referenceCount);
+
+	CheckSameHits(scene, *accel, *refAccel);
+}
+
+static void TestMemoryBudget() {
+	DiagonalScene scene;
+
+	const float memoryBudgets[] = { 0.f, .01f, .1f, .3f };
+	BOOST_FOREACH(const float memoryBudget, memoryBudgets) {
+		Context ctx(DebugHandler, GetConfig("SBVH", memoryBudget));
+		referenceCount = 0;
+		auto_ptr<BVHAccel> accel(scene.NewAccel(ctx));
+
+		const u_int maxReferenceCount = TRIANGLE_COUNT + static_cast<u_int>(memoryBudget * TRIANGLE_COUNT);
+		TEST_CHECK_MSG((referenceCount >= TRIANGLE_COUNT) && (referenceCount <= maxReferenceCount),
+				"memory budget: " << memoryBudget << ", references: " << referenceCount);
+		// No spatial split without memory budget
+		if (memoryBudget == 0.f)
+			TEST_CHECK(referenceCount == TRIANGLE_COUNT);
+	}
+}
+
+int main(int argc, char** argv) {
+	u_int failed = 0;
+	RUN_TEST_CASE(failed, TestSameHits);
+	RUN_TEST_CASE(failed, TestMemoryBudget);
+
+	return (failed > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,170 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+// TaskScheduler test: nested ParallelFor() calls, TaskGroup::Wait() from
+// threads not owned by the scheduler (it must run only the tasks of its own
+// group) and the change of the thread count while the workers are idle.
+
+#include <set>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include "luxrays/utils/taskscheduler.h"
+
+#include "testutils.h"
+
+using namespace std;
+using namespace luxrays;
+
+static const u_int INNER_COUNT = 1000;
+
+static void CountItems(const u_int begin, const u_int end, boost::atomic<u_int> *counter) {
+	*counter += end - begin;
+}
+
+static void InnerParallelFor(const u_int begin, const u_int end, TaskScheduler *scheduler,
+		boost::atomic<u_int> *counter) {
+	for (u_int i = begin; i < end; ++i)
+		ParallelFor(0, INNER_COUNT, 7, boost::bind(&CountItems, _1, _2, counter), *scheduler);
+}
+
+static void RecordThread(boost::mutex *threadIdsMutex, set<boost::thread::id> *threadIds) {
+	boost::unique_lock<boost::mutex> lock(*threadIdsMutex);
+	threadIds->insert(boost::this_thread::get_id());
+}
+
+static void SleepAndRecordThread(boost::mutex *threadIdsMutex, set<boost::thread::id> *threadIds) {
+	boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+	RecordThread(threadIdsMutex, threadIds);
+}
+
+static void NestedParallelFor(TaskScheduler *scheduler, const u_int outerCount,
+		boost::atomic<u_int> *counter) {
+	ParallelFor(0, outerCount, 1, boost::bind(&InnerParallelFor, _1, _2, scheduler, counter), *scheduler);
+}
+
+static void TestNestedParallelFor() {
+	for (u_int threadCount = 1; threadCount <= 8; threadCount *= 2) {
+		TaskScheduler scheduler(threadCount);
+
+		const u_int outerCount = 64;
+		boost::atomic<u_int> counter(0);
+		NestedParallelFor(&scheduler, outerCount, &counter);
+
+		TEST_CHECK_MSG(counter == outerCount * INNER_COUNT, threadCount << " threads: " << counter);
+	}
+}
+
+static void TestWaitFromNonWorkerThreads() {
+	TaskScheduler scheduler(4);
+
+	// Many threads, not owned by the scheduler, waiting at the same time
+	const u_int threadCount = 6;
+	const u_int outerCount = 16;
+	vector<boost::atomic<u_int> *> counters(threadCount);
+	vector<boost::thread *> threads(threadCount);
+	for (u_int i = 0; i < threadCount; ++i) {
+		counters[i] = new boost::atomic<u_int>(0);
+		threads[i] = new boost::thread(boost::bind(&NestedParallelFor, &scheduler, outerCount, counters[i]));
+	}
+	for (u_int i = 0; i < threadCount; ++i) {
+		threads[i]->join();
+		delete threads[i];
+	}
+	for (u_int i = 0; i < threadCount; ++i) {
+		TEST_CHECK_MSG(*counters[i] == outerCount * INNER_COUNT, "thread " << i << ": " << *counters[i]);
+		delete counters[i];
+	}
+
+	// Waiting for a group must not run the tasks of another group: the
+	// caller may own a lock they need. Without workers, only the waiting
+	// threads run the tasks.
+	TaskScheduler noWorkersScheduler(1);
+
+	boost::mutex threadIdsMutex;
+	set<boost::thread::id> waitedThreadIds, otherThreadIds;
+	TaskGroup waitedGroup(noWorkersScheduler), otherGroup(noWorkersScheduler);
+	waitedGroup.Run(boost::bind(&RecordThread, &threadIdsMutex, &waitedThreadIds));
+	// The most recent task is the first one to be picked
+	otherGroup.Run(boost::bind(&RecordThread, &threadIdsMutex, &otherThreadIds));
+
+	waitedGroup.Wait();
+	TEST_CHECK(waitedThreadIds.size() == 1);
+	TEST_CHECK(otherThreadIds.size() == 0);
+
+	otherGroup.Wait();
+	TEST_CHECK(otherThreadIds.size() == 1);
+}
+
+static void TestResizeWhileIdle() {
+	const u_int maxThreadCount = Max<u_int>(boost::thread::hardware_concurrency(), 8);
+	TaskScheduler scheduler(8);
+	TEST_CHECK(scheduler.GetThreadCount() == 8);
+
+	boost::mutex threadIdsMutex;
+
+	// Park all the workers: only the waiting thread runs the tasks
+	scheduler.SetThreadCount(1);
+	TEST_CHECK(scheduler.GetThreadCount() == 1);
+	{
+		set<boost::thread::id> threadIds;
+		TaskGroup group(scheduler);
+		for (u_int i = 0; i < 100; ++i)
+			group.Run(boost::bind(&SleepAndRecordThread, &threadIdsMutex, &threadIds));
+		group.Wait();
+
+		TEST_CHECK(threadIds.size() == 1);
+		TEST_CHECK(*threadIds.begin() == boost::this_thread::get_id());
+	}
+
+	// Wake up some of the parked workers
+	scheduler.SetThreadCount(4);
+	TEST_CHECK(scheduler.GetThreadCount() == 4);
+	{
+		set<boost::thread::id> threadIds;
+		TaskGroup group(scheduler);
+		for (u_int i = 0; i < 200; ++i)
+			group.Run(boost::bind(&SleepAndRecordThread, &threadIdsMutex, &threadIds));
+		group.Wait();
+
+		TEST_CHECK_MSG((threadIds.size() > 1) && (threadIds.size() <= 4), threadIds.size());
+	}
+
+	// The thread count is clamped
+	scheduler.SetThreadCount(maxThreadCount + 100);
+	TEST_CHECK_MSG(scheduler.GetThreadCount() == maxThreadCount, scheduler.GetThreadCount());
+	scheduler.SetThreadCount(0);
+	TEST_CHECK(scheduler.GetThreadCount() == 1);
+
+	boost::atomic<u_int> counter(0);
+	scheduler.SetThreadCount(8);
+	NestedParallelFor(&scheduler, 16, &counter);
+	TEST_CHECK(counter == 16 * INNER_COUNT);
+}
+
+int main(int argc, char** argv) {
+	u_int failed = 0;
+	RUN_TEST_CASE(failed, TestNestedParallelFor);
+	RUN_TEST_CASE(failed, TestWaitFromNonWorkerThreads);
+	RUN_TEST_CASE(failed, TestResizeWhileIdle);
+
+	return (failed > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
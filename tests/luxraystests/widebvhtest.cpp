@@ -0,0 +1,172 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+// BVH4Accel and BVH8Accel test: the wide SIMD traversal must return the same
+// Intersect() and Occluded() results of BVHAccel, with any builder and also
+// when the whole tree is a single leaf.
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/foreach.hpp>
+
+#include "luxrays/luxrays.h"
+#include "luxrays/core/context.h"
+#include "luxrays/core/randomgen.h"
+#include "luxrays/core/trianglemesh.h"
+#include "luxrays/accelerators/bvhaccel.h"
+#include "luxrays/accelerators/widebvhaccel.h"
+
+#include "testutils.h"
+
+using namespace std;
+using namespace luxrays;
+
+static const u_int RAY_COUNT = 100000;
+static const float SPACE_SIZE = 100.f;
+
+class RandomScene {
+public:
+	// The triangles are split in 2 meshes to test the mesh indices too
+	RandomScene(const u_int sceneTriangleCount) : rndGen(23), vertexCount(0), triangleCount(0) {
+		for (u_int m = 0; m < 2; ++m) {
+			const u_int count = (m == 0) ? (sceneTriangleCount + 1) / 2 : sceneTriangleCount / 2;
+			if (count == 0)
+				continue;
+
+			Point *vertices = TriangleMesh::AllocVerticesBuffer(3 * count);
+			Triangle *triangles = TriangleMesh::AllocTrianglesBuffer(count);
+			for (u_int i = 0; i < count; ++i) {
+				const Point center(rndGen.floatValue() * SPACE_SIZE, rndGen.floatValue() * SPACE_SIZE,
+						rndGen.floatValue() * SPACE_SIZE);
+				for (u_int j = 0; j < 3; ++j) {
+					vertices[3 * i + j] = center + 2.f * Vector(rndGen.floatValue(), rndGen.floatValue(), rndGen.floatValue());
+					triangles[i].v[j] = 3 * i + j;
+				}
+			}
+
+			triangleMeshes.push_back(new TriangleMesh(3 * count, count, vertices, triangles));
+			meshes.push_back(triangleMeshes.back());
+			vertexCount += 3 * count;
+			triangleCount += count;
+		}
+
+		for (u_int i = 0; i < RAY_COUNT; ++i) {
+			const Point orig(rndGen.floatValue() * SPACE_SIZE, rndGen.floatValue() * SPACE_SIZE,
+					rndGen.floatValue() * SPACE_SIZE);
+			const Vector dir(rndGen.floatValue() - .5f, rndGen.floatValue() - .5f, rndGen.floatValue() - .5f);
+			Ray ray(orig, Normalize(dir));
+			// Some short rays to test the early exit on maxt
+			if (i % 3 == 0)
+				ray.maxt = 5.f;
+			rays.push_back(ray);
+		}
+	}
+
+	~RandomScene() {
+		BOOST_FOREACH(TriangleMesh *mesh, triangleMeshes) {
+			mesh->Delete();
+			delete mesh;
+		}
+	}
+
+	template<class T> T *NewAccel(const Context &ctx) const {
+		T *accel = new T(&ctx);
+		accel->Init(meshes, vertexCount, triangleCount);
+
+		return accel;
+	}
+
+	RandomGenerator rndGen;
+	vector<TriangleMesh *> triangleMeshes;
+	deque<const Mesh *> meshes;
+	u_longlong vertexCount, triangleCount;
+	vector<Ray> rays;
+};
+
+static Properties GetConfig(const string &builderType) {
+	Properties cfg;
+	cfg << Property("accelerator.bvh.builder.type")(builderType);
+
+	return cfg;
+}
+
+// Checks that the 2 accelerators return the same results for all rays
+static void CheckSameHits(const RandomScene &scene, const Accelerator &accel,
+		const Accelerator &refAccel, const u_int minHits) {
+	u_int hits = 0;
+	u_int mismatches = 0;
+	u_int occludedMismatches = 0;
+	BOOST_FOREACH(const Ray &ray, scene.rays) {
+		RayHit hit, refHit;
+		accel.Intersect(&ray, &hit);
+		refAccel.Intersect(&ray, &refHit);
+
+		if (!refHit.Miss())
+			++hits;
+		if ((hit.Miss() != refHit.Miss()) || (!hit.Miss() && ((hit.t != refHit.t) ||
+				(hit.meshIndex != refHit.meshIndex) || (hit.triangleIndex != refHit.triangleIndex))))
+			++mismatches;
+		if (accel.Occluded(&ray) != refAccel.Occluded(&ray))
+			++occludedMismatches;
+	}
+
+	// Make sure the test is meaningful
+	TEST_CHECK_MSG(hits >= minHits, "hits: " << hits);
+	TEST_CHECK_MSG((mismatches == 0) && (occludedMismatches == 0), Accelerator::AcceleratorType2String(accel.GetType()) <<
+			": Intersect() mismatches: " << mismatches << ", Occluded() mismatches: " << occludedMismatches);
+}
+
+static void TestSameHits() {
+	RandomScene scene(50000);
+
+	const string builderTypes[] = { "CLASSIC", "PARALLEL_BINNED_SAH" };
+	BOOST_FOREACH(const string &builderType, builderTypes) {
+		Context ctx(NULL, GetConfig(builderType));
+
+		auto_ptr<BVHAccel> refAccel(scene.NewAccel<BVHAccel>(ctx));
+		auto_ptr<BVH4Accel> bvh4Accel(scene.NewAccel<BVH4Accel>(ctx));
+		auto_ptr<BVH8Accel> bvh8Accel(scene.NewAccel<BVH8Accel>(ctx));
+
+		CheckSameHits(scene, *bvh4Accel, *refAccel, RAY_COUNT / 10);
+		CheckSameHits(scene, *bvh8Accel, *refAccel, RAY_COUNT / 10);
+	}
+}
+
+static void TestSingleLeaf() {
+	// The root of the tree is a triangle leaf
+	RandomScene scene(1);
+	Context ctx(NULL, GetConfig("CLASSIC"));
+
+	auto_ptr<BVHAccel> refAccel(scene.NewAccel<BVHAccel>(ctx));
+	auto_ptr<BVH4Accel> bvh4Accel(scene.NewAccel<BVH4Accel>(ctx));
+	auto_ptr<BVH8Accel> bvh8Accel(scene.NewAccel<BVH8Accel>(ctx));
+
+	CheckSameHits(scene, *bvh4Accel, *refAccel, 0);
+	CheckSameHits(scene, *bvh8Accel, *refAccel, 0);
+}
+
+int main(int argc, char** argv) {
+	u_int failed = 0;
+	RUN_TEST_CASE(failed, TestSameHits);
+	RUN_TEST_CASE(failed, TestSingleLeaf);
+
+	return (failed > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
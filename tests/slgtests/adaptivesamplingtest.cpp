@@ -0,0 +1,219 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+// Adaptive sampling test: the samplers have to distribute the samples
+// according the CONVERGENCE channel and the convergence test has to stop the
+// rendering only when all pixels, including the ones receiving less samples,
+// are converged.
+
+#include <limits>
+#include <memory>
+
+#include "luxrays/luxrays.h"
+#include "luxrays/core/randomgen.h"
+#include "slg/film/film.h"
+#include "slg/film/sampleresult.h"
+#include "slg/film/imagepipeline/imagepipeline.h"
+#include "slg/film/imagepipeline/plugins/tonemaps/linear.h"
+#include "slg/samplers/random.h"
+
+#include "testutils.h"
+
+using namespace std;
+using namespace luxrays;
+using namespace slg;
+
+// Not a multiple of 4, to test the SSE and the scalar code of the
+// convergence test
+static const u_int FILM_WIDTH = 66;
+static const u_int FILM_HEIGHT = 32;
+static const u_int PIXEL_COUNT = FILM_WIDTH * FILM_HEIGHT;
+// The right half of the film
+static const u_int RIGHT_PIXEL_COUNT = (FILM_WIDTH / 2) * FILM_HEIGHT;
+static const float THRESHOLD = .02f;
+
+static Film *NewFilm() {
+	Film *film = new Film(FILM_WIDTH, FILM_HEIGHT, NULL);
+	film->oclEnable = false;
+	film->AddChannel(Film::RADIANCE_PER_PIXEL_NORMALIZED);
+	film->SetConvTestFlag(true);
+
+	// The image pipeline output is the pixel radiance
+	ImagePipeline *imagePipeline = new ImagePipeline();
+	imagePipeline->AddPlugin(new LinearToneMap(1.f));
+	film->SetImagePipelines(imagePipeline);
+
+	film->Init();
+
+	return film;
+}
+
+// Adds the samples of the given value to the left and the right half of
+// the film
+static void AddSamples(Film *film, const u_int leftSamples, const float leftValue,
+		const u_int rightSamples, const float rightValue) {
+	SampleResult sampleResult(Film::RADIANCE_PER_PIXEL_NORMALIZED, 1);
+
+	for (u_int y = 0; y < FILM_HEIGHT; ++y) {
+		for (u_int x = 0; x < FILM_WIDTH; ++x) {
+			const bool right = (x >= FILM_WIDTH / 2);
+			sampleResult.radiance[0] = Spectrum(right ? rightValue : leftValue);
+
+			const u_int samples = right ? rightSamples : leftSamples;
+			for (u_int i = 0; i < samples; ++i)
+				film->AddSample(x, y, sampleResult, 1.f);
+		}
+	}
+}
+
+static void CheckConvergence(const Film &film, const float leftValue, const float rightValue) {
+	u_int errors = 0;
+	for (u_int y = 0; y < FILM_HEIGHT; ++y) {
+		for (u_int x = 0; x < FILM_WIDTH; ++x) {
+			const float convergence = *(film.channel_CONVERGENCE->GetPixel(x, y));
+			if (convergence != ((x >= FILM_WIDTH / 2) ? rightValue : leftValue))
+				++errors;
+		}
+	}
+
+	TEST_CHECK_MSG(errors == 0, "wrong CONVERGENCE pixels: " << errors << "/" << PIXEL_COUNT);
+}
+
+static void TestSamplingDistribution() {
+	auto_ptr<Film> film(NewFilm());
+	TEST_CHECK(film->HasChannel(Film::CONVERGENCE));
+
+	// All pixels are sampled until the first convergence test
+	for (u_int i = 0; i < PIXEL_COUNT; ++i)
+		TEST_CHECK(*(film->channel_CONVERGENCE->GetPixel(i)) == numeric_limits<float>::infinity());
+
+	// The left half of the film is not converged at all and the right half
+	// is converged
+	for (u_int y = 0; y < FILM_HEIGHT; ++y)
+		for (u_int x = 0; x < FILM_WIDTH; ++x)
+			*(film->channel_CONVERGENCE->GetPixel(x, y)) = (x >= FILM_WIDTH / 2) ? 0.f : 1.f;
+
+	RandomGenerator rndGen(7);
+	RandomSamplerSharedData sharedData(film.get());
+	const float adaptiveStrength = .8f;
+	RandomSampler sampler(&rndGen, film.get(), NULL, &sharedData, adaptiveStrength);
+
+	u_int leftCount = 0;
+	u_int rightCount = 0;
+	for (u_int i = 0; i < 200000; ++i) {
+		sampler.RequestSamples(2);
+
+		if (sampler.GetSample(0) * FILM_WIDTH >= FILM_WIDTH / 2)
+			++rightCount;
+		else
+			++leftCount;
+	}
+
+	// The converged pixels receive (1 - adaptiveStrength) of the samples of
+	// the not converged ones
+	const float ratio = rightCount / (float)leftCount;
+	TEST_CHECK_MSG(fabsf(ratio - (1.f - adaptiveStrength)) < .01f, "right/left samples ratio: " << ratio);
+}
+
+static void TestThreadFilmChannels() {
+	auto_ptr<Film> film(NewFilm());
+
+	// The films of the render threads and tiles don't need the CONVERGENCE
+	// channel: the samplers read it from the engine film
+	Film threadFilm(FILM_WIDTH, FILM_HEIGHT, NULL);
+	threadFilm.CopyDynamicSettings(*film);
+	TEST_CHECK(!threadFilm.HasChannel(Film::CONVERGENCE));
+	TEST_CHECK(threadFilm.HasChannel(Film::RADIANCE_PER_PIXEL_NORMALIZED));
+}
+
+static void TestHaltOnStaticImage() {
+	auto_ptr<Film> film(NewFilm());
+
+	AddSamples(film.get(), 4, .5f, 4, .25f);
+	TEST_CHECK(film->RunConvergenceTest(THRESHOLD) == PIXEL_COUNT);
+
+	// The image doesn't change anymore
+	AddSamples(film.get(), 4, .5f, 4, .25f);
+	const u_int todoPixelsCount = film->RunConvergenceTest(THRESHOLD);
+	TEST_CHECK_MSG(todoPixelsCount == 0, "todo pixels: " << todoPixelsCount);
+	CheckConvergence(*film, 0.f, 0.f);
+}
+
+static void TestThrottledPixels() {
+	auto_ptr<Film> film(NewFilm());
+
+	AddSamples(film.get(), 4, .5f, 4, .5f);
+	film->RunConvergenceTest(THRESHOLD);
+
+	// The right half receives only 1 sample: its change (.08 / 5) is below
+	// the threshold but, with the same number of samples of the left half,
+	// the error would have been larger
+	AddSamples(film.get(), 16, .5f, 1, .58f);
+	const u_int todoPixelsCount = film->RunConvergenceTest(THRESHOLD);
+	TEST_CHECK_MSG(todoPixelsCount == RIGHT_PIXEL_COUNT, "todo pixels: " << todoPixelsCount);
+	CheckConvergence(*film, 0.f, 1.f);
+}
+
+static void TestNotSampledPixels() {
+	auto_ptr<Film> film(NewFilm());
+
+	AddSamples(film.get(), 4, .5f, 4, .5f);
+	film->RunConvergenceTest(THRESHOLD);
+
+	// The right half pixels have not received any sample so they can not be
+	// tested
+	AddSamples(film.get(), 4, .5f, 0, 0.f);
+	u_int todoPixelsCount = film->RunConvergenceTest(THRESHOLD);
+	TEST_CHECK_MSG(todoPixelsCount == RIGHT_PIXEL_COUNT, "todo pixels: " << todoPixelsCount);
+	CheckConvergence(*film, 0.f, 1.f);
+
+	AddSamples(film.get(), 4, .5f, 4, .5f);
+	todoPixelsCount = film->RunConvergenceTest(THRESHOLD);
+	TEST_CHECK_MSG(todoPixelsCount == 0, "todo pixels: " << todoPixelsCount);
+}
+
+static void TestReset() {
+	auto_ptr<Film> film(NewFilm());
+
+	AddSamples(film.get(), 4, .5f, 4, .5f);
+	film->RunConvergenceTest(THRESHOLD);
+	AddSamples(film.get(), 4, .5f, 4, .5f);
+	film->RunConvergenceTest(THRESHOLD);
+
+	// After a reset, the first test has to sample all pixels again
+	film->Reset();
+	film->ResetConvergenceTest();
+	CheckConvergence(*film, numeric_limits<float>::infinity(), numeric_limits<float>::infinity());
+
+	AddSamples(film.get(), 4, .5f, 4, .5f);
+	TEST_CHECK(film->RunConvergenceTest(THRESHOLD) == PIXEL_COUNT);
+	AddSamples(film.get(), 4, .5f, 4, .5f);
+	TEST_CHECK(film->RunConvergenceTest(THRESHOLD) == 0);
+}
+
+int main(int argc, char** argv) {
+	u_int failed = 0;
+	RUN_TEST_CASE(failed, TestSamplingDistribution);
+	RUN_TEST_CASE(failed, TestThreadFilmChannels);
+	RUN_TEST_CASE(failed, TestHaltOnStaticImage);
+	RUN_TEST_CASE(failed, TestThrottledPixels);
+	RUN_TEST_CASE(failed, TestNotSampledPixels);
+	RUN_TEST_CASE(failed, TestReset);
+
+	return (failed > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,198 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+// Camera response test: the LUT based CameraResponsePlugin::ApplyRegion()
+// has to match the reference CameraResponsePlugin::Map() for all presets
+// and for the curves too steep to be sampled by a LUT, leaving the pixels
+// out of the region or out of the mask untouched.
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include <boost/filesystem.hpp>
+
+#include "luxrays/luxrays.h"
+#include "luxrays/core/randomgen.h"
+#include "slg/slg.h"
+#include "slg/film/film.h"
+#include "slg/film/imagepipeline/imagepipeline.h"
+#include "slg/film/imagepipeline/plugins/cameraresponse.h"
+
+#include "testutils.h"
+
+using namespace std;
+using namespace luxrays;
+using namespace slg;
+
+static const u_int FILM_WIDTH = 67;
+static const u_int FILM_HEIGHT = 41;
+// The region applied, unaligned on purpose
+static const u_int REGION_X_START = 3;
+static const u_int REGION_X_END = 62;
+static const u_int REGION_Y_START = 5;
+static const u_int REGION_Y_END = 40;
+
+// Twice the LUT_MAX_ERROR of CameraResponsePlugin for the rounding errors
+static const float MAX_ERROR = 2e-4f;
+
+static const char *Presets[] = {
+	"Advantix_100CD", "Advantix_200CD", "Advantix_400CD",
+	"Agfachrome_ctpecisa_200CD", "Agfachrome_ctprecisa_100CD",
+	"Agfachrome_rsx2_050CD", "Agfachrome_rsx2_100CD", "Agfachrome_rsx2_200CD",
+	"Agfacolor_futura_100CD", "Agfacolor_futura_200CD", "Agfacolor_futura_400CD",
+	"Agfacolor_futuraII_100CD", "Agfacolor_futuraII_200CD", "Agfacolor_futuraII_400CD",
+	"Agfacolor_hdc_100_plusCD", "Agfacolor_hdc_200_plusCD", "Agfacolor_hdc_400_plusCD",
+	"Agfacolor_optimaII_100CD", "Agfacolor_optimaII_200CD", "Agfacolor_ultra_050_CD",
+	"Agfacolor_vista_100CD", "Agfacolor_vista_200CD", "Agfacolor_vista_400CD",
+	"Agfacolor_vista_800CD", "Agfapan_apx_025CD", "Agfapan_apx_100CD",
+	"Agfapan_apx_400CD", "Ektachrome_100_plusCD", "Ektachrome_100CD",
+	"Ektachrome_320TCD", "Ektachrome_400XCD", "Ektachrome_64CD",
+	"Ektachrome_64TCD", "Ektachrome_E100SCD", "F125CD", "F250CD", "F400CD",
+	"FCICD", "Gold_100CD", "Gold_200CD", "Kodachrome_200CD", "Kodachrome_25CD",
+	"Kodachrome_64CD", "Max_Zoom_800CD", "Portra_100TCD", "Portra_160NCCD",
+	"Portra_160VCCD", "Portra_400NCCD", "Portra_400VCCD", "Portra_800CD"
+};
+
+static u_int lutFallbackCount = 0;
+
+static void DebugHandler(const char *msg) {
+	if (strstr(msg, "the curve is evaluated without LUT"))
+		++lutFallbackCount;
+}
+
+class TestFilm {
+public:
+	TestFilm() {
+		film.reset(new Film(FILM_WIDTH, FILM_HEIGHT, NULL));
+		film->oclEnable = false;
+		film->SetImagePipelines(new ImagePipeline());
+		film->Init();
+
+		// Values in the [-0.1, 1.2] range to cover the clamping at both ends
+		// of the curves and the steps, with a pixel out of 8 not in the mask
+		RandomGenerator rndGen(131);
+		float *pixels = film->channel_IMAGEPIPELINEs[0]->GetPixels();
+		u_int *mask = film->channel_FRAMEBUFFER_MASK->GetPixels();
+		for (u_int i = 0; i < FILM_WIDTH * FILM_HEIGHT; ++i) {
+			for (u_int j = 0; j < 3; ++j)
+				pixels[i * 3 + j] = rndGen.floatValue() * 1.3f - .1f;
+			mask[i] = (rndGen.uintValue() % 8) ? 1 : 0;
+		}
+	}
+
+	auto_ptr<Film> film;
+};
+
+static bool IsInRegion(const u_int x, const u_int y) {
+	return (x >= REGION_X_START) && (x < REGION_X_END) &&
+			(y >= REGION_Y_START) && (y < REGION_Y_END);
+}
+
+static void CheckPlugin(CameraResponsePlugin &plugin, const string &name) {
+	TestFilm srcFilm, lutFilm;
+
+	plugin.ApplyRegion(*lutFilm.film, 0, REGION_X_START, REGION_X_END,
+			REGION_Y_START, REGION_Y_END);
+
+	const u_int *mask = srcFilm.film->channel_FRAMEBUFFER_MASK->GetPixels();
+	for (u_int y = 0; y < FILM_HEIGHT; ++y) {
+		for (u_int x = 0; x < FILM_WIDTH; ++x) {
+			const u_int index = x + y * FILM_WIDTH;
+			const float *src = srcFilm.film->channel_IMAGEPIPELINEs[0]->GetPixel(index);
+			const float *lut = lutFilm.film->channel_IMAGEPIPELINEs[0]->GetPixel(index);
+
+			RGBColor ref(src[0], src[1], src[2]);
+			if (mask[index] && IsInRegion(x, y))
+				plugin.Map(ref);
+
+			for (u_int i = 0; i < 3; ++i) {
+				// Written to catch NaNs too
+				TEST_CHECK_MSG(fabsf(lut[i] - ref.c[i]) <= MAX_ERROR, name << " pixel " << x << "x" << y <<
+						": " << lut[i] << " instead of " << ref.c[i]);
+			}
+		}
+	}
+}
+
+static void TestPresets() {
+	for (u_int i = 0; i < sizeof(Presets) / sizeof(Presets[0]); ++i) {
+		CameraResponsePlugin plugin(Presets[i]);
+		CheckPlugin(plugin, Presets[i]);
+
+		// The LUTs are built again by the copy
+		auto_ptr<CameraResponsePlugin> copy((CameraResponsePlugin *)plugin.Copy());
+		CheckPlugin(*copy, Presets[i]);
+	}
+}
+
+static void CheckCurveFile(const string &data, const string &name) {
+	const boost::filesystem::path fileName = boost::filesystem::temp_directory_path() /
+			boost::filesystem::unique_path("cameraresponsetest-%%%%-%%%%-%%%%.crf");
+	{
+		ofstream file(fileName.string().c_str());
+		file << data;
+	}
+
+	try {
+		CameraResponsePlugin plugin(fileName.string());
+		CheckPlugin(plugin, name);
+	} catch (...) {
+		boost::filesystem::remove(fileName);
+		throw;
+	}
+	boost::filesystem::remove(fileName);
+}
+
+static void TestSteepCurves() {
+	// A step in the middle of the range, much narrower than a LUT interval
+	const string stepI = "0 0.25 0.5 0.5000001 0.75 1";
+	const string stepB = "0 0.1 0.2 0.8 0.9 1";
+	const string smoothI = "0 0.25 0.5 0.75 1";
+	const string smoothB = "0 0.3 0.55 0.8 1";
+
+	lutFallbackCount = 0;
+	CheckCurveFile("StepMono\ngraph: I\nI = " + stepI + "\nB = " + stepB + "\n", "monochrome step");
+	TEST_CHECK_MSG(lutFallbackCount == 1, lutFallbackCount);
+
+	// Only the green curve is too steep
+	lutFallbackCount = 0;
+	CheckCurveFile(
+			"StepRed\ngraph: I\nI = " + smoothI + "\nB = " + smoothB + "\n"
+			"StepGreen\ngraph: I\nI = " + stepI + "\nB = " + stepB + "\n"
+			"StepBlue\ngraph: I\nI = " + smoothI + "\nB = " + smoothB + "\n",
+			"color step");
+	TEST_CHECK_MSG(lutFallbackCount == 1, lutFallbackCount);
+
+	// A smooth curve doesn't need the fallback
+	lutFallbackCount = 0;
+	CheckCurveFile("SmoothMono\ngraph: I\nI = " + smoothI + "\nB = " + smoothB + "\n", "monochrome smooth");
+	TEST_CHECK_MSG(lutFallbackCount == 0, lutFallbackCount);
+}
+
+int main(int argc, char** argv) {
+	SLG_DebugHandler = DebugHandler;
+
+	u_int failed = 0;
+	RUN_TEST_CASE(failed, TestPresets);
+	RUN_TEST_CASE(failed, TestSteepCurves);
+
+	return (failed > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
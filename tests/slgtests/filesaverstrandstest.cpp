@@ -0,0 +1,148 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+// FILESAVER render engine native strands test: a scene with a native strands
+// mesh has to be exported with the mesh in the serialized format and the
+// exported scene has to load the same mesh again.
+
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+
+#include <boost/filesystem.hpp>
+
+#include "luxcore/luxcore.h"
+
+#include "testutils.h"
+
+using namespace std;
+using namespace luxrays;
+using namespace luxcore;
+
+static const u_int HAIR_COUNT = 16;
+static const u_int HAIR_POINT_COUNT = 4;
+
+static void DefineScene(Scene *scene) {
+	scene->Parse(Properties().SetFromString(
+			"scene.camera.lookat.orig = 0 -5 0.5\n"
+			"scene.camera.lookat.target = 0 0 0.5\n"
+			"scene.materials.mat_white.type = matte\n"
+			"scene.materials.mat_white.kd = 0.75 0.75 0.75\n"
+			));
+
+	cyHairFile strandsFile;
+	strandsFile.SetHairCount(HAIR_COUNT);
+	strandsFile.SetPointCount(HAIR_COUNT * HAIR_POINT_COUNT);
+	strandsFile.SetArrays(CY_HAIR_FILE_POINTS_BIT);
+	strandsFile.SetDefaultSegmentCount(HAIR_POINT_COUNT - 1);
+	strandsFile.SetDefaultThickness(.01f);
+	float *points = strandsFile.GetPointsArray();
+	for (u_int i = 0; i < HAIR_COUNT; ++i) {
+		for (u_int j = 0; j < HAIR_POINT_COUNT; ++j) {
+			float *p = &points[(i * HAIR_POINT_COUNT + j) * 3];
+			p[0] = (i % 4) * .1f + j * .02f;
+			p[1] = (i / 4) * .1f;
+			p[2] = j * .3f;
+		}
+	}
+
+	scene->DefineStrands("hairs_shape", strandsFile, Scene::TESSEL_SEGMENTS,
+			0, 0.f, 0, false, false, false);
+
+	scene->Parse(Properties().SetFromString(
+			"scene.objects.hairs_obj.shape = hairs_shape\n"
+			"scene.objects.hairs_obj.material = mat_white\n"
+			));
+}
+
+static string ReadFile(const boost::filesystem::path &filePath) {
+	ifstream file(filePath.string().c_str(), ios_base::in | ios_base::binary);
+
+	return string(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+}
+
+static void TestExportAndLoad() {
+	const boost::filesystem::path exportDir = boost::filesystem::temp_directory_path() /
+			boost::filesystem::unique_path("filesaverstrandstest-%%%%-%%%%-%%%%");
+	boost::filesystem::create_directories(exportDir);
+	const boost::filesystem::path currentDir = boost::filesystem::current_path();
+
+	try {
+		// Export the scene
+		{
+			auto_ptr<Scene> scene(Scene::Create());
+			DefineScene(scene.get());
+
+			auto_ptr<RenderConfig> config(RenderConfig::Create(Properties() <<
+					Property("renderengine.type")("FILESAVER") <<
+					Property("filesaver.directory")(exportDir.generic_string()) <<
+					Property("filesaver.renderengine.type")("PATHCPU") <<
+					Property("film.width")(64u) <<
+					Property("film.height")(64u), scene.get()));
+			auto_ptr<RenderSession> session(RenderSession::Create(config.get()));
+			session->Start();
+			session->Stop();
+		}
+
+		// The strands mesh is saved in the serialized format and referenced
+		// with the strands property
+		const Properties sceneProps((exportDir / "scene.scn").string());
+		TEST_CHECK(!sceneProps.IsDefined("scene.objects.hairs_obj.ply"));
+		TEST_CHECK(sceneProps.IsDefined("scene.objects.hairs_obj.strands"));
+		const string meshFileName = sceneProps.Get("scene.objects.hairs_obj.strands").Get<string>();
+		TEST_CHECK_MSG(boost::filesystem::path(meshFileName).extension() == ".bpy", meshFileName);
+		TEST_CHECK_MSG(boost::filesystem::exists(exportDir / meshFileName), meshFileName);
+
+		// Load the exported scene, the file names are relative to the
+		// export directory
+		boost::filesystem::current_path(exportDir);
+		auto_ptr<Scene> scene(Scene::Create((exportDir / "scene.scn").string()));
+		TEST_CHECK(scene->IsMeshDefined(meshFileName));
+		TEST_CHECK(scene->ToProperties().IsDefined("scene.objects.hairs_obj.strands"));
+
+		// The loaded mesh is the same
+		scene->SaveMesh(meshFileName, (exportDir / "copy.bpy").string());
+		TEST_CHECK(ReadFile(exportDir / "copy.bpy") == ReadFile(exportDir / meshFileName));
+
+		// Strands meshes can not be saved as PLY
+		bool saveError = false;
+		try {
+			scene->SaveMesh(meshFileName, (exportDir / "copy.ply").string());
+		} catch (runtime_error &) {
+			saveError = true;
+		}
+		TEST_CHECK(saveError);
+	} catch (...) {
+		boost::filesystem::current_path(currentDir);
+		boost::filesystem::remove_all(exportDir);
+		throw;
+	}
+
+	boost::filesystem::current_path(currentDir);
+	boost::filesystem::remove_all(exportDir);
+}
+
+int main(int argc, char** argv) {
+	luxcore::Init();
+
+	u_int failed = 0;
+	RUN_TEST_CASE(failed, TestExportAndLoad);
+
+	return (failed > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
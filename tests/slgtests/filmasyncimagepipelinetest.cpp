@@ -0,0 +1,137 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+// Asynchronous image pipeline test: the frames computed in background have
+// to be published while the film keeps its samples (also when they are
+// merged again after a Film::Reset(), like the render engines do at each
+// update) but never after the rendering has been restarted.
+
+#include <memory>
+
+#include <boost/thread.hpp>
+
+#include "luxrays/luxrays.h"
+#include "slg/film/film.h"
+#include "slg/film/sampleresult.h"
+#include "slg/film/imagepipeline/imagepipeline.h"
+#include "slg/film/imagepipeline/plugins/tonemaps/linear.h"
+
+#include "testutils.h"
+
+using namespace std;
+using namespace luxrays;
+using namespace slg;
+
+static const u_int FILM_WIDTH = 64;
+static const u_int FILM_HEIGHT = 48;
+
+static Film *NewFilm() {
+	Film *film = new Film(FILM_WIDTH, FILM_HEIGHT, NULL);
+	film->oclEnable = false;
+	film->AddChannel(Film::RADIANCE_PER_PIXEL_NORMALIZED);
+
+	// The image pipeline output is the pixel radiance
+	ImagePipeline *imagePipeline = new ImagePipeline();
+	imagePipeline->AddPlugin(new LinearToneMap(1.f));
+	film->SetImagePipelines(imagePipeline);
+
+	film->Init();
+	film->SetAsyncImagePipelineFlag(true);
+
+	return film;
+}
+
+static void AddSamples(Film *film, const u_int samples, const float value) {
+	SampleResult sampleResult(Film::RADIANCE_PER_PIXEL_NORMALIZED, 1);
+	sampleResult.radiance[0] = Spectrum(value);
+
+	for (u_int y = 0; y < FILM_HEIGHT; ++y)
+		for (u_int x = 0; x < FILM_WIDTH; ++x)
+			for (u_int i = 0; i < samples; ++i)
+				film->AddSample(x, y, sampleResult, 1.f);
+	film->AddSampleCount(samples * FILM_WIDTH * FILM_HEIGHT);
+}
+
+static void CheckImage(const Film &film, const float value) {
+	const float *pixels = film.channel_IMAGEPIPELINEs[0]->GetPixels();
+
+	u_int errors = 0;
+	for (u_int i = 0; i < FILM_WIDTH * FILM_HEIGHT * 3; ++i) {
+		if (pixels[i] != value)
+			++errors;
+	}
+
+	TEST_CHECK_MSG(errors == 0, "wrong pixel values: " << errors << ", expected: " << value);
+}
+
+// Starts the execution of the image pipeline in background and waits for it
+static void RunInBackground(Film *film) {
+	film->RefreshImagePipeline(0);
+	boost::this_thread::sleep(boost::posix_time::milliseconds(300));
+}
+
+static void TestMergedFilm() {
+	auto_ptr<Film> film(NewFilm());
+
+	// The first frame is executed by the caller
+	AddSamples(film.get(), 4, 1.f);
+	film->RefreshImagePipeline(0);
+	CheckImage(*film, 1.f);
+
+	RunInBackground(film.get());
+
+	// The samples are merged again with some new ones
+	film->Reset();
+	AddSamples(film.get(), 4, 1.f);
+	AddSamples(film.get(), 4, .5f);
+
+	// The background frame is still valid and it is published
+	film->RefreshImagePipeline(0);
+	CheckImage(*film, 1.f);
+}
+
+static void TestRestartedFilm() {
+	auto_ptr<Film> film(NewFilm());
+
+	AddSamples(film.get(), 4, 1.f);
+	film->RefreshImagePipeline(0);
+	RunInBackground(film.get());
+
+	// The rendering is restarted
+	film->Reset();
+	AddSamples(film.get(), 1, .25f);
+
+	// The background frame shows the old samples so the image pipeline is
+	// executed by the caller
+	film->RefreshImagePipeline(0);
+	CheckImage(*film, .25f);
+
+	// And the asynchronous execution starts again
+	RunInBackground(film.get());
+	AddSamples(film.get(), 1, .75f);
+	film->RefreshImagePipeline(0);
+	CheckImage(*film, .25f);
+}
+
+int main(int argc, char** argv) {
+	u_int failed = 0;
+	RUN_TEST_CASE(failed, TestMergedFilm);
+	RUN_TEST_CASE(failed, TestRestartedFilm);
+
+	return (failed > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
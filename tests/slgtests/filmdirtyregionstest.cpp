@@ -0,0 +1,163 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+// Film dirty regions test: the image pipeline executed only on the regions
+// modified since its last execution must return the same output of a full
+// execution, also when the samples are splatted while the dirty regions are
+// merged.
+
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include "luxrays/luxrays.h"
+#include "luxrays/core/randomgen.h"
+#include "slg/film/film.h"
+#include "slg/film/sampleresult.h"
+#include "slg/film/imagepipeline/imagepipeline.h"
+#include "slg/film/imagepipeline/plugins/gammacorrection.h"
+#include "slg/film/imagepipeline/plugins/tonemaps/linear.h"
+
+#include "testutils.h"
+
+using namespace std;
+using namespace luxrays;
+using namespace slg;
+
+static const u_int FILM_WIDTH = 500;
+static const u_int FILM_HEIGHT = 300;
+static const u_int THREAD_COUNT = 4;
+static const u_int THREAD_SAMPLES = 200000;
+
+static Film *NewFilm(const bool threadSafe) {
+	Film *film = new Film(FILM_WIDTH, FILM_HEIGHT, NULL);
+	film->oclEnable = false;
+	film->AddChannel(Film::RADIANCE_PER_PIXEL_NORMALIZED);
+
+	// Only per-pixel plugins, so the image pipeline can run on the dirty
+	// regions
+	ImagePipeline *imagePipeline = new ImagePipeline();
+	imagePipeline->AddPlugin(new LinearToneMap(1.5f));
+	imagePipeline->AddPlugin(new GammaCorrectionPlugin(2.2f));
+	film->SetImagePipelines(imagePipeline);
+
+	film->Init();
+	film->SetThreadSafeFlag(threadSafe);
+
+	return film;
+}
+
+// Checks that the output of the last execution of the image pipeline is the
+// same of a full execution
+static void CheckImagePipeline(Film &film) {
+	const u_int valueCount = FILM_WIDTH * FILM_HEIGHT * 3;
+	const float *pixels = film.channel_IMAGEPIPELINEs[0]->GetPixels();
+	const vector<float> output(pixels, pixels + valueCount);
+
+	film.InvalidateImagePipelines();
+	film.ExecuteImagePipeline(0);
+
+	u_int mismatches = 0;
+	for (u_int i = 0; i < valueCount; ++i) {
+		if (output[i] != pixels[i])
+			++mismatches;
+	}
+
+	TEST_CHECK_MSG(mismatches == 0, "mismatches: " << mismatches << "/" << valueCount);
+}
+
+static void Splat(Film *film, const u_int seed, const u_int sampleCount) {
+	RandomGenerator rndGen(seed);
+	SampleResult sampleResult(Film::RADIANCE_PER_PIXEL_NORMALIZED, 1);
+
+	for (u_int i = 0; i < sampleCount; ++i) {
+		const u_int x = rndGen.uintValue() % FILM_WIDTH;
+		const u_int y = rndGen.uintValue() % FILM_HEIGHT;
+		sampleResult.radiance[0] = Spectrum(rndGen.floatValue(), rndGen.floatValue(), rndGen.floatValue());
+
+		film->AddSample(x, y, sampleResult, 1.f);
+	}
+}
+
+static void TestSplatsAndAddFilm() {
+	auto_ptr<Film> film(NewFilm(false));
+
+	// The first execution is always a full one
+	Splat(film.get(), 1, FILM_WIDTH * FILM_HEIGHT);
+	film->ExecuteImagePipeline(0);
+
+	RandomGenerator rndGen(2);
+	for (u_int pass = 0; pass < 20; ++pass) {
+		// A few samples and a small tile: the next execution runs only on
+		// the dirty regions
+		Splat(film.get(), pass + 3, 50);
+
+		auto_ptr<Film> tileFilm(NewFilm(false));
+		Splat(tileFilm.get(), pass + 100, FILM_WIDTH * FILM_HEIGHT);
+		const u_int x = rndGen.uintValue() % (FILM_WIDTH - 64);
+		const u_int y = rndGen.uintValue() % (FILM_HEIGHT - 64);
+		film->AddFilm(*tileFilm, x, y, 64, 64, x, y);
+
+		film->ExecuteImagePipeline(0);
+		CheckImagePipeline(*film);
+	}
+}
+
+static boost::atomic<u_int> runningThreads(0);
+
+static void ConcurrentSplat(Film *film, const u_int seed) {
+	Splat(film, seed, THREAD_SAMPLES);
+	--runningThreads;
+}
+
+static void TestConcurrentSplats() {
+	auto_ptr<Film> film(NewFilm(true));
+	film->ExecuteImagePipeline(0);
+
+	// The image pipeline keeps merging the dirty regions while the other
+	// threads splat
+	runningThreads = THREAD_COUNT;
+	boost::thread_group threads;
+	for (u_int i = 0; i < THREAD_COUNT; ++i)
+		threads.create_thread(boost::bind(ConcurrentSplat, film.get(), i + 1));
+
+	u_int executionCount = 0;
+	while (runningThreads > 0) {
+		film->ExecuteImagePipeline(0);
+		++executionCount;
+	}
+	threads.join_all();
+
+	// Make sure the test is meaningful
+	TEST_CHECK_MSG(executionCount > 1, "executions: " << executionCount);
+
+	// All the samples splatted during an execution must be merged by the
+	// next one
+	film->ExecuteImagePipeline(0);
+	CheckImagePipeline(*film);
+}
+
+int main(int argc, char** argv) {
+	u_int failed = 0;
+	RUN_TEST_CASE(failed, TestSplatsAndAddFilm);
+	RUN_TEST_CASE(failed, TestConcurrentSplats);
+
+	return (failed > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,256 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+// Film merge test: the bulk row operations used by Film::AddFilm() (SSE when
+// available) have to give exactly the same results of a per pixel scalar
+// merge, for widths not multiple of the vector size, unaligned rows and
+// sub-regions at any offset.
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "luxrays/luxrays.h"
+#include "luxrays/core/randomgen.h"
+#include "slg/film/film.h"
+#include "slg/film/framebuffer.h"
+
+#include "testutils.h"
+
+using namespace std;
+using namespace luxrays;
+using namespace slg;
+
+static const u_int FILM_WIDTH = 37;
+static const u_int FILM_HEIGHT = 23;
+
+typedef struct {
+	u_int srcOffsetX, srcOffsetY, srcWidth, srcHeight, dstOffsetX, dstOffsetY;
+} Region;
+
+static const Region Regions[] = {
+	{ 0, 0, FILM_WIDTH, FILM_HEIGHT, 0, 0 },
+	{ 1, 2, 13, 7, 5, 3 },
+	{ 0, 0, 1, 1, FILM_WIDTH - 1, FILM_HEIGHT - 1 },
+	{ 3, 1, 30, 20, 2, 2 },
+	{ 6, 0, 31, 23, 0, 0 }
+};
+
+//------------------------------------------------------------------------------
+// Random films
+//------------------------------------------------------------------------------
+
+static void RandomValue(RandomGenerator &rndGen, float &v) {
+	v = rndGen.floatValue() * 10.f - 2.f;
+}
+
+static void RandomValue(RandomGenerator &rndGen, u_int &v) {
+	v = rndGen.uintValue();
+}
+
+template<u_int CHANNELS, u_int WEIGHT_CHANNELS, class T> static void Fill(
+		GenericFrameBuffer<CHANNELS, WEIGHT_CHANNELS, T> *fb, RandomGenerator &rndGen) {
+	T *values = fb->GetPixels();
+	for (u_int i = 0; i < FILM_WIDTH * FILM_HEIGHT * CHANNELS; ++i)
+		RandomValue(rndGen, values[i]);
+}
+
+static Film *NewFilm(const u_long seed) {
+	Film *film = new Film(FILM_WIDTH, FILM_HEIGHT, NULL);
+	film->oclEnable = false;
+	film->AddChannel(Film::RADIANCE_PER_PIXEL_NORMALIZED);
+	film->AddChannel(Film::RADIANCE_PER_SCREEN_NORMALIZED);
+	film->AddChannel(Film::ALPHA);
+	film->AddChannel(Film::DEPTH);
+	film->AddChannel(Film::POSITION);
+	film->AddChannel(Film::MATERIAL_ID);
+	film->AddChannel(Film::UV);
+	film->AddChannel(Film::RAYCOUNT);
+	film->AddChannel(Film::IRRADIANCE);
+	film->Init();
+
+	RandomGenerator rndGen(seed);
+	Fill(film->channel_RADIANCE_PER_PIXEL_NORMALIZEDs[0], rndGen);
+	Fill(film->channel_RADIANCE_PER_SCREEN_NORMALIZEDs[0], rndGen);
+	Fill(film->channel_ALPHA, rndGen);
+	Fill(film->channel_POSITION, rndGen);
+	Fill(film->channel_MATERIAL_ID, rndGen);
+	Fill(film->channel_UV, rndGen);
+	Fill(film->channel_RAYCOUNT, rndGen);
+	Fill(film->channel_IRRADIANCE, rndGen);
+
+	// A few depth values, so many pixels have the same depth in both films
+	float *depths = film->channel_DEPTH->GetPixels();
+	for (u_int i = 0; i < FILM_WIDTH * FILM_HEIGHT; ++i)
+		depths[i] = (float)(rndGen.uintValue() % 4);
+
+	return film;
+}
+
+//------------------------------------------------------------------------------
+// Per pixel scalar merges
+//------------------------------------------------------------------------------
+
+static bool GetSrcPixel(const Region &region, const u_int x, const u_int y,
+		u_int &srcX, u_int &srcY) {
+	if ((x < region.dstOffsetX) || (x >= region.dstOffsetX + region.srcWidth) ||
+			(y < region.dstOffsetY) || (y >= region.dstOffsetY + region.srcHeight))
+		return false;
+
+	srcX = region.srcOffsetX + x - region.dstOffsetX;
+	srcY = region.srcOffsetY + y - region.dstOffsetY;
+
+	return true;
+}
+
+template<u_int CHANNELS, u_int WEIGHT_CHANNELS, class T> static void CheckAdd(
+		const GenericFrameBuffer<CHANNELS, WEIGHT_CHANNELS, T> *before,
+		const GenericFrameBuffer<CHANNELS, WEIGHT_CHANNELS, T> *src,
+		const GenericFrameBuffer<CHANNELS, WEIGHT_CHANNELS, T> *after,
+		const Region &region, const string &name) {
+	for (u_int y = 0; y < FILM_HEIGHT; ++y) {
+		for (u_int x = 0; x < FILM_WIDTH; ++x) {
+			u_int srcX, srcY;
+			const bool merged = GetSrcPixel(region, x, y, srcX, srcY);
+
+			for (u_int i = 0; i < CHANNELS; ++i) {
+				T expected = before->GetPixel(x, y)[i];
+				if (merged)
+					expected += src->GetPixel(srcX, srcY)[i];
+
+				TEST_CHECK_MSG(after->GetPixel(x, y)[i] == expected, name << " pixel " << x << "x" << y <<
+						": " << after->GetPixel(x, y)[i] << " instead of " << expected);
+			}
+		}
+	}
+}
+
+template<u_int CHANNELS, u_int WEIGHT_CHANNELS, class T> static void CheckSetByDepth(
+		const GenericFrameBuffer<CHANNELS, WEIGHT_CHANNELS, T> *before,
+		const GenericFrameBuffer<CHANNELS, WEIGHT_CHANNELS, T> *src,
+		const GenericFrameBuffer<CHANNELS, WEIGHT_CHANNELS, T> *after,
+		const GenericFrameBuffer<1, 0, float> *beforeDepth,
+		const GenericFrameBuffer<1, 0, float> *srcDepth,
+		const Region &region, const string &name) {
+	for (u_int y = 0; y < FILM_HEIGHT; ++y) {
+		for (u_int x = 0; x < FILM_WIDTH; ++x) {
+			u_int srcX, srcY;
+			const bool merged = GetSrcPixel(region, x, y, srcX, srcY) &&
+					(*(srcDepth->GetPixel(srcX, srcY)) < *(beforeDepth->GetPixel(x, y)));
+
+			for (u_int i = 0; i < CHANNELS; ++i) {
+				const T expected = merged ? src->GetPixel(srcX, srcY)[i] : before->GetPixel(x, y)[i];
+
+				TEST_CHECK_MSG(after->GetPixel(x, y)[i] == expected, name << " pixel " << x << "x" << y <<
+						": " << after->GetPixel(x, y)[i] << " instead of " << expected);
+			}
+		}
+	}
+}
+
+static void CheckDepth(const GenericFrameBuffer<1, 0, float> *before,
+		const GenericFrameBuffer<1, 0, float> *src,
+		const GenericFrameBuffer<1, 0, float> *after, const Region &region) {
+	for (u_int y = 0; y < FILM_HEIGHT; ++y) {
+		for (u_int x = 0; x < FILM_WIDTH; ++x) {
+			float expected = *(before->GetPixel(x, y));
+
+			u_int srcX, srcY;
+			if (GetSrcPixel(region, x, y, srcX, srcY))
+				expected = Min(expected, *(src->GetPixel(srcX, srcY)));
+
+			TEST_CHECK_MSG(*(after->GetPixel(x, y)) == expected, "DEPTH pixel " << x << "x" << y <<
+					": " << *(after->GetPixel(x, y)) << " instead of " << expected);
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+// Test cases
+//------------------------------------------------------------------------------
+
+// The bulk operations on their own, with every alignment and tail length
+static void TestBulkOperations() {
+	const u_int maxCount = 40;
+	const u_int maxOffset = 4;
+	const u_int size = maxCount + maxOffset + 1;
+
+	RandomGenerator rndGen(131);
+	vector<float> src(size), dst(size);
+	for (u_int i = 0; i < size; ++i)
+		RandomValue(rndGen, src[i]);
+
+	for (u_int count = 0; count <= maxCount; ++count) {
+		for (u_int dstOffset = 0; dstOffset < maxOffset; ++dstOffset) {
+			for (u_int srcOffset = 0; srcOffset < maxOffset; ++srcOffset) {
+				for (u_int i = 0; i < size; ++i)
+					RandomValue(rndGen, dst[i]);
+				vector<float> expectedAdd(dst), expectedMin(dst);
+				for (u_int i = 0; i < count; ++i) {
+					expectedAdd[dstOffset + i] += src[srcOffset + i];
+					expectedMin[dstOffset + i] = Min(expectedMin[dstOffset + i], src[srcOffset + i]);
+				}
+
+				vector<float> add(dst), min(dst);
+				FrameBufferAddValues(&add[dstOffset], &src[srcOffset], count);
+				FrameBufferMinValues(&min[dstOffset], &src[srcOffset], count);
+
+				TEST_CHECK_MSG(add == expectedAdd, "add count " << count << ", offsets " << dstOffset << " " << srcOffset);
+				TEST_CHECK_MSG(min == expectedMin, "min count " << count << ", offsets " << dstOffset << " " << srcOffset);
+			}
+		}
+	}
+}
+
+static void TestAddFilm() {
+	auto_ptr<Film> srcFilm(NewFilm(1));
+
+	for (u_int i = 0; i < sizeof(Regions) / sizeof(Regions[0]); ++i) {
+		const Region &region = Regions[i];
+
+		auto_ptr<Film> beforeFilm(NewFilm(2));
+		auto_ptr<Film> film(NewFilm(2));
+		film->AddFilm(*srcFilm, region.srcOffsetX, region.srcOffsetY,
+				region.srcWidth, region.srcHeight, region.dstOffsetX, region.dstOffsetY);
+
+		CheckAdd(beforeFilm->channel_RADIANCE_PER_PIXEL_NORMALIZEDs[0], srcFilm->channel_RADIANCE_PER_PIXEL_NORMALIZEDs[0],
+				film->channel_RADIANCE_PER_PIXEL_NORMALIZEDs[0], region, "RADIANCE_PER_PIXEL_NORMALIZED");
+		CheckAdd(beforeFilm->channel_RADIANCE_PER_SCREEN_NORMALIZEDs[0], srcFilm->channel_RADIANCE_PER_SCREEN_NORMALIZEDs[0],
+				film->channel_RADIANCE_PER_SCREEN_NORMALIZEDs[0], region, "RADIANCE_PER_SCREEN_NORMALIZED");
+		CheckAdd(beforeFilm->channel_ALPHA, srcFilm->channel_ALPHA, film->channel_ALPHA, region, "ALPHA");
+		CheckAdd(beforeFilm->channel_RAYCOUNT, srcFilm->channel_RAYCOUNT, film->channel_RAYCOUNT, region, "RAYCOUNT");
+		CheckAdd(beforeFilm->channel_IRRADIANCE, srcFilm->channel_IRRADIANCE, film->channel_IRRADIANCE, region, "IRRADIANCE");
+
+		CheckSetByDepth(beforeFilm->channel_POSITION, srcFilm->channel_POSITION, film->channel_POSITION,
+				beforeFilm->channel_DEPTH, srcFilm->channel_DEPTH, region, "POSITION");
+		CheckSetByDepth(beforeFilm->channel_MATERIAL_ID, srcFilm->channel_MATERIAL_ID, film->channel_MATERIAL_ID,
+				beforeFilm->channel_DEPTH, srcFilm->channel_DEPTH, region, "MATERIAL_ID");
+		CheckSetByDepth(beforeFilm->channel_UV, srcFilm->channel_UV, film->channel_UV,
+				beforeFilm->channel_DEPTH, srcFilm->channel_DEPTH, region, "UV");
+
+		CheckDepth(beforeFilm->channel_DEPTH, srcFilm->channel_DEPTH, film->channel_DEPTH, region);
+	}
+}
+
+int main(int argc, char** argv) {
+	u_int failed = 0;
+	RUN_TEST_CASE(failed, TestBulkOperations);
+	RUN_TEST_CASE(failed, TestAddFilm);
+
+	return (failed > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,209 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+// Film channel storage types test: a film saved with compact storage types
+// (HALF, BYTE) must load back with the same storage types and the values of
+// each channel within the precision of its type.
+
+#include <cmath>
+#include <limits>
+#include <memory>
+
+#include <boost/filesystem.hpp>
+
+#include "luxrays/luxrays.h"
+#include "luxrays/core/randomgen.h"
+#include "slg/film/film.h"
+
+#include "testutils.h"
+
+using namespace std;
+using namespace luxrays;
+using namespace slg;
+
+static const u_int FILM_WIDTH = 64;
+static const u_int FILM_HEIGHT = 48;
+static const u_int PIXEL_SAMPLES = 100;
+
+static Film *NewFilm(const bool compact) {
+	Film *film = new Film(FILM_WIDTH, FILM_HEIGHT, NULL);
+	film->oclEnable = false;
+	film->AddChannel(Film::RADIANCE_PER_PIXEL_NORMALIZED);
+	film->AddChannel(Film::ALPHA);
+	film->AddChannel(Film::GEOMETRY_NORMAL);
+	film->AddChannel(Film::UV);
+	film->AddChannel(Film::DIRECT_SHADOW_MASK);
+	if (compact) {
+		film->SetChannelStorage(Film::ALPHA, FRAMEBUFFER_STORAGE_HALF);
+		film->SetChannelStorage(Film::GEOMETRY_NORMAL, FRAMEBUFFER_STORAGE_HALF);
+		film->SetChannelStorage(Film::UV, FRAMEBUFFER_STORAGE_HALF);
+		film->SetChannelStorage(Film::DIRECT_SHADOW_MASK, FRAMEBUFFER_STORAGE_BYTE);
+	}
+	film->Init();
+
+	// The same pixels for both films
+	RandomGenerator rndGen(11);
+	for (u_int y = 0; y < FILM_HEIGHT; ++y) {
+		for (u_int x = 0; x < FILM_WIDTH; ++x) {
+			for (u_int i = 0; i < PIXEL_SAMPLES; ++i) {
+				const float radiance[3] = { rndGen.floatValue() * 100.f, rndGen.floatValue(), 0.f };
+				film->channel_RADIANCE_PER_PIXEL_NORMALIZEDs[0]->AddWeightedPixel(x, y, radiance, .5f);
+
+				const float alpha = rndGen.floatValue();
+				film->channel_ALPHA->AddWeightedPixel(x, y, &alpha, .5f);
+
+				const float shadow = (rndGen.floatValue() < .3f) ? 1.f : 0.f;
+				film->channel_DIRECT_SHADOW_MASK->AddWeightedPixel(x, y, &shadow, 1.f);
+			}
+
+			const Normal n = Normalize(Normal(rndGen.floatValue() - .5f, rndGen.floatValue() - .5f, rndGen.floatValue()));
+			film->channel_GEOMETRY_NORMAL->SetPixel(x, y, &n.x);
+
+			const float uv[2] = { rndGen.floatValue() * 4.f, rndGen.floatValue() * 4.f };
+			film->channel_UV->SetPixel(x, y, uv);
+		}
+	}
+
+	return film;
+}
+
+// Saves and loads back the film, it returns the size of the file
+static Film *SaveAndLoad(const Film &film, uintmax_t *fileSize) {
+	const boost::filesystem::path fileName = boost::filesystem::temp_directory_path() /
+			boost::filesystem::unique_path("filmstoragetest-%%%%-%%%%.flm");
+
+	Film::SaveSerialized(fileName.string(), &film);
+	*fileSize = boost::filesystem::file_size(fileName);
+	Film *loadedFilm = Film::LoadSerialized(fileName.string());
+	boost::filesystem::remove(fileName);
+
+	return loadedFilm;
+}
+
+// Returns the largest difference of the weighted pixels, relative to the
+// absolute value of the original pixels if it is larger than 1
+template<u_int CHANNELS, u_int WEIGHT_CHANNELS> static float MaxError(
+		const GenericFrameBuffer<CHANNELS, WEIGHT_CHANNELS, float> &fb,
+		const GenericFrameBuffer<CHANNELS, WEIGHT_CHANNELS, float> &loadedFb) {
+	TEST_CHECK((fb.GetWidth() == loadedFb.GetWidth()) && (fb.GetHeight() == loadedFb.GetHeight()));
+
+	float maxError = 0.f;
+	for (u_int y = 0; y < fb.GetHeight(); ++y) {
+		for (u_int x = 0; x < fb.GetWidth(); ++x) {
+			float v[CHANNELS], loadedV[CHANNELS];
+			fb.GetWeightedPixel(x, y, v);
+			loadedFb.GetWeightedPixel(x, y, loadedV);
+
+			for (u_int i = 0; i < CHANNELS - WEIGHT_CHANNELS; ++i)
+				maxError = Max(maxError, fabsf(v[i] - loadedV[i]) / Max(1.f, fabsf(v[i])));
+		}
+	}
+
+	return maxError;
+}
+
+static void TestFloatRoundTrip() {
+	auto_ptr<Film> film(NewFilm(false));
+	uintmax_t fileSize;
+	auto_ptr<Film> loadedFilm(SaveAndLoad(*film, &fileSize));
+
+	TEST_CHECK(loadedFilm->GetChannelStorage(Film::ALPHA) == FRAMEBUFFER_STORAGE_FLOAT);
+	TEST_CHECK(MaxError(*film->channel_RADIANCE_PER_PIXEL_NORMALIZEDs[0], *loadedFilm->channel_RADIANCE_PER_PIXEL_NORMALIZEDs[0]) == 0.f);
+	TEST_CHECK(MaxError(*film->channel_ALPHA, *loadedFilm->channel_ALPHA) == 0.f);
+	TEST_CHECK(MaxError(*film->channel_GEOMETRY_NORMAL, *loadedFilm->channel_GEOMETRY_NORMAL) == 0.f);
+	TEST_CHECK(MaxError(*film->channel_UV, *loadedFilm->channel_UV) == 0.f);
+	TEST_CHECK(MaxError(*film->channel_DIRECT_SHADOW_MASK, *loadedFilm->channel_DIRECT_SHADOW_MASK) == 0.f);
+}
+
+static void TestCompactRoundTrip() {
+	auto_ptr<Film> film(NewFilm(true));
+	uintmax_t fileSize;
+	auto_ptr<Film> loadedFilm(SaveAndLoad(*film, &fileSize));
+
+	// The storage types are saved with the film
+	TEST_CHECK(loadedFilm->GetChannelStorage(Film::ALPHA) == FRAMEBUFFER_STORAGE_HALF);
+	TEST_CHECK(loadedFilm->GetChannelStorage(Film::GEOMETRY_NORMAL) == FRAMEBUFFER_STORAGE_HALF);
+	TEST_CHECK(loadedFilm->GetChannelStorage(Film::UV) == FRAMEBUFFER_STORAGE_HALF);
+	TEST_CHECK(loadedFilm->GetChannelStorage(Film::DIRECT_SHADOW_MASK) == FRAMEBUFFER_STORAGE_BYTE);
+	TEST_CHECK(loadedFilm->GetChannelStorage(Film::RADIANCE_PER_PIXEL_NORMALIZED) == FRAMEBUFFER_STORAGE_FLOAT);
+
+	// Radiance is always stored in full precision
+	TEST_CHECK(MaxError(*film->channel_RADIANCE_PER_PIXEL_NORMALIZEDs[0], *loadedFilm->channel_RADIANCE_PER_PIXEL_NORMALIZEDs[0]) == 0.f);
+
+	// Half has 11 bits of mantissa
+	const float alphaError = MaxError(*film->channel_ALPHA, *loadedFilm->channel_ALPHA);
+	TEST_CHECK_MSG(alphaError < 1e-3f, "alpha error: " << alphaError);
+	const float normalError = MaxError(*film->channel_GEOMETRY_NORMAL, *loadedFilm->channel_GEOMETRY_NORMAL);
+	TEST_CHECK_MSG(normalError < 1e-3f, "geometry normal error: " << normalError);
+	const float uvError = MaxError(*film->channel_UV, *loadedFilm->channel_UV);
+	TEST_CHECK_MSG(uvError < 1e-3f, "UV error: " << uvError);
+
+	// Byte has a step of 1 / 255
+	const float shadowError = MaxError(*film->channel_DIRECT_SHADOW_MASK, *loadedFilm->channel_DIRECT_SHADOW_MASK);
+	TEST_CHECK_MSG(shadowError <= .5f / 255.f + 1e-6f, "direct shadow mask error: " << shadowError);
+
+	// The loaded film keeps accumulating with the original weights
+	TEST_CHECK(loadedFilm->channel_DIRECT_SHADOW_MASK->GetPixel(0, 0)[1] == (float)PIXEL_SAMPLES);
+}
+
+static void TestCompactFileSize() {
+	auto_ptr<Film> film(NewFilm(false));
+	uintmax_t fileSize;
+	auto_ptr<Film> loadedFilm(SaveAndLoad(*film, &fileSize));
+
+	auto_ptr<Film> compactFilm(NewFilm(true));
+	uintmax_t compactFileSize;
+	auto_ptr<Film> loadedCompactFilm(SaveAndLoad(*compactFilm, &compactFileSize));
+
+	TEST_CHECK_MSG(compactFileSize < fileSize, "float: " << fileSize << " bytes, compact: " << compactFileSize << " bytes");
+}
+
+static void TestHalfRange() {
+	auto_ptr<Film> film(new Film(2, 1, NULL));
+	film->oclEnable = false;
+	film->AddChannel(Film::UV);
+	film->SetChannelStorage(Film::UV, FRAMEBUFFER_STORAGE_HALF);
+	film->Init();
+
+	const float inf = numeric_limits<float>::infinity();
+	const float infinities[2] = { inf, -inf };
+	film->channel_UV->SetPixel(0, 0, infinities);
+	const float largeValues[2] = { 1e6f, -1e6f };
+	film->channel_UV->SetPixel(1, 0, largeValues);
+
+	uintmax_t fileSize;
+	auto_ptr<Film> loadedFilm(SaveAndLoad(*film, &fileSize));
+
+	// The infinities are kept, the other values are clamped to the half range
+	const float *loadedInfinities = loadedFilm->channel_UV->GetPixel(0, 0);
+	TEST_CHECK_MSG((loadedInfinities[0] == inf) && (loadedInfinities[1] == -inf),
+			loadedInfinities[0] << " " << loadedInfinities[1]);
+	const float *loadedLargeValues = loadedFilm->channel_UV->GetPixel(1, 0);
+	TEST_CHECK_MSG((loadedLargeValues[0] == HALF_MAX) && (loadedLargeValues[1] == -HALF_MAX),
+			loadedLargeValues[0] << " " << loadedLargeValues[1]);
+}
+
+int main(int argc, char** argv) {
+	u_int failed = 0;
+	RUN_TEST_CASE(failed, TestFloatRoundTrip);
+	RUN_TEST_CASE(failed, TestCompactRoundTrip);
+	RUN_TEST_CASE(failed, TestCompactFileSize);
+	RUN_TEST_CASE(failed, TestHalfRange);
+
+	return (failed > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
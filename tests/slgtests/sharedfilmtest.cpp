@@ -0,0 +1,238 @@
+/***************************************************************************
+ * Copyright 1998-2018 by authors (see AUTHORS.txt)                        *
+ *                                                                         *
+ *   This file is part of LuxCoreRender.                                   *
+ *                                                                         *
+ * Licensed under the Apache License, Version 2.0 (the "License");         *
+ * you may not use this file except in compliance with the License.        *
+ * You may obtain a copy of the License at                                 *
+ *                                                                         *
+ *     http://www.apache.org/licenses/LICENSE-2.0                          *
+ *                                                                         *
+ * Unless required by applicable law or agreed to in writing, software     *
+ * distributed under the License is distributed on an "AS IS" BASIS,       *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ * See the License for the specific language governing permissions and     *
+ * limitations under the License.                                          *
+ ***************************************************************************/
+
+// Shared film test: many threads splatting at the same time on a film with
+// the thread safe flag (the native.film.shared.enable mode of the CPU render
+// engines) must accumulate exactly the same values of a single thread. The
+// samples have small integer values so the sums don't depend on the order.
+// The readers of the film (image pipeline and AddFilm()) running at the same
+// time must never see a partially written pixel.
+
+#include <cmath>
+
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include "luxrays/luxrays.h"
+#include "slg/film/film.h"
+#include "slg/film/sampleresult.h"
+#include "slg/film/imagepipeline/imagepipeline.h"
+
+#include "testutils.h"
+
+using namespace std;
+using namespace luxrays;
+using namespace slg;
+
+// Not a multiple of the tile size, to have partial tiles too
+static const u_int FILM_WIDTH = 80;
+static const u_int FILM_HEIGHT = 70;
+static const u_int PIXEL_COUNT = FILM_WIDTH * FILM_HEIGHT;
+static const u_int THREAD_COUNT = 8;
+// Samples of each thread for each pixel
+static const u_int PIXEL_PASSES = 16;
+
+static Film *NewFilm(const bool threadSafe) {
+	Film *film = new Film(FILM_WIDTH, FILM_HEIGHT, NULL);
+	film->oclEnable = false;
+	film->AddChannel(Film::RADIANCE_PER_PIXEL_NORMALIZED);
+	film->AddChannel(Film::ALPHA);
+	film->AddChannel(Film::DEPTH);
+	film->SetRadianceGroupCount(2);
+	film->Init();
+	film->SetThreadSafeFlag(threadSafe);
+
+	return film;
+}
+
+static void Splat(Film *film, const u_int threadIndex) {
+	SampleResult sampleResult(Film::RADIANCE_PER_PIXEL_NORMALIZED | Film::ALPHA | Film::DEPTH, 2);
+
+	// Each thread visits the pixels in a different order so the threads
+	// keep hitting the same tiles at the same time
+	for (u_int pass = 0; pass < PIXEL_PASSES; ++pass) {
+		for (u_int i = 0; i < PIXEL_COUNT; ++i) {
+			const u_int pixelIndex = (i * 7919 + threadIndex * 104729 + pass) % PIXEL_COUNT;
+			const u_int x = pixelIndex % FILM_WIDTH;
+			const u_int y = pixelIndex / FILM_WIDTH;
+
+			sampleResult.radiance[0] = Spectrum(1.f, 2.f, 3.f);
+			sampleResult.radiance[1] = Spectrum((float)(threadIndex + 1));
+			sampleResult.alpha = 1.f;
+			sampleResult.depth = (float)(threadIndex + pass + 1);
+
+			film->AddSample(x, y, sampleResult, 1.f);
+			film->AddSampleCount(1.0);
+		}
+	}
+}
+
+static void CheckFilm(const Film &film) {
+	const float samplesPerPixel = (float)(THREAD_COUNT * PIXEL_PASSES);
+	// Sum of (threadIndex + 1) over all threads, for each pass
+	const float group1Value = (float)(PIXEL_PASSES * THREAD_COUNT * (THREAD_COUNT + 1) / 2);
+
+	u_int errors = 0;
+	for (u_int y = 0; y < FILM_HEIGHT; ++y) {
+		for (u_int x = 0; x < FILM_WIDTH; ++x) {
+			const float *group0 = film.channel_RADIANCE_PER_PIXEL_NORMALIZEDs[0]->GetPixel(x, y);
+			const float *group1 = film.channel_RADIANCE_PER_PIXEL_NORMALIZEDs[1]->GetPixel(x, y);
+			const float *alpha = film.channel_ALPHA->GetPixel(x, y);
+			const float *depth = film.channel_DEPTH->GetPixel(x, y);
+
+			if ((group0[0] != samplesPerPixel) || (group0[1] != 2.f * samplesPerPixel) ||
+					(group0[2] != 3.f * samplesPerPixel) || (group0[3] != samplesPerPixel) ||
+					(group1[0] != group1Value) || (group1[3] != samplesPerPixel) ||
+					(alpha[0] != samplesPerPixel) || (alpha[1] != samplesPerPixel) ||
+					// The depth keeps the minimum
+					(depth[0] != 1.f))
+				++errors;
+		}
+	}
+
+	TEST_CHECK_MSG(errors == 0, "wrong pixels: " << errors << "/" << PIXEL_COUNT);
+	TEST_CHECK_MSG(film.GetTotalSampleCount() == (double)(THREAD_COUNT * PIXEL_PASSES * PIXEL_COUNT),
+			"total sample count: " << film.GetTotalSampleCount());
+}
+
+static void TestSingleThread() {
+	auto_ptr<Film> film(NewFilm(false));
+
+	for (u_int i = 0; i < THREAD_COUNT; ++i)
+		Splat(film.get(), i);
+
+	CheckFilm(*film);
+}
+
+static void TestConcurrentSplats() {
+	auto_ptr<Film> film(NewFilm(true));
+	TEST_CHECK(film->IsThreadSafe());
+
+	boost::thread_group threads;
+	for (u_int i = 0; i < THREAD_COUNT; ++i)
+		threads.create_thread(boost::bind(Splat, film.get(), i));
+	threads.join_all();
+
+	CheckFilm(*film);
+}
+
+static void TestConcurrentSplatsAfterReset() {
+	auto_ptr<Film> film(NewFilm(true));
+
+	// The CPU render engines reset the shared film at the end of each scene
+	// edit: the tile locks must survive it
+	Splat(film.get(), 0);
+	film->Reset();
+	TEST_CHECK(film->IsThreadSafe());
+	TEST_CHECK(film->GetTotalSampleCount() == 0.0);
+
+	boost::thread_group threads;
+	for (u_int i = 0; i < THREAD_COUNT; ++i)
+		threads.create_thread(boost::bind(Splat, film.get(), i));
+	threads.join_all();
+
+	CheckFilm(*film);
+}
+
+//------------------------------------------------------------------------------
+// Concurrent readers
+//------------------------------------------------------------------------------
+
+static void SplatConstant(Film *film, const u_int threadIndex) {
+	SampleResult sampleResult(Film::RADIANCE_PER_PIXEL_NORMALIZED, 1);
+	sampleResult.radiance[0] = Spectrum(1.f, 2.f, 3.f);
+
+	for (u_int pass = 0; pass < PIXEL_PASSES; ++pass) {
+		for (u_int i = 0; i < PIXEL_COUNT; ++i) {
+			const u_int pixelIndex = (i * 7919 + threadIndex * 104729 + pass) % PIXEL_COUNT;
+
+			film->AddSample(pixelIndex % FILM_WIDTH, pixelIndex / FILM_WIDTH, sampleResult, 1.f);
+		}
+	}
+}
+
+// The radiance of all samples is (1, 2, 3): a pixel read while the weight and
+// the color are written has an error of at least 1 / (samples per pixel)
+static const float READ_MAX_ERROR = 1e-4f;
+
+static bool IsPixelWrong(const float *pixel) {
+	return (fabsf(pixel[0] - 1.f) > READ_MAX_ERROR) || (fabsf(pixel[1] - 2.f) > READ_MAX_ERROR) ||
+			(fabsf(pixel[2] - 3.f) > READ_MAX_ERROR);
+}
+
+static void ReadFilm(Film *film, boost::atomic<bool> *splatsDone, u_int *errors, u_int *reads) {
+	auto_ptr<Film> snapshot(new Film(FILM_WIDTH, FILM_HEIGHT, NULL));
+	snapshot->oclEnable = false;
+	snapshot->AddChannel(Film::RADIANCE_PER_PIXEL_NORMALIZED);
+	snapshot->Init();
+
+	while (!*splatsDone) {
+		film->ExecuteImagePipeline(0);
+		for (u_int i = 0; i < PIXEL_COUNT; ++i) {
+			if (*(film->channel_FRAMEBUFFER_MASK->GetPixel(i)) &&
+					IsPixelWrong(film->channel_IMAGEPIPELINEs[0]->GetPixel(i)))
+				++(*errors);
+		}
+
+		snapshot->Reset();
+		snapshot->AddFilm(*film);
+		for (u_int i = 0; i < PIXEL_COUNT; ++i) {
+			// The sums of the samples are exact
+			const float *pixel = snapshot->channel_RADIANCE_PER_PIXEL_NORMALIZEDs[0]->GetPixel(i);
+			if ((pixel[1] != 2.f * pixel[0]) || (pixel[2] != 3.f * pixel[0]) || (pixel[3] != pixel[0]))
+				++(*errors);
+		}
+
+		++(*reads);
+	}
+}
+
+static void TestConcurrentReaders() {
+	auto_ptr<Film> film(new Film(FILM_WIDTH, FILM_HEIGHT, NULL));
+	film->oclEnable = false;
+	film->AddChannel(Film::RADIANCE_PER_PIXEL_NORMALIZED);
+	film->SetImagePipelines(new ImagePipeline());
+	film->Init();
+	film->SetThreadSafeFlag(true);
+
+	boost::atomic<bool> splatsDone(false);
+	u_int errors = 0;
+	u_int reads = 0;
+	boost::thread reader(boost::bind(ReadFilm, film.get(), &splatsDone, &errors, &reads));
+
+	boost::thread_group threads;
+	for (u_int i = 0; i < THREAD_COUNT; ++i)
+		threads.create_thread(boost::bind(SplatConstant, film.get(), i));
+	threads.join_all();
+
+	splatsDone = true;
+	reader.join();
+
+	TEST_CHECK_MSG(errors == 0, "partially written pixels read: " << errors << " in " << reads << " reads");
+}
+
+int main(int argc, char** argv) {
+	u_int failed = 0;
+	RUN_TEST_CASE(failed, TestSingleThread);
+	RUN_TEST_CASE(failed, TestConcurrentSplats);
+	RUN_TEST_CASE(failed, TestConcurrentSplatsAfterReset);
+	RUN_TEST_CASE(failed, TestConcurrentReaders);
+
+	return (failed > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}